@@ -0,0 +1,59 @@
+#pragma once
+
+#include "Framebuffer.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+// Minimal benchmarking helpers.
+// Every benchmark reports time per processed item (hit, ray, lookup...),
+// so numbers stay comparable when the workload size changes.
+
+// Results are accumulated here so the compiler can't drop benchmarked code.
+extern volatile double BenchSink;
+
+// Run \p body \p iterations times and return the mean wall-clock time of
+// one iteration in nanoseconds.
+template <typename TBody>
+double MeasureNs(unsigned iterations, TBody body) {
+  // Warm-up run: fills caches and lazily built data.
+  body();
+
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned i = 0; i < iterations; ++i)
+    body();
+  auto end = std::chrono::steady_clock::now();
+
+  double total = std::chrono::duration<double, std::nano>(end - start).count();
+  return total / iterations;
+}
+
+inline void ReportBenchmark(const std::string &name, double nsPerItem,
+                            const std::string &unit = "item") {
+  std::printf("%-48s %12.2f ns/%s\n", name.c_str(), nsPerItem, unit.c_str());
+}
+
+// Root mean square difference of two images, for benchmarks which trade
+// quality for time.
+inline double RMSE(const Framebuffer &a, const Framebuffer &b) {
+  double sum = 0.0;
+  for (std::size_t i = 0; i < a.GetNumPixels(); ++i) {
+    glm::dvec3 d = a[i] - b[i];
+    sum += glm::dot(d, d) / 3.0;
+  }
+  return std::sqrt(sum / a.GetNumPixels());
+}
+
+// Benchmark groups, each one is defined in its own *Bench.cpp file.
+void RunDenoiseBenchmarks();
+void RunGeometryBenchmarks();
+void RunImageBenchmarks();
+void RunIrradianceBenchmarks();
+void RunLightBenchmarks();
+void RunPhotonBenchmarks();
+void RunRenderBenchmarks();
+void RunSamplerBenchmarks();
+void RunShadingBenchmarks();
+void RunTextureBenchmarks();
@@ -0,0 +1,17 @@
+#include "Bench.h"
+
+volatile double BenchSink = 0.0;
+
+int main() {
+  RunSamplerBenchmarks();
+  RunShadingBenchmarks();
+  RunRenderBenchmarks();
+  RunLightBenchmarks();
+  RunDenoiseBenchmarks();
+  RunIrradianceBenchmarks();
+  RunPhotonBenchmarks();
+  RunTextureBenchmarks();
+  RunGeometryBenchmarks();
+  RunImageBenchmarks();
+  return 0;
+}
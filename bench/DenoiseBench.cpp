@@ -0,0 +1,49 @@
+#include "Bench.h"
+#include "Denoiser.h"
+
+#include <random>
+
+namespace {
+
+const unsigned Width = 3840;
+const unsigned Height = 2160;
+const unsigned Iterations = 3;
+
+// Noisy 4K image of boxes: 64x64 pixel blocks of different normals,
+// albedos and depths.
+void BuildNoisyImage(Framebuffer &fb, GuideBuffers &guides) {
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> noise(-0.2f, 0.2f);
+  guides.Reset(Width, Height);
+  for (unsigned y = 0; y < Height; ++y) {
+    for (unsigned x = 0; x < Width; ++x) {
+      std::size_t i = static_cast<std::size_t>(y) * Width + x;
+      unsigned block = (x / 64 + y / 64) % 3;
+      guides.normalX[i] = block == 0 ? 1.0f : 0.0f;
+      guides.normalY[i] = block == 1 ? 1.0f : 0.0f;
+      guides.normalZ[i] = block == 2 ? 1.0f : 0.0f;
+      guides.albedoR[i] = guides.albedoG[i] = guides.albedoB[i] = 0.3f * block;
+      guides.depth[i] = 5.0f + block;
+      fb[i] = glm::dvec3(0.2 + 0.3 * block + noise(rng));
+    }
+  }
+}
+
+} // anonymous namespace
+
+
+void RunDenoiseBenchmarks() {
+  Framebuffer noisy(Width, Height);
+  GuideBuffers guides;
+  BuildNoisyImage(noisy, guides);
+
+  Framebuffer fb(Width, Height);
+  Denoiser denoiser;
+  double ns = MeasureNs(Iterations, [&]() {
+    denoiser.Denoise(noisy, guides, fb);
+    BenchSink = BenchSink + fb[0].r;
+  });
+  ReportBenchmark("Denoise, a-trous, 5 passes (4K)", ns / fb.GetNumPixels(),
+                  "pixel");
+  std::printf("%-48s %12.3f s/frame\n", "", ns * 1.0e-9);
+}
@@ -0,0 +1,272 @@
+#include "Bench.h"
+#include "LodMesh.h"
+#include "PagedMesh.h"
+#include "Renderer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const unsigned GridSize = 400;
+const unsigned NumRays = 100000;
+const char *const MeshPath = "GeometryBench.pmesh";
+const char *const CompactPath = "GeometryBench_compact.pmesh";
+
+// Rolling terrain of 2 * GridSize^2 faces over [-100, 100]^2.
+Mesh Terrain() {
+  Mesh mesh(true, 0);
+  for (unsigned j = 0; j <= GridSize; ++j) {
+    for (unsigned i = 0; i <= GridSize; ++i) {
+      double x = -100.0 + 200.0 * i / GridSize, z = -100.0 + 200.0 * j / GridSize;
+      mesh.AddVertex(glm::dvec3(x, 2.0 * std::sin(0.3 * x) * std::cos(0.2 * z), z));
+    }
+  }
+  for (unsigned j = 0; j < GridSize; ++j) {
+    for (unsigned i = 0; i < GridSize; ++i) {
+      TMeshIndex v = j * (GridSize + 1) + i;
+      mesh.AddQuadFace(v, v + GridSize + 1, v + GridSize + 2, v + 1);
+    }
+  }
+  mesh.CalculateNormals();
+  return mesh;
+}
+
+// Brute-force intersection of a 30 x 30 patch of quads with faces of
+// 16-bit indexes, and with the same faces widened to 32 bits by unused
+// vertexes.
+void BenchIndexWidths(const std::vector<Ray> &rays) {
+  const unsigned PatchSize = 30, PatchRays = 2000;
+  for (bool wide : { false, true }) {
+    Mesh patch(true, 0);
+    for (unsigned j = 0; j <= PatchSize; ++j) {
+      for (unsigned i = 0; i <= PatchSize; ++i)
+        patch.AddVertex(glm::dvec3(-10.0 + 20.0 * i / PatchSize, 0.0,
+                                   -10.0 + 20.0 * j / PatchSize));
+    }
+    for (unsigned j = 0; j < PatchSize; ++j) {
+      for (unsigned i = 0; i < PatchSize; ++i) {
+        TMeshIndex v = j * (PatchSize + 1) + i;
+        patch.AddQuadFace(v, v + PatchSize + 1, v + PatchSize + 2, v + 1);
+      }
+    }
+    while (wide && patch.GetIndexWidth() == MeshIndexWidth::Bits16)
+      patch.AddVertex(glm::dvec3(0.0, -1.0, 0.0));
+    patch.CalculateNormals();
+
+    double ns = MeasureNs(3, [&]() {
+      for (unsigned r = 0; r < PatchRays; ++r) {
+        IntersectionResult hit = patch.Intersect(rays[r]);
+        BenchSink += hit ? hit.GetDistance() : 0.0;
+      }
+    });
+    ReportBenchmark(wide ? "Mesh, brute force, 32-bit indexes" :
+                           "Mesh, brute force, 16-bit indexes",
+                    ns / PatchRays, "ray");
+    std::printf("%-48s %12.1f KB of faces\n", "",
+                patch.GetFaceBytes() / 1024.0);
+  }
+}
+
+// A 100 x 100 patch of the terrain seen from 50 and from 400 units away
+// by a 64 x 64 camera: brute-force intersection of all its faces, and of
+// the levels of detail the rays' footprints pick.
+void BenchLod() {
+  const unsigned PatchSize = 100;
+  std::unique_ptr<Mesh> patch(new Mesh(true, 0));
+  for (unsigned j = 0; j <= PatchSize; ++j) {
+    for (unsigned i = 0; i <= PatchSize; ++i) {
+      double x = -25.0 + 50.0 * i / PatchSize, z = -25.0 + 50.0 * j / PatchSize;
+      patch->AddVertex(glm::dvec3(x, 2.0 * std::sin(0.3 * x) * std::cos(0.2 * z), z));
+    }
+  }
+  for (unsigned j = 0; j < PatchSize; ++j) {
+    for (unsigned i = 0; i < PatchSize; ++i) {
+      TMeshIndex v = j * (PatchSize + 1) + i;
+      patch->AddQuadFace(v, v + PatchSize + 1, v + PatchSize + 2, v + 1);
+    }
+  }
+  patch->CalculateNormals();
+  std::size_t numFaces = patch->GetNumFaces();
+
+  std::clock_t start = std::clock();
+  LodMesh lod(std::move(patch));
+  double seconds = static_cast<double>(std::clock() - start) / CLOCKS_PER_SEC;
+  ReportBenchmark("LOD chain, simplification", 1.0e9 * seconds / numFaces, "face");
+  for (unsigned l = 0; l < lod.GetNumLevels(); ++l)
+    std::printf("%-48s %12zu faces, error %.3f\n", "", lod.GetMesh(l)->GetNumFaces(),
+                lod.GetError(l));
+
+  for (double distance : { 50.0, 400.0 }) {
+    Camera camera(glm::dvec3(0.0, 0.5 * distance, -distance), glm::dvec3(0.0, 0.0, 1.0),
+                  glm::vec2(64, 64), 10.0);
+    camera.LookAt(glm::dvec3(0.0));
+    std::vector<Ray> rays;
+    for (unsigned y = 0; y < 64; ++y) {
+      for (unsigned x = 0; x < 64; ++x)
+        rays.push_back(camera.GetPrimaryRay(x + 0.5, y + 0.5));
+    }
+    char name[64];
+    for (bool useLod : { false, true }) {
+      double ns = MeasureNs(1, [&]() {
+        for (const Ray &ray : rays) {
+          IntersectionResult hit = useLod ? lod.Intersect(ray) :
+                                            lod.GetMesh(0)->Intersect(ray);
+          BenchSink += hit ? hit.GetDistance() : 0.0;
+        }
+      });
+      std::snprintf(name, sizeof(name), "Mesh at %.0f, %s", distance,
+                    useLod ? "LOD by footprint" : "all faces");
+      ReportBenchmark(name, ns / rays.size(), "ray");
+    }
+    std::printf("%-48s %12u camera level, %u footprint level of the center\n", "",
+                lod.SelectLevel(camera),
+                lod.GetLevelForWidth(rays[32 * 64 + 32].GetWidthAt(
+                  glm::length(camera.GetPosition()))));
+  }
+
+  // Far away only the camera's level and coarser ones are needed.
+  std::size_t allBytes = lod.GetResidentBytes();
+  lod.ReleaseFinerLevels();
+  std::printf("%-48s %12.2f MB of levels, %.2f MB with finer ones released\n", "",
+              allBytes / 1048576.0, lod.GetResidentBytes() / 1048576.0);
+}
+
+// Rays down at a 20 x 20 patch of the terrain (a view whose working set
+// is a few clusters), or at all of it.
+std::vector<Ray> Rays(bool coherent) {
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+  double extent = coherent ? 10.0 : 100.0;
+  std::vector<Ray> rays;
+  for (unsigned i = 0; i < NumRays; ++i) {
+    glm::dvec3 target(extent * uniform(rng), 0.0, extent * uniform(rng));
+    glm::dvec3 origin = target + glm::dvec3(5.0 * uniform(rng), 20.0, 5.0 * uniform(rng));
+    rays.push_back(Ray(origin, glm::normalize(target - origin)));
+  }
+  return rays;
+}
+
+void BenchRays(PagedMesh &mesh, const std::vector<Ray> &rays,
+               const std::string &name) {
+  mesh.ResetStats();
+  double ns = MeasureNs(3, [&]() {
+    for (const Ray &ray : rays) {
+      IntersectionResult hit = mesh.Intersect(ray);
+      BenchSink += hit ? hit.GetDistance() : 0.0;
+    }
+  });
+  ReportBenchmark(name, ns / rays.size(), "ray");
+  // Warm-up included.
+  GeometryStats stats = mesh.GetStats();
+  double seconds = 4.0 * ns * 1.0e-9;
+  std::printf("%-48s %12.0f page-ins/s, %.1f MB read, %.1f MB resident\n", "",
+              stats.pageIns / seconds, stats.bytesRead / 1048576.0,
+              mesh.GetResidentBytes() / 1048576.0);
+}
+
+// Path trace the terrain, paged under a budget of \p budget bytes, with
+// 4 threads waiting for clusters or suspending samples which miss them.
+// Reports the share of the threads' time spent computing.
+void BenchRender(std::size_t budget, bool async, const std::string &name) {
+  Scene scene;
+  scene.GetMaterials().AddMaterial("terrain",
+    Material(glm::dvec3(0.1), glm::dvec3(0.7), glm::dvec3(0.2), 20.0));
+  std::unique_ptr<PagedMesh> mesh(new PagedMesh(budget));
+  mesh->Open(MeshPath);
+  scene.AddObject(std::move(mesh));
+  scene.AddLight(PointLight(glm::dvec3(0.0, 50.0, -50.0), glm::dvec3(0.1),
+                            glm::dvec3(0.8), glm::dvec3(0.8)));
+  scene.Freeze();
+
+  RenderSettings settings;
+  settings.integrator = Integrator::PathTracing;
+  settings.numThreads = 4;
+  settings.asyncPaging = async;
+  Camera camera(glm::dvec3(0.0, 40.0, -120.0), glm::dvec3(0.0, -0.4, 1.0),
+                glm::uvec2(128, 96));
+  Framebuffer fb(128, 96);
+  Renderer renderer(settings);
+  std::clock_t cpu = std::clock();
+  double ns = MeasureNs(2, [&]() { renderer.Render(scene, camera, fb); });
+  double cpuSeconds = double(std::clock() - cpu) / CLOCKS_PER_SEC;
+  ReportBenchmark(name, ns / fb.GetNumPixels(), "pixel");
+  // Warm-up included. Out of the cores the threads can run on.
+  unsigned cores = std::min(settings.numThreads,
+                            std::max(std::thread::hardware_concurrency(), 1u));
+  std::printf("%-48s %12.0f%% CPU busy, %llu samples suspended\n", "",
+              100.0 * cpuSeconds / (3.0 * ns * 1.0e-9 * cores),
+              static_cast<unsigned long long>(renderer.GetStats().suspendedSamples));
+}
+
+} // anonymous namespace
+
+
+void RunGeometryBenchmarks() {
+  Mesh terrain = Terrain();
+  PagedMeshWriter writer;
+  if (!writer.Open(MeshPath)) {
+    std::printf("Geometry benchmarks skipped: can't write %s\n", MeshPath);
+    return;
+  }
+  writer.AddMesh(terrain);
+  writer.Close();
+
+  std::vector<Ray> coherent = Rays(true);
+  std::vector<Ray> scattered = Rays(false);
+  BenchIndexWidths(coherent);
+  BenchLod();
+
+  // Everything fits: as fast as geometry in memory gets.
+  PagedMesh mesh;
+  mesh.Open(MeshPath);
+  BenchRays(mesh, coherent, "Paged mesh, local view, resident");
+  BenchRays(mesh, scattered, "Paged mesh, whole terrain, resident");
+  std::size_t allBytes = mesh.GetResidentBytes();
+  std::printf("%-48s %12.1f MB directory, %zu clusters\n", "",
+              mesh.GetDirectoryBytes() / 1048576.0, mesh.GetNumClusters());
+
+  // A budget of 1/8 of the geometry: the local view's clusters still fit,
+  // the whole terrain's are paged in and out.
+  PagedMesh small(allBytes / 8);
+  small.Open(MeshPath);
+  BenchRays(small, coherent, "Paged mesh, local view, 1/8 budget");
+  BenchRays(small, scattered, "Paged mesh, whole terrain, 1/8 budget");
+
+  BenchRender(allBytes / 8, false, "Paged mesh, path traced, 1/8 budget");
+  BenchRender(allBytes / 8, true, "Paged mesh, path traced, async paging");
+
+  // Compact layouts, all resident.
+  struct Layout {
+    VertexFormat format;
+    bool meshlets;
+    const char *name;
+  };
+  const Layout layouts[] = {
+    { VertexFormat::Quantized16, false, "Paged mesh, whole terrain, 16-bit vertexes" },
+    { VertexFormat::Quantized21, false, "Paged mesh, whole terrain, 21-bit vertexes" },
+    { VertexFormat::Exact, true, "Paged mesh, whole terrain, meshlets" },
+    { VertexFormat::Quantized16, true, "Paged mesh, whole terrain, 16-bit meshlets" },
+  };
+  for (const Layout &layout : layouts) {
+    PagedMeshSettings settings;
+    settings.vertexFormat = layout.format;
+    settings.meshlets = layout.meshlets;
+    PagedMeshWriter compactWriter(settings);
+    if (!compactWriter.Open(CompactPath))
+      break;
+    compactWriter.AddMesh(terrain);
+    compactWriter.Close();
+    PagedMesh compact;
+    compact.Open(CompactPath);
+    BenchRays(compact, scattered, layout.name);
+  }
+
+  std::remove(MeshPath);
+  std::remove(CompactPath);
+}
@@ -0,0 +1,138 @@
+#include "Bench.h"
+#include "ImageWriter.h"
+#include "Renderer.h"
+#include "Mesh.h"
+#include "Sphere.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+
+const unsigned Width = 2048;
+const unsigned Height = 1024;
+const char *const ImagePath = "ImageBench";
+
+// Smooth gradients with some noise, like a rendered image.
+Framebuffer TestImage() {
+  Framebuffer fb(Width, Height);
+  std::uint32_t state = 1;
+  for (unsigned y = 0; y < Height; ++y) {
+    for (unsigned x = 0; x < Width; ++x) {
+      state = state * 1664525u + 1013904223u;
+      double noise = (state >> 8) / 16777216.0 * 0.02;
+      fb.At(x, y) = glm::dvec3(0.5 + 0.5 * std::sin(0.01 * x) + noise,
+                               static_cast<double>(y) / Height,
+                               0.3 + 0.2 * std::cos(0.003 * (x + y)));
+    }
+  }
+  return fb;
+}
+
+void BenchWrite(const Framebuffer &image, const std::string &extension,
+                unsigned numThreads, const std::string &name) {
+  std::string path = std::string(ImagePath) + extension;
+  ImageWriterSettings settings;
+  settings.numThreads = numThreads;
+  double ns = MeasureNs(3, [&]() { WriteImage(path, image, settings); });
+  ReportBenchmark(name, ns / image.GetNumPixels(), "pixel");
+  std::FILE *file = std::fopen(path.c_str(), "rb");
+  if (file) {
+    std::fseek(file, 0, SEEK_END);
+    std::printf("%-48s %12.1f MB\n", "", std::ftell(file) / 1048576.0);
+    std::fclose(file);
+  }
+  std::remove(path.c_str());
+}
+
+// Floor and spheres.
+void BuildScene(Scene &scene) {
+  MaterialManager &materials = scene.GetMaterials();
+  TMaterialId floor = materials.AddMaterial("floor",
+    Material(glm::dvec3(0.1), glm::dvec3(0.3), glm::dvec3(0.5), 20.0));
+  TMaterialId red = materials.AddMaterial("red",
+    Material(glm::dvec3(0.1, 0.0, 0.0), glm::dvec3(0.2), glm::dvec3(0.8, 0.1, 0.1), 30.0));
+  std::unique_ptr<Mesh> plane(new Mesh(false, floor));
+  plane->AddQuadFace(plane->AddVertex(glm::dvec3(-20.0, 0.0, -20.0)),
+                     plane->AddVertex(glm::dvec3(-20.0, 0.0, 20.0)),
+                     plane->AddVertex(glm::dvec3(20.0, 0.0, 20.0)),
+                     plane->AddVertex(glm::dvec3(20.0, 0.0, -20.0)));
+  plane->CalculateNormals();
+  scene.AddObject(std::move(plane));
+  for (int i = 0; i < 5; ++i) {
+    scene.AddObject(std::unique_ptr<Sphere>(
+      new Sphere(glm::dvec3(2.5 * (i - 2), 1.0, 2.0 * i), 1.0, red)));
+  }
+  scene.AddLight(PointLight(glm::dvec3(-5.0, 10.0, -5.0), glm::dvec3(0.1),
+                            glm::dvec3(0.7), glm::dvec3(0.7)));
+  scene.SetBackground(glm::dvec3(0.3, 0.5, 0.8));
+  scene.Freeze();
+}
+
+} // anonymous namespace
+
+
+void RunImageBenchmarks() {
+  // Encoding and writing a whole image.
+  Framebuffer image = TestImage();
+  BenchWrite(image, ".ppm", 0, "Image write, PPM");
+  BenchWrite(image, ".png", 1, "Image write, PNG, 1 thread");
+  BenchWrite(image, ".png", 0, "Image write, PNG, all threads");
+  BenchWrite(image, ".exr", 0, "Image write, EXR");
+
+  // Render, then write, against bands streamed to the writer while the
+  // next ones render.
+  Scene scene;
+  BuildScene(scene);
+  const unsigned W = 640, H = 480, BandRows = 32;
+  Camera camera(glm::dvec3(0.0, 4.0, -10.0), glm::dvec3(0.0, -0.3, 1.0),
+                glm::uvec2(W, H));
+  Renderer renderer;
+  std::string path = std::string(ImagePath) + ".png";
+
+  double ns = MeasureNs(3, [&]() {
+    Framebuffer fb(W, H);
+    renderer.Render(scene, camera, fb);
+    WriteImage(path, fb);
+  });
+  ReportBenchmark("Render, then write PNG", ns / (W * H), "pixel");
+
+  ImageWriterStats stats;
+  ns = MeasureNs(3, [&]() {
+    ImageWriter writer;
+    writer.Open(path, ImageFormat::PNG, W, H);
+    for (unsigned y = 0; y < H; y += BandRows) {
+      Camera band = camera;
+      band.SetRegion(glm::uvec2(0, y), glm::uvec2(W, BandRows));
+      Framebuffer fb(W, BandRows);
+      renderer.Render(scene, band, fb);
+      writer.WriteRegion(0, y, fb);
+    }
+    writer.Close();
+    stats = writer.GetStats();
+  });
+  ReportBenchmark("Render bands, streamed to PNG", ns / (W * H), "pixel");
+  std::printf("%-48s %12.1f MB buffered at most (image: %.1f MB)\n", "",
+              stats.peakBufferedBytes / 1048576.0,
+              W * H * sizeof(glm::dvec3) / 1048576.0);
+  std::remove(path.c_str());
+
+  // All AOVs, from the primary hits of the beauty render.
+  path = std::string(ImagePath) + ".exr";
+  ns = MeasureNs(3, [&]() {
+    Framebuffer fb(W, H);
+    renderer.Render(scene, camera, fb);
+    WriteImage(path, fb);
+  });
+  ReportBenchmark("Render, then write EXR", ns / (W * H), "pixel");
+  ns = MeasureNs(3, [&]() {
+    Framebuffer fb(W, H);
+    AovBuffers aovs(AovBit(Aov::Depth) | AovBit(Aov::Normal) |
+                    AovBit(Aov::Albedo) | AovBit(Aov::ObjectId));
+    renderer.Render(scene, camera, fb, nullptr, &aovs);
+    WriteImage(path, fb, aovs);
+  });
+  ReportBenchmark("Render, then write EXR with all AOVs", ns / (W * H), "pixel");
+  std::remove(path.c_str());
+}
@@ -0,0 +1,110 @@
+#include "Bench.h"
+#include "Renderer.h"
+#include "Mesh.h"
+#include "Sphere.h"
+
+#include <cmath>
+
+namespace {
+
+const unsigned Width = 80;
+const unsigned Height = 60;
+
+void AddQuad(Scene &scene, TMaterialId mat, const glm::dvec3 &p0,
+             const glm::dvec3 &p1, const glm::dvec3 &p2, const glm::dvec3 &p3) {
+  std::unique_ptr<Mesh> quad(new Mesh(false, mat));
+  quad->AddQuadFace(quad->AddVertex(p0), quad->AddVertex(p1),
+                    quad->AddVertex(p2), quad->AddVertex(p3));
+  quad->CalculateNormals();
+  scene.AddObject(std::move(quad));
+}
+
+// Closed room with matte walls, a pillar and a few spheres, lit by one
+// lamp near the ceiling: most of the light is indirect.
+void BuildRoom(Scene &scene) {
+  MaterialManager &materials = scene.GetMaterials();
+  TMaterialId white = materials.AddMaterial("white",
+    Material(glm::dvec3(0.0), glm::dvec3(0.0), glm::dvec3(0.75), 1.0));
+  TMaterialId red = materials.AddMaterial("red",
+    Material(glm::dvec3(0.0), glm::dvec3(0.0), glm::dvec3(0.7, 0.15, 0.1), 1.0));
+  TMaterialId blue = materials.AddMaterial("blue",
+    Material(glm::dvec3(0.0), glm::dvec3(0.05), glm::dvec3(0.1, 0.2, 0.6), 20.0));
+
+  const double W = 6.0, H = 4.0, D = 8.0;
+  AddQuad(scene, white, glm::dvec3(-W, 0.0, -D), glm::dvec3(W, 0.0, -D),
+          glm::dvec3(W, 0.0, D), glm::dvec3(-W, 0.0, D));
+  AddQuad(scene, white, glm::dvec3(-W, H, -D), glm::dvec3(-W, H, D),
+          glm::dvec3(W, H, D), glm::dvec3(W, H, -D));
+  AddQuad(scene, red, glm::dvec3(-W, 0.0, -D), glm::dvec3(-W, 0.0, D),
+          glm::dvec3(-W, H, D), glm::dvec3(-W, H, -D));
+  AddQuad(scene, white, glm::dvec3(W, 0.0, -D), glm::dvec3(W, H, -D),
+          glm::dvec3(W, H, D), glm::dvec3(W, 0.0, D));
+  AddQuad(scene, white, glm::dvec3(-W, 0.0, D), glm::dvec3(W, 0.0, D),
+          glm::dvec3(W, H, D), glm::dvec3(-W, H, D));
+  AddQuad(scene, white, glm::dvec3(-W, 0.0, -D), glm::dvec3(-W, H, -D),
+          glm::dvec3(W, H, -D), glm::dvec3(W, 0.0, -D));
+
+  // Pillar.
+  const double P = 0.6;
+  AddQuad(scene, white, glm::dvec3(2.0 - P, 0.0, 3.0 - P), glm::dvec3(2.0 - P, H, 3.0 - P),
+          glm::dvec3(2.0 + P, H, 3.0 - P), glm::dvec3(2.0 + P, 0.0, 3.0 - P));
+  AddQuad(scene, white, glm::dvec3(2.0 - P, 0.0, 3.0 + P), glm::dvec3(2.0 - P, H, 3.0 + P),
+          glm::dvec3(2.0 - P, H, 3.0 - P), glm::dvec3(2.0 - P, 0.0, 3.0 - P));
+
+  for (int i = 0; i < 3; ++i) {
+    scene.AddObject(std::unique_ptr<Sphere>(new Sphere(
+      glm::dvec3(-3.0 + 2.5 * i, 0.8, 4.0 - i), 0.8, i == 1 ? blue : white)));
+  }
+
+  scene.AddLight(PointLight(glm::dvec3(-2.0, 3.5, 2.0), glm::dvec3(0.0),
+                            glm::dvec3(1.0), glm::dvec3(1.0)));
+  scene.SetBackground(glm::dvec3(0.0));
+  scene.Freeze();
+}
+
+// Render with \p settings, report error against \p reference and time.
+void BenchPaths(const Scene &scene, const Camera &camera,
+                const RenderSettings &settings, const Framebuffer &reference,
+                const std::string &name) {
+  Framebuffer fb(Width, Height);
+  Renderer renderer(settings);
+  renderer.Render(scene, camera, fb);
+  const RenderStats &stats = renderer.GetStats();
+  std::printf("%-48s %12.5f RMSE %8.3f s\n", name.c_str(),
+              RMSE(fb, reference), stats.renderSeconds);
+  if (stats.irradianceRecords) {
+    std::printf("%-48s %12llu records\n", "",
+                static_cast<unsigned long long>(stats.irradianceRecords));
+  }
+}
+
+} // anonymous namespace
+
+
+void RunIrradianceBenchmarks() {
+  Scene scene;
+  BuildRoom(scene);
+  Camera camera(glm::dvec3(0.0, 2.0, -7.5), glm::dvec3(0.0, -0.1, 1.0),
+                glm::uvec2(Width, Height));
+
+  RenderSettings settings;
+  settings.integrator = Integrator::PathTracing;
+  settings.maxDepth = 8;
+  settings.numThreads = 1;
+
+  // Indirect diffuse lighting path traced, against the irradiance cache,
+  // at equal sample counts: error against a 512 spp path traced reference
+  // and total time (prepass included).
+  settings.minSamples = settings.maxSamples = 512;
+  Framebuffer reference(Width, Height);
+  Renderer(settings).Render(scene, camera, reference);
+
+  for (unsigned spp = 4; spp <= 64; spp *= 4) {
+    settings.minSamples = settings.maxSamples = spp;
+    std::string suffix = ", " + std::to_string(spp) + " spp";
+    settings.irradianceCaching = false;
+    BenchPaths(scene, camera, settings, reference, "Room, path traced" + suffix);
+    settings.irradianceCaching = true;
+    BenchPaths(scene, camera, settings, reference, "Room, irradiance cache" + suffix);
+  }
+}
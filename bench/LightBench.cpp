@@ -0,0 +1,139 @@
+#include "Bench.h"
+#include "Denoiser.h"
+#include "Renderer.h"
+#include "Mesh.h"
+#include "Sphere.h"
+
+#include <cmath>
+
+namespace {
+
+const unsigned Width = 80;
+const unsigned Height = 60;
+const unsigned Iterations = 2;
+
+// Street lamps over a large plaza with a few spheres: 5000 short-range
+// lights, of which only a handful reach any point.
+void BuildPlaza(Scene &scene) {
+  MaterialManager &materials = scene.GetMaterials();
+  TMaterialId ground = materials.AddMaterial("ground",
+    Material(glm::dvec3(0.1), glm::dvec3(0.05), glm::dvec3(0.6), 10.0));
+  TMaterialId ball = materials.AddMaterial("ball",
+    Material(glm::dvec3(0.1), glm::dvec3(0.3), glm::dvec3(0.4, 0.4, 0.7), 60.0));
+
+  const double Side = 200.0;
+  std::unique_ptr<Mesh> plaza(new Mesh(false, ground));
+  plaza->AddQuadFace(plaza->AddVertex(glm::dvec3(-Side, 0.0, -Side)),
+                     plaza->AddVertex(glm::dvec3(-Side, 0.0, Side)),
+                     plaza->AddVertex(glm::dvec3(Side, 0.0, Side)),
+                     plaza->AddVertex(glm::dvec3(Side, 0.0, -Side)));
+  plaza->CalculateNormals();
+  scene.AddObject(std::move(plaza));
+
+  for (int i = 0; i < 16; ++i) {
+    scene.AddObject(std::unique_ptr<Sphere>(new Sphere(
+      glm::dvec3(8.0 * (i % 4) - 12.0, 1.0, 8.0 * (i / 4)), 1.0, ball)));
+  }
+
+  // 50x100 lamps, 4 units apart, each reaching 6 units.
+  for (int i = 0; i < 5000; ++i) {
+    glm::dvec3 position(4.0 * (i % 50) - 100.0, 3.0, 4.0 * (i / 50) - 100.0);
+    scene.AddLight(PointLight(position, glm::dvec3(0.002), glm::dvec3(0.3),
+                              glm::dvec3(0.4), /*radius=*/6.0));
+  }
+  scene.Freeze();
+}
+
+Framebuffer BenchLights(const Scene &scene, const Camera &camera,
+                        const RenderSettings &settings, const std::string &name) {
+  Framebuffer fb(Width, Height);
+  Renderer renderer(settings);
+  double ns = MeasureNs(Iterations, [&]() {
+    renderer.Render(scene, camera, fb);
+    BenchSink = BenchSink + fb[0].r;
+  });
+
+  const RenderStats &stats = renderer.GetStats();
+  ReportBenchmark(name, ns / fb.GetNumPixels(), "pixel");
+  std::printf("%-48s %12.2f lights/hit\n", "",
+              static_cast<double>(stats.lightSamples) /
+              (stats.primaryRays + stats.reflectionRays));
+  return fb;
+}
+
+} // anonymous namespace
+
+
+void RunLightBenchmarks() {
+  Scene scene;
+  BuildPlaza(scene);
+  Camera camera(glm::dvec3(0.0, 12.0, -20.0), glm::dvec3(0.0, -0.5, 1.0),
+                glm::uvec2(Width, Height));
+
+  RenderSettings settings;
+  settings.mode = RenderMode::Deferred;
+  settings.maxDepth = 1;
+
+  settings.lightCulling = false;
+  Framebuffer reference =
+    BenchLights(scene, camera, settings, "Render, all lights (5000 lamps)");
+  settings.lightCulling = true;
+  BenchLights(scene, camera, settings, "Render, light grid (5000 lamps)");
+
+  // Convergence versus time of light tree sampling: error against the
+  // exact image for growing numbers of samples.
+  settings.directLighting = DirectLighting::SampledLights;
+  for (unsigned samples = 1; samples <= 64; samples *= 4) {
+    settings.lightSamplesPerHit = samples;
+    std::string name = "Render, light tree, " + std::to_string(samples) +
+                       " samples/hit (5000 lamps)";
+    Framebuffer fb = BenchLights(scene, camera, settings, name);
+    std::printf("%-48s %12.5f RMSE\n", "", RMSE(fb, reference));
+  }
+
+  // Equal-error comparison of samplers: antialiased light tree renders
+  // against an antialiased exact one.
+  settings.directLighting = DirectLighting::AllLights;
+  settings.minSamples = settings.maxSamples = 64;
+  Framebuffer antialiased(Width, Height);
+  Renderer(settings).Render(scene, camera, antialiased);
+
+  settings.directLighting = DirectLighting::SampledLights;
+  settings.lightSamplesPerHit = 1;
+  const SamplerType samplers[] = {
+    SamplerType::Random, SamplerType::Sobol, SamplerType::BlueNoise
+  };
+  const char *samplerNames[] = { "random", "Sobol", "blue noise" };
+  for (int s = 0; s < 3; ++s) {
+    settings.sampler = samplers[s];
+    for (unsigned spp = 4; spp <= 16; spp *= 4) {
+      settings.minSamples = settings.maxSamples = spp;
+      Framebuffer fb(Width, Height);
+      Renderer(settings).Render(scene, camera, fb);
+      std::printf("%-48s %12.5f RMSE\n",
+                  ("Light tree, " + std::string(samplerNames[s]) + ", " +
+                   std::to_string(spp) + " spp").c_str(),
+                  RMSE(fb, antialiased));
+    }
+  }
+
+  // Low sample count plus denoising, against brute force: error and total
+  // time of both.
+  settings.sampler = SamplerType::Sobol;
+  for (unsigned spp = 4; spp <= 64; spp *= 4) {
+    settings.minSamples = settings.maxSamples = spp;
+    Framebuffer fb(Width, Height);
+    Renderer renderer(settings);
+    GuideBuffers guides;
+    renderer.Render(scene, camera, fb, &guides);
+    double seconds = renderer.GetStats().renderSeconds;
+    std::string name = "Light tree, Sobol, " + std::to_string(spp) + " spp";
+    std::printf("%-48s %12.5f RMSE %8.3f s\n", name.c_str(),
+                RMSE(fb, antialiased), seconds);
+
+    Denoiser denoiser;
+    denoiser.Denoise(fb, guides, fb);
+    std::printf("%-48s %12.5f RMSE %8.3f s\n", (name + ", denoised").c_str(),
+                RMSE(fb, antialiased), seconds + denoiser.GetSeconds());
+  }
+}
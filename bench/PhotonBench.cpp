@@ -0,0 +1,125 @@
+#include "Bench.h"
+#include "PhotonMap.h"
+#include "Renderer.h"
+#include "Mesh.h"
+#include "Sphere.h"
+
+#include <cmath>
+#include <random>
+
+namespace {
+
+const unsigned Width = 80;
+const unsigned Height = 60;
+const unsigned NumPhotons = 200000;
+const unsigned NumQueries = 20000;
+
+void AddQuad(Scene &scene, TMaterialId mat, const glm::dvec3 &p0,
+             const glm::dvec3 &p1, const glm::dvec3 &p2, const glm::dvec3 &p3) {
+  std::unique_ptr<Mesh> quad(new Mesh(false, mat));
+  quad->AddQuadFace(quad->AddVertex(p0), quad->AddVertex(p1),
+                    quad->AddVertex(p2), quad->AddVertex(p3));
+  quad->CalculateNormals();
+  scene.AddObject(std::move(quad));
+}
+
+// Matte floor between two glossy walls and a glossy sphere, lit by one
+// lamp: most of the floor's light is reflected by the glossy surfaces.
+void BuildGallery(Scene &scene) {
+  MaterialManager &materials = scene.GetMaterials();
+  TMaterialId floor = materials.AddMaterial("floor",
+    Material(glm::dvec3(0.0), glm::dvec3(0.0), glm::dvec3(0.7), 1.0));
+  TMaterialId metal = materials.AddMaterial("metal",
+    Material(glm::dvec3(0.0), glm::dvec3(0.9, 0.8, 0.6), glm::dvec3(0.0), 200.0));
+
+  AddQuad(scene, floor, glm::dvec3(-20.0, 0.0, -20.0), glm::dvec3(-20.0, 0.0, 20.0),
+          glm::dvec3(20.0, 0.0, 20.0), glm::dvec3(20.0, 0.0, -20.0));
+  AddQuad(scene, metal, glm::dvec3(-6.0, 0.0, 6.0), glm::dvec3(-6.0, 5.0, 6.0),
+          glm::dvec3(6.0, 5.0, 6.0), glm::dvec3(6.0, 0.0, 6.0));
+  AddQuad(scene, metal, glm::dvec3(-6.0, 0.0, -6.0), glm::dvec3(-6.0, 5.0, -6.0),
+          glm::dvec3(-6.0, 5.0, 6.0), glm::dvec3(-6.0, 0.0, 6.0));
+  scene.AddObject(std::unique_ptr<Sphere>(
+    new Sphere(glm::dvec3(2.0, 1.0, 2.0), 1.0, metal)));
+
+  scene.AddLight(PointLight(glm::dvec3(1.0, 4.0, -1.0), glm::dvec3(0.0),
+                            glm::dvec3(1.0), glm::dvec3(1.0)));
+  scene.SetBackground(glm::dvec3(0.0));
+  scene.Freeze();
+}
+
+void BenchCaustics(const Scene &scene, const Camera &camera,
+                   const RenderSettings &settings, const Framebuffer &reference,
+                   const std::string &name) {
+  Framebuffer fb(Width, Height);
+  Renderer renderer(settings);
+  renderer.Render(scene, camera, fb);
+  const RenderStats &stats = renderer.GetStats();
+  std::printf("%-48s %12.5f RMSE %8.3f s\n", name.c_str(),
+              RMSE(fb, reference), stats.renderSeconds);
+  if (stats.photonsStored) {
+    std::printf("%-48s %12llu photons\n", "",
+                static_cast<unsigned long long>(stats.photonsStored));
+  }
+}
+
+} // anonymous namespace
+
+
+void RunPhotonBenchmarks() {
+  // Photons over a few surfaces of a room, queried near them.
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> uniform(-5.0f, 5.0f);
+  std::vector<Photon> photons(NumPhotons);
+  for (unsigned i = 0; i < NumPhotons; ++i) {
+    Photon &p = photons[i];
+    p.position = glm::vec3(uniform(rng), 0.0f, uniform(rng));
+    p.position[i % 3] = i % 2 ? -5.0f : 5.0f;
+    p.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+    p.power = glm::vec3(1.0f);
+  }
+  std::vector<glm::dvec3> queries(NumQueries);
+  for (glm::dvec3 &q : queries)
+    q = glm::dvec3(photons[rng() % NumPhotons].position);
+
+  PhotonMap map;
+  double ns = MeasureNs(3, [&]() { map.Build(photons, 1.0); });
+  ReportBenchmark("Photon map build", ns / NumPhotons, "photon");
+  for (unsigned k : { 10u, 50u, 200u }) {
+    ns = MeasureNs(3, [&]() {
+      for (const glm::dvec3 &q : queries)
+        BenchSink += map.EstimateIrradiance(q, glm::dvec3(0.0, 1.0, 0.0), k, 1.0).r;
+    });
+    ReportBenchmark("Photon map, " + std::to_string(k) + " nearest", ns / NumQueries,
+                    "query");
+  }
+
+  // Light reflected by glossy surfaces path traced, against the photon
+  // map, at equal sample counts: error against a 256 spp path traced
+  // reference and total time (photon pass included).
+  Scene scene;
+  BuildGallery(scene);
+  Camera camera(glm::dvec3(3.0, 4.0, -8.0), glm::dvec3(-0.3, -0.4, 1.0),
+                glm::uvec2(Width, Height));
+  RenderSettings settings;
+  settings.integrator = Integrator::PathTracing;
+  settings.maxDepth = 6;
+  settings.numThreads = 1;
+  settings.minSamples = settings.maxSamples = 256;
+  Framebuffer reference(Width, Height);
+  Renderer(settings).Render(scene, camera, reference);
+
+  settings.photonMap.maxEmitted = 1000000;
+  for (unsigned spp = 4; spp <= 16; spp *= 4) {
+    settings.minSamples = settings.maxSamples = spp;
+    std::string suffix = ", " + std::to_string(spp) + " spp";
+    settings.photonMapping = false;
+    BenchCaustics(scene, camera, settings, reference, "Gallery, path traced" + suffix);
+    settings.photonMapping = true;
+    BenchCaustics(scene, camera, settings, reference, "Gallery, photon map" + suffix);
+  }
+
+  // Photon pass and paths on all threads.
+  settings.numThreads = 0;
+  BenchCaustics(scene, camera, settings, reference,
+                "Gallery, photon map, 16 spp, all threads");
+}
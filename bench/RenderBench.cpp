@@ -0,0 +1,136 @@
+#include "Bench.h"
+#include "Renderer.h"
+#include "Mesh.h"
+#include "Sphere.h"
+
+#include <cmath>
+
+namespace {
+
+const unsigned Width = 160;
+const unsigned Height = 120;
+const unsigned Iterations = 3;
+
+void AddQuad(Scene &scene, TMaterialId mat, const glm::dvec3 &p0,
+             const glm::dvec3 &p1, const glm::dvec3 &p2, const glm::dvec3 &p3) {
+  std::unique_ptr<Mesh> quad(new Mesh(false, mat));
+  quad->AddQuadFace(quad->AddVertex(p0), quad->AddVertex(p1),
+                    quad->AddVertex(p2), quad->AddVertex(p3));
+  quad->CalculateNormals();
+  scene.AddObject(std::move(quad));
+}
+
+// Two parallel mirrors with a row of spheres between them: most primary
+// rays bounce many times.
+void BuildHallOfMirrors(Scene &scene) {
+  MaterialManager &materials = scene.GetMaterials();
+  TMaterialId mirror = materials.AddMaterial("mirror",
+    Material(glm::dvec3(0.0), glm::dvec3(0.95), glm::dvec3(0.05), 200.0));
+  TMaterialId floor = materials.AddMaterial("floor",
+    Material(glm::dvec3(0.2), glm::dvec3(0.1), glm::dvec3(0.6), 10.0));
+  TMaterialId red = materials.AddMaterial("red",
+    Material(glm::dvec3(0.2, 0.0, 0.0), glm::dvec3(0.5), glm::dvec3(0.8, 0.1, 0.1), 50.0));
+
+  AddQuad(scene, mirror, glm::dvec3(-5.0, -5.0, -50.0), glm::dvec3(-5.0, -5.0, 50.0),
+          glm::dvec3(-5.0, 5.0, 50.0), glm::dvec3(-5.0, 5.0, -50.0));
+  AddQuad(scene, mirror, glm::dvec3(5.0, -5.0, -50.0), glm::dvec3(5.0, 5.0, -50.0),
+          glm::dvec3(5.0, 5.0, 50.0), glm::dvec3(5.0, -5.0, 50.0));
+  AddQuad(scene, floor, glm::dvec3(-5.0, -5.0, -50.0), glm::dvec3(5.0, -5.0, -50.0),
+          glm::dvec3(5.0, -5.0, 50.0), glm::dvec3(-5.0, -5.0, 50.0));
+
+  for (int i = 0; i < 8; ++i) {
+    scene.AddObject(std::unique_ptr<Sphere>(new Sphere(
+      glm::dvec3(i % 2 ? 2.0 : -2.0, -3.5, 4.0 * i), 1.5, i % 2 ? red : mirror)));
+  }
+
+  scene.AddLight(PointLight(glm::dvec3(0.0, 4.0, -10.0), glm::dvec3(0.1),
+                            glm::dvec3(0.7), glm::dvec3(0.7)));
+  scene.AddLight(PointLight(glm::dvec3(0.0, 4.0, 20.0), glm::dvec3(0.0),
+                            glm::dvec3(0.5), glm::dvec3(0.5)));
+  scene.Freeze();
+}
+
+Framebuffer BenchRender(const Scene &scene, const Camera &camera,
+                        const RenderSettings &settings, const std::string &name) {
+  Framebuffer fb(Width, Height);
+  Renderer renderer(settings);
+  double ns = MeasureNs(Iterations, [&]() {
+    renderer.Render(scene, camera, fb);
+    BenchSink = BenchSink + fb[0].r;
+  });
+
+  const RenderStats &stats = renderer.GetStats();
+  std::uint64_t rays = stats.primaryRays + stats.reflectionRays + stats.shadowRays;
+  ReportBenchmark(name, ns / rays, "ray");
+  std::printf("%-48s %12.2f reflections/sample\n", "",
+              static_cast<double>(stats.reflectionRays) / stats.samples);
+  return fb;
+}
+
+// Root mean square difference of two images, and difference of their
+// means (which shows bias rather than noise).
+void ReportError(const Framebuffer &fb, const Framebuffer &reference) {
+  double sum = 0.0;
+  glm::dvec3 meanDiff(0.0);
+  for (std::size_t i = 0; i < fb.GetNumPixels(); ++i) {
+    glm::dvec3 d = fb[i] - reference[i];
+    sum += glm::dot(d, d) / 3.0;
+    meanDiff += d;
+  }
+  meanDiff /= static_cast<double>(fb.GetNumPixels());
+  std::printf("%-48s %12.5f RMSE\n", "", std::sqrt(sum / fb.GetNumPixels()));
+  std::printf("%-48s %12.5f mean error\n", "",
+              (meanDiff.r + meanDiff.g + meanDiff.b) / 3.0);
+}
+
+} // anonymous namespace
+
+
+void RunRenderBenchmarks() {
+  Scene scene;
+  BuildHallOfMirrors(scene);
+  Camera camera(glm::dvec3(0.0, 0.0, -20.0), glm::dvec3(0.3, -0.1, 1.0),
+                glm::uvec2(Width, Height));
+
+  RenderSettings settings;
+  settings.maxDepth = 16;
+
+  settings.mode = RenderMode::Recursive;
+  BenchRender(scene, camera, settings, "Render, recursive (hall of mirrors)");
+  settings.mode = RenderMode::Wavefront;
+  BenchRender(scene, camera, settings, "Render, wavefront (hall of mirrors)");
+  settings.mode = RenderMode::Deferred;
+  BenchRender(scene, camera, settings, "Render, deferred (hall of mirrors)");
+
+  // Path termination: every path traced to maxDepth, against the throughput
+  // cutoff and Russian roulette, with enough samples to tell bias from
+  // noise.
+  settings.mode = RenderMode::Recursive;
+  settings.minSamples = settings.maxSamples = 16;
+  settings.throughputCutoff = 0.0;
+  settings.rouletteThroughput = 0.0;
+  Framebuffer full =
+    BenchRender(scene, camera, settings, "Render, full depth, 16 spp");
+  settings.throughputCutoff = RenderSettings().throughputCutoff;
+  Framebuffer cutOff =
+    BenchRender(scene, camera, settings, "Render, throughput cutoff, 16 spp");
+  ReportError(cutOff, full);
+  settings.rouletteThroughput = RenderSettings().rouletteThroughput;
+  Framebuffer roulette =
+    BenchRender(scene, camera, settings, "Render, cutoff and roulette, 16 spp");
+  ReportError(roulette, full);
+
+  // Path tracing: diffuse and glossy interreflections. Noise at 16 spp
+  // against a 256 spp reference.
+  settings.integrator = Integrator::PathTracing;
+  settings.numThreads = 1;
+  settings.minSamples = settings.maxSamples = 256;
+  Framebuffer reference(Width, Height);
+  Renderer(settings).Render(scene, camera, reference);
+  settings.minSamples = settings.maxSamples = 16;
+  BenchRender(scene, camera, settings, "Path tracing, 1 thread, 16 spp");
+  settings.numThreads = 0;
+  Framebuffer paths =
+    BenchRender(scene, camera, settings, "Path tracing, all threads, 16 spp");
+  ReportError(paths, reference);
+}
@@ -0,0 +1,42 @@
+#include "Bench.h"
+#include "Sampler.h"
+
+#include <random>
+#include <vector>
+
+namespace {
+
+const unsigned Iterations = 20;
+const unsigned NumPixels = 1024;
+const std::uint32_t NumDimensions = 64;
+
+void BenchGenerate(const Sampler &sampler, const std::string &name) {
+  std::vector<double> values(NumDimensions);
+  double ns = MeasureNs(Iterations, [&]() {
+    for (unsigned p = 0; p < NumPixels; ++p) {
+      sampler.Generate(glm::uvec2(p % 32, p / 32), 7, 0, NumDimensions,
+                       values.data());
+      BenchSink = BenchSink + values[p % NumDimensions];
+    }
+  });
+  ReportBenchmark(name, ns / (NumPixels * NumDimensions), "sample");
+}
+
+} // anonymous namespace
+
+
+void RunSamplerBenchmarks() {
+  // Reference: the generator a renderer would use otherwise.
+  std::mt19937 gen(12345);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  double ns = MeasureNs(Iterations, [&]() {
+    for (unsigned i = 0; i < NumPixels * NumDimensions; ++i)
+      BenchSink = BenchSink + uniform(gen);
+  });
+  ReportBenchmark("Samples, std::mt19937", ns / (NumPixels * NumDimensions),
+                  "sample");
+
+  BenchGenerate(Sampler(SamplerType::Random), "Samples, Philox (64-dim vectors)");
+  BenchGenerate(Sampler(SamplerType::Sobol), "Samples, Owen-scrambled Sobol");
+  BenchGenerate(Sampler(SamplerType::BlueNoise), "Samples, blue-noise Sobol");
+}
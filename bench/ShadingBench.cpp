@@ -0,0 +1,68 @@
+#include "Bench.h"
+#include "Shading.h"
+
+#include <random>
+
+namespace {
+
+const std::size_t NumHits = 4096;
+const unsigned Iterations = 50;
+
+glm::dvec3 RandomUnitVector(std::mt19937 &gen) {
+  std::uniform_real_distribution<double> dist(-1.0, 1.0);
+  glm::dvec3 v;
+  do {
+    v = glm::dvec3(dist(gen), dist(gen), dist(gen));
+  } while (glm::length(v) < 1.0e-3 || glm::length(v) > 1.0);
+  return glm::normalize(v);
+}
+
+void BenchShading(const MaterialManager &materials,
+                  const std::vector<PointLight> &lights,
+                  const HitBatch &hits, SpecularPowMode mode,
+                  const std::string &name) {
+  std::vector<glm::dvec3> colors;
+  double ns = MeasureNs(Iterations, [&]() {
+    ShadeBlinnPhong(materials, lights, hits, colors, mode);
+    BenchSink = BenchSink + colors[0].r;
+  });
+  ReportBenchmark(name, ns / hits.Size(), "hit");
+}
+
+} // anonymous namespace
+
+
+void RunShadingBenchmarks() {
+  std::mt19937 gen(12345);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+  MaterialManager materials;
+  for (int i = 0; i < 16; ++i) {
+    Material mat(glm::dvec3(0.1), glm::dvec3(unit(gen)),
+                 glm::dvec3(unit(gen), unit(gen), unit(gen)),
+                 5.0 + 100.0 * unit(gen));
+    materials.AddMaterial("material" + std::to_string(i), mat);
+  }
+  materials.Freeze();
+
+  HitBatch hits;
+  hits.Reserve(NumHits);
+  for (std::size_t i = 0; i < NumHits; ++i) {
+    glm::dvec3 point = 10.0 * RandomUnitVector(gen);
+    hits.Add(point, RandomUnitVector(gen), RandomUnitVector(gen),
+             static_cast<TMaterialId>(i % materials.GetNumMaterials()));
+  }
+
+  for (std::size_t numLights : {1, 8}) {
+    std::vector<PointLight> lights;
+    for (std::size_t i = 0; i < numLights; ++i)
+      lights.push_back(PointLight(20.0 * RandomUnitVector(gen), glm::dvec3(0.05),
+                                  glm::dvec3(0.5), glm::dvec3(0.5)));
+
+    std::string suffix = " (" + std::to_string(numLights) + " lights)";
+    BenchShading(materials, lights, hits, SpecularPowMode::Exact,
+                 "Blinn-Phong, exact pow" + suffix);
+    BenchShading(materials, lights, hits, SpecularPowMode::Fast,
+                 "Blinn-Phong, fast pow" + suffix);
+  }
+}
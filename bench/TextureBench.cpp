@@ -0,0 +1,133 @@
+#include "Bench.h"
+#include "Texture.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const unsigned Size = 2048;
+const unsigned NumLookups = 200000;
+const char *const TexturePath = "TextureBench.tmip";
+
+// Smooth colors with some detail on every scale.
+std::vector<glm::vec3> Texels() {
+  std::vector<glm::vec3> texels(static_cast<std::size_t>(Size) * Size);
+  for (unsigned y = 0; y < Size; ++y) {
+    for (unsigned x = 0; x < Size; ++x) {
+      float u = static_cast<float>(x) / Size, v = static_cast<float>(y) / Size;
+      texels[static_cast<std::size_t>(y) * Size + x] = glm::vec3(
+        0.5f + 0.5f * std::sin(40.0f * u + 7.0f * v),
+        0.5f + 0.5f * std::sin(90.0f * v) * std::cos(13.0f * u),
+        (x ^ y) % 64 / 63.0f);
+    }
+  }
+  return texels;
+}
+
+struct Lookup {
+  glm::dvec2 uv;
+  double footprint;
+};
+
+// Lookups along a camera sweeping over the texture (neighbours use the
+// same tiles), or scattered all over it.
+std::vector<Lookup> Lookups(bool coherent) {
+  std::mt19937 rng(3);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  std::vector<Lookup> lookups(NumLookups);
+  for (unsigned i = 0; i < NumLookups; ++i) {
+    Lookup &l = lookups[i];
+    if (coherent) {
+      unsigned row = i / 500, column = i % 500;
+      l.uv = glm::dvec2(column / 500.0, row / 400.0);
+    } else {
+      l.uv = glm::dvec2(uniform(rng), uniform(rng));
+    }
+    l.footprint = 0.5 / Size + 4.0 / Size * uniform(rng);
+  }
+  return lookups;
+}
+
+void ReportStats(const TextureStats &stats) {
+  std::uint64_t tiles = stats.tileHits + stats.tileMisses;
+  std::printf("%-48s %12.2f %% hits, %.1f MB read\n", "",
+              tiles ? 100.0 * stats.tileHits / tiles : 0.0,
+              stats.bytesRead / 1048576.0);
+}
+
+// Time of \p lookups made by \p numThreads threads through \p cache with
+// tiles dropped before every run (cold) or not.
+void BenchLookups(TextureCache &cache, const std::vector<Lookup> &lookups,
+                  unsigned numThreads, bool cold, const std::string &name) {
+  TextureStats stats;
+  std::vector<double> sums(numThreads);
+  auto run = [&](unsigned t, TextureStats &threadStats) {
+    for (std::size_t i = t; i < lookups.size(); i += numThreads)
+      sums[t] += cache.Sample(0, lookups[i].uv, lookups[i].footprint, threadStats).r;
+  };
+  double ns = MeasureNs(3, [&]() {
+    if (cold)
+      cache.Clear();
+    std::vector<TextureStats> threadStats(numThreads);
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < numThreads; ++t)
+      threads.push_back(std::thread(run, t, std::ref(threadStats[t])));
+    run(0, threadStats[0]);
+    for (std::thread &thread : threads)
+      thread.join();
+    stats = TextureStats();
+    for (unsigned t = 0; t < numThreads; ++t) {
+      stats += threadStats[t];
+      BenchSink += sums[t];
+    }
+  });
+  ReportBenchmark(name, ns / lookups.size(), "lookup");
+  ReportStats(stats);
+}
+
+} // anonymous namespace
+
+
+void RunTextureBenchmarks() {
+  std::vector<glm::vec3> texels = Texels();
+  std::vector<Lookup> coherent = Lookups(true);
+  std::vector<Lookup> scattered = Lookups(false);
+  unsigned numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+  // The same texture with uncompressed and BC1 tiles: BC1 decodes every
+  // texel but reads and keeps an eighth of the bytes.
+  for (TextureFormat format : { TextureFormat::RGBA8, TextureFormat::BC1 }) {
+    if (!WriteTexture(TexturePath, Size, Size, texels, 64, format)) {
+      std::printf("Texture benchmarks skipped: can't write %s\n", TexturePath);
+      return;
+    }
+    std::string prefix = format == TextureFormat::BC1 ? "Texture BC1, " : "Texture, ";
+
+    // The whole pyramid (about 22 MB, 2.8 MB compressed) fits.
+    TextureCache cache;
+    cache.AddTexture(TexturePath);
+    BenchLookups(cache, coherent, 1, false, prefix + "coherent, warm");
+    BenchLookups(cache, scattered, 1, false, prefix + "scattered, warm");
+    BenchLookups(cache, coherent, 1, true, prefix + "coherent, cold");
+    BenchLookups(cache, scattered, numThreads, false,
+                 prefix + "scattered, warm, all threads");
+    std::printf("%-48s %12.1f MB resident\n", "",
+                cache.GetResidentBytes() / 1048576.0);
+
+    // A budget of 1/8 of the uncompressed texture: scattered lookups
+    // thrash it, much less so when most of the compressed pyramid fits.
+    TextureCache small(Size * Size * 4 / 8);
+    small.AddTexture(TexturePath);
+    BenchLookups(small, coherent, 1, false, prefix + "coherent, 1/8 budget");
+    BenchLookups(small, scattered, 1, false, prefix + "scattered, 1/8 budget");
+    BenchLookups(small, scattered, numThreads, false,
+                 prefix + "scattered, 1/8 budget, all threads");
+
+    std::remove(TexturePath);
+  }
+}
@@ -0,0 +1,144 @@
+#include "AovBuffers.h"
+
+#include <cassert>
+#include <limits>
+
+namespace {
+
+const char *const AovNames[NumAovs] = { "depth", "normal", "albedo", "id" };
+
+// Channels of all AOVs, in order.
+struct AovChannel {
+  Aov aov;
+  const char *name;
+  std::vector<float> AovBuffers::*plane;
+};
+
+const AovChannel Channels[] = {
+  { Aov::Depth, "Z", &AovBuffers::depth },
+  { Aov::Normal, "N.X", &AovBuffers::normalX },
+  { Aov::Normal, "N.Y", &AovBuffers::normalY },
+  { Aov::Normal, "N.Z", &AovBuffers::normalZ },
+  { Aov::Albedo, "albedo.R", &AovBuffers::albedoR },
+  { Aov::Albedo, "albedo.G", &AovBuffers::albedoG },
+  { Aov::Albedo, "albedo.B", &AovBuffers::albedoB },
+  { Aov::ObjectId, "id", &AovBuffers::objectId },
+};
+
+// Entry of Channels of requested channel \p channel of \p mask.
+const AovChannel &FindChannel(TAovMask mask, unsigned channel)
+{
+  for (const AovChannel &c : Channels) {
+    if (!(mask & AovBit(c.aov)))
+      continue;
+    if (!channel)
+      return c;
+    --channel;
+  }
+  assert(false && "AOV channel out of range!");
+  return Channels[0];
+}
+
+} // anonymous namespace
+
+
+bool ParseAovs(const std::string &list, TAovMask &mask)
+{
+  mask = 0;
+  std::size_t begin = 0;
+  for (;;) {
+    std::size_t end = list.find(',', begin);
+    std::string name = list.substr(begin, end == std::string::npos ?
+                                          std::string::npos : end - begin);
+    unsigned a = 0;
+    while (a < NumAovs && name != AovNames[a])
+      ++a;
+    if (a == NumAovs)
+      return false;
+    mask |= AovBit(static_cast<Aov>(a));
+    if (end == std::string::npos)
+      return true;
+    begin = end + 1;
+  }
+}
+
+
+// === AovBuffers ===
+void AovBuffers::Reset(unsigned w, unsigned h)
+{
+  width = w;
+  height = h;
+  std::size_t n = GetNumPixels();
+  for (const AovChannel &c : Channels) {
+    std::vector<float> &plane = this->*c.plane;
+    if (Has(c.aov))
+      plane.assign(n, 0.0f);
+    else
+      std::vector<float>().swap(plane);
+  }
+  hits.assign(n, 0);
+}
+
+
+void AovBuffers::AddHit(std::size_t i, const IntersectionResult &hit,
+                        const glm::dvec3 &normal, const glm::dvec3 &albedo)
+{
+  assert(i < hits.size() && "Pixel index out of bounds!");
+  if (Has(Aov::Depth))
+    depth[i] += static_cast<float>(hit.GetDistance());
+  if (Has(Aov::Normal)) {
+    normalX[i] += static_cast<float>(normal.x);
+    normalY[i] += static_cast<float>(normal.y);
+    normalZ[i] += static_cast<float>(normal.z);
+  }
+  if (Has(Aov::Albedo)) {
+    albedoR[i] += static_cast<float>(albedo.r);
+    albedoG[i] += static_cast<float>(albedo.g);
+    albedoB[i] += static_cast<float>(albedo.b);
+  }
+  if (Has(Aov::ObjectId) && !hits[i])
+    objectId[i] = static_cast<float>(hit.GetObjectId());
+  ++hits[i];
+}
+
+
+void AovBuffers::Resolve()
+{
+  for (std::size_t i = 0; i < hits.size(); ++i) {
+    if (!hits[i]) {
+      if (Has(Aov::Depth))
+        depth[i] = std::numeric_limits<float>::infinity();
+      if (Has(Aov::ObjectId))
+        objectId[i] = -1.0f;
+      continue;
+    }
+    float scale = 1.0f / hits[i];
+    for (const AovChannel &c : Channels) {
+      if (Has(c.aov) && c.aov != Aov::ObjectId)
+        (this->*c.plane)[i] *= scale;
+    }
+  }
+}
+
+
+unsigned AovBuffers::GetNumChannels(TAovMask m)
+{
+  unsigned n = 0;
+  for (const AovChannel &c : Channels) {
+    if (m & AovBit(c.aov))
+      ++n;
+  }
+  return n;
+}
+
+
+const char *AovBuffers::GetChannelName(TAovMask m, unsigned channel)
+{
+  return FindChannel(m, channel).name;
+}
+
+
+const std::vector<float> &AovBuffers::GetChannel(unsigned channel) const
+{
+  return this->*FindChannel(mask, channel).plane;
+}
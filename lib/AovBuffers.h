@@ -0,0 +1,84 @@
+#pragma once
+
+#include "IntersectionResult.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Arbitrary output variables: features of the surfaces seen through every
+// pixel, output besides its color for compositing.
+enum class Aov : unsigned {
+  // Distance of the primary hit from the camera, infinite where camera
+  // rays miss the scene.
+  Depth,
+  // Normal of the primary hit, facing the camera.
+  Normal,
+  // Diffuse color of the primary hit, texture included.
+  Albedo,
+  // Index in the scene of the object hit by the pixel's first sample which
+  // hit anything, -1 if none did.
+  ObjectId,
+};
+
+const unsigned NumAovs = 4;
+
+// Set of AOVs: bit i stands for Aov i.
+using TAovMask = unsigned;
+
+inline TAovMask AovBit(Aov aov) { return 1u << static_cast<unsigned>(aov); }
+
+// Parse \p list of comma separated AOV names (depth, normal, albedo, id)
+// into \p mask. Returns false if a name isn't known.
+bool ParseAovs(const std::string &list, TAovMask &mask);
+
+// Requested AOVs of an image. Planar: one array per channel, row by row.
+// Depth, normal and albedo are averaged over the pixel's samples which hit
+// the scene, normal and albedo are zero where none did. Planes of AOVs not
+// requested are empty.
+class AovBuffers {
+public:
+  explicit AovBuffers(TAovMask m = 0) : mask(m), width(0), height(0) {}
+
+  // Resize to \p w by \p h pixels and clear the requested planes.
+  void Reset(unsigned w, unsigned h);
+
+  // Add the primary hit of a sample of pixel \p i: \p normal facing the
+  // camera and \p albedo. Sums until Resolve().
+  void AddHit(std::size_t i, const IntersectionResult &hit,
+              const glm::dvec3 &normal, const glm::dvec3 &albedo);
+
+  // Sums to means, after the last AddHit().
+  void Resolve();
+
+public:
+  TAovMask GetMask() const { return mask; }
+  bool Has(Aov aov) const { return (mask & AovBit(aov)) != 0; }
+
+  unsigned GetWidth() const { return width; }
+  unsigned GetHeight() const { return height; }
+  std::size_t GetNumPixels() const { return static_cast<std::size_t>(width) * height; }
+
+  // Channels of the requested AOVs, in the order of Aov, named as in
+  // OpenEXR files: "Z", "N.X", "N.Y", "N.Z", "albedo.R", "albedo.G",
+  // "albedo.B", "id".
+  unsigned GetNumChannels() const { return GetNumChannels(mask); }
+  static unsigned GetNumChannels(TAovMask m);
+  static const char *GetChannelName(TAovMask m, unsigned channel);
+  const char *GetChannelName(unsigned channel) const {
+    return GetChannelName(mask, channel);
+  }
+  const std::vector<float> &GetChannel(unsigned channel) const;
+
+  std::vector<float> depth;
+  std::vector<float> normalX, normalY, normalZ;
+  std::vector<float> albedoR, albedoG, albedoB;
+  std::vector<float> objectId;
+
+private:
+  TAovMask mask;
+  unsigned width;
+  unsigned height;
+
+  // Number of samples of every pixel which hit the scene.
+  std::vector<std::uint32_t> hits;
+};
@@ -0,0 +1,110 @@
+#include "Bvh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// Node bounds grow by this much relative to their coordinates before
+// they're rounded to floats, so rounding errors of ray tests in double
+// precision can't make rays miss boxes of items they hit.
+const double BoundsPadding = 1.0e-6;
+
+float RoundDown(double value)
+{
+  float f = static_cast<float>(value);
+  return f > value ? std::nextafter(f, -std::numeric_limits<float>::max()) : f;
+}
+
+
+float RoundUp(double value)
+{
+  float f = static_cast<float>(value);
+  return f < value ? std::nextafter(f, std::numeric_limits<float>::max()) : f;
+}
+
+
+struct Builder {
+  const std::vector<glm::dvec3> &itemMin;
+  const std::vector<glm::dvec3> &itemMax;
+  unsigned leafSize;
+  std::vector<BvhNode> &nodes;
+  std::uint32_t *items;
+
+  std::uint32_t BuildNode(std::uint32_t begin, std::uint32_t end);
+};
+
+
+std::uint32_t Builder::BuildNode(std::uint32_t begin, std::uint32_t end)
+{
+  std::uint32_t index = static_cast<std::uint32_t>(nodes.size());
+  nodes.push_back(BvhNode());
+
+  glm::dvec3 lo(std::numeric_limits<double>::max());
+  glm::dvec3 hi(-std::numeric_limits<double>::max());
+  glm::dvec3 centerMin = lo, centerMax = hi;
+  for (std::uint32_t i = begin; i < end; ++i) {
+    lo = glm::min(lo, itemMin[items[i]]);
+    hi = glm::max(hi, itemMax[items[i]]);
+    glm::dvec3 center = 0.5 * (itemMin[items[i]] + itemMax[items[i]]);
+    centerMin = glm::min(centerMin, center);
+    centerMax = glm::max(centerMax, center);
+  }
+
+  BvhNode node;
+  for (int a = 0; a < 3; ++a) {
+    double pad = BoundsPadding * (1.0 + std::max(std::abs(lo[a]), std::abs(hi[a])));
+    node.boundsMin[a] = RoundDown(lo[a] - pad);
+    node.boundsMax[a] = RoundUp(hi[a] + pad);
+  }
+
+  if (end - begin <= leafSize) {
+    node.index = begin;
+    node.count = end - begin;
+  } else {
+    // Median split along the longest axis of the centers.
+    glm::dvec3 extent = centerMax - centerMin;
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2)
+                                   : (extent.y > extent.z ? 1 : 2);
+    std::uint32_t middle = begin + (end - begin) / 2;
+    std::nth_element(items + begin, items + middle, items + end,
+                     [&](std::uint32_t a, std::uint32_t b) {
+                       return itemMin[a][axis] + itemMax[a][axis] <
+                              itemMin[b][axis] + itemMax[b][axis];
+                     });
+
+    node.count = 0;
+    BuildNode(begin, middle);
+    node.index = BuildNode(middle, end);
+  }
+
+  nodes[index] = node;
+  return index;
+}
+
+} // anonymous namespace
+
+
+void BuildBvh(const std::vector<glm::dvec3> &itemMin,
+              const std::vector<glm::dvec3> &itemMax, unsigned leafSize,
+              std::vector<BvhNode> &nodes, std::vector<std::uint32_t> &order)
+{
+  assert(itemMin.size() == itemMax.size() && "Item bounds don't match!");
+  assert(leafSize > 0 && "Empty BVH leaves!");
+  nodes.clear();
+  order.resize(itemMin.size());
+  for (std::size_t i = 0; i < order.size(); ++i)
+    order[i] = static_cast<std::uint32_t>(i);
+  if (order.empty())
+    return;
+
+  Builder builder = { itemMin, itemMax, leafSize, nodes, order.data() };
+  builder.BuildNode(0, static_cast<std::uint32_t>(order.size()));
+}
+
+
+BvhRay::BvhRay(const Ray &ray)
+  : origin(ray.GetOrigin()), invDirection(1.0 / ray.GetDirection())
+{
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "Ray.h"
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Node of a bounding volume hierarchy. Bounds are floats, rounded outwards
+// (and padded a little) from the double bounds of the node's items, so
+// they stay conservative and a node is 32 bytes. Nodes are stored depth
+// first: an inner node's first child follows it.
+struct BvhNode {
+  float boundsMin[3];
+  float boundsMax[3];
+  // Leaf: position of its first item in the item order. Inner node: index
+  // of its second child.
+  std::uint32_t index;
+  // Leaf: number of its items. Inner node: 0.
+  std::uint32_t count;
+
+  bool IsLeaf() const { return count != 0; }
+};
+
+// Build a hierarchy over items with bounds [\p itemMin[i], \p itemMax[i]]
+// into \p nodes. Nodes are split at the median of their items' centers
+// along the longest axis of the centers' bounds, down to leaves of at most
+// \p leafSize items. \p order gets the item indices in leaf order.
+void BuildBvh(const std::vector<glm::dvec3> &itemMin,
+              const std::vector<glm::dvec3> &itemMax, unsigned leafSize,
+              std::vector<BvhNode> &nodes, std::vector<std::uint32_t> &order);
+
+// Ray set up for box tests.
+struct BvhRay {
+  explicit BvhRay(const Ray &ray);
+
+  // Whether the ray passes through \p node's bounds before \p maxDistance.
+  // If so, \p entry is where it enters them (0 if it starts inside).
+  // Axes along which a bound is NaN (the origin on a slab of a direction
+  // parallel to it) don't restrict the interval.
+  bool Intersect(const BvhNode &node, double maxDistance, double &entry) const {
+    double tNear = 0.0, tFar = maxDistance;
+    for (int a = 0; a < 3; ++a) {
+      double t0 = (node.boundsMin[a] - origin[a]) * invDirection[a];
+      double t1 = (node.boundsMax[a] - origin[a]) * invDirection[a];
+      if (t0 > t1)
+        std::swap(t0, t1);
+      if (t0 > tNear)
+        tNear = t0;
+      if (t1 < tFar)
+        tFar = t1;
+    }
+    entry = tNear;
+    return tNear <= tFar;
+  }
+
+  glm::dvec3 origin;
+  glm::dvec3 invDirection;
+};
+
+// Walk the leaves of \p nodes which \p ray passes through closer than
+// \p maxDistance, nearer children first: \p leaf(first, count) is called
+// with the leaf's items and may lower \p maxDistance (to the closest hit
+// so far), which prunes the rest of the walk.
+template <typename TLeafFunc>
+void TraverseBvh(const std::vector<BvhNode> &nodes, const Ray &ray,
+                 double &maxDistance, TLeafFunc leaf)
+{
+  if (nodes.empty())
+    return;
+
+  const unsigned MaxDepth = 64;
+  struct Entry {
+    std::uint32_t node;
+    double distance;
+  };
+  Entry stack[MaxDepth];
+  unsigned size = 0;
+
+  BvhRay bvhRay(ray);
+  double entry;
+  if (!bvhRay.Intersect(nodes[0], maxDistance, entry))
+    return;
+  stack[size++] = Entry{ 0, entry };
+  while (size) {
+    Entry top = stack[--size];
+    if (top.distance > maxDistance)
+      continue;
+    const BvhNode &node = nodes[top.node];
+    if (node.IsLeaf()) {
+      leaf(node.index, node.count);
+      continue;
+    }
+
+    std::uint32_t first = top.node + 1, second = node.index;
+    double firstEntry, secondEntry;
+    bool hitFirst = bvhRay.Intersect(nodes[first], maxDistance, firstEntry);
+    bool hitSecond = bvhRay.Intersect(nodes[second], maxDistance, secondEntry);
+    assert(size + 2 <= MaxDepth && "BVH is too deep!");
+    // The nearer child is popped first.
+    if (hitFirst && hitSecond && firstEntry > secondEntry) {
+      std::swap(first, second);
+      std::swap(firstEntry, secondEntry);
+    }
+    if (hitSecond)
+      stack[size++] = Entry{ second, secondEntry };
+    if (hitFirst)
+      stack[size++] = Entry{ first, firstEntry };
+  }
+}
@@ -1,13 +1,42 @@
 #include "Camera.h"
 
 Camera::Camera(const glm::dvec3 &pos, const glm::dvec3 &dir,
-               const glm::vec2 &res)
-  : position(pos), direction(dir), resolution(res) {
+               const glm::vec2 &res, double fov)
+  : position(pos), direction(dir), resolution(res), regionOffset(0, 0),
+    regionSize(resolution), fieldOfView(fov) {
+  assert(fov > 0.0 && fov < 180.0 && "Camera's field of view out of bounds!");
   Normalize();
 }
 
 Camera::~Camera() {}
 
+Ray Camera::GetPrimaryRay(double x, double y) const {
+  // Build an orthonormal basis of the image plane. If camera looks straight
+  // up or down, use Z axis as "up" instead of Y.
+  glm::dvec3 worldUp(0.0, 1.0, 0.0);
+  if (std::abs(glm::dot(direction, worldUp)) > 1.0 - 1.0e-9)
+    worldUp = glm::dvec3(0.0, 0.0, 1.0);
+  glm::dvec3 right = glm::normalize(glm::cross(direction, worldUp));
+  glm::dvec3 up = glm::cross(right, direction);
+
+  // Half-height of the image plane at distance 1.
+  double halfHeight = std::tan(glm::radians(fieldOfView) * 0.5);
+  double halfWidth = halfHeight * resolution.x / resolution.y;
+
+  // Map pixel coordinates to [-1, 1].
+  double u = 2.0 * (x + regionOffset.x) / resolution.x - 1.0;
+  double v = 1.0 - 2.0 * (y + regionOffset.y) / resolution.y;
+
+  return Ray(position,
+             direction + u * halfWidth * right + v * halfHeight * up,
+             0.0, GetPixelSpread());
+}
+
+double Camera::GetPixelSpread() const {
+  double halfHeight = std::tan(glm::radians(fieldOfView) * 0.5);
+  return std::atan(2.0 * halfHeight / resolution.y);
+}
+
 void Camera::LookAt(const glm::dvec3 &point) {
   if (point != position) {
     direction = point - position;
@@ -38,6 +67,13 @@ void Camera::MoveBackward(double distance) {
   position -= distance * direction;
 }
 
+void Camera::SetRegion(const glm::uvec2 &offset, const glm::uvec2 &size) {
+  assert(size.x > 0 && size.y > 0 && offset.x + size.x <= resolution.x &&
+         offset.y + size.y <= resolution.y && "Camera region out of bounds!");
+  regionOffset = offset;
+  regionSize = size;
+}
+
 void Camera::Normalize() {
   direction = glm::normalize(direction);
   assert(std::abs(glm::length(direction) - 1.0) < 0.00001 &&
@@ -2,14 +2,30 @@
 
 #include <glm/glm.hpp>
 #include <cassert>
+#include "Ray.h"
 
 class Camera {
 public:
   // === Constructors ===
 
-  Camera(const glm::dvec3 &pos, const glm::dvec3 &dir, const glm::vec2 &res);
+  // \p fov is the vertical field of view in degrees.
+  Camera(const glm::dvec3 &pos, const glm::dvec3 &dir, const glm::vec2 &res,
+         double fov = 60.0);
   ~Camera();
 
+  // === Ray generation ===
+
+  // Ray from camera's position through point (\p x, \p y) of the image
+  // plane, in pixels. (0, 0) is the top-left corner of the image, so the
+  // center of pixel (i, j) is (i + 0.5, j + 0.5).
+  // The image plane is oriented so that world's Y axis points up.
+  // The ray is a cone from the camera's position spreading by the angle of
+  // one pixel (GetPixelSpread()).
+  Ray GetPrimaryRay(double x, double y) const;
+
+  // Angle subtended by a pixel at the center of the image, radians.
+  double GetPixelSpread() const;
+
   // === Camera movement ===
 
   // Change camera's focus to \p point, preserving the position.
@@ -26,18 +42,35 @@ public:
   // Move camera backward (opposite to direction).
   void MoveBackward(double distance);
 
+  // === Image regions ===
+
+  // See only \p size pixels of the image, from pixel \p offset: pixel
+  // (x, y) of the camera is pixel \p offset + (x, y) of the image, and
+  // GetResolution() is \p size. Rays are those of the whole image, so an
+  // image can be rendered region by region.
+  void SetRegion(const glm::uvec2 &offset, const glm::uvec2 &size);
+
 private:
   // Normalize direction - make it of length 1.
   void Normalize();
 
   glm::dvec3 position;
   glm::dvec3 direction;
+  // Of the whole image.
   glm::uvec2 resolution;
+  glm::uvec2 regionOffset;
+  glm::uvec2 regionSize;
+  // Vertical field of view, degrees.
+  double fieldOfView;
 
 public:
   // Getters.
   glm::dvec3 GetPosition() const { return position; }
   glm::dvec3 GetDirection() const { return direction; }
-  glm::uvec2 GetResolution() const { return resolution; }
+  // Resolution of the region seen (the whole image by default).
+  glm::uvec2 GetResolution() const { return regionSize; }
+  glm::uvec2 GetImageResolution() const { return resolution; }
+  glm::uvec2 GetRegionOffset() const { return regionOffset; }
+  double GetFieldOfView() const { return fieldOfView; }
 };
 
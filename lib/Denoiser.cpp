@@ -0,0 +1,237 @@
+#include "Denoiser.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+namespace {
+
+// Pixels of a row filtered at once: sums are kept in local arrays, so the
+// tap loops only write memory no plane can alias and vectorize.
+const unsigned ChunkSize = 256;
+
+// Weights of the a-trous kernel along one axis (linear B-spline).
+const float KernelWeights[3] = { 0.25f, 0.5f, 0.25f };
+
+// exp(-x) for x >= 0, as (1 - x/16)^16. Within 0.02 of exp(-x). No
+// transcendental calls, so the loops using it vectorize. Flushed to zero
+// from x = 15.5 (exp(-x) < 2e-7): smaller values would go through
+// denormals, which are many times slower.
+inline float FastExpNeg(float x) {
+  float t = 1.0f - x * (1.0f / 16.0f);
+  t = t > 1.0f / 32.0f ? t : 0.0f;
+  t *= t;
+  t *= t;
+  t *= t;
+  t *= t;
+  return t;
+}
+
+} // anonymous namespace
+
+
+// === GuideBuffers ===
+void GuideBuffers::Reset(unsigned w, unsigned h)
+{
+  width = w;
+  height = h;
+  std::size_t n = static_cast<std::size_t>(w) * h;
+  for (std::vector<float> *plane : { &normalX, &normalY, &normalZ,
+                                     &albedoR, &albedoG, &albedoB, &depth,
+                                     &error })
+    plane->assign(n, 0.0f);
+}
+
+
+// === Denoiser ===
+void Denoiser::Denoise(const Framebuffer &input, const GuideBuffers &guides,
+                       Framebuffer &output)
+{
+  assert(input.GetWidth() == guides.GetWidth() &&
+         input.GetHeight() == guides.GetHeight() &&
+         "Guide buffers don't match the image!");
+  assert(output.GetWidth() == input.GetWidth() &&
+         output.GetHeight() == input.GetHeight() &&
+         "Output size doesn't match the input!");
+
+  auto start = std::chrono::steady_clock::now();
+
+  std::size_t n = input.GetNumPixels();
+  for (int c = 0; c < 3; ++c) {
+    source[c].resize(n);
+    target[c].resize(n);
+  }
+  depthScale.resize(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    source[0][i] = static_cast<float>(input[i].r);
+    source[1][i] = static_cast<float>(input[i].g);
+    source[2][i] = static_cast<float>(input[i].b);
+    float scale = settings.depthSigma * guides.depth[i];
+    depthScale[i] = scale > 0.0f ? 1.0f / (scale * scale) : 0.0f;
+  }
+
+  // Error estimates of few samples are noisy themselves: variance is
+  // averaged over 3x3 pixels (edges repeated), summing rows then columns.
+  // The first pass's target serves as scratch for row sums.
+  unsigned width = input.GetWidth();
+  unsigned height = input.GetHeight();
+  std::vector<float> &rowSums = target[0];
+  for (unsigned y = 0; y < height; ++y) {
+    const float *e = &guides.error[static_cast<std::size_t>(y) * width];
+    float *sums = &rowSums[static_cast<std::size_t>(y) * width];
+    for (unsigned x = 1; x + 1 < width; ++x)
+      sums[x] = e[x - 1] * e[x - 1] + e[x] * e[x] + e[x + 1] * e[x + 1];
+    unsigned last = width - 1;
+    sums[0] = 2.0f * e[0] * e[0] + e[std::min(1u, last)] * e[std::min(1u, last)];
+    if (last > 0)
+      sums[last] = 2.0f * e[last] * e[last] + e[last - 1] * e[last - 1];
+  }
+
+  colorScale.resize(n);
+  float colorVariance = settings.colorSigma * settings.colorSigma;
+  float errorVariance = settings.errorSigma * settings.errorSigma / 9.0f;
+  for (unsigned y = 0; y < height; ++y) {
+    const float *above = &rowSums[static_cast<std::size_t>(y ? y - 1 : 0) * width];
+    const float *middle = &rowSums[static_cast<std::size_t>(y) * width];
+    const float *below =
+      &rowSums[static_cast<std::size_t>(std::min(y + 1, height - 1)) * width];
+    float *scale = &colorScale[static_cast<std::size_t>(y) * width];
+    for (unsigned x = 0; x < width; ++x)
+      scale[x] = 1.0f / (colorVariance +
+                         errorVariance * (above[x] + middle[x] + below[x]));
+  }
+
+  unsigned numThreads = settings.numThreads;
+  if (!numThreads)
+    numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+  numThreads = std::min(numThreads, std::max(height, 1u));
+
+  // Passes depend on each other's results: threads are joined after each.
+  for (unsigned iteration = 0; iteration < settings.iterations; ++iteration) {
+    if (numThreads == 1) {
+      FilterRows(guides, iteration, 0, height);
+    } else {
+      std::vector<std::thread> threads;
+      for (unsigned t = 0; t < numThreads; ++t) {
+        unsigned begin = static_cast<unsigned>(std::uint64_t(height) * t / numThreads);
+        unsigned end = static_cast<unsigned>(std::uint64_t(height) * (t + 1) / numThreads);
+        threads.push_back(std::thread(&Denoiser::FilterRows, this,
+                                      std::cref(guides), iteration, begin, end));
+      }
+      for (std::thread &thread : threads)
+        thread.join();
+    }
+    for (int c = 0; c < 3; ++c)
+      std::swap(source[c], target[c]);
+  }
+
+  for (std::size_t i = 0; i < n; ++i)
+    output[i] = glm::dvec3(source[0][i], source[1][i], source[2][i]);
+
+  auto end = std::chrono::steady_clock::now();
+  seconds = std::chrono::duration<double>(end - start).count();
+}
+
+
+void Denoiser::FilterRows(const GuideBuffers &guides, unsigned iteration,
+                          unsigned begin, unsigned end)
+{
+  const int width = static_cast<int>(guides.GetWidth());
+  const int height = static_cast<int>(guides.GetHeight());
+  const int step = 1 << iteration;
+
+  // Inverse squared scales of the edge-stopping terms. Color scale halves
+  // every pass.
+  const float invStep = 1.0f / static_cast<float>(step * step);
+  const float colorStep = static_cast<float>(step * step);
+  const float invNormal = 1.0f / (settings.normalSigma * settings.normalSigma);
+  const float invAlbedo = 1.0f / (settings.albedoSigma * settings.albedoSigma);
+
+  float sumR[ChunkSize], sumG[ChunkSize], sumB[ChunkSize], sumW[ChunkSize];
+
+  for (int y = static_cast<int>(begin); y < static_cast<int>(end); ++y) {
+    std::size_t row = static_cast<std::size_t>(y) * width;
+    for (int chunk = 0; chunk < width; chunk += ChunkSize) {
+      int chunkEnd = std::min(chunk + static_cast<int>(ChunkSize), width);
+      std::fill(sumR, sumR + ChunkSize, 0.0f);
+      std::fill(sumG, sumG + ChunkSize, 0.0f);
+      std::fill(sumB, sumB + ChunkSize, 0.0f);
+      std::fill(sumW, sumW + ChunkSize, 0.0f);
+
+      // Center pixel p, neighbour q.
+      const float *pR = &source[0][row + chunk];
+      const float *pG = &source[1][row + chunk];
+      const float *pB = &source[2][row + chunk];
+      const float *pNx = &guides.normalX[row + chunk];
+      const float *pNy = &guides.normalY[row + chunk];
+      const float *pNz = &guides.normalZ[row + chunk];
+      const float *pAr = &guides.albedoR[row + chunk];
+      const float *pAg = &guides.albedoG[row + chunk];
+      const float *pAb = &guides.albedoB[row + chunk];
+      const float *pZ = &guides.depth[row + chunk];
+      const float *pZs = &depthScale[row + chunk];
+      const float *pCs = &colorScale[row + chunk];
+
+      for (int ky = -1; ky <= 1; ++ky) {
+        int qy = y + ky * step;
+        if (qy < 0 || qy >= height)
+          continue;
+        for (int kx = -1; kx <= 1; ++kx) {
+          // Neighbours outside the image are skipped: only the range of
+          // the chunk whose neighbours are inside is visited.
+          int offset = kx * step;
+          int first = std::max(chunk, -offset) - chunk;
+          int last = std::min(chunkEnd, width - offset) - chunk;
+          if (first >= last)
+            continue;
+
+          // Pointers to q of the chunk's first pixel p (which may lie
+          // before the image) would be invalid: everything is offset by
+          // the first visited pixel instead.
+          std::size_t q = static_cast<std::size_t>(qy) * width + chunk +
+                          offset + first;
+          const float *qR = &source[0][q];
+          const float *qG = &source[1][q];
+          const float *qB = &source[2][q];
+          const float *qNx = &guides.normalX[q];
+          const float *qNy = &guides.normalY[q];
+          const float *qNz = &guides.normalZ[q];
+          const float *qAr = &guides.albedoR[q];
+          const float *qAg = &guides.albedoG[q];
+          const float *qAb = &guides.albedoB[q];
+          const float *qZ = &guides.depth[q];
+          const float kernel = KernelWeights[ky + 1] * KernelWeights[kx + 1];
+
+          for (int x = 0; x < last - first; ++x) {
+            int p = first + x;
+            float dR = pR[p] - qR[x], dG = pG[p] - qG[x], dB = pB[p] - qB[x];
+            float dNx = pNx[p] - qNx[x], dNy = pNy[p] - qNy[x],
+                  dNz = pNz[p] - qNz[x];
+            float dAr = pAr[p] - qAr[x], dAg = pAg[p] - qAg[x],
+                  dAb = pAb[p] - qAb[x];
+            float dZ = pZ[p] - qZ[x];
+            float e = (dR * dR + dG * dG + dB * dB) * pCs[p] * colorStep +
+                      (dNx * dNx + dNy * dNy + dNz * dNz) * invNormal +
+                      (dAr * dAr + dAg * dAg + dAb * dAb) * invAlbedo +
+                      dZ * dZ * pZs[p] * invStep;
+            float w = kernel * FastExpNeg(e);
+            sumR[p] += w * qR[x];
+            sumG[p] += w * qG[x];
+            sumB[p] += w * qB[x];
+            sumW[p] += w;
+          }
+        }
+      }
+
+      // The center tap always has a positive weight.
+      for (int x = 0; x < chunkEnd - chunk; ++x) {
+        float inv = 1.0f / sumW[x];
+        target[0][row + chunk + x] = sumR[x] * inv;
+        target[1][row + chunk + x] = sumG[x] * inv;
+        target[2][row + chunk + x] = sumB[x] * inv;
+      }
+    }
+  }
+}
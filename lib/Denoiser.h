@@ -0,0 +1,99 @@
+#pragma once
+
+#include "Framebuffer.h"
+#include <vector>
+
+// Features of the surfaces seen through every pixel, which guide the
+// denoiser: normal (facing the camera), diffuse albedo and distance of the
+// primary hit, averaged over the pixel's samples, all zero where camera
+// rays miss the scene. And the estimated noise: standard error of the
+// pixel's mean luminance, 0 if unknown. Planar: one array per channel,
+// row by row.
+class GuideBuffers {
+public:
+  GuideBuffers() : width(0), height(0) {}
+
+  // Resize to \p w by \p h pixels and set everything to zero.
+  void Reset(unsigned w, unsigned h);
+
+  unsigned GetWidth() const { return width; }
+  unsigned GetHeight() const { return height; }
+  std::size_t GetNumPixels() const { return depth.size(); }
+
+  std::vector<float> normalX, normalY, normalZ;
+  std::vector<float> albedoR, albedoG, albedoB;
+  std::vector<float> depth;
+  std::vector<float> error;
+
+private:
+  unsigned width;
+  unsigned height;
+};
+
+struct DenoiseSettings {
+  DenoiseSettings() :
+    iterations(5), colorSigma(0.1f), errorSigma(8.0f), normalSigma(0.3f),
+    albedoSigma(0.1f), depthSigma(0.02f), numThreads(0) {}
+
+  // Number of filter passes. Pass i blends every pixel with its 8
+  // neighbours 2^i pixels away, so 5 passes cover a 63x63 window.
+  unsigned iterations;
+
+  // Edge-stopping: a neighbour's weight falls off with the differences of
+  // its color, normal and albedo from the pixel's, relative to these
+  // scales, and with the difference of depth relative to depthSigma times
+  // the pixel's depth per pixel of distance.
+  //
+  // Color scale grows with the pixel's noise, so that noisy images are
+  // smoothed more: it's colorSigma and errorSigma times the standard error
+  // (averaged over the pixel's 3x3 neighbourhood) added in quadrature. It's
+  // halved every pass, as the image gets smoother.
+  float colorSigma;
+  float errorSigma;
+  float normalSigma;
+  float albedoSigma;
+  float depthSigma;
+
+  // Threads filtering bands of rows, 0 for one per hardware thread.
+  unsigned numThreads;
+};
+
+// Edge-aware a-trous wavelet filter (Dammertz et al., "Edge-avoiding
+// a-trous wavelet transform for fast global illumination filtering"):
+// smooths noise of low-sample renders within surfaces, keeping edges
+// which show up in the guide buffers.
+class Denoiser {
+public:
+  explicit Denoiser(const DenoiseSettings &s = DenoiseSettings()) :
+    settings(s), seconds(0.0) {}
+
+  // Filter \p input into \p output (may be the same framebuffer), guided
+  // by \p guides of the same size.
+  void Denoise(const Framebuffer &input, const GuideBuffers &guides,
+               Framebuffer &output);
+
+public:
+  const DenoiseSettings &GetSettings() const { return settings; }
+
+  // Wall-clock time of the last Denoise() call.
+  double GetSeconds() const { return seconds; }
+
+private:
+  // Filter rows [begin, end) of the current color planes for pass
+  // \p iteration.
+  void FilterRows(const GuideBuffers &guides, unsigned iteration,
+                  unsigned begin, unsigned end);
+
+  DenoiseSettings settings;
+  double seconds;
+
+  // Planar colors: input and output of the current pass, swapped after
+  // every pass. Kept between calls.
+  std::vector<float> source[3];
+  std::vector<float> target[3];
+
+  // Per pixel: inverse squared color scale of the first pass, and
+  // 1 / (depthSigma * depth)^2 (0 for misses).
+  std::vector<float> colorScale;
+  std::vector<float> depthScale;
+};
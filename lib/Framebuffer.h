@@ -0,0 +1,49 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+// Image of linear RGB colors, stored row by row starting from the top.
+class Framebuffer {
+public:
+  Framebuffer(unsigned w, unsigned h) :
+    width(w), height(h),
+    pixels(static_cast<std::size_t>(w) * h, glm::dvec3(0.0, 0.0, 0.0)) {}
+
+  void Clear(const glm::dvec3 &color = glm::dvec3(0.0, 0.0, 0.0)) {
+    std::fill(pixels.begin(), pixels.end(), color);
+  }
+
+public:
+  unsigned GetWidth() const { return width; }
+  unsigned GetHeight() const { return height; }
+  std::size_t GetNumPixels() const { return pixels.size(); }
+
+  // Access by linear index: y * width + x.
+  glm::dvec3 &operator[](std::size_t idx) {
+    assert(idx < pixels.size() && "Pixel index out of bounds!");
+    return pixels[idx];
+  }
+  const glm::dvec3 &operator[](std::size_t idx) const {
+    assert(idx < pixels.size() && "Pixel index out of bounds!");
+    return pixels[idx];
+  }
+
+  glm::dvec3 &At(unsigned x, unsigned y) {
+    assert(x < width && y < height && "Pixel coordinates out of bounds!");
+    return pixels[static_cast<std::size_t>(y) * width + x];
+  }
+  const glm::dvec3 &At(unsigned x, unsigned y) const {
+    assert(x < width && y < height && "Pixel coordinates out of bounds!");
+    return pixels[static_cast<std::size_t>(y) * width + x];
+  }
+
+  const std::vector<glm::dvec3> &GetPixels() const { return pixels; }
+
+private:
+  unsigned width;
+  unsigned height;
+  std::vector<glm::dvec3> pixels;
+};
@@ -0,0 +1,847 @@
+#include "ImageWriter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+// === Encoding helpers ===
+
+std::uint8_t ToSRGB8(float linear)
+{
+  float c = std::min(std::max(linear, 0.0f), 1.0f);
+  c = c <= 0.0031308f ? 12.92f * c : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+  return static_cast<std::uint8_t>(c * 255.0f + 0.5f);
+}
+
+
+void PutBE32(std::vector<std::uint8_t> &out, std::uint32_t value)
+{
+  for (int shift = 24; shift >= 0; shift -= 8)
+    out.push_back(static_cast<std::uint8_t>(value >> shift));
+}
+
+
+void PutLE32(std::vector<std::uint8_t> &out, std::uint32_t value)
+{
+  for (int shift = 0; shift < 32; shift += 8)
+    out.push_back(static_cast<std::uint8_t>(value >> shift));
+}
+
+
+void PutLE16(std::vector<std::uint8_t> &out, std::uint16_t value)
+{
+  out.push_back(static_cast<std::uint8_t>(value));
+  out.push_back(static_cast<std::uint8_t>(value >> 8));
+}
+
+
+// === PNG ===
+
+const std::uint8_t PNGSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+const unsigned BytesPerPixel = 3;
+
+std::uint32_t Crc32(std::uint32_t crc, const std::uint8_t *data, std::size_t size)
+{
+  static const std::vector<std::uint32_t> table = []() {
+    std::vector<std::uint32_t> t(256);
+    for (std::uint32_t n = 0; n < 256; ++n) {
+      std::uint32_t c = n;
+      for (int k = 0; k < 8; ++k)
+        c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      t[n] = c;
+    }
+    return t;
+  }();
+  crc = ~crc;
+  for (std::size_t i = 0; i < size; ++i)
+    crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+
+std::uint32_t Adler32(std::uint32_t adler, const std::uint8_t *data, std::size_t size)
+{
+  const std::uint32_t Mod = 65521;
+  // Most bytes which can be summed before the sums may overflow.
+  const std::size_t Run = 5552;
+  std::uint32_t a = adler & 0xFFFF, b = adler >> 16;
+  while (size) {
+    std::size_t n = std::min(size, Run);
+    size -= n;
+    for (; n; --n) {
+      a += *data++;
+      b += a;
+    }
+    a %= Mod;
+    b %= Mod;
+  }
+  return (b << 16) | a;
+}
+
+
+// Append chunk \p type with \p size bytes of \p data to \p out.
+void AppendPNGChunk(std::vector<std::uint8_t> &out, const char *type,
+                    const std::uint8_t *data, std::size_t size)
+{
+  PutBE32(out, static_cast<std::uint32_t>(size));
+  std::size_t start = out.size();
+  out.insert(out.end(), type, type + 4);
+  out.insert(out.end(), data, data + size);
+  PutBE32(out, Crc32(0, &out[start], out.size() - start));
+}
+
+
+std::uint8_t Paeth(int a, int b, int c)
+{
+  int p = a + b - c;
+  int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+  if (pa <= pb && pa <= pc)
+    return static_cast<std::uint8_t>(a);
+  return static_cast<std::uint8_t>(pb <= pc ? b : c);
+}
+
+
+// Filter \p row (\p size bytes, \p above is the row before it) into
+// \p out: the filter type byte, then the filtered bytes. Of None, Sub, Up
+// and Paeth, the filter with the smallest sum of absolute (signed) bytes
+// is picked, which usually compresses best. \p scratch has size bytes.
+void FilterRow(const std::uint8_t *row, const std::uint8_t *above,
+               std::size_t size, std::uint8_t *out, std::uint8_t *scratch)
+{
+  const std::uint8_t Types[] = { 0, 1, 2, 4 };
+  unsigned long bestSum = ~0ul;
+  for (std::uint8_t type : Types) {
+    unsigned long sum = 0;
+    for (std::size_t i = 0; i < size; ++i) {
+      int left = i >= BytesPerPixel ? row[i - BytesPerPixel] : 0;
+      int upLeft = i >= BytesPerPixel ? above[i - BytesPerPixel] : 0;
+      int predicted = type == 1 ? left : type == 2 ? above[i] :
+                      type == 4 ? Paeth(left, above[i], upLeft) : 0;
+      scratch[i] = static_cast<std::uint8_t>(row[i] - predicted);
+      sum += static_cast<unsigned long>(std::abs(static_cast<std::int8_t>(scratch[i])));
+    }
+    if (sum < bestSum) {
+      bestSum = sum;
+      out[0] = type;
+      std::memcpy(out + 1, scratch, size);
+    }
+  }
+}
+
+
+// === Deflate ===
+
+// Bits written least significant first, as deflate wants them.
+class BitWriter {
+public:
+  explicit BitWriter(std::vector<std::uint8_t> &o) : out(o), bits(0), count(0) {}
+
+  void Put(std::uint32_t value, unsigned n) {
+    bits |= static_cast<std::uint64_t>(value) << count;
+    count += n;
+    while (count >= 8) {
+      out.push_back(static_cast<std::uint8_t>(bits));
+      bits >>= 8;
+      count -= 8;
+    }
+  }
+
+  // Huffman codes are stored most significant bit first.
+  void PutCode(std::uint32_t code, unsigned n) {
+    std::uint32_t reversed = 0;
+    for (unsigned i = 0; i < n; ++i)
+      reversed |= ((code >> i) & 1) << (n - 1 - i);
+    Put(reversed, n);
+  }
+
+  // Pad to a byte boundary.
+  void Align() {
+    if (count)
+      Put(0, 8 - count);
+  }
+
+private:
+  std::vector<std::uint8_t> &out;
+  std::uint64_t bits;
+  unsigned count;
+};
+
+const unsigned MinMatch = 3;
+const unsigned MaxMatch = 258;
+const unsigned WindowSize = 32768;
+const unsigned HashBits = 15;
+// Candidates of a match tried, most recent first.
+const unsigned MaxChain = 16;
+
+// Match lengths and distances: base of every code, and its extra bits.
+const unsigned LengthBase[29] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+const unsigned LengthExtra[29] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+const unsigned DistanceBase[30] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+  257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+const unsigned DistanceExtra[30] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+  7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+// Literal/length symbol in the fixed Huffman code.
+void PutSymbol(BitWriter &bits, unsigned symbol)
+{
+  if (symbol < 144)
+    bits.PutCode(0x30 + symbol, 8);
+  else if (symbol < 256)
+    bits.PutCode(0x190 + symbol - 144, 9);
+  else if (symbol < 280)
+    bits.PutCode(symbol - 256, 7);
+  else
+    bits.PutCode(0xC0 + symbol - 280, 8);
+}
+
+
+void PutMatch(BitWriter &bits, unsigned length, unsigned distance)
+{
+  unsigned code = static_cast<unsigned>(
+    std::upper_bound(LengthBase, LengthBase + 29, length) - LengthBase - 1);
+  PutSymbol(bits, 257 + code);
+  bits.Put(length - LengthBase[code], LengthExtra[code]);
+  code = static_cast<unsigned>(
+    std::upper_bound(DistanceBase, DistanceBase + 30, distance) - DistanceBase - 1);
+  bits.PutCode(code, 5);
+  bits.Put(distance - DistanceBase[code], DistanceExtra[code]);
+}
+
+
+// Compress \p size bytes of \p data as one deflate block of fixed Huffman
+// codes (greedy LZ77 matching over hash chains) appended to \p out. The
+// block is followed by an empty stored block so it ends on a byte boundary
+// and blocks compressed independently can be concatenated, unless it's
+// the \p last one of the stream.
+void Deflate(const std::uint8_t *data, std::size_t size, bool last,
+             std::vector<std::uint8_t> &out)
+{
+  BitWriter bits(out);
+  bits.Put(last ? 1 : 0, 1);
+  bits.Put(1, 2);
+
+  // Most recent position of every hash of 3 bytes, and the previous
+  // position with the same hash of every position.
+  std::vector<std::int32_t> head(std::size_t(1) << HashBits, -1);
+  std::vector<std::int32_t> prev(size);
+  auto hash = [&](std::size_t i) {
+    return ((data[i] << 10) ^ (data[i + 1] << 5) ^ data[i + 2]) &
+           ((1u << HashBits) - 1);
+  };
+  auto insert = [&](std::size_t i) {
+    if (i + MinMatch <= size) {
+      unsigned h = hash(i);
+      prev[i] = head[h];
+      head[h] = static_cast<std::int32_t>(i);
+    }
+  };
+
+  std::size_t i = 0;
+  while (i < size) {
+    unsigned bestLength = 0, bestDistance = 0;
+    if (i + MinMatch <= size) {
+      unsigned maxLength = static_cast<unsigned>(std::min<std::size_t>(MaxMatch, size - i));
+      std::int32_t candidate = head[hash(i)];
+      for (unsigned chain = 0; candidate >= 0 && i - candidate <= WindowSize &&
+                               chain < MaxChain; ++chain) {
+        const std::uint8_t *a = data + candidate, *b = data + i;
+        unsigned length = 0;
+        while (length < maxLength && a[length] == b[length])
+          ++length;
+        if (length > bestLength) {
+          bestLength = length;
+          bestDistance = static_cast<unsigned>(i - candidate);
+          if (length == maxLength)
+            break;
+        }
+        candidate = prev[candidate];
+      }
+    }
+
+    if (bestLength >= MinMatch) {
+      PutMatch(bits, bestLength, bestDistance);
+      for (std::size_t end = i + bestLength; i < end; ++i)
+        insert(i);
+    } else {
+      PutSymbol(bits, data[i]);
+      insert(i);
+      ++i;
+    }
+  }
+  PutSymbol(bits, 256);
+
+  if (!last) {
+    bits.Put(0, 3);
+    bits.Align();
+    bits.Put(0x0000, 16);
+    bits.Put(0xFFFF, 16);
+  }
+  bits.Align();
+}
+
+
+// === OpenEXR ===
+
+const std::uint32_t EXRMagic = 20000630;
+// Version 2, single part, tiled.
+const std::uint32_t EXRVersion = 2 | 0x200;
+const std::int32_t EXRHalf = 1;
+const std::int32_t EXRFloat = 2;
+const std::uint8_t EXRRandomY = 2;
+
+void PutEXRAttribute(std::vector<std::uint8_t> &out, const char *name,
+                     const char *type, const std::vector<std::uint8_t> &value)
+{
+  out.insert(out.end(), name, name + std::strlen(name) + 1);
+  out.insert(out.end(), type, type + std::strlen(type) + 1);
+  PutLE32(out, static_cast<std::uint32_t>(value.size()));
+  out.insert(out.end(), value.begin(), value.end());
+}
+
+
+// Bits of \p value as a half float (packHalf2x16 puts its first value in
+// the low bits).
+std::uint16_t ToHalf(float value)
+{
+  return static_cast<std::uint16_t>(glm::packHalf2x16(glm::vec2(value, 0.0f)) & 0xFFFF);
+}
+
+
+std::uint32_t FloatBits(float value)
+{
+  std::uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+} // anonymous namespace
+
+
+bool GetImageFormat(const std::string &path, ImageFormat &format)
+{
+  std::size_t dot = path.rfind('.');
+  if (dot == std::string::npos)
+    return false;
+  std::string extension = path.substr(dot + 1);
+  for (char &c : extension)
+    c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  if (extension == "ppm")
+    format = ImageFormat::PPM;
+  else if (extension == "png")
+    format = ImageFormat::PNG;
+  else if (extension == "exr")
+    format = ImageFormat::EXR;
+  else
+    return false;
+  return true;
+}
+
+
+// === ImageWriter ===
+ImageWriter::ImageWriter(const ImageWriterSettings &s)
+  : settings(s), file(nullptr), format(ImageFormat::PPM), width(0),
+    height(0), aovMask(0), numAovChannels(0), ok(false), queuedBytes(0),
+    closing(false), nextBand(0), bandBytes(0), adler(1), tableOffset(0),
+    fileOffset(0)
+{
+  assert(settings.bandHeight > 0 && settings.chunkRows > 0 &&
+         "Invalid image writer settings!");
+}
+
+
+ImageWriter::~ImageWriter()
+{
+  Close();
+}
+
+
+bool ImageWriter::Open(const std::string &path, ImageFormat f, unsigned w,
+                       unsigned h, TAovMask aovs)
+{
+  assert(!file && "Image writer is already open!");
+  assert(w > 0 && h > 0 && "Empty image!");
+  assert((!aovs || f == ImageFormat::EXR) && "Only EXR files have AOVs!");
+  file = std::fopen(path.c_str(), "wb");
+  if (!file)
+    return false;
+
+  format = f;
+  width = w;
+  height = h;
+  aovMask = aovs;
+  numAovChannels = AovBuffers::GetNumChannels(aovs);
+  ok = true;
+  stats = ImageWriterStats();
+  queuedBytes = 0;
+  closing = false;
+  bands.clear();
+  bands.resize(NumBands());
+  bandWritten.assign(NumBands(), 0);
+  nextBand = 0;
+  bandBytes = 0;
+  previousRow.assign(static_cast<std::size_t>(width) * BytesPerPixel, 0);
+  adler = 1;
+  fileOffset = 0;
+
+  WriteHeader();
+  writer = std::thread(&ImageWriter::Run, this);
+  return true;
+}
+
+
+void ImageWriter::WriteRegion(unsigned x, unsigned y, const Framebuffer &pixels,
+                              const AovBuffers *aovs)
+{
+  assert(file && "Image writer isn't open!");
+  assert(x + pixels.GetWidth() <= width && y + pixels.GetHeight() <= height &&
+         "Region out of the image!");
+  assert((!aovs || (aovs->GetMask() == aovMask &&
+                    aovs->GetWidth() == pixels.GetWidth() &&
+                    aovs->GetHeight() == pixels.GetHeight())) &&
+         "AOVs don't match the image!");
+
+  Region region;
+  region.x = x;
+  region.y = y;
+  region.width = pixels.GetWidth();
+  region.height = pixels.GetHeight();
+  region.rgb.resize(pixels.GetNumPixels() * 3);
+  for (std::size_t i = 0; i < pixels.GetNumPixels(); ++i) {
+    region.rgb[3 * i] = static_cast<float>(pixels[i].r);
+    region.rgb[3 * i + 1] = static_cast<float>(pixels[i].g);
+    region.rgb[3 * i + 2] = static_cast<float>(pixels[i].b);
+  }
+  if (aovs && numAovChannels) {
+    region.aovs.resize(pixels.GetNumPixels() * numAovChannels);
+    for (unsigned c = 0; c < numAovChannels; ++c) {
+      const std::vector<float> &channel = aovs->GetChannel(c);
+      for (std::size_t i = 0; i < pixels.GetNumPixels(); ++i)
+        region.aovs[i * numAovChannels + c] = channel[i];
+    }
+  }
+  std::size_t bytes = RegionBytes(region);
+
+  std::unique_lock<std::mutex> lock(queueMutex);
+  // A region larger than the whole budget waits for an empty queue.
+  queueNotFull.wait(lock, [&]() {
+    return !queuedBytes || queuedBytes + bytes <= settings.maxQueuedBytes;
+  });
+  queuedBytes += bytes;
+  queue.push_back(std::move(region));
+  queueNotEmpty.notify_one();
+}
+
+
+bool ImageWriter::Close()
+{
+  if (!file)
+    return ok;
+
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    closing = true;
+  }
+  queueNotEmpty.notify_one();
+  writer.join();
+
+  // Bands not completed by regions, in order.
+  for (unsigned b = 0; b < NumBands(); ++b) {
+    if (bandWritten[b])
+      continue;
+    if (!bands[b])
+      StartBand(b);
+    WriteBand(b);
+  }
+  WriteTrailer();
+
+  if (std::fclose(file) != 0)
+    ok = false;
+  file = nullptr;
+  bands.clear();
+  return ok;
+}
+
+
+void ImageWriter::Run()
+{
+  for (;;) {
+    Region region;
+    std::size_t queued;
+    {
+      std::unique_lock<std::mutex> lock(queueMutex);
+      queueNotEmpty.wait(lock, [&]() { return closing || !queue.empty(); });
+      if (queue.empty())
+        return;
+      region = std::move(queue.front());
+      queue.pop_front();
+      queued = queuedBytes;
+    }
+
+    Merge(region, queued);
+
+    {
+      std::lock_guard<std::mutex> lock(queueMutex);
+      queuedBytes -= RegionBytes(region);
+    }
+    queueNotFull.notify_all();
+  }
+}
+
+
+void ImageWriter::Merge(const Region &region, std::size_t queued)
+{
+  const unsigned bandHeight = settings.bandHeight;
+  unsigned firstBand = region.y / bandHeight;
+  unsigned endBand = (region.y + region.height + bandHeight - 1) / bandHeight;
+  for (unsigned b = firstBand; b < endBand; ++b) {
+    assert(!bandWritten[b] && "Region overlaps a written band!");
+    if (!bands[b])
+      StartBand(b);
+  }
+  stats.peakBufferedBytes = std::max(stats.peakBufferedBytes, queued + bandBytes);
+
+  for (unsigned row = 0; row < region.height; ++row) {
+    unsigned y = region.y + row;
+    Band &band = *bands[y / bandHeight];
+    std::size_t offset = (static_cast<std::size_t>(y % bandHeight) * width + region.x) * 3;
+    std::copy(&region.rgb[static_cast<std::size_t>(row) * region.width * 3],
+              &region.rgb[static_cast<std::size_t>(row + 1) * region.width * 3],
+              &band.rgb[offset]);
+    if (!region.aovs.empty()) {
+      const std::size_t stride = static_cast<std::size_t>(region.width) * numAovChannels;
+      std::copy(&region.aovs[row * stride], &region.aovs[(row + 1) * stride],
+                &band.aovs[offset / 3 * numAovChannels]);
+    }
+  }
+
+  for (unsigned b = firstBand; b < endBand; ++b) {
+    unsigned begin = std::max(region.y, b * bandHeight);
+    unsigned end = std::min(region.y + region.height, b * bandHeight + BandRows(b));
+    Band &band = *bands[b];
+    band.pixelsCovered += static_cast<std::size_t>(region.width) * (end - begin);
+    assert(band.pixelsCovered <= static_cast<std::size_t>(width) * BandRows(b) &&
+           "Overlapping regions!");
+    if (band.pixelsCovered == static_cast<std::size_t>(width) * BandRows(b))
+      BandDone(b);
+  }
+}
+
+
+void ImageWriter::StartBand(unsigned index)
+{
+  std::size_t numPixels = static_cast<std::size_t>(width) * BandRows(index);
+  bands[index].reset(new Band());
+  bands[index]->rgb.assign(numPixels * 3, 0.0f);
+  bands[index]->aovs.assign(numPixels * numAovChannels, 0.0f);
+  bandBytes += BandBytes(index);
+}
+
+
+void ImageWriter::BandDone(unsigned index)
+{
+  if (format == ImageFormat::EXR) {
+    WriteBand(index);
+    return;
+  }
+  // Scanline formats: bands in order.
+  while (nextBand < NumBands() && bands[nextBand] &&
+         bands[nextBand]->pixelsCovered ==
+           static_cast<std::size_t>(width) * BandRows(nextBand)) {
+    WriteBand(nextBand);
+    ++nextBand;
+  }
+}
+
+
+void ImageWriter::WriteBand(unsigned index)
+{
+  auto start = std::chrono::steady_clock::now();
+  const Band &band = *bands[index];
+  unsigned y = index * settings.bandHeight;
+  switch (format) {
+  case ImageFormat::PPM:
+    WritePPMBand(y, BandRows(index), band);
+    break;
+  case ImageFormat::PNG:
+    WritePNGBand(y, BandRows(index), band);
+    break;
+  case ImageFormat::EXR:
+    WriteEXRBand(y, BandRows(index), band);
+    break;
+  }
+  bands[index].reset();
+  bandBytes -= BandBytes(index);
+  bandWritten[index] = 1;
+  stats.writeSeconds += std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - start).count();
+}
+
+
+// === Formats ===
+void ImageWriter::WriteHeader()
+{
+  std::vector<std::uint8_t> out;
+  switch (format) {
+  case ImageFormat::PPM: {
+    std::string header = "P6\n" + std::to_string(width) + " " +
+                         std::to_string(height) + "\n255\n";
+    out.assign(header.begin(), header.end());
+    break;
+  }
+  case ImageFormat::PNG: {
+    out.assign(PNGSignature, PNGSignature + 8);
+    std::vector<std::uint8_t> ihdr;
+    PutBE32(ihdr, width);
+    PutBE32(ihdr, height);
+    // 8 bits per channel, RGB, deflate, adaptive filters, not interlaced.
+    const std::uint8_t fields[] = { 8, 2, 0, 0, 0 };
+    ihdr.insert(ihdr.end(), fields, fields + 5);
+    AppendPNGChunk(out, "IHDR", ihdr.data(), ihdr.size());
+    // zlib header: deflate with a 32K window, no dictionary.
+    const std::uint8_t zlib[] = { 0x78, 0x01 };
+    AppendPNGChunk(out, "IDAT", zlib, 2);
+    break;
+  }
+  case ImageFormat::EXR: {
+    const unsigned tileSize = settings.bandHeight;
+    PutLE32(out, EXRMagic);
+    PutLE32(out, EXRVersion);
+
+    // Channels in alphabetical order.
+    exrChannels.clear();
+    const char *const colorNames[3] = { "R", "G", "B" };
+    for (unsigned c = 0; c < 3; ++c)
+      exrChannels.push_back(EXRChannel{ colorNames[c], true, c });
+    for (unsigned c = 0; c < numAovChannels; ++c) {
+      exrChannels.push_back(
+        EXRChannel{ AovBuffers::GetChannelName(aovMask, c), false, c });
+    }
+    std::sort(exrChannels.begin(), exrChannels.end(),
+              [](const EXRChannel &a, const EXRChannel &b) {
+      return std::strcmp(a.name, b.name) < 0;
+    });
+    std::vector<std::uint8_t> value;
+    for (const EXRChannel &channel : exrChannels) {
+      value.insert(value.end(), channel.name,
+                   channel.name + std::strlen(channel.name) + 1);
+      PutLE32(value, channel.isColor ? EXRHalf : EXRFloat);
+      // pLinear and reserved bytes, then x and y sampling.
+      PutLE32(value, 0);
+      PutLE32(value, 1);
+      PutLE32(value, 1);
+    }
+    value.push_back(0);
+    PutEXRAttribute(out, "channels", "chlist", value);
+    PutEXRAttribute(out, "compression", "compression", std::vector<std::uint8_t>(1, 0));
+    value.clear();
+    PutLE32(value, 0);
+    PutLE32(value, 0);
+    PutLE32(value, width - 1);
+    PutLE32(value, height - 1);
+    PutEXRAttribute(out, "dataWindow", "box2i", value);
+    PutEXRAttribute(out, "displayWindow", "box2i", value);
+    // Tiles are written as their bands are done.
+    PutEXRAttribute(out, "lineOrder", "lineOrder", std::vector<std::uint8_t>(1, EXRRandomY));
+    value.clear();
+    PutLE32(value, FloatBits(1.0f));
+    PutEXRAttribute(out, "pixelAspectRatio", "float", value);
+    PutEXRAttribute(out, "screenWindowWidth", "float", value);
+    value.clear();
+    PutLE32(value, FloatBits(0.0f));
+    PutLE32(value, FloatBits(0.0f));
+    PutEXRAttribute(out, "screenWindowCenter", "v2f", value);
+    // One level, rounded down.
+    value.clear();
+    PutLE32(value, tileSize);
+    PutLE32(value, tileSize);
+    value.push_back(0);
+    PutEXRAttribute(out, "tiles", "tiledesc", value);
+    out.push_back(0);
+
+    // Offset table, filled by WriteTrailer().
+    unsigned tilesX = (width + tileSize - 1) / tileSize;
+    tileOffsets.assign(static_cast<std::size_t>(tilesX) * NumBands(), 0);
+    tableOffset = static_cast<long>(out.size());
+    out.resize(out.size() + tileOffsets.size() * sizeof(std::uint64_t), 0);
+    break;
+  }
+  }
+  Write(out.data(), out.size());
+}
+
+
+void ImageWriter::WritePPMBand(unsigned, unsigned rows, const Band &band)
+{
+  std::vector<std::uint8_t> out(static_cast<std::size_t>(width) * rows * 3);
+  for (std::size_t i = 0; i < out.size(); ++i)
+    out[i] = ToSRGB8(band.rgb[i]);
+  Write(out.data(), out.size());
+}
+
+
+void ImageWriter::WritePNGBand(unsigned y, unsigned rows, const Band &band)
+{
+  // Rows of sRGB bytes, filtered: a filter byte and the row's bytes each.
+  const std::size_t rowBytes = static_cast<std::size_t>(width) * BytesPerPixel;
+  std::vector<std::uint8_t> filtered(rows * (rowBytes + 1));
+  std::vector<std::uint8_t> row(rowBytes), scratch(rowBytes);
+  for (unsigned r = 0; r < rows; ++r) {
+    for (std::size_t i = 0; i < rowBytes; ++i)
+      row[i] = ToSRGB8(band.rgb[r * rowBytes + i]);
+    FilterRow(row.data(), previousRow.data(), rowBytes,
+              &filtered[r * (rowBytes + 1)], scratch.data());
+    std::swap(row, previousRow);
+  }
+  adler = Adler32(adler, filtered.data(), filtered.size());
+
+  // Chunks of rows compressed in parallel, written in order.
+  unsigned numChunks = (rows + settings.chunkRows - 1) / settings.chunkRows;
+  bool lastBand = y + rows == height;
+  std::vector<std::vector<std::uint8_t>> compressed(numChunks);
+  std::atomic<unsigned> nextChunk(0);
+  auto compress = [&]() {
+    for (unsigned c = nextChunk++; c < numChunks; c = nextChunk++) {
+      std::size_t begin = static_cast<std::size_t>(c) * settings.chunkRows * (rowBytes + 1);
+      std::size_t end = std::min(begin + settings.chunkRows * (rowBytes + 1), filtered.size());
+      Deflate(&filtered[begin], end - begin, lastBand && c + 1 == numChunks,
+              compressed[c]);
+    }
+  };
+
+  unsigned numThreads = settings.numThreads;
+  if (!numThreads)
+    numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+  numThreads = std::min(numThreads, numChunks);
+  std::vector<std::thread> threads;
+  for (unsigned t = 1; t < numThreads; ++t)
+    threads.push_back(std::thread(compress));
+  compress();
+  for (std::thread &thread : threads)
+    thread.join();
+
+  std::vector<std::uint8_t> out;
+  for (const std::vector<std::uint8_t> &chunk : compressed) {
+    out.clear();
+    AppendPNGChunk(out, "IDAT", chunk.data(), chunk.size());
+    Write(out.data(), out.size());
+  }
+}
+
+
+void ImageWriter::WriteEXRBand(unsigned y, unsigned rows, const Band &band)
+{
+  const unsigned tileSize = settings.bandHeight;
+  const unsigned tilesX = (width + tileSize - 1) / tileSize;
+  const unsigned pixelBytes = 3 * 2 + numAovChannels * 4;
+  std::vector<std::uint8_t> out;
+  for (unsigned tx = 0; tx < tilesX; ++tx) {
+    unsigned x = tx * tileSize;
+    unsigned tileWidth = std::min(tileSize, width - x);
+    tileOffsets[static_cast<std::size_t>(y / tileSize) * tilesX + tx] = fileOffset;
+
+    out.clear();
+    PutLE32(out, tx);
+    PutLE32(out, y / tileSize);
+    PutLE32(out, 0);
+    PutLE32(out, 0);
+    PutLE32(out, tileWidth * rows * pixelBytes);
+    // Every line of the tile: its values of each channel in turn.
+    for (unsigned r = 0; r < rows; ++r) {
+      std::size_t first = static_cast<std::size_t>(r) * width + x;
+      for (const EXRChannel &channel : exrChannels) {
+        if (channel.isColor) {
+          const float *line = &band.rgb[first * 3];
+          for (unsigned i = 0; i < tileWidth; ++i)
+            PutLE16(out, ToHalf(line[3 * i + channel.index]));
+        } else {
+          const float *line = &band.aovs[first * numAovChannels];
+          for (unsigned i = 0; i < tileWidth; ++i)
+            PutLE32(out, FloatBits(line[numAovChannels * i + channel.index]));
+        }
+      }
+    }
+    Write(out.data(), out.size());
+  }
+}
+
+
+void ImageWriter::WriteTrailer()
+{
+  std::vector<std::uint8_t> out;
+  switch (format) {
+  case ImageFormat::PPM:
+    break;
+  case ImageFormat::PNG: {
+    std::vector<std::uint8_t> checksum;
+    PutBE32(checksum, adler);
+    AppendPNGChunk(out, "IDAT", checksum.data(), checksum.size());
+    AppendPNGChunk(out, "IEND", nullptr, 0);
+    Write(out.data(), out.size());
+    break;
+  }
+  case ImageFormat::EXR:
+    for (std::uint64_t offset : tileOffsets) {
+      PutLE32(out, static_cast<std::uint32_t>(offset));
+      PutLE32(out, static_cast<std::uint32_t>(offset >> 32));
+    }
+    // Over the placeholder written by WriteHeader().
+    if (ok && (std::fseek(file, tableOffset, SEEK_SET) != 0 ||
+               std::fwrite(out.data(), out.size(), 1, file) != 1))
+      ok = false;
+    break;
+  }
+}
+
+
+void ImageWriter::Write(const void *data, std::size_t size)
+{
+  if (!ok || !size)
+    return;
+  if (std::fwrite(data, size, 1, file) != 1) {
+    ok = false;
+    return;
+  }
+  stats.bytesWritten += size;
+  fileOffset += size;
+}
+
+
+bool WriteImage(const std::string &path, const Framebuffer &fb,
+                const ImageWriterSettings &settings)
+{
+  ImageFormat format;
+  if (!GetImageFormat(path, format))
+    return false;
+  ImageWriter writer(settings);
+  if (!writer.Open(path, format, fb.GetWidth(), fb.GetHeight()))
+    return false;
+  writer.WriteRegion(0, 0, fb);
+  return writer.Close();
+}
+
+
+bool WriteImage(const std::string &path, const Framebuffer &fb,
+                const AovBuffers &aovs, const ImageWriterSettings &settings)
+{
+  ImageFormat format;
+  if (!GetImageFormat(path, format) || format != ImageFormat::EXR)
+    return false;
+  ImageWriter writer(settings);
+  if (!writer.Open(path, format, fb.GetWidth(), fb.GetHeight(), aovs.GetMask()))
+    return false;
+  writer.WriteRegion(0, 0, fb, &aovs);
+  return writer.Close();
+}
@@ -0,0 +1,214 @@
+#pragma once
+
+#include "AovBuffers.h"
+#include "Framebuffer.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class ImageFormat {
+  // Binary PPM (P6): 8-bit sRGB.
+  PPM,
+  // 8-bit sRGB RGB, rows filtered and deflated (fixed Huffman codes) in
+  // chunks compressed in parallel.
+  PNG,
+  // Tiled OpenEXR, uncompressed: linear half-float R, G, B, and AOVs as
+  // float channels.
+  EXR,
+};
+
+// Format of image file \p path, by its extension (.ppm, .png or .exr).
+// Returns false if it's none of them.
+bool GetImageFormat(const std::string &path, ImageFormat &format);
+
+struct ImageWriterSettings {
+  ImageWriterSettings() :
+    bandHeight(64), maxQueuedBytes(std::size_t(64) << 20), chunkRows(16),
+    numThreads(0) {}
+
+  // The image is assembled and written in bands of this many rows (and
+  // EXR tiles of this size).
+  unsigned bandHeight;
+
+  // Upper bound of memory (bytes) of regions passed to WriteRegion() and
+  // not yet merged into their bands: WriteRegion() waits for the writer
+  // when it's reached.
+  std::size_t maxQueuedBytes;
+
+  // PNG bands are compressed in chunks of this many rows, in parallel.
+  unsigned chunkRows;
+
+  // Threads compressing PNG chunks, 0 for one per hardware thread.
+  unsigned numThreads;
+};
+
+struct ImageWriterStats {
+  ImageWriterStats() :
+    bytesWritten(0), peakBufferedBytes(0), writeSeconds(0.0) {}
+
+  std::uint64_t bytesWritten;
+
+  // Largest memory held at once by queued regions and incomplete bands.
+  std::size_t peakBufferedBytes;
+
+  // Time the writer thread spent encoding and writing.
+  double writeSeconds;
+};
+
+// Writes an image to a file region by region, while it's being rendered.
+//
+// Regions passed to WriteRegion() are queued and merged by a writer thread
+// into bands of rows. A band is encoded and written as soon as all of its
+// pixels are there (PPM and PNG bands in order, EXR tiles in any order),
+// and its memory released. So the whole image is never in memory, as long
+// as regions come roughly row by row, and encoding overlaps rendering.
+class ImageWriter {
+public:
+  explicit ImageWriter(const ImageWriterSettings &s = ImageWriterSettings());
+  // Close()s the file.
+  ~ImageWriter();
+  ImageWriter(const ImageWriter &other) = delete;
+  ImageWriter& operator= (const ImageWriter &other) = delete;
+
+  // Create file \p path for an image of \p width x \p height pixels in
+  // \p format and start the writer thread. The image has channels for
+  // \p aovs besides its colors (EXR only). Returns false if the file
+  // can't be created.
+  bool Open(const std::string &path, ImageFormat format, unsigned width,
+            unsigned height, TAovMask aovs = 0);
+
+  // Queue \p pixels (linear colors) as the region of the image from
+  // (\p x, \p y), with \p aovs of the same size if not null (they must
+  // have the AOVs passed to Open()). Regions must be within the image and
+  // must not overlap.
+  void WriteRegion(unsigned x, unsigned y, const Framebuffer &pixels,
+                   const AovBuffers *aovs = nullptr);
+
+  // Write the remaining bands (pixels no region covered are black) and
+  // close the file. Returns false if anything failed to be written.
+  bool Close();
+
+public:
+  const ImageWriterSettings &GetSettings() const { return settings; }
+  // Complete after Close().
+  const ImageWriterStats &GetStats() const { return stats; }
+
+private:
+  // Colors of a region, RGB interleaved, row by row, and its AOV channels
+  // interleaved the same way (empty if it has none).
+  struct Region {
+    unsigned x, y, width, height;
+    std::vector<float> rgb;
+    std::vector<float> aovs;
+  };
+
+  // Rows of the image being assembled.
+  struct Band {
+    Band() : pixelsCovered(0) {}
+    std::vector<float> rgb;
+    std::vector<float> aovs;
+    std::size_t pixelsCovered;
+  };
+
+  // EXR channel: a color component (half) or an AOV channel (float).
+  struct EXRChannel {
+    const char *name;
+    bool isColor;
+    unsigned index;
+  };
+
+  // Body of the writer thread: merge queued regions until Close().
+  void Run();
+  // Copy \p region into its bands, writing those it completes. \p queued
+  // is the size of the queue, region included.
+  void Merge(const Region &region, std::size_t queued);
+  // Allocate band \p index, all black.
+  void StartBand(unsigned index);
+  // Encode band \p index, or queue it until the bands before it are
+  // written if the format needs them in order.
+  void BandDone(unsigned index);
+  // Encode and write band \p index and release it.
+  void WriteBand(unsigned index);
+
+  // === Formats ===
+  void WriteHeader();
+  void WritePPMBand(unsigned y, unsigned rows, const Band &band);
+  void WritePNGBand(unsigned y, unsigned rows, const Band &band);
+  void WriteEXRBand(unsigned y, unsigned rows, const Band &band);
+  void WriteTrailer();
+
+  void Write(const void *data, std::size_t size);
+
+  unsigned NumBands() const {
+    return (height + settings.bandHeight - 1) / settings.bandHeight;
+  }
+  unsigned BandRows(unsigned index) const {
+    return std::min(settings.bandHeight, height - index * settings.bandHeight);
+  }
+  std::size_t BandBytes(unsigned index) const {
+    return static_cast<std::size_t>(width) * BandRows(index) *
+           (3 + numAovChannels) * sizeof(float);
+  }
+  static std::size_t RegionBytes(const Region &region) {
+    return (region.rgb.size() + region.aovs.size()) * sizeof(float);
+  }
+
+  ImageWriterSettings settings;
+  ImageWriterStats stats;
+
+  std::FILE *file;
+  ImageFormat format;
+  unsigned width, height;
+  TAovMask aovMask;
+  unsigned numAovChannels;
+  bool ok;
+
+  // Queue of regions shared with the writer thread, and its size in
+  // bytes. The writer thread stops when it's empty and closing is set.
+  std::mutex queueMutex;
+  std::condition_variable queueNotEmpty;
+  std::condition_variable queueNotFull;
+  std::deque<Region> queue;
+  std::size_t queuedBytes;
+  bool closing;
+  std::thread writer;
+
+  // Everything below belongs to the writer thread.
+
+  // Bands being assembled (null if not started or written), which ones
+  // were written, the first band not yet written in order (scanline
+  // formats), and the memory they hold.
+  std::vector<std::unique_ptr<Band>> bands;
+  std::vector<std::uint8_t> bandWritten;
+  unsigned nextBand;
+  std::size_t bandBytes;
+
+  // PNG: last row of the previous band (for filters), and Adler-32 of the
+  // uncompressed stream so far.
+  std::vector<std::uint8_t> previousRow;
+  std::uint32_t adler;
+
+  // EXR: channels in the file's (alphabetical) order, file offsets of all
+  // tiles, row by row, and where their table is.
+  std::vector<EXRChannel> exrChannels;
+  std::vector<std::uint64_t> tileOffsets;
+  long tableOffset;
+  std::uint64_t fileOffset;
+};
+
+// Write \p fb to \p path in the format of its extension. Returns false if
+// the format isn't known or the file can't be written.
+bool WriteImage(const std::string &path, const Framebuffer &fb,
+                const ImageWriterSettings &settings = ImageWriterSettings());
+
+// Write \p fb and its \p aovs to EXR file \p path.
+bool WriteImage(const std::string &path, const Framebuffer &fb,
+                const AovBuffers &aovs,
+                const ImageWriterSettings &settings = ImageWriterSettings());
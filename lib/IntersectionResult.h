@@ -2,6 +2,14 @@
 
 #include "Ray.h"
 #include "Material.h"
+#include <cstdint>
+#include <limits>
+
+// Index of an object in its scene.
+using TObjectId = std::uint32_t;
+
+// Id which doesn't refer to any object.
+const TObjectId InvalidObjectId = std::numeric_limits<TObjectId>::max();
 
 // Struct to store the results of intersection test.
 class IntersectionResult {
@@ -13,14 +21,17 @@ public:
     ray(glm::dvec3(0.0, 0.0, 0.0), glm::dvec3(0.0, 0.0, 0.0)),
     // Fake normal vector, it must not be used in this case.
     normal(glm::dvec3(0.0, 0.0, 0.0)),
-    // Empty material.
-    material(nullptr) {}
+    // No material.
+    material(InvalidMaterialId), curvature(0.0),
+    texCoord(0.0, 0.0), texCoordScale(0.0), object(InvalidObjectId) {}
 
   // Constructs an object when intersection occurred.
+  // \p c is the curvature of the surface along \p n (0 for flat ones).
   IntersectionResult(const Ray &r, double d, const glm::dvec3 &n,
-                     const Material *mat) :
+                     TMaterialId mat, double c = 0.0) :
     hasIntersection(true), distance(d), ray(r), normal(n),
-    material(mat) {}
+    material(mat), curvature(c), texCoord(0.0, 0.0), texCoordScale(0.0),
+    object(InvalidObjectId) {}
 
   operator bool() const { return hasIntersection; }
 
@@ -51,7 +62,37 @@ public:
     return normal;
   }
 
-  const Material *GetMaterialPtr() const { return material; }
+  // Normal flipped to face the incoming ray.
+  glm::dvec3 GetFacingNormal() const {
+    return glm::dot(normal, ray.GetDirection()) > 0.0 ? -normal : normal;
+  }
+
+  TMaterialId GetMaterialId() const { return material; }
+
+  // Width of the ray's footprint at the hit, across the ray. Spread over
+  // the surface, it is 1 / |cos| times longer along the ray's direction.
+  double GetFootprint() const { return ray.GetWidthAt(distance); }
+
+  double GetCurvature() const { return curvature; }
+
+  // Curvature along GetFacingNormal(): convex surfaces seen from inside are
+  // concave.
+  double GetFacingCurvature() const {
+    return glm::dot(normal, ray.GetDirection()) > 0.0 ? -curvature : curvature;
+  }
+
+  // Texture coordinates at the hit, and their change per unit of distance
+  // along the surface (0 for surfaces without coordinates).
+  void SetTexCoord(const glm::dvec2 &uv, double scale) {
+    texCoord = uv;
+    texCoordScale = scale;
+  }
+  glm::dvec2 GetTexCoord() const { return texCoord; }
+  double GetTexCoordScale() const { return texCoordScale; }
+
+  // Index of the intersected object in its scene, set by Scene::Intersect().
+  void SetObjectId(TObjectId id) { object = id; }
+  TObjectId GetObjectId() const { return object; }
 
 private:
   // Indicates whether an intersection occured.
@@ -67,6 +108,15 @@ private:
   // Normal vector to the surface at the point of intersection.
   glm::dvec3 normal;
 
-  // TODO: Meterial of intersection surface.
-  const Material *material;
+  // Id of the intersected surface's material.
+  TMaterialId material;
+
+  // 1 / radius of the surface at the hit, positive where it bulges
+  // towards the normal.
+  double curvature;
+
+  glm::dvec2 texCoord;
+  double texCoordScale;
+
+  TObjectId object;
 };
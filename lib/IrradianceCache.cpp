@@ -0,0 +1,260 @@
+#include "IrradianceCache.h"
+#include "glm/gtc/constants.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace {
+
+// Octree depth limit: nodes are 1/65536 of the root's size.
+const unsigned MaxOctreeDepth = 16;
+
+// Records lying this far (relative to their radius) in front of a point
+// are not used for it: they see surfaces the point doesn't (Ward's test).
+// Nonzero because records on a curved surface lie a little in front of
+// each other.
+const double InFrontTolerance = 1.0e-3;
+
+} // anonymous namespace
+
+
+// === IrradianceGather ===
+IrradianceGather::IrradianceGather(const glm::dvec3 &p, const glm::dvec3 &n,
+                                   const glm::dvec3 &t, const glm::dvec3 &b,
+                                   unsigned numRays) :
+  position(p), normal(n), tangent(t), bitangent(b)
+{
+  // About pi times more phi strata than theta strata (Ward and Heckbert):
+  // cells are then about square.
+  double m = std::round(std::sqrt(numRays / glm::pi<double>()));
+  thetaStrata = static_cast<unsigned>(std::max(m, 1.0));
+  phiStrata = std::max(numRays / thetaStrata, 1u);
+  radiance.assign(GetNumCells(), glm::dvec3(0.0));
+  distance.assign(GetNumCells(), 0.0);
+}
+
+
+glm::dvec3 IrradianceGather::GetDirection(unsigned j, unsigned k, double u1,
+                                          double u2) const
+{
+  // sin^2(theta) uniform: density cos(theta) / pi over the hemisphere.
+  double sin2 = (j + u1) / thetaStrata;
+  double sinTheta = std::sqrt(sin2);
+  double cosTheta = std::sqrt(std::max(1.0 - sin2, 0.0));
+  double phi = glm::two_pi<double>() * (k + u2) / phiStrata;
+  return sinTheta * std::cos(phi) * tangent +
+         sinTheta * std::sin(phi) * bitangent + cosTheta * normal;
+}
+
+
+IrradianceRecord ComputeIrradianceRecord(const IrradianceGather &gather,
+                                         double minRadius, double maxRadius)
+{
+  const unsigned m = gather.thetaStrata;
+  const unsigned n = gather.phiStrata;
+  const double twoPi = glm::two_pi<double>();
+  auto cell = [n](unsigned j, unsigned k) { return j * n + k; };
+
+  IrradianceRecord record;
+  record.position = gather.position;
+  record.normal = gather.normal;
+  record.irradiance = glm::dvec3(0.0);
+  record.rotationGradient = glm::dmat3(0.0);
+  record.translationGradient = glm::dmat3(0.0);
+
+  double inverseDistanceSum = 0.0;
+  for (unsigned i = 0; i < gather.GetNumCells(); ++i) {
+    record.irradiance += gather.radiance[i];
+    inverseDistanceSum += 1.0 / gather.distance[i];
+  }
+  double cellWeight = glm::pi<double>() / gather.GetNumCells();
+  record.irradiance *= cellWeight;
+
+  for (unsigned k = 0; k < n; ++k) {
+    // u: towards the middle of the phi stratum, v: axis of rotation
+    // turning the normal towards u. vMinus: direction of increasing phi at
+    // the stratum's first edge.
+    double phi = twoPi * (k + 0.5) / n;
+    double phiMinus = twoPi * k / n;
+    glm::dvec3 u = std::cos(phi) * gather.tangent + std::sin(phi) * gather.bitangent;
+    glm::dvec3 v = glm::cross(gather.normal, u);
+    glm::dvec3 vMinus = -std::sin(phiMinus) * gather.tangent +
+                        std::cos(phiMinus) * gather.bitangent;
+    unsigned prevK = (k + n - 1) % n;
+
+    glm::dvec3 rotation(0.0);
+    glm::dvec3 acrossTheta(0.0);
+    glm::dvec3 acrossPhi(0.0);
+    for (unsigned j = 0; j < m; ++j) {
+      double sin2 = (j + 0.5) / m;
+      double sinTheta = std::sqrt(sin2);
+      double tanTheta = sinTheta / std::sqrt(1.0 - sin2);
+      const glm::dvec3 &radiance = gather.radiance[cell(j, k)];
+      // Turning the normal towards u by d scales the cosine of this
+      // cell by about 1 + d * tan(theta).
+      rotation += tanTheta * radiance;
+
+      // Change across the boundary with the previous theta stratum, where
+      // sin^2(theta-) = j / m.
+      if (j > 0) {
+        double sin2Minus = static_cast<double>(j) / m;
+        double invDist = 1.0 / std::min(gather.distance[cell(j, k)],
+                                        gather.distance[cell(j - 1, k)]);
+        acrossTheta += std::sqrt(sin2Minus) * (1.0 - sin2Minus) * invDist *
+                       (radiance - gather.radiance[cell(j - 1, k)]);
+      }
+
+      // Change across the boundary with the previous phi stratum: moving
+      // by dx shifts phi of a point at distance r by dx / (r sin(theta)),
+      // which sweeps cos(theta) sin(theta) dtheta dphi of projected solid
+      // angle per unit of theta.
+      double sinMinus = std::sqrt(static_cast<double>(j) / m);
+      double sinPlus = std::sqrt(static_cast<double>(j + 1) / m);
+      double invDist = 1.0 / std::min(gather.distance[cell(j, k)],
+                                      gather.distance[cell(j, prevK)]);
+      acrossPhi += (sinPlus - sinMinus) * invDist *
+                   (radiance - gather.radiance[cell(j, prevK)]);
+    }
+
+    for (int c = 0; c < 3; ++c) {
+      record.rotationGradient[c] += v * (rotation[c] * cellWeight);
+      record.translationGradient[c] += u * (acrossTheta[c] * twoPi / n) +
+                                       vMinus * acrossPhi[c];
+    }
+  }
+
+  // Harmonic mean distance, then the gradient limit.
+  double radius = inverseDistanceSum > 0.0
+                    ? gather.GetNumCells() / inverseDistanceSum : maxRadius;
+  glm::dvec3 gradient = record.translationGradient[0] +
+                        record.translationGradient[1] +
+                        record.translationGradient[2];
+  double change = glm::length(gradient);
+  double total = record.irradiance.r + record.irradiance.g + record.irradiance.b;
+  if (change * radius > total)
+    radius = total / change;
+  record.radius = std::min(std::max(radius, minRadius), maxRadius);
+  return record;
+}
+
+
+// === IrradianceCache ===
+void IrradianceCache::Reset(const glm::dvec3 &boundsMin,
+                            const glm::dvec3 &boundsMax)
+{
+  rootMin = boundsMin;
+  rootMax = boundsMax;
+  nodes.assign(1, Node());
+  records.clear();
+}
+
+
+void IrradianceCache::Add(const IrradianceRecord &record)
+{
+  assert(records.size() < 0xFFFFFFFFu && "Too many irradiance records!");
+  std::uint32_t index = static_cast<std::uint32_t>(records.size());
+  records.push_back(record);
+
+  glm::dvec3 extent(accuracy * record.radius);
+  glm::dvec3 lo = record.position - extent;
+  glm::dvec3 hi = record.position + extent;
+  if (glm::any(glm::greaterThan(lo, rootMax)) ||
+      glm::any(glm::lessThan(hi, rootMin)))
+    nodes[0].records.push_back(index);
+  else
+    Insert(0, rootMin, rootMax, index, lo, hi, 0);
+}
+
+
+void IrradianceCache::Insert(std::uint32_t node, const glm::dvec3 &lo,
+                             const glm::dvec3 &hi, std::uint32_t record,
+                             const glm::dvec3 &recordLo,
+                             const glm::dvec3 &recordHi, unsigned depth)
+{
+  glm::dvec3 nodeSize = hi - lo;
+  glm::dvec3 recordSize = recordHi - recordLo;
+  if (depth == MaxOctreeDepth ||
+      glm::dot(nodeSize, nodeSize) < glm::dot(recordSize, recordSize)) {
+    nodes[node].records.push_back(record);
+    return;
+  }
+
+  glm::dvec3 mid = 0.5 * (lo + hi);
+  for (unsigned child = 0; child < 8; ++child) {
+    glm::dvec3 childLo, childHi;
+    for (int a = 0; a < 3; ++a) {
+      bool upper = (child >> a) & 1;
+      childLo[a] = upper ? mid[a] : lo[a];
+      childHi[a] = upper ? hi[a] : mid[a];
+    }
+    if (glm::any(glm::greaterThan(recordLo, childHi)) ||
+        glm::any(glm::lessThan(recordHi, childLo)))
+      continue;
+
+    // Indices only: nodes may be reallocated by the push_back.
+    if (!nodes[node].children[child]) {
+      nodes[node].children[child] = static_cast<std::uint32_t>(nodes.size());
+      nodes.push_back(Node());
+    }
+    Insert(nodes[node].children[child], childLo, childHi, record, recordLo,
+           recordHi, depth + 1);
+  }
+}
+
+
+bool IrradianceCache::Lookup(const glm::dvec3 &point, const glm::dvec3 &normal,
+                             glm::dvec3 &irradiance) const
+{
+  glm::dvec3 sum(0.0);
+  double weightSum = 0.0;
+  glm::dvec3 lo = rootMin;
+  glm::dvec3 hi = rootMax;
+  bool inside = !glm::any(glm::lessThan(point, lo)) &&
+                !glm::any(glm::greaterThan(point, hi));
+
+  std::uint32_t node = 0;
+  for (;;) {
+    for (std::uint32_t i : nodes[node].records) {
+      const IrradianceRecord &record = records[i];
+      glm::dvec3 offset = point - record.position;
+      double error = glm::length(offset) / record.radius +
+                     std::sqrt(std::max(1.0 - glm::dot(normal, record.normal), 0.0));
+      if (error >= accuracy)
+        continue;
+      if (0.5 * glm::dot(offset, normal + record.normal) <
+          -InFrontTolerance * record.radius)
+        continue;
+
+      // Falls to zero at the edge of the record's area, so records
+      // fade in and out smoothly.
+      double weight = 1.0 / std::max(error, 1.0e-9) - 1.0 / accuracy;
+      glm::dvec3 value = record.irradiance +
+                         glm::cross(record.normal, normal) * record.rotationGradient +
+                         offset * record.translationGradient;
+      sum += weight * glm::max(value, glm::dvec3(0.0));
+      weightSum += weight;
+    }
+
+    if (!inside)
+      break;
+    glm::dvec3 mid = 0.5 * (lo + hi);
+    unsigned child = 0;
+    for (int a = 0; a < 3; ++a) {
+      if (point[a] >= mid[a]) {
+        child |= 1u << a;
+        lo[a] = mid[a];
+      } else {
+        hi[a] = mid[a];
+      }
+    }
+    node = nodes[node].children[child];
+    if (!node)
+      break;
+  }
+
+  if (weightSum <= 0.0)
+    return false;
+  irradiance = sum / weightSum;
+  return true;
+}
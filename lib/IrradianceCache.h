@@ -0,0 +1,132 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#include <cstdint>
+#include <vector>
+
+struct IrradianceCacheSettings {
+  IrradianceCacheSettings() :
+    accuracy(0.25), gatherRays(256), minPixelRadius(2.0),
+    maxPixelRadius(32.0), prepassStep(16) {}
+
+  // Ward's a: a record is used for points where the error estimate
+  // |p - p_i| / R_i + sqrt(1 - n . n_i) stays below this value. Smaller
+  // values place more records.
+  double accuracy;
+
+  // Hemisphere samples per record (rounded to a grid of strata).
+  unsigned gatherRays;
+
+  // Limits of the radius a record is used within (accuracy times R_i),
+  // in pixels of the image at the record's distance from the camera.
+  // Keeps records from piling up in corners and from being stretched over
+  // large flat areas.
+  double minPixelRadius;
+  double maxPixelRadius;
+
+  // Records are placed coarse to fine, at primary hits of every
+  // prepassStep-th pixel, then every half as many, down to every pixel:
+  // later levels only add records where earlier ones don't reach.
+  unsigned prepassStep;
+};
+
+// Irradiance at a point, with its derivatives and the distance it's valid
+// over.
+struct IrradianceRecord {
+  glm::dvec3 position;
+  glm::dvec3 normal;
+  glm::dvec3 irradiance;
+
+  // Harmonic mean distance to the surfaces seen from the record, clamped.
+  double radius;
+
+  // Changes of irradiance (one column per color channel) with rotation of
+  // the normal (E(n) ~ E + (n_i x n) . rotation) and with position
+  // (E(p) ~ E + (p - p_i) . translation).
+  glm::dmat3 rotationGradient;
+  glm::dmat3 translationGradient;
+};
+
+// Hemisphere samples for a new record: the hemisphere above \p normal is
+// split into thetaStrata x phiStrata cells of equal projected solid angle,
+// each one sampled by one ray.
+struct IrradianceGather {
+  // Basis \p t, \p b, \p n must be orthonormal.
+  IrradianceGather(const glm::dvec3 &p, const glm::dvec3 &n,
+                   const glm::dvec3 &t, const glm::dvec3 &b,
+                   unsigned numRays);
+
+  // Direction of the ray of cell (\p j, \p k) at (\p u1, \p u2) within it.
+  glm::dvec3 GetDirection(unsigned j, unsigned k, double u1, double u2) const;
+
+  unsigned GetNumCells() const { return thetaStrata * phiStrata; }
+
+  glm::dvec3 position;
+  glm::dvec3 normal;
+  glm::dvec3 tangent;
+  glm::dvec3 bitangent;
+  unsigned thetaStrata;
+  unsigned phiStrata;
+
+  // Per cell (j * phiStrata + k), filled by the caller: radiance arriving
+  // along the ray and distance to its hit (infinity for misses).
+  std::vector<glm::dvec3> radiance;
+  std::vector<double> distance;
+};
+
+// Irradiance, its gradients (Ward and Heckbert, "Irradiance gradients"; the
+// term across phi strata weighs the swept projected solid angle) and
+// radius of \p gather. The radius is limited to [minRadius, maxRadius] and
+// to the distance over which the translation gradient would change
+// irradiance by more than its value.
+IrradianceRecord ComputeIrradianceRecord(const IrradianceGather &gather,
+                                         double minRadius, double maxRadius);
+
+// Sparse irradiance samples over the surfaces of a scene (Ward et al., "A
+// ray tracing solution for diffuse interreflection"), interpolated at
+// nearby points with similar normals.
+//
+// Records are kept in an octree: every record is stored in the nodes its
+// area of influence overlaps, at the depth where nodes are about as large
+// as the area. A lookup checks the records of the nodes on the path from
+// the root to the leaf containing the point.
+class IrradianceCache {
+public:
+  explicit IrradianceCache(double a = IrradianceCacheSettings().accuracy) :
+    accuracy(a) { Reset(glm::dvec3(0.0), glm::dvec3(0.0)); }
+
+  // Remove all records and set bounds of the octree. Records may be added
+  // outside the bounds, but are only found by lookups within them.
+  void Reset(const glm::dvec3 &boundsMin, const glm::dvec3 &boundsMax);
+
+  void Add(const IrradianceRecord &record);
+
+  // Weighted mean of the records valid at \p point with normal \p normal,
+  // extrapolated by their gradients. Returns false if there are none.
+  bool Lookup(const glm::dvec3 &point, const glm::dvec3 &normal,
+              glm::dvec3 &irradiance) const;
+
+public:
+  double GetAccuracy() const { return accuracy; }
+  std::size_t GetNumRecords() const { return records.size(); }
+  const IrradianceRecord &GetRecord(std::size_t i) const { return records[i]; }
+
+private:
+  struct Node {
+    Node() { for (std::uint32_t &c : children) c = 0; }
+
+    // Indices of child nodes, 0 for none (the root is nobody's child).
+    std::uint32_t children[8];
+    std::vector<std::uint32_t> records;
+  };
+
+  void Insert(std::uint32_t node, const glm::dvec3 &lo, const glm::dvec3 &hi,
+              std::uint32_t record, const glm::dvec3 &recordLo,
+              const glm::dvec3 &recordHi, unsigned depth);
+
+  double accuracy;
+  glm::dvec3 rootMin;
+  glm::dvec3 rootMax;
+  std::vector<Node> nodes;
+  std::vector<IrradianceRecord> records;
+};
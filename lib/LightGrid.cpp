@@ -0,0 +1,113 @@
+#include "LightGrid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+
+namespace {
+
+// Limits the grid size for scenes with a few small lights far apart.
+const unsigned MaxCellsPerAxis = 128;
+
+} // anonymous namespace
+
+
+void LightGrid::Build(const std::vector<PointLight> &lights)
+{
+  assert(lights.size() <= 0xFFFFFFFFu && "Too many lights!");
+
+  cellOffsets.clear();
+  cellLights.clear();
+  unboundedLights.clear();
+  dims = glm::uvec3(0);
+
+  // Bounds of all spheres of influence and mean radius.
+  glm::dvec3 lo(std::numeric_limits<double>::max());
+  glm::dvec3 hi(-std::numeric_limits<double>::max());
+  double radiusSum = 0.0;
+  std::size_t numBounded = 0;
+  for (std::size_t l = 0; l < lights.size(); ++l) {
+    if (!lights[l].IsBounded()) {
+      unboundedLights.push_back(static_cast<std::uint32_t>(l));
+      continue;
+    }
+    glm::dvec3 r(lights[l].radius);
+    lo = glm::min(lo, lights[l].position - r);
+    hi = glm::max(hi, lights[l].position + r);
+    radiusSum += lights[l].radius;
+    ++numBounded;
+  }
+
+  if (numBounded == 0)
+    return;
+
+  double cellSize = radiusSum / numBounded;
+  glm::dvec3 extent = hi - lo;
+  for (int a = 0; a < 3; ++a) {
+    double cells = std::ceil(extent[a] / cellSize);
+    dims[a] = static_cast<unsigned>(std::min(std::max(cells, 1.0),
+                                             static_cast<double>(MaxCellsPerAxis)));
+  }
+  boundsMin = lo;
+  invCellSize = glm::dvec3(dims) / extent;
+
+  // Two passes over the lights: count overlaps per cell, then fill the
+  // compressed lists.
+  std::size_t numCells = static_cast<std::size_t>(dims.x) * dims.y * dims.z;
+  cellOffsets.assign(numCells + 1, 0);
+
+  for (int pass = 0; pass < 2; ++pass) {
+    for (std::size_t l = 0; l < lights.size(); ++l) {
+      if (!lights[l].IsBounded())
+        continue;
+
+      const glm::dvec3 &p = lights[l].position;
+      double r = lights[l].radius;
+      glm::dvec3 cellLo = glm::floor((p - r - boundsMin) * invCellSize);
+      glm::dvec3 cellHi = glm::floor((p + r - boundsMin) * invCellSize);
+      glm::uvec3 first(glm::max(cellLo, glm::dvec3(0.0)));
+      glm::uvec3 last(glm::min(cellHi, glm::dvec3(dims - 1u)));
+
+      for (unsigned z = first.z; z <= last.z; ++z)
+      for (unsigned y = first.y; y <= last.y; ++y)
+      for (unsigned x = first.x; x <= last.x; ++x) {
+        // Skip cells of the bounding box which the sphere doesn't touch.
+        glm::dvec3 boxLo = boundsMin + glm::dvec3(x, y, z) / invCellSize;
+        glm::dvec3 boxHi = boundsMin + glm::dvec3(x + 1, y + 1, z + 1) / invCellSize;
+        glm::dvec3 closest = glm::clamp(p, boxLo, boxHi);
+        glm::dvec3 d = closest - p;
+        if (glm::dot(d, d) > r * r)
+          continue;
+
+        std::size_t cell = (static_cast<std::size_t>(z) * dims.y + y) * dims.x + x;
+        if (pass == 0)
+          ++cellOffsets[cell + 1];
+        else
+          cellLights[cellOffsets[cell]++] = static_cast<std::uint32_t>(l);
+      }
+    }
+
+    if (pass == 0) {
+      // Prefix sum: cellOffsets[c] is where cell c starts.
+      for (std::size_t c = 1; c <= numCells; ++c)
+        cellOffsets[c] += cellOffsets[c - 1];
+      assert(cellOffsets.back() <= 0xFFFFFFFFu && "Light grid is too large!");
+      cellLights.resize(cellOffsets.back());
+    }
+  }
+
+  // The fill pass moved every offset to the end of its cell: shift back.
+  for (std::size_t c = numCells; c > 0; --c)
+    cellOffsets[c] = cellOffsets[c - 1];
+  cellOffsets[0] = 0;
+}
+
+
+double LightGrid::GetMeanLightsPerCell() const
+{
+  double bounded = GetNumCells()
+    ? static_cast<double>(cellLights.size()) / GetNumCells()
+    : 0.0;
+  return bounded + unboundedLights.size();
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#include "PointLight.h"
+#include <cstdint>
+#include <vector>
+
+// Uniform grid over the spheres of influence of point lights, for fast
+// lookup of the lights which can affect a point.
+//
+// Each cell lists the bounded lights whose sphere overlaps it (compressed
+// into one array, cell after cell). Unbounded lights reach everywhere and
+// are kept in a separate list which every query returns.
+class LightGrid {
+public:
+  LightGrid() : boundsMin(0.0), invCellSize(0.0), dims(0) {}
+
+  // (Re)build the grid over \p lights. Cells are about as large as the
+  // mean influence radius, so a light overlaps a few cells and a cell
+  // holds about as many lights as the neighbourhood of a point.
+  void Build(const std::vector<PointLight> &lights);
+
+  // Call \p func(lightIndex) for every light which may affect \p point:
+  // all unbounded lights and the bounded ones overlapping its cell.
+  // The callee still has to check the distance.
+  template <typename TFunc>
+  void ForEachLight(const glm::dvec3 &point, TFunc func) const {
+    for (std::uint32_t l : unboundedLights)
+      func(l);
+
+    std::size_t cell;
+    if (!FindCell(point, cell))
+      return;
+    for (std::uint32_t i = cellOffsets[cell]; i < cellOffsets[cell + 1]; ++i)
+      func(cellLights[i]);
+  }
+
+public:
+  glm::uvec3 GetDimensions() const { return dims; }
+  std::size_t GetNumCells() const { return cellOffsets.empty() ? 0 : cellOffsets.size() - 1; }
+  std::size_t GetNumUnbounded() const { return unboundedLights.size(); }
+
+  // Mean number of lights returned by ForEachLight for a point inside the
+  // grid.
+  double GetMeanLightsPerCell() const;
+
+private:
+  // Finds the cell containing \p point. Returns false if it's outside of
+  // the grid (no bounded light reaches it).
+  bool FindCell(const glm::dvec3 &point, std::size_t &cell) const {
+    if (GetNumCells() == 0)
+      return false;
+
+    glm::dvec3 rel = (point - boundsMin) * invCellSize;
+    if (rel.x < 0.0 || rel.y < 0.0 || rel.z < 0.0 ||
+        rel.x >= dims.x || rel.y >= dims.y || rel.z >= dims.z)
+      return false;
+
+    cell = (static_cast<std::size_t>(rel.z) * dims.y +
+            static_cast<std::size_t>(rel.y)) * dims.x +
+           static_cast<std::size_t>(rel.x);
+    return true;
+  }
+
+  glm::dvec3 boundsMin;
+  glm::dvec3 invCellSize;
+  glm::uvec3 dims;
+
+  // Lights of cell c are cellLights[cellOffsets[c] .. cellOffsets[c + 1]).
+  std::vector<std::uint32_t> cellOffsets;
+  std::vector<std::uint32_t> cellLights;
+  std::vector<std::uint32_t> unboundedLights;
+};
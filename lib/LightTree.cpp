@@ -0,0 +1,174 @@
+#include "LightTree.h"
+#include "glm/gtc/constants.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+
+namespace {
+
+const std::uint32_t NoParent = 0xFFFFFFFFu;
+
+// Brightness of a light color.
+double Power(const glm::dvec3 &color) {
+  return (color.r + color.g + color.b) / 3.0;
+}
+
+} // anonymous namespace
+
+
+void LightTree::Build(const std::vector<PointLight> &lights)
+{
+  assert(lights.size() < NoParent && "Too many lights!");
+
+  nodes.clear();
+  leafOfLight.assign(lights.size(), 0);
+  if (lights.empty())
+    return;
+
+  nodes.reserve(2 * lights.size() - 1);
+  std::vector<std::uint32_t> order(lights.size());
+  std::iota(order.begin(), order.end(), 0);
+  BuildNode(lights, order.data(), order.data() + order.size(), NoParent);
+}
+
+
+std::uint32_t LightTree::BuildNode(const std::vector<PointLight> &lights,
+                                   std::uint32_t *begin, std::uint32_t *end,
+                                   std::uint32_t parent)
+{
+  std::uint32_t index = static_cast<std::uint32_t>(nodes.size());
+  nodes.push_back(Node());
+
+  Node node;
+  node.boundsMin = glm::dvec3(std::numeric_limits<double>::max());
+  node.boundsMax = glm::dvec3(-std::numeric_limits<double>::max());
+  node.ambientPower = 0.0;
+  node.power = 0.0;
+  node.invRadius = std::numeric_limits<double>::max();
+  node.parent = parent;
+  for (const std::uint32_t *l = begin; l != end; ++l) {
+    const PointLight &light = lights[*l];
+    node.boundsMin = glm::min(node.boundsMin, light.position);
+    node.boundsMax = glm::max(node.boundsMax, light.position);
+    node.ambientPower += Power(light.ambientColor);
+    node.power += Power(light.diffuseColor) + Power(light.specularColor);
+    node.invRadius = std::min(node.invRadius, light.GetInvRadius());
+  }
+
+  if (end - begin == 1) {
+    node.isLeaf = true;
+    node.index = *begin;
+    leafOfLight[*begin] = index;
+  } else {
+    // Median split along the longest axis.
+    glm::dvec3 extent = node.boundsMax - node.boundsMin;
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2)
+                                   : (extent.y > extent.z ? 1 : 2);
+    std::uint32_t *middle = begin + (end - begin) / 2;
+    std::nth_element(begin, middle, end,
+                     [&](std::uint32_t a, std::uint32_t b) {
+                       return lights[a].position[axis] < lights[b].position[axis];
+                     });
+
+    node.isLeaf = false;
+    BuildNode(lights, begin, middle, index);
+    node.index = BuildNode(lights, middle, end, index);
+  }
+
+  nodes[index] = node;
+  return index;
+}
+
+
+double LightTree::Importance(const Node &node, const glm::dvec3 &point,
+                             const glm::dvec3 &normal) const
+{
+  // Falloff is largest at the closest point of the bounds.
+  glm::dvec3 closest = glm::clamp(point, node.boundsMin, node.boundsMax);
+  double falloff = LightFalloff(glm::length(closest - point), node.invRadius);
+  if (falloff <= 0.0)
+    return 0.0;
+
+  // Bound of N.L: angle to the center of the bounds, minus the half-angle
+  // of their bounding sphere.
+  double cosine = 1.0;
+  glm::dvec3 center = 0.5 * (node.boundsMin + node.boundsMax);
+  glm::dvec3 toCenter = center - point;
+  double dist = glm::length(toCenter);
+  double sphereRadius = 0.5 * glm::length(node.boundsMax - node.boundsMin);
+  if (dist > sphereRadius) {
+    double angle = std::acos(glm::clamp(glm::dot(normal, toCenter) / dist, -1.0, 1.0));
+    double halfAngle = std::asin(sphereRadius / dist);
+    double minAngle = std::max(angle - halfAngle, 0.0);
+    cosine = minAngle < glm::half_pi<double>() ? std::cos(minAngle) : 0.0;
+  }
+
+  return falloff * (node.ambientPower + node.power * cosine);
+}
+
+
+bool LightTree::Sample(const glm::dvec3 &point, const glm::dvec3 &normal,
+                       double u, std::uint32_t &light, double &pdf) const
+{
+  if (nodes.empty() || Importance(nodes[0], point, normal) <= 0.0)
+    return false;
+
+  pdf = 1.0;
+  std::uint32_t index = 0;
+  while (!nodes[index].isLeaf) {
+    std::uint32_t first = index + 1;
+    std::uint32_t second = nodes[index].index;
+    double importanceFirst = Importance(nodes[first], point, normal);
+    double importanceSecond = Importance(nodes[second], point, normal);
+    double total = importanceFirst + importanceSecond;
+    // Bounds are conservative: a node may be important while both of its
+    // children are not.
+    if (total <= 0.0)
+      return false;
+
+    // Reuse \p u: rescale its remainder to [0, 1) after every choice.
+    double pFirst = importanceFirst / total;
+    if (u < pFirst) {
+      u /= pFirst;
+      pdf *= pFirst;
+      index = first;
+    } else {
+      u = (u - pFirst) / (1.0 - pFirst);
+      pdf *= 1.0 - pFirst;
+      index = second;
+    }
+    u = std::min(u, 1.0 - std::numeric_limits<double>::epsilon());
+  }
+
+  light = nodes[index].index;
+  return true;
+}
+
+
+double LightTree::Pdf(const glm::dvec3 &point, const glm::dvec3 &normal,
+                      std::uint32_t light) const
+{
+  assert(light < leafOfLight.size() && "Light index out of bounds!");
+
+  if (Importance(nodes[0], point, normal) <= 0.0)
+    return 0.0;
+
+  // Walk up from the leaf, multiplying the probabilities of the choices.
+  double pdf = 1.0;
+  std::uint32_t index = leafOfLight[light];
+  while (nodes[index].parent != NoParent) {
+    std::uint32_t parent = nodes[index].parent;
+    std::uint32_t first = parent + 1;
+    std::uint32_t second = nodes[parent].index;
+    double importanceFirst = Importance(nodes[first], point, normal);
+    double importanceSecond = Importance(nodes[second], point, normal);
+    double total = importanceFirst + importanceSecond;
+    if (total <= 0.0)
+      return 0.0;
+    pdf *= (index == first ? importanceFirst : importanceSecond) / total;
+    index = parent;
+  }
+  return pdf;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#include "PointLight.h"
+#include <cstdint>
+#include <vector>
+
+// Binary tree over point lights for importance sampling of direct lighting
+// in scenes with many lights.
+//
+// Every node bounds the positions of its lights and stores their total
+// power and largest influence radius. To pick a light for a shading point,
+// the tree is walked from the root, choosing a child with probability
+// proportional to an upper bound of its lights' contribution at the point:
+// power, scaled by the largest falloff over the node's bounds and by the
+// largest cosine between the surface normal and a direction into the
+// bounds. Point lights emit in all directions, so emitter orientation
+// doesn't take part.
+class LightTree {
+public:
+  // (Re)build the tree over \p lights. Nodes are split at the median of
+  // the longest axis of their lights' positions.
+  void Build(const std::vector<PointLight> &lights);
+
+  // Pick a light for the surface point \p point with normal \p normal,
+  // using a uniform random number \p u in [0, 1). Returns false if no light
+  // was picked; otherwise \p light is the picked light's index and \p pdf
+  // is the probability it was picked with.
+  //
+  // Node bounds are conservative, so a walk may end in a node whose lights
+  // all turn out to be out of reach, and probabilities of all lights may
+  // sum up to less than 1. Every light which contributes to the point has
+  // a non-zero probability though, so estimates stay unbiased.
+  bool Sample(const glm::dvec3 &point, const glm::dvec3 &normal, double u,
+              std::uint32_t &light, double &pdf) const;
+
+  // Probability of Sample picking \p light for \p point and \p normal.
+  double Pdf(const glm::dvec3 &point, const glm::dvec3 &normal,
+             std::uint32_t light) const;
+
+public:
+  std::size_t GetNumNodes() const { return nodes.size(); }
+  bool Empty() const { return nodes.empty(); }
+
+private:
+  struct Node {
+    glm::dvec3 boundsMin;
+    glm::dvec3 boundsMax;
+    // Summed over the node's lights: ambient term, which reaches surfaces
+    // facing any way, and diffuse and specular terms.
+    double ambientPower;
+    double power;
+    // Of the largest radius; 0 if any light is unbounded.
+    double invRadius;
+    // Leaf: index of its light. Inner node: index of the second child, the
+    // first one follows the node itself.
+    std::uint32_t index;
+    std::uint32_t parent;
+    bool isLeaf;
+  };
+
+  std::uint32_t BuildNode(const std::vector<PointLight> &lights,
+                          std::uint32_t *begin, std::uint32_t *end,
+                          std::uint32_t parent);
+
+  // Upper bound of the contribution of \p node's lights at the point.
+  double Importance(const Node &node, const glm::dvec3 &point,
+                    const glm::dvec3 &normal) const;
+
+  std::vector<Node> nodes;
+  // Leaf node of every light.
+  std::vector<std::uint32_t> leafOfLight;
+};
@@ -0,0 +1,652 @@
+#include "LodMesh.h"
+#include "Bvh.h"
+#include "Morton.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <thread>
+
+namespace {
+
+// Symmetric 4x4 matrix Q of a sum of squared distances to planes: the
+// distance of point p is (p, 1) Q (p, 1)^T.
+struct Quadric {
+  Quadric() { std::fill(q, q + 10, 0.0); }
+
+  // Plane of points p with dot(n, p) + d = 0, \p n of length 1.
+  Quadric(const glm::dvec3 &n, double d) {
+    q[0] = n.x * n.x; q[1] = n.x * n.y; q[2] = n.x * n.z; q[3] = n.x * d;
+    q[4] = n.y * n.y; q[5] = n.y * n.z; q[6] = n.y * d;
+    q[7] = n.z * n.z; q[8] = n.z * d;
+    q[9] = d * d;
+  }
+
+  Quadric &operator+=(const Quadric &other) {
+    for (int i = 0; i < 10; ++i)
+      q[i] += other.q[i];
+    return *this;
+  }
+
+  double Error(const glm::dvec3 &p) const {
+    return p.x * (q[0] * p.x + 2.0 * (q[1] * p.y + q[2] * p.z + q[3])) +
+           p.y * (q[4] * p.y + 2.0 * (q[5] * p.z + q[6])) +
+           p.z * (q[7] * p.z + 2.0 * q[8]) + q[9];
+  }
+
+  // Point of least error. False if there's no single one (planes are
+  // parallel or fewer than 3).
+  bool Minimum(glm::dvec3 &p) const {
+    glm::dmat3 a(q[0], q[1], q[2], q[1], q[4], q[5], q[2], q[5], q[7]);
+    double det = glm::determinant(a);
+    double scale = q[0] + q[4] + q[7];
+    if (std::abs(det) <= 1.0e-9 * scale * scale * scale)
+      return false;
+    p = glm::inverse(a) * -glm::dvec3(q[3], q[6], q[8]);
+    return true;
+  }
+
+  // xx xy xz xw yy yz yw zz zw ww.
+  double q[10];
+};
+
+// Distance from \p p to triangle \p P.
+double TriangleDistance(const glm::dvec3 &p, const glm::dvec3 P[3])
+{
+  glm::dvec3 n = glm::cross(P[1] - P[0], P[2] - P[0]);
+  double area2 = glm::dot(n, n);
+  if (area2 > 0.0) {
+    // Inside if p projects onto the same side of every edge.
+    bool inside = true;
+    for (int i = 0; i < 3 && inside; ++i)
+      inside = glm::dot(glm::cross(P[(i + 1) % 3] - P[i], p - P[i]), n) >= 0.0;
+    if (inside)
+      return std::abs(glm::dot(p - P[0], n)) / std::sqrt(area2);
+  }
+  double distance = std::numeric_limits<double>::max();
+  for (int i = 0; i < 3; ++i) {
+    glm::dvec3 edge = P[(i + 1) % 3] - P[i];
+    double length2 = glm::dot(edge, edge);
+    double t = length2 > 0.0 ?
+      glm::clamp(glm::dot(p - P[i], edge) / length2, 0.0, 1.0) : 0.0;
+    distance = std::min(distance, glm::length(p - (P[i] + t * edge)));
+  }
+  return distance;
+}
+
+// Face being simplified: vertex indexes in the mesh.
+struct SimplifyFace {
+  TMeshIndex v[3];
+  TMaterialId material;
+  bool alive;
+};
+
+// Vertexes and faces of a mesh being simplified, shared by regions. A
+// region only changes its faces and the vertexes only its faces use.
+struct SimplifyState {
+  std::vector<glm::dvec3> points;
+  std::vector<glm::dvec2> texCoords;
+  std::vector<SimplifyFace> faces;
+  // Vertexes which don't move.
+  std::vector<char> locked;
+};
+
+// Collapse of edge (a, b) of a region, as local vertex indexes, into
+// point, valid while both vertexes are at their versions.
+struct Collapse {
+  double cost;
+  std::uint32_t a, b;
+  std::uint32_t versionA, versionB;
+  glm::dvec3 point;
+
+  bool operator>(const Collapse &other) const { return cost > other.cost; }
+};
+
+// Collapse edges of faces \p regionFaces[0 .. count) of \p state, in
+// order of cost, while it's at most \p maxCost. If \p collapses isn't
+// null, it gets the largest cost so far and the number of faces removed
+// by every collapse, and \p state is left as it is. Otherwise the faces
+// left and their vertexes are stored to \p state, and \p error gets the
+// largest distance of a vertex of the region from them.
+void SimplifyRegion(SimplifyState &state, const std::uint32_t *regionFaces,
+                    std::size_t count, double maxCost,
+                    std::vector<std::pair<double, std::uint32_t>> *collapses,
+                    double &error)
+{
+  error = 0.0;
+
+  // The region's vertexes, sorted by their index in the mesh, and its
+  // faces and their vertexes' faces by local indexes.
+  std::vector<TMeshIndex> vertexes;
+  for (std::size_t f = 0; f < count; ++f) {
+    const SimplifyFace &face = state.faces[regionFaces[f]];
+    vertexes.insert(vertexes.end(), face.v, face.v + 3);
+  }
+  std::sort(vertexes.begin(), vertexes.end());
+  vertexes.erase(std::unique(vertexes.begin(), vertexes.end()), vertexes.end());
+  std::size_t numVertexes = vertexes.size();
+
+  std::vector<std::uint32_t> faces(3 * count);
+  std::vector<char> alive(count, 1);
+  std::vector<std::vector<std::uint32_t>> vertexFaces(numVertexes);
+  std::vector<Quadric> quadrics(numVertexes);
+  for (std::size_t f = 0; f < count; ++f) {
+    const SimplifyFace &face = state.faces[regionFaces[f]];
+    for (int v = 0; v < 3; ++v) {
+      std::uint32_t local = static_cast<std::uint32_t>(
+        std::lower_bound(vertexes.begin(), vertexes.end(), face.v[v]) -
+        vertexes.begin());
+      faces[3 * f + v] = local;
+      vertexFaces[local].push_back(static_cast<std::uint32_t>(f));
+    }
+    const glm::dvec3 &p0 = state.points[face.v[0]];
+    glm::dvec3 n = glm::cross(state.points[face.v[1]] - p0,
+                              state.points[face.v[2]] - p0);
+    double length = glm::length(n);
+    if (length <= 0.0)
+      continue;
+    n /= length;
+    Quadric plane(n, -glm::dot(n, p0));
+    for (int v = 0; v < 3; ++v)
+      quadrics[faces[3 * f + v]] += plane;
+  }
+
+  std::vector<glm::dvec3> original(numVertexes);
+  std::vector<glm::dvec2> texCoords(numVertexes);
+  for (std::size_t v = 0; v < numVertexes; ++v) {
+    original[v] = state.points[vertexes[v]];
+    texCoords[v] = state.texCoords[vertexes[v]];
+  }
+  std::vector<glm::dvec3> points(original);
+  auto point = [&](std::uint32_t v) -> const glm::dvec3 & {
+    return points[v];
+  };
+  auto isLocked = [&](std::uint32_t v) -> bool {
+    return state.locked[vertexes[v]] != 0;
+  };
+
+  std::vector<char> removed(numVertexes, 0);
+  std::vector<std::uint32_t> versions(numVertexes, 0);
+  std::priority_queue<Collapse, std::vector<Collapse>,
+                      std::greater<Collapse>> queue;
+
+  // Queue the collapse of (a, b), unless both are locked.
+  auto push = [&](std::uint32_t a, std::uint32_t b) {
+    bool lockedA = isLocked(a), lockedB = isLocked(b);
+    if (lockedA && lockedB)
+      return;
+    Quadric sum = quadrics[a];
+    sum += quadrics[b];
+    Collapse c;
+    c.a = a;
+    c.b = b;
+    c.versionA = versions[a];
+    c.versionB = versions[b];
+    if (lockedA) {
+      c.point = point(a);
+    } else if (lockedB) {
+      c.point = point(b);
+    } else if (!sum.Minimum(c.point) ||
+               glm::length(c.point - 0.5 * (point(a) + point(b))) >
+               glm::length(point(b) - point(a))) {
+      // The best of the ends and the midpoint, also when the minimum is
+      // off the edge (the planes are nearly parallel).
+      const glm::dvec3 candidates[3] = {
+        point(a), point(b), 0.5 * (point(a) + point(b)) };
+      c.point = candidates[0];
+      for (const glm::dvec3 &candidate : candidates) {
+        if (sum.Error(candidate) < sum.Error(c.point))
+          c.point = candidate;
+      }
+    }
+    c.cost = std::max(sum.Error(c.point), 0.0);
+    queue.push(c);
+  };
+  for (std::size_t f = 0; f < count; ++f) {
+    for (int v = 0; v < 3; ++v) {
+      std::uint32_t a = faces[3 * f + v], b = faces[3 * f + (v + 1) % 3];
+      // Edges of two faces are queued once.
+      if (a < b)
+        push(a, b);
+    }
+  }
+
+  // Other vertexes of the alive faces of v.
+  auto neighbours = [&](std::uint32_t v, std::vector<std::uint32_t> &result) {
+    result.clear();
+    for (std::uint32_t f : vertexFaces[v]) {
+      if (!alive[f])
+        continue;
+      for (int i = 0; i < 3; ++i) {
+        if (faces[3 * f + i] != v)
+          result.push_back(faces[3 * f + i]);
+      }
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+  };
+
+  // Whether moving v to p turns any of its faces without \p other over.
+  auto flips = [&](std::uint32_t v, std::uint32_t other, const glm::dvec3 &p) {
+    for (std::uint32_t f : vertexFaces[v]) {
+      if (!alive[f])
+        continue;
+      const std::uint32_t *fv = &faces[3 * f];
+      if (fv[0] == other || fv[1] == other || fv[2] == other)
+        continue;
+      glm::dvec3 P[3], moved[3];
+      for (int i = 0; i < 3; ++i) {
+        P[i] = point(fv[i]);
+        moved[i] = fv[i] == v ? p : P[i];
+      }
+      glm::dvec3 before = glm::cross(P[1] - P[0], P[2] - P[0]);
+      glm::dvec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+      if (glm::dot(before, after) <= 0.1 * glm::length(before) * glm::length(after))
+        return true;
+    }
+    return false;
+  };
+
+  std::vector<std::uint32_t> aroundA, aroundB;
+  double largestCost = 0.0;
+  while (!queue.empty()) {
+    Collapse c = queue.top();
+    queue.pop();
+    if (removed[c.a] || removed[c.b] || versions[c.a] != c.versionA ||
+        versions[c.b] != c.versionB)
+      continue;
+    if (c.cost > maxCost)
+      break;
+
+    // Link condition: the ends share only the vertexes of the faces of the
+    // edge, or the collapse pinches the surface.
+    neighbours(c.a, aroundA);
+    neighbours(c.b, aroundB);
+    std::size_t shared = 0, edgeFaces = 0;
+    for (std::uint32_t v : aroundA)
+      shared += std::binary_search(aroundB.begin(), aroundB.end(), v);
+    for (std::uint32_t f : vertexFaces[c.a]) {
+      const std::uint32_t *fv = &faces[3 * f];
+      if (alive[f] && (fv[0] == c.b || fv[1] == c.b || fv[2] == c.b))
+        ++edgeFaces;
+    }
+    if (shared != edgeFaces)
+      continue;
+    if (flips(c.a, c.b, c.point) || flips(c.b, c.a, c.point))
+      continue;
+
+    // The locked end (if any) stays; the other one is merged into it.
+    std::uint32_t keep = c.b, merged = c.a;
+    if (isLocked(c.a))
+      std::swap(keep, merged);
+    if (!isLocked(keep)) {
+      // Texture coordinates of the point's projection on the edge.
+      glm::dvec3 edge = point(keep) - point(merged);
+      double length2 = glm::dot(edge, edge);
+      double t = length2 > 0.0 ?
+        glm::clamp(glm::dot(c.point - point(merged), edge) / length2, 0.0, 1.0) :
+        1.0;
+      texCoords[keep] = glm::mix(texCoords[merged], texCoords[keep], t);
+      points[keep] = c.point;
+    }
+    quadrics[keep] += quadrics[merged];
+    removed[merged] = 1;
+    ++versions[keep];
+
+    std::uint32_t facesRemoved = 0;
+    for (std::uint32_t f : vertexFaces[merged]) {
+      if (!alive[f])
+        continue;
+      std::uint32_t *fv = &faces[3 * f];
+      if (fv[0] == keep || fv[1] == keep || fv[2] == keep) {
+        alive[f] = 0;
+        ++facesRemoved;
+        continue;
+      }
+      for (int i = 0; i < 3; ++i) {
+        if (fv[i] == merged)
+          fv[i] = keep;
+      }
+      vertexFaces[keep].push_back(f);
+    }
+    std::vector<std::uint32_t>().swap(vertexFaces[merged]);
+    std::vector<std::uint32_t> &keepFaces = vertexFaces[keep];
+    keepFaces.erase(std::remove_if(keepFaces.begin(), keepFaces.end(),
+                                   [&](std::uint32_t f) { return !alive[f]; }),
+                    keepFaces.end());
+
+    largestCost = std::max(largestCost, c.cost);
+    if (collapses)
+      collapses->push_back(std::make_pair(largestCost, facesRemoved));
+
+    neighbours(keep, aroundA);
+    for (std::uint32_t v : aroundA)
+      push(keep, v);
+  }
+  if (collapses)
+    return;
+
+  // Distances of the region's vertexes from the faces left, nearest first
+  // down a BVH over them.
+  std::vector<std::uint32_t> left;
+  std::vector<glm::dvec3> leftMin, leftMax;
+  for (std::uint32_t f = 0; f < count; ++f) {
+    if (!alive[f])
+      continue;
+    left.push_back(f);
+    const std::uint32_t *fv = &faces[3 * f];
+    leftMin.push_back(glm::min(point(fv[0]), glm::min(point(fv[1]), point(fv[2]))));
+    leftMax.push_back(glm::max(point(fv[0]), glm::max(point(fv[1]), point(fv[2]))));
+  }
+  std::vector<BvhNode> nodes;
+  std::vector<std::uint32_t> order;
+  BuildBvh(leftMin, leftMax, 4, nodes, order);
+  std::vector<std::uint32_t> stack;
+  for (std::uint32_t v = 0; v < numVertexes && !nodes.empty(); ++v) {
+    if (isLocked(v))
+      continue;
+    const glm::dvec3 &p = original[v];
+    double distance = std::numeric_limits<double>::max();
+    stack.assign(1, 0);
+    while (!stack.empty()) {
+      std::uint32_t index = stack.back();
+      stack.pop_back();
+      const BvhNode &node = nodes[index];
+      glm::dvec3 outside(0.0);
+      for (int a = 0; a < 3; ++a)
+        outside[a] = std::max(std::max(node.boundsMin[a] - p[a], p[a] - node.boundsMax[a]), 0.0);
+      if (glm::length(outside) >= distance)
+        continue;
+      if (!node.IsLeaf()) {
+        stack.push_back(node.index);
+        stack.push_back(index + 1);
+        continue;
+      }
+      for (std::uint32_t i = node.index; i < node.index + node.count; ++i) {
+        const std::uint32_t *fv = &faces[3 * left[order[i]]];
+        const glm::dvec3 P[3] = { point(fv[0]), point(fv[1]), point(fv[2]) };
+        distance = std::min(distance, TriangleDistance(p, P));
+      }
+    }
+    error = std::max(error, distance);
+  }
+
+  for (std::uint32_t v = 0; v < numVertexes; ++v) {
+    if (!removed[v] && !isLocked(v)) {
+      state.points[vertexes[v]] = points[v];
+      state.texCoords[vertexes[v]] = texCoords[v];
+    }
+  }
+  for (std::size_t f = 0; f < count; ++f) {
+    SimplifyFace &face = state.faces[regionFaces[f]];
+    face.alive = alive[f] != 0;
+    for (int v = 0; v < 3; ++v)
+      face.v[v] = vertexes[faces[3 * f + v]];
+  }
+}
+
+} // anonymous namespace
+
+
+std::unique_ptr<Mesh> SimplifyMesh(const Mesh &mesh, std::size_t targetFaces,
+                                   double &error, const SimplifySettings &s)
+{
+  assert(s.regionFaces && "Simplification regions can't be empty!");
+  error = 0.0;
+  const Mesh::TVertexes &meshVertexes = mesh.GetVertexes();
+  std::size_t numVertexes = meshVertexes.size();
+  std::size_t numFaces = mesh.GetNumFaces();
+
+  SimplifyState state;
+  state.points.resize(numVertexes);
+  state.texCoords.resize(numVertexes);
+  for (std::size_t v = 0; v < numVertexes; ++v) {
+    state.points[v] = meshVertexes[v].point;
+    state.texCoords[v] = meshVertexes[v].texCoord;
+  }
+  state.faces.resize(numFaces);
+  for (std::size_t f = 0; f < numFaces; ++f) {
+    MeshFace face = mesh.GetFace(f);
+    std::copy(face.vertexIndexes, face.vertexIndexes + 3, state.faces[f].v);
+    state.faces[f].material = face.material;
+    state.faces[f].alive = true;
+  }
+
+  // Regions: faces in the Morton order of their centers, cut into runs.
+  glm::dvec3 boundsMin(std::numeric_limits<double>::max());
+  glm::dvec3 boundsMax(-std::numeric_limits<double>::max());
+  for (const glm::dvec3 &p : state.points) {
+    boundsMin = glm::min(boundsMin, p);
+    boundsMax = glm::max(boundsMax, p);
+  }
+  glm::dvec3 extent = glm::max(boundsMax - boundsMin, glm::dvec3(1.0e-30));
+  std::vector<std::pair<std::uint32_t, std::uint32_t>> codes(numFaces);
+  for (std::size_t f = 0; f < numFaces; ++f) {
+    const TMeshIndex *v = state.faces[f].v;
+    glm::dvec3 center = (state.points[v[0]] + state.points[v[1]] +
+                         state.points[v[2]]) / 3.0;
+    glm::uvec3 cell(glm::clamp((center - boundsMin) / extent * 1024.0,
+                               glm::dvec3(0.0), glm::dvec3(1023.0)));
+    codes[f] = std::make_pair(MortonCode3D(cell.x, cell.y, cell.z),
+                              static_cast<std::uint32_t>(f));
+  }
+  std::sort(codes.begin(), codes.end());
+  std::vector<std::uint32_t> order(numFaces);
+  for (std::size_t f = 0; f < numFaces; ++f)
+    order[f] = codes[f].second;
+  std::vector<std::size_t> regionBegins(1, 0);
+  std::size_t next = s.shiftRegions ? std::max(s.regionFaces / 2, 1u) : s.regionFaces;
+  for (; next < numFaces; next += s.regionFaces)
+    regionBegins.push_back(next);
+  regionBegins.push_back(numFaces);
+  std::size_t numRegions = regionBegins.size() - 1;
+
+  // Lock vertexes of several regions or materials, and those of edges
+  // which aren't shared by exactly two faces.
+  state.locked.assign(numVertexes, 0);
+  const std::uint32_t NoRegion = std::numeric_limits<std::uint32_t>::max();
+  std::vector<std::uint32_t> vertexRegion(numVertexes, NoRegion);
+  std::vector<TMaterialId> vertexMaterial(numVertexes);
+  for (std::size_t r = 0; r < numRegions; ++r) {
+    for (std::size_t i = regionBegins[r]; i < regionBegins[r + 1]; ++i) {
+      const SimplifyFace &face = state.faces[order[i]];
+      for (TMeshIndex v : face.v) {
+        if (vertexRegion[v] == NoRegion) {
+          vertexRegion[v] = static_cast<std::uint32_t>(r);
+          vertexMaterial[v] = face.material;
+        } else if (vertexRegion[v] != r || vertexMaterial[v] != face.material) {
+          state.locked[v] = 1;
+        }
+      }
+    }
+  }
+  std::vector<std::pair<TMeshIndex, TMeshIndex>> edges;
+  edges.reserve(3 * numFaces);
+  for (const SimplifyFace &face : state.faces) {
+    for (int v = 0; v < 3; ++v)
+      edges.push_back(std::minmax(face.v[v], face.v[(v + 1) % 3]));
+  }
+  std::sort(edges.begin(), edges.end());
+  for (std::size_t i = 0; i < edges.size();) {
+    std::size_t j = i + 1;
+    while (j < edges.size() && edges[j] == edges[i])
+      ++j;
+    if (j - i != 2)
+      state.locked[edges[i].first] = state.locked[edges[i].second] = 1;
+    i = j;
+  }
+
+  // Regions are simplified by threads taking them in turn, twice. First
+  // every region records the costs of all its collapses. The largest cost
+  // at which the regions together are down to targetFaces is where they
+  // all stop the second time. So regions aren't simplified evenly, but as
+  // a simplification of the whole mesh in order of cost would, but for
+  // their borders.
+  std::vector<std::vector<std::pair<double, std::uint32_t>>> collapses(numRegions);
+  std::vector<double> regionErrors(numRegions, 0.0);
+  double maxCost = std::numeric_limits<double>::max();
+  auto simplifyRegions = [&](bool record) {
+    std::atomic<std::size_t> nextRegion(0);
+    auto work = [&]() {
+      for (;;) {
+        std::size_t r = nextRegion++;
+        if (r >= numRegions)
+          return;
+        std::size_t begin = regionBegins[r], size = regionBegins[r + 1] - begin;
+        SimplifyRegion(state, &order[begin], size, maxCost,
+                       record ? &collapses[r] : nullptr, regionErrors[r]);
+      }
+    };
+    unsigned numThreads = s.numThreads;
+    if (!numThreads)
+      numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    numThreads = static_cast<unsigned>(
+      std::min<std::size_t>(numThreads, std::max(numRegions, std::size_t(1))));
+    if (numThreads == 1) {
+      work();
+    } else {
+      std::vector<std::thread> threads;
+      for (unsigned t = 0; t < numThreads; ++t)
+        threads.push_back(std::thread(work));
+      for (std::thread &thread : threads)
+        thread.join();
+    }
+  };
+  simplifyRegions(true);
+  std::vector<std::pair<double, std::uint32_t>> costs;
+  for (const auto &region : collapses)
+    costs.insert(costs.end(), region.begin(), region.end());
+  std::sort(costs.begin(), costs.end());
+  maxCost = -1.0;
+  std::size_t numLeft = numFaces;
+  for (std::size_t i = 0; i < costs.size() && numLeft > targetFaces; ++i) {
+    numLeft -= costs[i].second;
+    maxCost = costs[i].first;
+  }
+  simplifyRegions(false);
+  error = *std::max_element(regionErrors.begin(), regionErrors.end());
+
+  // The faces left and their vertexes, in their order.
+  std::unique_ptr<Mesh> result(new Mesh(mesh.GetInterpolateNormals(),
+                                        mesh.GetMaterial()));
+  const TMeshIndex NoVertex = std::numeric_limits<TMeshIndex>::max();
+  std::vector<TMeshIndex> remap(numVertexes, NoVertex);
+  for (const SimplifyFace &face : state.faces) {
+    if (!face.alive)
+      continue;
+    for (TMeshIndex v : face.v) {
+      if (remap[v] != NoVertex)
+        continue;
+      remap[v] = result->AddVertex(state.points[v]);
+      if (mesh.HasTexCoords())
+        result->SetTexCoord(remap[v], state.texCoords[v]);
+    }
+  }
+  for (const SimplifyFace &face : state.faces) {
+    if (face.alive)
+      result->AddFace(remap[face.v[0]], remap[face.v[1]], remap[face.v[2]],
+                      face.material);
+  }
+  result->CalculateNormals();
+  return result;
+}
+
+
+// === LodMesh ===
+LodMesh::LodMesh(std::unique_ptr<Mesh> mesh, const LodSettings &s)
+  : settings(s), level(0), firstResident(0), center(0.0), radius(0.0)
+{
+  assert(mesh && "Mesh of LodMesh is null!");
+  assert(s.reduction > 0.0 && s.reduction < 1.0 &&
+         "Reduction of LOD levels out of bounds!");
+  const Mesh::TVertexes &vertexes = mesh->GetVertexes();
+  if (!vertexes.empty()) {
+    glm::dvec3 boundsMin = vertexes[0].point, boundsMax = boundsMin;
+    for (const MeshVertex &v : vertexes) {
+      boundsMin = glm::min(boundsMin, v.point);
+      boundsMax = glm::max(boundsMax, v.point);
+    }
+    center = 0.5 * (boundsMin + boundsMax);
+    for (const MeshVertex &v : vertexes)
+      radius = std::max(radius, glm::length(v.point - center));
+  }
+
+  levels.push_back(Level{ std::move(mesh), 0.0 });
+  SimplifySettings simplify = s.simplify;
+  while (levels.size() < s.maxLevels) {
+    const Level &last = levels.back();
+    std::size_t faces = last.mesh->GetNumFaces();
+    std::size_t target = static_cast<std::size_t>(faces * s.reduction);
+    if (target < s.minFaces)
+      break;
+    simplify.shiftRegions = levels.size() % 2 == 0;
+    double error;
+    std::unique_ptr<Mesh> simplified = SimplifyMesh(*last.mesh, target, error,
+                                                    simplify);
+    // Stalled: most of the faces are locked.
+    if (simplified->GetNumFaces() > faces - (faces - target) / 4)
+      break;
+    levels.push_back(Level{ std::move(simplified), last.error + error });
+  }
+}
+
+
+IntersectionResult LodMesh::Intersect(const Ray &ray) const
+{
+  unsigned l = level;
+  if (settings.selection == LodSelection::Footprint &&
+      (ray.GetConeWidth() != 0.0 || ray.GetConeSpread() != 0.0)) {
+    double distance = std::max(glm::length(center - ray.GetOrigin()) - radius, 0.0);
+    l = GetLevelForWidth(ray.GetWidthAt(distance));
+  }
+  return levels[l].mesh->Intersect(ray);
+}
+
+
+unsigned LodMesh::SelectLevel(const Camera &camera)
+{
+  double distance = std::max(glm::length(center - camera.GetPosition()) - radius, 0.0);
+  SetLevel(GetLevelForWidth(distance * std::tan(camera.GetPixelSpread())));
+  return level;
+}
+
+
+void LodMesh::SetLevel(unsigned l)
+{
+  assert(l < levels.size() && "LOD level out of bounds!");
+  level = std::max(l, firstResident);
+}
+
+
+unsigned LodMesh::GetLevelForWidth(double width) const
+{
+  unsigned l = firstResident;
+  while (l + 1 < levels.size() &&
+         levels[l + 1].error <= settings.pixelError * width)
+    ++l;
+  return l;
+}
+
+
+void LodMesh::ReleaseFinerLevels()
+{
+  for (unsigned l = firstResident; l < level; ++l)
+    levels[l].mesh.reset();
+  firstResident = level;
+}
+
+
+std::size_t LodMesh::GetResidentBytes() const
+{
+  std::size_t bytes = 0;
+  for (const Level &l : levels) {
+    if (l.mesh)
+      bytes += l.mesh->GetVertexes().capacity() * sizeof(MeshVertex) +
+               l.mesh->GetFaceBytes();
+  }
+  return bytes;
+}
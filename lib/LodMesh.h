@@ -0,0 +1,129 @@
+#pragma once
+
+#include "Camera.h"
+#include "Mesh.h"
+#include "Object3d.h"
+#include <memory>
+#include <vector>
+
+struct SimplifySettings {
+  SimplifySettings() : numThreads(0), regionFaces(2048), shiftRegions(false) {}
+
+  // Threads simplifying regions, 0 for one per hardware thread.
+  unsigned numThreads;
+
+  // Faces are split into regions of this many faces, consecutive in the
+  // Morton order of their centers, which are simplified independently.
+  // Vertexes shared by regions don't move, so regions' borders stay as
+  // they are.
+  unsigned regionFaces;
+
+  // Offset region borders by half a region. Simplifying every other level
+  // of a chain so moves the borders kept by the previous one.
+  bool shiftRegions;
+};
+
+// Simplify \p mesh down to about \p targetFaces faces by collapsing edges
+// in order of their quadric error (Garland and Heckbert, "Surface
+// simplification using quadric error metrics"), region by region in
+// parallel. A collapsed edge's vertex goes to where its squared distance
+// to the planes of the faces merged into it is least. Collapses which
+// would flip a face or make the surface non-manifold are skipped.
+// Vertexes of open edges, and those between faces of different
+// materials, don't move, so outlines and material borders are kept.
+//
+// Returns a new mesh with normals calculated. \p error gets an estimate
+// of how far the surface moved: the largest distance of a vertex of the
+// mesh from the faces of its region left.
+std::unique_ptr<Mesh> SimplifyMesh(const Mesh &mesh, std::size_t targetFaces,
+                                   double &error,
+                                   const SimplifySettings &s = SimplifySettings());
+
+// How LodMesh picks the level a ray intersects.
+enum class LodSelection {
+  // The level picked by SelectLevel() or SetLevel(), for all rays.
+  Fixed,
+  // The coarsest level whose error is within the ray's footprint where it
+  // reaches the mesh's bounds. Rays without a cone (shadow rays) use the
+  // fixed level.
+  Footprint,
+};
+
+struct LodSettings {
+  LodSettings() :
+    reduction(0.5), minFaces(64), maxLevels(8), pixelError(0.5),
+    selection(LodSelection::Footprint) {}
+
+  // Every level has this share of the faces of the previous one. The
+  // chain ends at minFaces, at maxLevels levels, or when simplification
+  // stalls.
+  double reduction;
+  std::size_t minFaces;
+  unsigned maxLevels;
+
+  // A level is used where its error is at most this share of the width of
+  // a pixel (or of a ray's footprint).
+  double pixelError;
+
+  LodSelection selection;
+
+  // Levels are simplified from each other with these, region borders
+  // shifted every other level.
+  SimplifySettings simplify;
+};
+
+// Mesh with a chain of levels of detail: level 0 is the mesh itself,
+// every next one a simplification of the previous. Rays intersect a
+// single level, so distant meshes, which cover a few pixels, cost a
+// fraction of their faces. Levels finer than ever needed can be released.
+class LodMesh : public IObject3D {
+public:
+  // Build the chain from \p mesh.
+  explicit LodMesh(std::unique_ptr<Mesh> mesh,
+                   const LodSettings &s = LodSettings());
+
+  IntersectionResult Intersect(const Ray &ray) const override;
+
+  // Set the fixed level to the one for the projected size of the mesh
+  // seen by \p camera: the coarsest whose error is within a pixel's width
+  // at the mesh's nearest bound. Returns it.
+  unsigned SelectLevel(const Camera &camera);
+  void SetLevel(unsigned level);
+  unsigned GetLevel() const { return level; }
+
+  // Coarsest level whose error is within a footprint of width \p width,
+  // not finer than the first resident one.
+  unsigned GetLevelForWidth(double width) const;
+
+  // Release levels finer than the fixed one. Rays which would intersect
+  // them intersect the fixed level.
+  void ReleaseFinerLevels();
+
+public:
+  unsigned GetNumLevels() const { return static_cast<unsigned>(levels.size()); }
+  // Null if released.
+  const Mesh *GetMesh(unsigned l) const { return levels[l].mesh.get(); }
+  double GetError(unsigned l) const { return levels[l].error; }
+  unsigned GetFirstResidentLevel() const { return firstResident; }
+
+  // Memory held by the vertexes and faces of resident levels.
+  std::size_t GetResidentBytes() const;
+
+  const LodSettings &GetSettings() const { return settings; }
+
+private:
+  struct Level {
+    std::unique_ptr<Mesh> mesh;
+    // Estimated distance from level 0: the errors of the simplifications
+    // which led to it, summed.
+    double error;
+  };
+
+  LodSettings settings;
+  std::vector<Level> levels;
+  unsigned level;
+  unsigned firstResident;
+  // Bounding sphere of level 0.
+  glm::dvec3 center;
+  double radius;
+};
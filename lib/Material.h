@@ -1,19 +1,36 @@
 #pragma once
 
 #include "glm/glm.hpp"
+#include "Texture.h"
+
+#include <cassert>
+#include <cstdint>
+#include <limits>
+
+// Dense material identifier, assigned by MaterialManager.
+// Primitives store only this id; material values are looked up in the
+// manager's table when shading.
+using TMaterialId = std::uint16_t;
+
+// Id which doesn't refer to any material.
+const TMaterialId InvalidMaterialId = std::numeric_limits<TMaterialId>::max();
 
 class Material {
 public:
   Material(const glm::dvec3 &a, const glm::dvec3 &s,
            const glm::dvec3 &d, double shine) :
     ambientColor(a), specularColor(s), diffuseColor(d),
-    shininess(shine) {}
+    shininess(shine), diffuseTexture(InvalidTextureId) {}
+
+  // Texture whose color multiplies the diffuse color, or InvalidTextureId.
+  void SetDiffuseTexture(TTextureId id) { diffuseTexture = id; }
 
 public:
   glm::dvec3 GetAmbient() const { return ambientColor; }
   glm::dvec3 GetSpecular() const { return specularColor; }
   glm::dvec3 GetDiffuse() const { return diffuseColor; }
   double GetShininess() const { return shininess; }
+  TTextureId GetDiffuseTexture() const { return diffuseTexture; }
 
   #ifndef NDEBUG
   void AssertValueBounds() const {
@@ -37,4 +54,5 @@ private:
   glm::dvec3 specularColor;
   glm::dvec3 diffuseColor;
   double shininess;
+  TTextureId diffuseTexture;
 };
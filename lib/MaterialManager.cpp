@@ -0,0 +1,59 @@
+#include "MaterialManager.h"
+
+TMaterialId MaterialManager::AddMaterial(const std::string &name,
+                                         const Material &mat)
+{
+  assert(!frozen && "Cannot add materials to a frozen MaterialManager!");
+  #ifndef NDEBUG
+  mat.AssertValueBounds();
+  #endif // !NDEBUG
+
+  auto it = ids.find(name);
+  if (it != ids.end()) {
+    // Known name: overwrite values in place.
+    TMaterialId id = it->second;
+    ambientColors[id] = mat.GetAmbient();
+    specularColors[id] = mat.GetSpecular();
+    diffuseColors[id] = mat.GetDiffuse();
+    shininess[id] = mat.GetShininess();
+    diffuseTextures[id] = mat.GetDiffuseTexture();
+    return id;
+  }
+
+  assert(names.size() < InvalidMaterialId && "Too many materials!");
+  TMaterialId id = static_cast<TMaterialId>(names.size());
+  ids.emplace(name, id);
+  names.push_back(name);
+  ambientColors.push_back(mat.GetAmbient());
+  specularColors.push_back(mat.GetSpecular());
+  diffuseColors.push_back(mat.GetDiffuse());
+  shininess.push_back(mat.GetShininess());
+  diffuseTextures.push_back(mat.GetDiffuseTexture());
+
+  return id;
+}
+
+
+TMaterialId MaterialManager::GetMaterialId(const std::string &name) const
+{
+  auto it = ids.find(name);
+  return it != ids.end() ? it->second : InvalidMaterialId;
+}
+
+
+Material MaterialManager::GetMaterial(TMaterialId id) const
+{
+  AssertValidId(id);
+  Material mat(ambientColors[id], specularColors[id],
+               diffuseColors[id], shininess[id]);
+  mat.SetDiffuseTexture(diffuseTextures[id]);
+  return mat;
+}
+
+
+Material MaterialManager::GetMaterialByName(const std::string &name) const
+{
+  TMaterialId id = GetMaterialId(name);
+  assert(id != InvalidMaterialId && "Material not found!");
+  return GetMaterial(id);
+}
@@ -2,23 +2,89 @@
 
 #include <unordered_map>
 #include <string>
+#include <vector>
 #include "Material.h"
 
+// Registry of all materials of a scene.
+//
+// Material names are interned into dense ids [0..GetNumMaterials()).
+// Values are stored as a structure of arrays indexed by id, so shading code
+// does an indexed load instead of chasing a pointer per hit.
+//
+// The manager is filled while the scene is built. Freeze() makes it
+// read-only: after that nothing is reallocated and any number of render
+// threads may read it concurrently without locking.
 class MaterialManager {
-  MaterialManager() {}
+public:
+  MaterialManager() : frozen(false) {}
   MaterialManager(const MaterialManager &other) = delete;
   MaterialManager& operator= (const MaterialManager &other) = delete;
 
-  void AddMaterial(const std::string &name, const Material &mat) {
-    materials[name] = mat;
+  // Register material \p mat under \p name and return its id.
+  // Registering an already known name overwrites its values and keeps the id.
+  TMaterialId AddMaterial(const std::string &name, const Material &mat);
+
+  // Returns id of material \p name or InvalidMaterialId if it is unknown.
+  TMaterialId GetMaterialId(const std::string &name) const;
+
+  // Assemble a Material object from the table.
+  Material GetMaterial(TMaterialId id) const;
+  Material GetMaterialByName(const std::string &name) const;
+
+  // Forbid any further modifications.
+  void Freeze() { frozen = true; }
+  bool IsFrozen() const { return frozen; }
+
+public:
+  std::size_t GetNumMaterials() const { return names.size(); }
+
+  const std::string &GetName(TMaterialId id) const {
+    AssertValidId(id);
+    return names[id];
+  }
+
+  // Per-channel indexed access.
+  const glm::dvec3 &GetAmbient(TMaterialId id) const {
+    AssertValidId(id);
+    return ambientColors[id];
+  }
+
+  const glm::dvec3 &GetSpecular(TMaterialId id) const {
+    AssertValidId(id);
+    return specularColors[id];
   }
 
-  const Material &GetMaterialByName(const std::string &name) const {
-    auto it = materials.find(name);
-    assert(it != materials.end() && "Material not found!");
-    return it->second;
+  const glm::dvec3 &GetDiffuse(TMaterialId id) const {
+    AssertValidId(id);
+    return diffuseColors[id];
+  }
+
+  double GetShininess(TMaterialId id) const {
+    AssertValidId(id);
+    return shininess[id];
+  }
+
+  TTextureId GetDiffuseTexture(TMaterialId id) const {
+    AssertValidId(id);
+    return diffuseTextures[id];
   }
 
 private:
-  std::unordered_map<std::string, Material> materials;
+  void AssertValidId(TMaterialId id) const {
+    assert(id < names.size() && "Material id out of bounds!");
+    (void)id;
+  }
+
+  // Name -> id.
+  std::unordered_map<std::string, TMaterialId> ids;
+
+  // Id -> values. All vectors have the same size.
+  std::vector<std::string> names;
+  std::vector<glm::dvec3> ambientColors;
+  std::vector<glm::dvec3> specularColors;
+  std::vector<glm::dvec3> diffuseColors;
+  std::vector<double> shininess;
+  std::vector<TTextureId> diffuseTextures;
+
+  bool frozen;
 };
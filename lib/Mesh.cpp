@@ -1,118 +1,150 @@
 #include "Mesh.h"
 
-// === MeshVertex struct ===
-MeshVertex::MeshVertex(const Mesh *parent, glm::dvec3 p, glm::dvec3 n)
-  : point(p)
-  , normal(n)
-  , faceIndexes()
-  , parentMesh(parent)
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+bool IntersectTriangle(const Ray &ray, const glm::dvec3 &V0,
+                       const glm::dvec3 &V1, const glm::dvec3 &V2,
+                       double &d, double &u, double &v)
 {
-  assert(parent && "Parent mesh of MeshVertex is null!");
+  // Epsilon for floating-point comparisons.
+  const double EPS = 1.0e-6;
+
+  auto E1 = V1 - V0;
+  auto E2 = V2 - V0;
+  auto P = glm::cross(ray.GetDirection(), E2);
+  double det = glm::dot(E1, P);
+  double invDet = 1.0 / det;
+
+  if (det > -EPS && det < EPS)
+    return false; // No intersection.
+
+  auto T = ray.GetOrigin() - V0;
+  u = glm::dot(T, P) * invDet;
+  if (u < 0.0 || u > 1.0)
+    return false; // No intersection.
+
+  auto Q = glm::cross(T, E1);
+  v = glm::dot(ray.GetDirection(), Q) * invDet;
+  if (v < 0.0 || u + v > 1.0)
+    return false; // No intersection.
+
+  d = glm::dot(E2, Q) * invDet;
+  return d >= EPS;
 }
 
 
-void MeshVertex::CalculateNormal()
+void SetTriangleTexCoord(IntersectionResult &hit, const glm::dvec3 P[3],
+                         const glm::dvec2 T[3], double u, double v)
 {
-  if (faceIndexes.empty())
-    return;
+  // Coordinates change uniformly over the face: by the square root of
+  // its area in texture space over its area in space.
+  glm::dvec2 D1 = T[1] - T[0];
+  glm::dvec2 D2 = T[2] - T[0];
+  double uvArea = std::abs(D1.x * D2.y - D1.y * D2.x);
+  double area = glm::length(glm::cross(P[1] - P[0], P[2] - P[0]));
+  hit.SetTexCoord((1.0 - u - v) * T[0] + u * T[1] + v * T[2],
+                  area > 0.0 ? std::sqrt(uvArea / area) : 0.0);
+}
 
-  if (glm::length(normal) > 1.0e-5)
-    return;
 
-  glm::dvec3 resultNormal(0.0, 0.0, 0.0);
+MeshIndexWidth GetMeshIndexWidth(std::size_t numVertexes)
+{
+  // Indexes of n vertexes are at most n - 1.
+  if (numVertexes <= std::size_t(std::numeric_limits<std::uint16_t>::max()) + 1)
+    return MeshIndexWidth::Bits16;
+  if (numVertexes - 1 <= std::numeric_limits<std::uint32_t>::max())
+    return MeshIndexWidth::Bits32;
+  return MeshIndexWidth::Bits64;
+}
 
-  assert(parentMesh && "Parent mesh of MeshVertex is null!");
-  for (const auto meshIdx : faceIndexes) {
-    glm::dvec3 currentNormal = parentMesh->GetFaces()[meshIdx].GetNormalVectorCross();
-    resultNormal = glm::normalize(resultNormal + currentNormal);
-  }
 
-  normal = resultNormal;
+// === MeshVertex struct ===
+MeshVertex::MeshVertex(glm::dvec3 p, glm::dvec3 n)
+  : point(p)
+  , normal(n)
+  , texCoord(0.0, 0.0)
+{
 }
 
 
-// === MeshFace struct ===
-MeshFace::MeshFace(TMeshIndex idx1,
-                   TMeshIndex idx2,
-                   TMeshIndex idx3,
-                   const Material *mat,
-                   const Mesh *parent)
+// === BasicMeshFace struct ===
+template <typename TIndex>
+BasicMeshFace<TIndex>::BasicMeshFace(TMeshIndex idx1,
+                                     TMeshIndex idx2,
+                                     TMeshIndex idx3,
+                                     TMaterialId mat)
   : material(mat)
-  , parentMesh(parent)
 {
-  assert(parentMesh && "Parent mesh of MeshFace is null!");
   // A face can only be constructed from pairwise-dfferent vertexes.
   assert(idx1 != idx2 && idx1 != idx3 && idx2 != idx3 &&
          "Cannot construct a face from less than 3 different vertexes!");
-  vertexIndexes[0] = idx1;
-  vertexIndexes[1] = idx2;
-  vertexIndexes[2] = idx3;
+  assert(std::max(idx1, std::max(idx2, idx3)) <=
+         std::numeric_limits<TIndex>::max() &&
+         "Vertex index doesn't fit the face's index width!");
+  vertexIndexes[0] = static_cast<TIndex>(idx1);
+  vertexIndexes[1] = static_cast<TIndex>(idx2);
+  vertexIndexes[2] = static_cast<TIndex>(idx3);
 }
 
 
-const MeshVertex& MeshFace::GetVertex(TMeshIndex idx) const
+template <typename TIndex>
+const MeshVertex& BasicMeshFace<TIndex>::GetVertex(const Mesh &mesh,
+                                                   TMeshIndex idx) const
 {
   assert(idx <= 2 && "Vertex index in face out of bounds!");
-  return parentMesh->GetVertexes()[vertexIndexes[idx]];
+  return mesh.GetVertexes()[vertexIndexes[idx]];
 }
 
 
-IntersectionResult MeshFace::Intersect(const Ray &ray) const
+template <typename TIndex>
+IntersectionResult BasicMeshFace<TIndex>::Intersect(const Mesh &mesh,
+                                                    const Ray &ray) const
 {
   #ifndef NDEBUG
   ray.AssertNormalized();
   #endif // !NDEBUG
 
-  // Epsilon for floating-point comparisons.
-  const double EPS = 1.0e-6;
   // Vertexes that form this face.
-  auto V0 = GetVertex(0).point;
-  auto V1 = GetVertex(1).point;
-  auto V2 = GetVertex(2).point;
+  const glm::dvec3 P[3] = { GetVertex(mesh, 0).point,
+                            GetVertex(mesh, 1).point,
+                            GetVertex(mesh, 2).point };
   // Resulting values.
   double d, u, v;
-
-  auto E1 = V1 - V0;
-  auto E2 = V2 - V0;
-  auto P = glm::cross(ray.GetDirection(), E2);
-  double det = glm::dot(E1, P);
-  double invDet = 1.0 / det;
-
-  if (det > -EPS && det < EPS)
-    return IntersectionResult(); // No intersection.
-
-  auto T = ray.GetOrigin() - V0;
-  u = glm::dot(T, P) * invDet;
-  if (u < 0.0 || u > 1.0)
-    return IntersectionResult(); // No intersection.
-
-  auto Q = glm::cross(T, E1);
-  v = glm::dot(ray.GetDirection(), Q) * invDet;
-  if (v < 0.0 || u + v > 1.0)
+  if (!IntersectTriangle(ray, P[0], P[1], P[2], d, u, v))
     return IntersectionResult(); // No intersection.
 
-  d = glm::dot(E2, Q) * invDet;
-  if (d < EPS)
-    return IntersectionResult();
-
-  return IntersectionResult(ray, d, GetNormalVector(u, v), material); // Intersection.
+  // Intersection.
+  IntersectionResult result(ray, d, GetNormalVector(mesh, u, v), material);
+  if (mesh.HasTexCoords()) {
+    const glm::dvec2 T[3] = { GetVertex(mesh, 0).texCoord,
+                              GetVertex(mesh, 1).texCoord,
+                              GetVertex(mesh, 2).texCoord };
+    SetTriangleTexCoord(result, P, T, u, v);
+  }
+  return result;
 }
 
 
-glm::dvec3 MeshFace::GetNormalVector(double u, double v) const
+template <typename TIndex>
+glm::dvec3 BasicMeshFace<TIndex>::GetNormalVector(const Mesh &mesh,
+                                                  double u, double v) const
 {
-  assert(parentMesh && "Parent mesh of MeshFace is null!");
-  return parentMesh->GetInterpolateNormals()
-    ? GetNormalVectorInterpolated(u, v)
-    : GetNormalVectorCross();
+  return mesh.GetInterpolateNormals()
+    ? GetNormalVectorInterpolated(mesh, u, v)
+    : GetNormalVectorCross(mesh);
 }
 
 
-glm::dvec3 MeshFace::GetNormalVectorInterpolated(double u, double v) const
+template <typename TIndex>
+glm::dvec3
+BasicMeshFace<TIndex>::GetNormalVectorInterpolated(const Mesh &mesh,
+                                                   double u, double v) const
 {
-  auto V0 = GetVertex(0).normal;
-  auto V1 = GetVertex(1).normal;
-  auto V2 = GetVertex(2).normal;
+  auto V0 = GetVertex(mesh, 0).normal;
+  auto V1 = GetVertex(mesh, 1).normal;
+  auto V2 = GetVertex(mesh, 2).normal;
 
 #ifndef NDEBUG
   const double EPS = 1.0e-6;
@@ -126,21 +158,23 @@ glm::dvec3 MeshFace::GetNormalVectorInterpolated(double u, double v) const
 }
 
 
-glm::dvec3 MeshFace::GetNormalVectorCross() const
+template <typename TIndex>
+glm::dvec3 BasicMeshFace<TIndex>::GetNormalVectorCross(const Mesh &mesh) const
 {
-  auto P0 = GetVertex(0).point;
-  auto P1 = GetVertex(1).point;
-  auto P2 = GetVertex(2).point;
+  auto P0 = GetVertex(mesh, 0).point;
+  auto P1 = GetVertex(mesh, 1).point;
+  auto P2 = GetVertex(mesh, 2).point;
 
   return glm::normalize(glm::cross(P0 - P1, P2 - P1));
 }
 
 
-double MeshFace::GetSquare() const
+template <typename TIndex>
+double BasicMeshFace<TIndex>::GetSquare(const Mesh &mesh) const
 {
-  auto P0 = GetVertex(0).point;
-  auto P1 = GetVertex(1).point;
-  auto P2 = GetVertex(2).point;
+  auto P0 = GetVertex(mesh, 0).point;
+  auto P1 = GetVertex(mesh, 1).point;
+  auto P2 = GetVertex(mesh, 2).point;
 
   double a = glm::length(P2 - P0);
   double b = glm::length(P1 - P0);
@@ -151,10 +185,87 @@ double MeshFace::GetSquare() const
 }
 
 
+template struct BasicMeshFace<std::uint16_t>;
+template struct BasicMeshFace<std::uint32_t>;
+template struct BasicMeshFace<std::uint64_t>;
+
+
 // === Mesh ===
+template <>
+std::vector<MeshFace16> &Mesh::Faces<std::uint16_t>() { return faces16; }
+template <>
+std::vector<MeshFace32> &Mesh::Faces<std::uint32_t>() { return faces32; }
+template <>
+std::vector<MeshFace64> &Mesh::Faces<std::uint64_t>() { return faces64; }
+template <>
+const std::vector<MeshFace16> &Mesh::Faces<std::uint16_t>() const
+{
+  return faces16;
+}
+template <>
+const std::vector<MeshFace32> &Mesh::Faces<std::uint32_t>() const
+{
+  return faces32;
+}
+template <>
+const std::vector<MeshFace64> &Mesh::Faces<std::uint64_t>() const
+{
+  return faces64;
+}
+
+
+template <typename TIndex, typename TWiderIndex>
+void Mesh::WidenFaces()
+{
+  std::vector<BasicMeshFace<TIndex>> &from = Faces<TIndex>();
+  std::vector<BasicMeshFace<TWiderIndex>> &to = Faces<TWiderIndex>();
+  to.reserve(from.size());
+  for (const auto &face : from)
+    to.push_back(BasicMeshFace<TWiderIndex>(face));
+  std::vector<BasicMeshFace<TIndex>>().swap(from);
+}
+
+
+MeshFace Mesh::GetFace(TMeshIndex idx) const
+{
+  assert(idx < GetNumFaces() && "Face index out of bounds!");
+  switch (indexWidth) {
+  case MeshIndexWidth::Bits16:
+    return MeshFace(faces16[idx]);
+  case MeshIndexWidth::Bits32:
+    return MeshFace(faces32[idx]);
+  case MeshIndexWidth::Bits64:
+    return faces64[idx];
+  }
+  return faces64[idx];
+}
+
+
+std::size_t Mesh::GetNumFaces() const
+{
+  return faces16.size() + faces32.size() + faces64.size();
+}
+
+
+std::size_t Mesh::GetFaceBytes() const
+{
+  return faces16.capacity() * sizeof(MeshFace16) +
+         faces32.capacity() * sizeof(MeshFace32) +
+         faces64.capacity() * sizeof(MeshFace64);
+}
+
+
 TMeshIndex Mesh::AddVertex(const glm::dvec3 &p, const glm::dvec3 &n)
 {
-  vertexes.push_back(MeshVertex(this, p, n));
+  vertexes.push_back(MeshVertex(p, n));
+  MeshIndexWidth width = GetMeshIndexWidth(vertexes.size());
+  if (width != indexWidth) {
+    if (indexWidth == MeshIndexWidth::Bits16)
+      WidenFaces<std::uint16_t, std::uint32_t>();
+    if (width == MeshIndexWidth::Bits64)
+      WidenFaces<std::uint32_t, std::uint64_t>();
+    indexWidth = width;
+  }
   return vertexes.size() - 1;
 }
 
@@ -172,16 +283,22 @@ TMeshIndex
 Mesh::AddFace(TMeshIndex idx1,
               TMeshIndex idx2,
               TMeshIndex idx3,
-              const Material *mat)
+              TMaterialId mat)
 {
-  faces.push_back(MeshFace(idx1, idx2, idx3, mat, this));
-  TMeshIndex newFaceIndex = faces.size() - 1;
-  // Add current face index to its vertexes.
-  vertexes[idx1].faceIndexes.insert(newFaceIndex);
-  vertexes[idx2].faceIndexes.insert(newFaceIndex);
-  vertexes[idx3].faceIndexes.insert(newFaceIndex);
-
-  return newFaceIndex;
+  assert(idx1 < vertexes.size() && idx2 < vertexes.size() &&
+         idx3 < vertexes.size() && "Vertex index out of bounds!");
+  switch (indexWidth) {
+  case MeshIndexWidth::Bits16:
+    faces16.push_back(MeshFace16(idx1, idx2, idx3, mat));
+    break;
+  case MeshIndexWidth::Bits32:
+    faces32.push_back(MeshFace32(idx1, idx2, idx3, mat));
+    break;
+  case MeshIndexWidth::Bits64:
+    faces64.push_back(MeshFace64(idx1, idx2, idx3, mat));
+    break;
+  }
+  return GetNumFaces() - 1;
 }
 
 
@@ -196,7 +313,7 @@ Mesh::AddQuadFace(TMeshIndex idx1, TMeshIndex idx2,
 std::pair<TMeshIndex, TMeshIndex>
 Mesh::AddQuadFace(TMeshIndex idx1, TMeshIndex idx2,
                   TMeshIndex idx3, TMeshIndex idx4,
-                  const Material *mat)
+                  TMaterialId mat)
 {
   TMeshIndex i1 = AddFace(idx1, idx2, idx3, mat);
   TMeshIndex i2 = AddFace(idx1, idx3, idx4, mat);
@@ -204,18 +321,61 @@ Mesh::AddQuadFace(TMeshIndex idx1, TMeshIndex idx2,
 
 }
 
+void Mesh::SetTexCoord(TMeshIndex idx, const glm::dvec2 &uv)
+{
+  assert(idx < vertexes.size() && "Vertex index out of bounds!");
+  vertexes[idx].texCoord = uv;
+  hasTexCoords = true;
+}
+
+
+template <typename TIndex>
+void Mesh::AccumulateNormals()
+{
+  // Vertexes without a normal get the normalized sum of the flat normals
+  // of their faces, accumulated in the order of the faces. Vertexes
+  // without faces keep theirs.
+  enum : std::uint8_t { Keep, Calculate, Accumulate };
+  std::vector<std::uint8_t> state(vertexes.size());
+  for (std::size_t v = 0; v < vertexes.size(); ++v)
+    state[v] = glm::length(vertexes[v].normal) > 1.0e-5 ? Keep : Calculate;
+
+  for (const auto &face : Faces<TIndex>()) {
+    glm::dvec3 normal = face.GetNormalVectorCross(*this);
+    for (TIndex idx : face.vertexIndexes) {
+      if (state[idx] == Keep)
+        continue;
+      glm::dvec3 sum = state[idx] == Accumulate ?
+                       vertexes[idx].normal + normal : normal;
+      vertexes[idx].normal = glm::normalize(sum);
+      state[idx] = Accumulate;
+    }
+  }
+}
+
+
 void Mesh::CalculateNormals()
 {
-  for (auto &v : vertexes)
-    v.CalculateNormal();
+  switch (indexWidth) {
+  case MeshIndexWidth::Bits16:
+    AccumulateNormals<std::uint16_t>();
+    break;
+  case MeshIndexWidth::Bits32:
+    AccumulateNormals<std::uint32_t>();
+    break;
+  case MeshIndexWidth::Bits64:
+    AccumulateNormals<std::uint64_t>();
+    break;
+  }
 }
 
 
-IntersectionResult Mesh::Intersect(const Ray &ray) const
+template <typename TIndex>
+IntersectionResult Mesh::IntersectFaces(const Ray &ray) const
 {
   IntersectionResult finalResult;
-  for (const auto &face : faces) {
-    IntersectionResult currentResult = face.Intersect(ray);
+  for (const auto &face : Faces<TIndex>()) {
+    IntersectionResult currentResult = face.Intersect(*this, ray);
     if (currentResult &&
         (!finalResult || currentResult < finalResult)) {
       finalResult = currentResult;
@@ -224,3 +384,17 @@ IntersectionResult Mesh::Intersect(const Ray &ray) const
 
   return finalResult;
 }
+
+
+IntersectionResult Mesh::Intersect(const Ray &ray) const
+{
+  switch (indexWidth) {
+  case MeshIndexWidth::Bits16:
+    return IntersectFaces<std::uint16_t>(ray);
+  case MeshIndexWidth::Bits32:
+    return IntersectFaces<std::uint32_t>(ray);
+  case MeshIndexWidth::Bits64:
+    return IntersectFaces<std::uint64_t>(ray);
+  }
+  return IntersectionResult();
+}
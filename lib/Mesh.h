@@ -5,108 +5,150 @@
 #include "IntersectionResult.h"
 #include "Object3d.h"
 #include "Material.h"
-#include <set>
+#include <cstdint>
 #include <vector>
 
 // Forward-declaration of class Mesh.
 class Mesh;
 
-// Type of an abstract index.
-using TMeshIndex = unsigned int;
+// Type of an abstract index of a vertex or a face in Mesh's interface,
+// wide enough for any mesh. Faces store narrower ones (MeshIndexWidth).
+using TMeshIndex = std::uint64_t;
+
+// Width of the vertex indexes stored by the faces of a mesh.
+enum class MeshIndexWidth {
+  Bits16,
+  Bits32,
+  Bits64,
+};
+
+// Narrowest width indexing \p numVertexes vertexes.
+MeshIndexWidth GetMeshIndexWidth(std::size_t numVertexes);
+
+// Ray intersection test of triangle (\p V0, \p V1, \p V2), Moller-Trumbore.
+// Returns true if \p ray hits it in front of its origin: \p d is the
+// distance of the hit and \p u and \p v its barycentric coordinates
+// (weights of V1 and V2).
+bool IntersectTriangle(const Ray &ray, const glm::dvec3 &V0,
+                       const glm::dvec3 &V1, const glm::dvec3 &V2,
+                       double &d, double &u, double &v);
+
+// Set texture coordinates of \p hit at (\p u, \p v) on the triangle of
+// points \p P and texture coordinates \p T.
+void SetTriangleTexCoord(IntersectionResult &hit, const glm::dvec3 P[3],
+                         const glm::dvec2 T[3], double u, double v);
 
 // Struct representing a vertex in mesh.
 // MeshVertex manages:
 //   1. Its 3D coordinates;
 //   2. Its normal vector (normalized, i. e. of length 1);
-//   3. A set of indexes of adjacent faces.
+//   3. Its texture coordinates.
 //
 // Normally in a mesh each vertex has at least 1 adjacent face.
 struct MeshVertex {
-  MeshVertex(const Mesh *parent,
-             glm::dvec3 p = glm::dvec3(0.0, 0.0, 0.0),
-             glm::dvec3 n = glm::dvec3(0.0, 0.0, 0.0));
-
-  // Calculate normal vector from adjacent faces.
-  // For each adjacent face use its flat normal (cross product),
-  // resulting normal vector is normalized weighted sum of faces' normals.
-  void CalculateNormal();
+  explicit MeshVertex(glm::dvec3 p = glm::dvec3(0.0, 0.0, 0.0),
+                      glm::dvec3 n = glm::dvec3(0.0, 0.0, 0.0));
 
   // 3D coordinates of the vertex.
   glm::dvec3 point;
   // Normal vector (of length 1).
   glm::dvec3 normal;
-  // Vector of indexes of adjacent faces.
-  std::set<TMeshIndex> faceIndexes;
-
-  // Pointer to a Mesh this face belongs to. Used to access faces.
-  const Mesh *parentMesh;
+  // Texture coordinates, used if the mesh has them.
+  glm::dvec2 texCoord;
 };
 
 
-// Struct representing a (triangle) face in mesh.
-// MeshFace manages:
+// Struct representing a (triangle) face in mesh, with vertex indexes of
+// type TIndex.
+// BasicMeshFace manages:
 //   1. A set of vertexes that form it;
 //   2. Intersection with a ray.
 //   3. Calculation of normal vectors that form a smooth vector field.
+// Faces hold only indexes and a material: methods which need the vertexes
+// take the mesh \p mesh the face belongs to.
 // TODO:
 //   1. <some other useful info>.
-struct MeshFace {
-  MeshFace(TMeshIndex idx1,
-           TMeshIndex idx2,
-           TMeshIndex idx3,
-           const Material *mat,
-           const Mesh *parent);
+template <typename TIndex>
+struct BasicMeshFace {
+  BasicMeshFace(TMeshIndex idx1,
+                TMeshIndex idx2,
+                TMeshIndex idx3,
+                TMaterialId mat);
+
+  // Same face with indexes of another width.
+  template <typename TOtherIndex>
+  explicit BasicMeshFace(const BasicMeshFace<TOtherIndex> &other) :
+    material(other.material) {
+    for (unsigned v = 0; v < VertexesInFace; ++v)
+      vertexIndexes[v] = static_cast<TIndex>(other.vertexIndexes[v]);
+  }
 
   // Ray intersection test.
   // Implements Mller-Trumbore intersection algorithm.
-  IntersectionResult Intersect(const Ray &ray) const;
+  IntersectionResult Intersect(const Mesh &mesh, const Ray &ray) const;
 
   // Returns a normal vector in a given point, represented by
   // its barycentric coordinates (returned by hasIntersection method).
   // Normals form a smooth vector field.
-  glm::dvec3 GetNormalVector(double u, double v) const;
-  glm::dvec3 GetNormalVectorInterpolated(double u, double v) const;
-  glm::dvec3 GetNormalVectorCross() const;
+  glm::dvec3 GetNormalVector(const Mesh &mesh, double u, double v) const;
+  glm::dvec3 GetNormalVectorInterpolated(const Mesh &mesh,
+                                         double u, double v) const;
+  glm::dvec3 GetNormalVectorCross(const Mesh &mesh) const;
 
   // Get square of the triangle.
-  double GetSquare() const;
+  double GetSquare(const Mesh &mesh) const;
 
   // Get one of 3 vertexes that form this face.
   // Index \p idx must be in range of [0..2].
-  const MeshVertex& GetVertex(TMeshIndex idx) const;
-  const MeshVertex& operator[](TMeshIndex idx) const {
-    return GetVertex(idx);
-  }
+  const MeshVertex& GetVertex(const Mesh &mesh, TMeshIndex idx) const;
 
   static const unsigned int VertexesInFace = 3;
 
   // Array of indexes of vertexes that form this face.
-  TMeshIndex vertexIndexes[VertexesInFace];
+  TIndex vertexIndexes[VertexesInFace];
 
   // Material.
-  const Material *material;
-
-  // Pointer to a Mesh this face belongs to. Used to access vertexes.
-  const Mesh *parentMesh;
+  TMaterialId material;
 };
 
+// Faces as stored by meshes of each index width (8, 16 and 32 bytes),
+// and with indexes of the interface's width.
+using MeshFace16 = BasicMeshFace<std::uint16_t>;
+using MeshFace32 = BasicMeshFace<std::uint32_t>;
+using MeshFace64 = BasicMeshFace<std::uint64_t>;
+using MeshFace = BasicMeshFace<TMeshIndex>;
+
 
 // Class representing an arbitrary mesh.
+//
+// Faces store their vertex indexes with the narrowest width indexing the
+// mesh's vertexes: 16 bits up to 65536 of them, then 32, then 64. The
+// width grows as vertexes are added (faces are converted once per step).
+// Intersection and normal calculation are compiled for every width.
 class Mesh : public IObject3D {
 public:
-  Mesh(bool interpolate, const Material *mat) :
-    interpolateNormals(interpolate), material(mat) {}
+  Mesh(bool interpolate, TMaterialId mat) :
+    interpolateNormals(interpolate), hasTexCoords(false),
+    indexWidth(MeshIndexWidth::Bits16), material(mat) {}
 
 public:
   using TVertexes = std::vector<MeshVertex>;
-  using TFaces = std::vector<MeshFace>;
 
   bool GetInterpolateNormals() const { return interpolateNormals; }
+  bool HasTexCoords() const { return hasTexCoords; }
+  // Material of faces added without one.
+  TMaterialId GetMaterial() const { return material; }
   const TVertexes& GetVertexes() const { return vertexes; }
-  const TFaces&    GetFaces() const { return faces; }
+
+  // Face \p idx, with indexes of the interface's width.
+  MeshFace GetFace(TMeshIndex idx) const;
 
   std::size_t GetNumVertexes() const { return vertexes.size(); }
-  std::size_t GetNumFaces() const { return faces.size(); }
+  std::size_t GetNumFaces() const;
+
+  MeshIndexWidth GetIndexWidth() const { return indexWidth; }
+  // Memory held by the faces.
+  std::size_t GetFaceBytes() const;
 
   TMeshIndex AddVertex(const glm::dvec3 &p,
                        const glm::dvec3 &n = glm::dvec3(0.0, 0.0, 0.0));
@@ -118,7 +160,7 @@ public:
   TMeshIndex AddFace(TMeshIndex idx1,
                      TMeshIndex idx2,
                      TMeshIndex idx3,
-                     const Material *mat);
+                     TMaterialId mat);
 
   // Add quad face (ccw).
   // Adds two triangle faces (ccw) and returns their indexes.
@@ -131,7 +173,11 @@ public:
   std::pair<TMeshIndex, TMeshIndex>
   AddQuadFace(TMeshIndex idx1, TMeshIndex idx2,
               TMeshIndex idx3, TMeshIndex idx4,
-              const Material *mat);
+              TMaterialId mat);
+
+  // Set texture coordinates of vertex \p idx. Once any vertex has them,
+  // hits carry coordinates interpolated over their face.
+  void SetTexCoord(TMeshIndex idx, const glm::dvec2 &uv);
 
   // Calculate normals for each vertex.
   void CalculateNormals();
@@ -139,11 +185,31 @@ public:
   IntersectionResult Intersect(const Ray &ray) const override;
 
 private:
+  // Faces of index type TIndex.
+  template <typename TIndex>
+  std::vector<BasicMeshFace<TIndex>> &Faces();
+  template <typename TIndex>
+  const std::vector<BasicMeshFace<TIndex>> &Faces() const;
+
+  // Convert faces from TIndex to TWiderIndex.
+  template <typename TIndex, typename TWiderIndex>
+  void WidenFaces();
+
+  template <typename TIndex>
+  IntersectionResult IntersectFaces(const Ray &ray) const;
+  template <typename TIndex>
+  void AccumulateNormals();
+
   // Flag indicating whether normal vectors are interpolated or not.
   bool interpolateNormals;
+  bool hasTexCoords;
 
   TVertexes vertexes;
-  TFaces faces;
+  // Faces of indexWidth; the others are empty.
+  MeshIndexWidth indexWidth;
+  std::vector<MeshFace16> faces16;
+  std::vector<MeshFace32> faces32;
+  std::vector<MeshFace64> faces64;
 
-  const Material *material;
+  TMaterialId material;
 };
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+
+// Morton (Z-order) codes. Points which are close in space get close codes,
+// so sorting by the code groups spatially coherent items together.
+
+// Spread lower 10 bits of \p v so that there are two zero bits between
+// every two consecutive bits.
+inline std::uint32_t MortonExpandBits(std::uint32_t v) {
+  v &= 0x3FF;
+  v = (v | (v << 16)) & 0x030000FF;
+  v = (v | (v << 8))  & 0x0300F00F;
+  v = (v | (v << 4))  & 0x030C30C3;
+  v = (v | (v << 2))  & 0x09249249;
+  return v;
+}
+
+// 30-bit Morton code of a point with 10-bit integer coordinates.
+inline std::uint32_t MortonCode3D(std::uint32_t x, std::uint32_t y,
+                                  std::uint32_t z) {
+  return (MortonExpandBits(x) << 2) | (MortonExpandBits(y) << 1) |
+         MortonExpandBits(z);
+}
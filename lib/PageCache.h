@@ -0,0 +1,225 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+class PageLoader;
+class PageMissScope;
+
+// PageMissScope::Current(), and a miss of page \p page of \p owner
+// recorded by \p scope, whose load gets the scope's loader. Defined with
+// PageMissScope: PageLoader.h includes Texture.h, which includes this.
+PageMissScope *CurrentPageMissScope();
+void DeferPageMiss(PageMissScope *scope, const void *owner, std::uint64_t page,
+                   const std::function<void(PageLoader *)> &load);
+
+// Pages of paged data (texture tiles, mesh clusters) read when first
+// needed, and kept under a memory budget shared by all of them: when a read
+// exceeds it, the least recently used pages are evicted.
+//
+// Lookups may be made from any number of threads. Pages are added before
+// lookups start. Lookups made under a PageMissScope with a loader don't
+// read pages which aren't resident, they request them from the loader.
+template <typename TPage>
+class PageCache {
+public:
+  explicit PageCache(std::size_t budget);
+  PageCache(const PageCache &other) = delete;
+  PageCache& operator= (const PageCache &other) = delete;
+
+  // Add \p count pages, none resident. Returns the index of the first.
+  std::size_t AddPages(std::size_t count);
+
+  // Page \p index. If it isn't resident, \p read(bytes) is called under the
+  // page's lock, and returns the page and sets bytes to its size. If a
+  // PageMissScope defers the read, \p missing is returned instead and
+  // \p reload(loader) requested from the scope's loader: it reads the page
+  // with a blocking Get(). \p hit tells whether the page was resident.
+  template <typename TRead, typename TReload>
+  std::shared_ptr<const TPage> Get(std::size_t index, TRead read,
+                                   TReload reload,
+                                   const std::shared_ptr<const TPage> &missing,
+                                   bool &hit) const;
+
+  // Evict all pages.
+  void Clear();
+
+public:
+  std::size_t GetNumPages() const { return slots.size(); }
+  // Memory taken by the residency of pages, resident or not.
+  std::size_t GetSlotBytes() const { return slots.size() * sizeof(Slot); }
+
+  // A smaller budget is enforced by the next read.
+  void SetBudget(std::size_t b) { budget = b; }
+  std::size_t GetBudget() const { return budget; }
+  std::size_t GetResidentBytes() const { return residentBytes; }
+
+  // Pages evicted to stay within the budget.
+  std::uint64_t GetNumEvictions() const { return evictions; }
+  void ResetNumEvictions() { evictions = 0; }
+
+private:
+  // A page and its residency. page and bytes are only accessed under
+  // mutex; resident and lastUse are also read by eviction without it.
+  struct Slot {
+    Slot() : bytes(0), resident(false), lastUse(0) {}
+    std::mutex mutex;
+    std::shared_ptr<const TPage> page;
+    std::size_t bytes;
+    std::atomic<bool> resident;
+    std::atomic<std::uint64_t> lastUse;
+  };
+
+  // Evict least recently used pages until the cache is under 7/8 of the
+  // budget. If another thread is already evicting, it's left to that
+  // thread, which evicts again once it's done.
+  void Evict() const;
+
+  std::size_t budget;
+  // Slots don't move when pages are added.
+  mutable std::deque<Slot> slots;
+
+  mutable std::atomic<std::size_t> residentBytes;
+  // Incremented by every read.
+  mutable std::atomic<std::uint64_t> useClock;
+  mutable std::mutex evictionMutex;
+  // Set by threads which found another one evicting.
+  mutable std::atomic<bool> evictionPending;
+  mutable std::atomic<std::uint64_t> evictions;
+};
+
+
+template <typename TPage>
+PageCache<TPage>::PageCache(std::size_t b)
+  : budget(b), residentBytes(0), useClock(0), evictionPending(false),
+    evictions(0)
+{
+}
+
+
+template <typename TPage>
+std::size_t PageCache<TPage>::AddPages(std::size_t count)
+{
+  std::size_t first = slots.size();
+  for (std::size_t i = 0; i < count; ++i)
+    slots.emplace_back();
+  return first;
+}
+
+
+template <typename TPage>
+template <typename TRead, typename TReload>
+std::shared_ptr<const TPage>
+PageCache<TPage>::Get(std::size_t index, TRead read, TReload reload,
+                      const std::shared_ptr<const TPage> &missing,
+                      bool &hit) const
+{
+  assert(index < slots.size() && "Page index out of bounds!");
+  Slot &slot = slots[index];
+  hit = false;
+  PageMissScope *scope = CurrentPageMissScope();
+  // Not even locked: the loader may be holding the lock while it reads.
+  if (scope && !slot.resident) {
+    DeferPageMiss(scope, this, index, reload);
+    return missing;
+  }
+
+  std::shared_ptr<const TPage> page;
+  bool overBudget = false;
+  {
+    std::lock_guard<std::mutex> lock(slot.mutex);
+    hit = static_cast<bool>(slot.page);
+    if (hit) {
+      // Stores only when reads happened since: hot pages stay in the
+      // cache of every thread using them.
+      std::uint64_t now = useClock.load(std::memory_order_relaxed);
+      if (slot.lastUse.load(std::memory_order_relaxed) != now)
+        slot.lastUse.store(now, std::memory_order_relaxed);
+      return slot.page;
+    }
+    // Evicted since it was checked.
+    if (scope) {
+      DeferPageMiss(scope, this, index, reload);
+      return missing;
+    }
+
+    std::size_t bytes = 0;
+    page = read(bytes);
+    slot.page = page;
+    slot.bytes = bytes;
+    slot.lastUse.store(++useClock, std::memory_order_relaxed);
+    slot.resident = true;
+    overBudget = (residentBytes += bytes) > budget;
+  }
+
+  if (overBudget)
+    Evict();
+  return page;
+}
+
+
+template <typename TPage>
+void PageCache<TPage>::Clear()
+{
+  for (Slot &slot : slots) {
+    slot.page.reset();
+    slot.resident = false;
+  }
+  residentBytes = 0;
+}
+
+
+template <typename TPage>
+void PageCache<TPage>::Evict() const
+{
+  // The evicting thread checks for evictions left to it after unlocking:
+  // one requested while it held the lock is never lost.
+  evictionPending = true;
+  while (evictionPending) {
+    std::unique_lock<std::mutex> lock(evictionMutex, std::try_to_lock);
+    if (!lock.owns_lock())
+      return;
+    evictionPending = false;
+
+    // Pages read by other threads meanwhile aren't among the candidates of
+    // a pass: pass again until under the target.
+    std::size_t target = budget / 8 * 7;
+    bool evicted = true;
+    while (residentBytes > target && evicted) {
+      std::vector<std::pair<std::uint64_t, Slot *>> candidates;
+      for (Slot &slot : slots) {
+        if (slot.resident)
+          candidates.push_back(std::make_pair(slot.lastUse.load(), &slot));
+      }
+      std::sort(candidates.begin(), candidates.end(),
+                [](const std::pair<std::uint64_t, Slot *> &a,
+                   const std::pair<std::uint64_t, Slot *> &b) {
+                  return a.first < b.first;
+                });
+
+      evicted = false;
+      for (const std::pair<std::uint64_t, Slot *> &candidate : candidates) {
+        if (residentBytes <= target)
+          break;
+        Slot &slot = *candidate.second;
+        std::lock_guard<std::mutex> slotLock(slot.mutex);
+        if (!slot.page)
+          continue;
+        slot.page.reset();
+        slot.resident = false;
+        residentBytes -= slot.bytes;
+        ++evictions;
+        evicted = true;
+      }
+    }
+  }
+}
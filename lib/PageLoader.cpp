@@ -0,0 +1,124 @@
+#include "PageLoader.h"
+
+#include <cassert>
+
+namespace {
+
+// Innermost PageMissScope of every thread.
+thread_local PageMissScope *currentScope = nullptr;
+
+} // anonymous namespace
+
+
+// === PageLoader ===
+PageLoader::PageLoader() :
+  lastTicket(0), completed(0), stopping(false)
+{
+  thread = std::thread(&PageLoader::Run, this);
+}
+
+
+PageLoader::~PageLoader()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  requested.notify_all();
+  thread.join();
+}
+
+
+PageLoader::TTicket PageLoader::Request(const void *owner, std::uint64_t page,
+                                        std::function<void()> load)
+{
+  std::pair<const void*, std::uint64_t> key(owner, page);
+  TTicket ticket;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = pending.find(key);
+    if (it != pending.end())
+      return it->second;
+    queue.push_back(Load{ key, std::move(load) });
+    ticket = pending[key] = ++lastTicket;
+  }
+  requested.notify_one();
+  return ticket;
+}
+
+
+void PageLoader::Wait(TTicket ticket)
+{
+  if (IsDone(ticket))
+    return;
+  std::unique_lock<std::mutex> lock(mutex);
+  done.wait(lock, [&]() { return IsDone(ticket); });
+}
+
+
+void PageLoader::Run()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  for (;;) {
+    requested.wait(lock, [&]() { return stopping || !queue.empty(); });
+    if (queue.empty())
+      return;
+    Load load = std::move(queue.front());
+    queue.pop_front();
+    lock.unlock();
+    load.load();
+    lock.lock();
+    // Still pending while it's being made: requests made meanwhile get
+    // its ticket rather than a second load.
+    pending.erase(load.page);
+    ++completed;
+    done.notify_all();
+  }
+}
+
+
+// === PageMissScope ===
+PageMissScope::PageMissScope(PageLoader *l) :
+  loader(l), previous(currentScope), missed(false), ticket(0)
+{
+  currentScope = this;
+}
+
+
+PageMissScope::~PageMissScope()
+{
+  assert(currentScope == this && "Page miss scopes must nest!");
+  currentScope = previous;
+}
+
+
+PageMissScope *PageMissScope::Current()
+{
+  return currentScope && currentScope->loader ? currentScope : nullptr;
+}
+
+
+void PageMissScope::Miss(const void *owner, std::uint64_t page,
+                         std::function<void()> load)
+{
+  assert(loader && "Page miss without a loader!");
+  PageLoader::TTicket t = loader->Request(owner, page, std::move(load));
+  missed = true;
+  if (t > ticket)
+    ticket = t;
+}
+
+
+// === PageCache ===
+PageMissScope *CurrentPageMissScope()
+{
+  return PageMissScope::Current();
+}
+
+
+void DeferPageMiss(PageMissScope *scope, const void *owner, std::uint64_t page,
+                   const std::function<void(PageLoader *)> &load)
+{
+  PageLoader *loader = scope->GetLoader();
+  scope->Miss(owner, page, [load, loader]() { load(loader); });
+}
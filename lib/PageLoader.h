@@ -0,0 +1,105 @@
+#pragma once
+
+#include "Texture.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+// Loads of paged data (mesh clusters, texture tiles) made on a background
+// thread, so threads which need a page that isn't resident can do other
+// work meanwhile.
+//
+// Loads are made one at a time, in request order: a load is done once
+// every load requested before it is. The pages' own files serialize reads
+// anyway.
+class PageLoader {
+public:
+  // Position of a load in the order of requests.
+  using TTicket = std::uint64_t;
+
+  PageLoader();
+  // Makes the pending loads, then stops the thread.
+  ~PageLoader();
+  PageLoader(const PageLoader &other) = delete;
+  PageLoader& operator= (const PageLoader &other) = delete;
+
+  // Queue \p load, which reads page \p page of \p owner, unless a load of
+  // it is already queued. Returns the ticket of the load.
+  TTicket Request(const void *owner, std::uint64_t page,
+                  std::function<void()> load);
+
+  // Whether load \p ticket (and all before it) is done.
+  bool IsDone(TTicket ticket) const { return completed >= ticket; }
+
+  // Wait until load \p ticket is done.
+  void Wait(TTicket ticket);
+
+public:
+  std::uint64_t GetNumLoads() const { return completed; }
+
+  // Texture tiles read by loads. Only written by the loader thread: read
+  // it when no loads are pending.
+  TextureStats &GetTextureStats() { return textures; }
+
+private:
+  struct Load {
+    std::pair<const void*, std::uint64_t> page;
+    std::function<void()> load;
+  };
+
+  void Run();
+
+  std::mutex mutex;
+  std::condition_variable requested;
+  std::condition_variable done;
+  std::deque<Load> queue;
+  // Ticket of every queued load.
+  std::map<std::pair<const void*, std::uint64_t>, TTicket> pending;
+  TTicket lastTicket;
+  std::atomic<TTicket> completed;
+  bool stopping;
+  TextureStats textures;
+  std::thread thread;
+};
+
+// While a PageMissScope with a loader is alive, lookups of paged data made
+// by its thread don't wait for pages which aren't resident: they request
+// them from the loader and go on as if the page were empty (a cluster with
+// no faces, black texels), and the scope records the miss. Whatever was
+// computed from those lookups must then be discarded, and computed again
+// once the page is loaded (IsDone(GetTicket())).
+//
+// Scopes may nest; the innermost one is current.
+class PageMissScope {
+public:
+  // With a null \p loader, lookups block as without a scope.
+  explicit PageMissScope(PageLoader *loader);
+  ~PageMissScope();
+  PageMissScope(const PageMissScope &other) = delete;
+  PageMissScope& operator= (const PageMissScope &other) = delete;
+
+  // Scope of the calling thread which defers page misses, or null if
+  // lookups must block.
+  static PageMissScope *Current();
+
+  // Page \p page of \p owner isn't resident: request \p load.
+  void Miss(const void *owner, std::uint64_t page, std::function<void()> load);
+
+public:
+  PageLoader *GetLoader() const { return loader; }
+  bool Missed() const { return missed; }
+  // Ticket of the last miss: all pages missed are loaded once it's done.
+  PageLoader::TTicket GetTicket() const { return ticket; }
+
+private:
+  PageLoader *loader;
+  PageMissScope *previous;
+  bool missed;
+  PageLoader::TTicket ticket;
+};
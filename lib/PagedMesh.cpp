@@ -0,0 +1,832 @@
+#include "PagedMesh.h"
+#include "PageLoader.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+// File layout: header, clusters, then the directory (a PagedClusterInfo
+// per cluster). Every cluster is a ClusterHeader followed by its BVH
+// nodes, vertex points and normals, texture coordinates (if it has them),
+// then 3 vertex indexes and a material per face. Quantized clusters have
+// a QuantizationHeader after the ClusterHeader, and their points and
+// normals (if interpolated) are packed. Clusters of meshlets have their
+// meshlets (and an end marker) after the texture coordinates, and 8-bit
+// vertex indexes.
+const std::uint32_t Magic = 0x48534D50; // "PMSH"
+const std::uint32_t Version = 3;
+
+struct FileHeader {
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint32_t numClusters;
+  std::uint32_t reserved;
+  std::uint64_t directoryOffset;
+};
+
+struct ClusterHeader {
+  std::uint32_t numVertexes;
+  std::uint32_t numFaces;
+  std::uint32_t numNodes;
+  std::uint32_t flags;
+  std::uint32_t numMeshlets;
+  std::uint32_t reserved;
+};
+
+const std::uint32_t InterpolateNormalsFlag = 1;
+const std::uint32_t TexCoordsFlag = 2;
+const std::uint32_t Quantized16Flag = 4;
+const std::uint32_t Quantized21Flag = 8;
+const std::uint32_t MeshletsFlag = 16;
+
+// Grid of a quantized cluster's points: see Cluster.
+struct QuantizationHeader {
+  double origin[3];
+  double step;
+  std::int64_t cell[3];
+};
+
+VertexFormat GetVertexFormat(std::uint32_t flags)
+{
+  if (flags & Quantized16Flag)
+    return VertexFormat::Quantized16;
+  if (flags & Quantized21Flag)
+    return VertexFormat::Quantized21;
+  return VertexFormat::Exact;
+}
+
+// Bits per coordinate of quantized points.
+unsigned QuantizationBits(VertexFormat format)
+{
+  return format == VertexFormat::Quantized16 ? 16 : 21;
+}
+
+// Bytes of a cluster of \p header's sizes.
+std::size_t ClusterBytes(const ClusterHeader &header)
+{
+  std::size_t headerBytes = sizeof(ClusterHeader), vertexBytes = 0;
+  switch (GetVertexFormat(header.flags)) {
+  case VertexFormat::Exact:
+    vertexBytes = 2 * sizeof(glm::dvec3);
+    break;
+  case VertexFormat::Quantized16:
+  case VertexFormat::Quantized21:
+    headerBytes += sizeof(QuantizationHeader);
+    vertexBytes = header.flags & Quantized16Flag ? 3 * sizeof(std::uint16_t) :
+                                                  sizeof(std::uint64_t);
+    if (header.flags & InterpolateNormalsFlag)
+      vertexBytes += sizeof(std::uint32_t);
+    break;
+  }
+  if (header.flags & TexCoordsFlag)
+    vertexBytes += sizeof(glm::dvec2);
+  std::size_t indexBytes = sizeof(std::uint32_t);
+  if (header.flags & MeshletsFlag) {
+    headerBytes += (header.numMeshlets + 1) * sizeof(PagedMeshlet);
+    indexBytes = sizeof(std::uint8_t);
+  }
+  return headerBytes + header.numNodes * sizeof(BvhNode) +
+         header.numVertexes * vertexBytes +
+         header.numFaces * (3 * indexBytes + sizeof(TMaterialId));
+}
+
+
+// \p x in [-1, 1] as a 16-bit signed normalized value.
+std::uint16_t PackSnorm16(double x)
+{
+  return static_cast<std::uint16_t>(static_cast<std::int16_t>(
+    std::lround(std::min(std::max(x, -1.0), 1.0) * 32767.0)));
+}
+
+
+double UnpackSnorm16(std::uint16_t x)
+{
+  return std::max(static_cast<std::int16_t>(x) / 32767.0, -1.0);
+}
+
+
+// Unit vector \p n folded onto the octahedron |x| + |y| + |z| = 1, whose
+// lower half is unfolded over the corners of the square, as two snorms.
+std::uint32_t PackOctahedral(const glm::dvec3 &n)
+{
+  glm::dvec2 p = glm::dvec2(n.x, n.y) / (std::abs(n.x) + std::abs(n.y) + std::abs(n.z));
+  if (n.z < 0.0) {
+    p = glm::dvec2((1.0 - std::abs(p.y)) * (p.x >= 0.0 ? 1.0 : -1.0),
+                   (1.0 - std::abs(p.x)) * (p.y >= 0.0 ? 1.0 : -1.0));
+  }
+  return PackSnorm16(p.x) | static_cast<std::uint32_t>(PackSnorm16(p.y)) << 16;
+}
+
+
+glm::dvec3 UnpackOctahedral(std::uint32_t packed)
+{
+  glm::dvec2 p(UnpackSnorm16(static_cast<std::uint16_t>(packed)),
+               UnpackSnorm16(static_cast<std::uint16_t>(packed >> 16)));
+  glm::dvec3 n(p.x, p.y, 1.0 - std::abs(p.x) - std::abs(p.y));
+  double fold = std::max(-n.z, 0.0);
+  n.x += n.x >= 0.0 ? -fold : fold;
+  n.y += n.y >= 0.0 ? -fold : fold;
+  return glm::normalize(n);
+}
+
+
+const std::uint64_t Mask21 = (std::uint64_t(1) << 21) - 1;
+
+
+// Split faces [\p first, \p last) (positions into the triples of vertexes
+// \p indexes, with centers \p centers) into meshlets: halves at the median
+// center along the longest axis of the centers' bounds, until they have
+// few enough faces and vertexes. The end of every meshlet (relative to
+// \p base) is appended to \p ends.
+void SplitMeshlets(const std::vector<std::uint32_t> &indexes,
+                   const std::vector<glm::dvec3> &centers, std::uint32_t *first,
+                   std::uint32_t *last, const std::uint32_t *base,
+                   std::vector<std::uint32_t> &ends)
+{
+  std::size_t count = last - first;
+  if (count <= MaxMeshletFaces) {
+    std::vector<std::uint32_t> used;
+    for (const std::uint32_t *f = first; f != last; ++f)
+      used.insert(used.end(), &indexes[3 * *f], &indexes[3 * *f] + 3);
+    std::sort(used.begin(), used.end());
+    if (std::unique(used.begin(), used.end()) - used.begin() <= MaxMeshletVertexes) {
+      ends.push_back(static_cast<std::uint32_t>(last - base));
+      return;
+    }
+  }
+
+  glm::dvec3 low = centers[*first], high = low;
+  for (const std::uint32_t *f = first; f != last; ++f) {
+    low = glm::min(low, centers[*f]);
+    high = glm::max(high, centers[*f]);
+  }
+  glm::dvec3 size = high - low;
+  int axis = size.x >= size.y && size.x >= size.z ? 0 : (size.y >= size.z ? 1 : 2);
+  std::uint32_t *middle = first + count / 2;
+  std::nth_element(first, middle, last, [&](std::uint32_t a, std::uint32_t b) {
+    return centers[a][axis] < centers[b][axis];
+  });
+  SplitMeshlets(indexes, centers, first, middle, base, ends);
+  SplitMeshlets(indexes, centers, middle, last, base, ends);
+}
+
+
+// Copy the next elements of \p out's size from \p in.
+template <typename T>
+void Read(const std::uint8_t *&in, std::vector<T> &out)
+{
+  std::memcpy(out.data(), in, out.size() * sizeof(T));
+  in += out.size() * sizeof(T);
+}
+
+
+template <typename T>
+std::size_t VectorBytes(const std::vector<T> &v)
+{
+  return v.capacity() * sizeof(T);
+}
+
+} // anonymous namespace
+
+
+// === PagedMeshWriter ===
+PagedMeshWriter::PagedMeshWriter(const PagedMeshSettings &s)
+  : settings(s), gridOrigin(0.0), gridStep(1.0), file(nullptr), ok(false),
+    fileOffset(0), numFaces(0)
+{
+  assert(settings.clusterFaces > 0 && settings.leafFaces > 0 &&
+         "Invalid paged mesh settings!");
+}
+
+
+PagedMeshWriter::~PagedMeshWriter()
+{
+  Close();
+}
+
+
+bool PagedMeshWriter::Open(const std::string &path)
+{
+  assert(!file && "Paged mesh writer is already open!");
+  file = std::fopen(path.c_str(), "wb");
+  if (!file)
+    return false;
+
+  ok = true;
+  fileOffset = 0;
+  numFaces = 0;
+  directory.clear();
+  // Placeholder, completed by Close().
+  FileHeader header = FileHeader();
+  Write(&header, sizeof(header));
+  return true;
+}
+
+
+void PagedMeshWriter::AddMesh(const Mesh &mesh)
+{
+  assert(file && "Paged mesh writer isn't open!");
+  std::size_t numMeshFaces = mesh.GetNumFaces();
+  std::vector<glm::dvec3> faceMin(numMeshFaces), faceMax(numMeshFaces);
+  for (std::size_t f = 0; f < numMeshFaces; ++f) {
+    MeshFace face = mesh.GetFace(f);
+    faceMin[f] = faceMax[f] = face.GetVertex(mesh, 0).point;
+    for (unsigned v = 1; v < MeshFace::VertexesInFace; ++v) {
+      faceMin[f] = glm::min(faceMin[f], face.GetVertex(mesh, v).point);
+      faceMax[f] = glm::max(faceMax[f], face.GetVertex(mesh, v).point);
+    }
+  }
+
+  // Clusters are the leaves of a BVH over the mesh's faces.
+  std::vector<BvhNode> nodes;
+  std::vector<std::uint32_t> order;
+  BuildBvh(faceMin, faceMax, settings.clusterFaces, nodes, order);
+
+  // The grid spans the largest cluster with 2^bits - 2 steps: a cluster's
+  // points are at most 2^bits - 1 steps from its corner cell once snapped.
+  if (settings.vertexFormat != VertexFormat::Exact && numMeshFaces) {
+    gridOrigin = faceMin[0];
+    double extent = 0.0;
+    for (const BvhNode &node : nodes) {
+      if (!node.IsLeaf())
+        continue;
+      glm::dvec3 leafMin = faceMin[order[node.index]], leafMax = faceMax[order[node.index]];
+      for (std::uint32_t i = node.index + 1; i < node.index + node.count; ++i) {
+        leafMin = glm::min(leafMin, faceMin[order[i]]);
+        leafMax = glm::max(leafMax, faceMax[order[i]]);
+      }
+      gridOrigin = glm::min(gridOrigin, leafMin);
+      glm::dvec3 size = leafMax - leafMin;
+      extent = std::max(extent, std::max(size.x, std::max(size.y, size.z)));
+    }
+    unsigned bits = QuantizationBits(settings.vertexFormat);
+    gridStep = extent > 0.0 ? extent / ((std::uint64_t(1) << bits) - 2) : 1.0;
+  }
+  for (const BvhNode &node : nodes) {
+    if (node.IsLeaf())
+      WriteCluster(mesh, &order[node.index], node.count);
+  }
+  numFaces += numMeshFaces;
+}
+
+
+bool PagedMeshWriter::Close()
+{
+  if (!file)
+    return ok;
+
+  FileHeader header = FileHeader();
+  header.magic = Magic;
+  header.version = Version;
+  header.numClusters = static_cast<std::uint32_t>(directory.size());
+  header.directoryOffset = fileOffset;
+  Write(directory.data(), directory.size() * sizeof(PagedClusterInfo));
+  if (ok && (std::fseek(file, 0, SEEK_SET) != 0 ||
+             std::fwrite(&header, sizeof(header), 1, file) != 1))
+    ok = false;
+
+  if (std::fclose(file) != 0)
+    ok = false;
+  file = nullptr;
+  directory.clear();
+  return ok;
+}
+
+
+void PagedMeshWriter::WriteCluster(const Mesh &mesh, const std::uint32_t *faces,
+                                   std::uint32_t count)
+{
+  const Mesh::TVertexes &meshVertexes = mesh.GetVertexes();
+  bool quantized = settings.vertexFormat != VertexFormat::Exact;
+  bool use16 = settings.vertexFormat == VertexFormat::Quantized16;
+
+  // Vertexes of the cluster's faces, sorted by their index in the mesh.
+  std::vector<TMeshIndex> vertexes;
+  for (std::uint32_t f = 0; f < count; ++f) {
+    MeshFace face = mesh.GetFace(faces[f]);
+    vertexes.insert(vertexes.end(), face.vertexIndexes,
+                    face.vertexIndexes + MeshFace::VertexesInFace);
+  }
+  std::sort(vertexes.begin(), vertexes.end());
+  vertexes.erase(std::unique(vertexes.begin(), vertexes.end()), vertexes.end());
+
+  std::vector<glm::dvec3> points;
+  for (TMeshIndex v : vertexes)
+    points.push_back(meshVertexes[v].point);
+
+  // Quantized: points snapped to the grid, the cluster's corner being its
+  // lowest cell of every axis. The snapped points are the cluster's.
+  QuantizationHeader grid = QuantizationHeader();
+  std::vector<std::int64_t> offsets;
+  if (quantized) {
+    std::vector<std::int64_t> cells(3 * points.size());
+    for (unsigned a = 0; a < 3; ++a) {
+      grid.origin[a] = gridOrigin[a];
+      grid.cell[a] = std::numeric_limits<std::int64_t>::max();
+      for (std::size_t i = 0; i < points.size(); ++i) {
+        cells[3 * i + a] = std::llround((points[i][a] - gridOrigin[a]) / gridStep);
+        grid.cell[a] = std::min(grid.cell[a], cells[3 * i + a]);
+      }
+    }
+    grid.step = gridStep;
+
+    const std::int64_t maxOffset = (std::int64_t(1) << QuantizationBits(settings.vertexFormat)) - 1;
+    for (std::size_t i = 0; i < points.size(); ++i) {
+      for (unsigned a = 0; a < 3; ++a) {
+        std::int64_t offset = cells[3 * i + a] - grid.cell[a];
+        assert(offset <= maxOffset && "Cluster is larger than the grid allows!");
+        offset = std::min(offset, maxOffset);
+        offsets.push_back(offset);
+        points[i][a] = gridOrigin[a] + static_cast<double>(grid.cell[a] + offset) * gridStep;
+      }
+    }
+  }
+
+  // Faces as local vertex indexes.
+  std::vector<std::uint32_t> faceIndexes;
+  std::vector<glm::dvec3> faceMin(count), faceMax(count);
+  for (std::uint32_t f = 0; f < count; ++f) {
+    MeshFace face = mesh.GetFace(faces[f]);
+    for (unsigned v = 0; v < MeshFace::VertexesInFace; ++v) {
+      std::uint32_t local = static_cast<std::uint32_t>(
+        std::lower_bound(vertexes.begin(), vertexes.end(),
+                         face.vertexIndexes[v]) - vertexes.begin());
+      faceIndexes.push_back(local);
+      faceMin[f] = v ? glm::min(faceMin[f], points[local]) : points[local];
+      faceMax[f] = v ? glm::max(faceMax[f], points[local]) : points[local];
+    }
+  }
+
+  // The cluster's own BVH, which orders its faces (or its meshlets), and
+  // the local vertex of every stored vertex.
+  std::vector<BvhNode> nodes;
+  std::vector<std::uint32_t> order, vertexOrder, faceOrder, indexes;
+  std::vector<PagedMeshlet> meshlets;
+  std::vector<std::uint8_t> localIndexes;
+  if (settings.meshlets) {
+    std::vector<std::uint32_t> grouped(count);
+    std::vector<glm::dvec3> centers(count);
+    for (std::uint32_t f = 0; f < count; ++f) {
+      grouped[f] = f;
+      centers[f] = 0.5 * (faceMin[f] + faceMax[f]);
+    }
+    std::vector<std::uint32_t> ends;
+    SplitMeshlets(faceIndexes, centers, grouped.data(), grouped.data() + count,
+                  grouped.data(), ends);
+
+    std::vector<glm::dvec3> groupMin, groupMax;
+    for (std::size_t g = 0; g < ends.size(); ++g) {
+      std::uint32_t first = g ? ends[g - 1] : 0;
+      groupMin.push_back(faceMin[grouped[first]]);
+      groupMax.push_back(faceMax[grouped[first]]);
+      for (std::uint32_t i = first + 1; i < ends[g]; ++i) {
+        groupMin.back() = glm::min(groupMin.back(), faceMin[grouped[i]]);
+        groupMax.back() = glm::max(groupMax.back(), faceMax[grouped[i]]);
+      }
+    }
+    BuildBvh(groupMin, groupMax, 1, nodes, order);
+
+    for (std::uint32_t g : order) {
+      std::uint32_t first = g ? ends[g - 1] : 0;
+      meshlets.push_back(PagedMeshlet{ static_cast<std::uint32_t>(vertexOrder.size()),
+                                       static_cast<std::uint32_t>(faceOrder.size()) });
+      std::vector<std::uint32_t> block;
+      for (std::uint32_t i = first; i < ends[g]; ++i)
+        block.insert(block.end(), &faceIndexes[3 * grouped[i]], &faceIndexes[3 * grouped[i]] + 3);
+      std::sort(block.begin(), block.end());
+      block.erase(std::unique(block.begin(), block.end()), block.end());
+      vertexOrder.insert(vertexOrder.end(), block.begin(), block.end());
+      for (std::uint32_t i = first; i < ends[g]; ++i) {
+        faceOrder.push_back(grouped[i]);
+        for (unsigned v = 0; v < 3; ++v) {
+          localIndexes.push_back(static_cast<std::uint8_t>(
+            std::lower_bound(block.begin(), block.end(),
+                             faceIndexes[3 * grouped[i] + v]) - block.begin()));
+        }
+      }
+    }
+    meshlets.push_back(PagedMeshlet{ static_cast<std::uint32_t>(vertexOrder.size()),
+                                     static_cast<std::uint32_t>(faceOrder.size()) });
+  } else {
+    BuildBvh(faceMin, faceMax, settings.leafFaces, nodes, order);
+    for (std::uint32_t v = 0; v < vertexes.size(); ++v)
+      vertexOrder.push_back(v);
+    for (std::uint32_t f : order) {
+      faceOrder.push_back(f);
+      indexes.insert(indexes.end(), &faceIndexes[3 * f], &faceIndexes[3 * f] + 3);
+    }
+  }
+
+  ClusterHeader header = ClusterHeader();
+  header.numVertexes = static_cast<std::uint32_t>(vertexOrder.size());
+  header.numFaces = count;
+  header.numNodes = static_cast<std::uint32_t>(nodes.size());
+  header.flags = (mesh.GetInterpolateNormals() ? InterpolateNormalsFlag : 0) |
+                 (mesh.HasTexCoords() ? TexCoordsFlag : 0);
+  if (quantized)
+    header.flags |= use16 ? Quantized16Flag : Quantized21Flag;
+  if (settings.meshlets) {
+    header.flags |= MeshletsFlag;
+    header.numMeshlets = static_cast<std::uint32_t>(meshlets.size() - 1);
+  }
+
+  // Stored vertexes.
+  std::vector<glm::dvec3> storedPoints, normals;
+  std::vector<glm::dvec2> texCoords;
+  std::vector<std::uint16_t> points16;
+  std::vector<std::uint64_t> points21;
+  std::vector<std::uint32_t> packedNormals;
+  for (std::uint32_t v : vertexOrder) {
+    const MeshVertex &vertex = meshVertexes[vertexes[v]];
+    texCoords.push_back(vertex.texCoord);
+    if (!quantized) {
+      storedPoints.push_back(vertex.point);
+      normals.push_back(vertex.normal);
+      continue;
+    }
+    const std::int64_t *offset = &offsets[3 * static_cast<std::size_t>(v)];
+    if (use16) {
+      for (unsigned a = 0; a < 3; ++a)
+        points16.push_back(static_cast<std::uint16_t>(offset[a]));
+    } else {
+      points21.push_back(static_cast<std::uint64_t>(offset[0]) |
+                         static_cast<std::uint64_t>(offset[1]) << 21 |
+                         static_cast<std::uint64_t>(offset[2]) << 42);
+    }
+    if (mesh.GetInterpolateNormals())
+      packedNormals.push_back(PackOctahedral(vertex.normal));
+  }
+  std::vector<TMaterialId> materials;
+  for (std::uint32_t f : faceOrder)
+    materials.push_back(mesh.GetFace(faces[f]).material);
+
+  PagedClusterInfo info;
+  std::copy(nodes[0].boundsMin, nodes[0].boundsMin + 3, info.boundsMin);
+  std::copy(nodes[0].boundsMax, nodes[0].boundsMax + 3, info.boundsMax);
+  info.offset = fileOffset;
+  info.bytes = static_cast<std::uint32_t>(ClusterBytes(header));
+  info.numFaces = count;
+  directory.push_back(info);
+
+  Write(&header, sizeof(header));
+  if (quantized)
+    Write(&grid, sizeof(grid));
+  Write(nodes.data(), nodes.size() * sizeof(BvhNode));
+  Write(storedPoints.data(), storedPoints.size() * sizeof(glm::dvec3));
+  Write(normals.data(), normals.size() * sizeof(glm::dvec3));
+  Write(points16.data(), points16.size() * sizeof(std::uint16_t));
+  Write(points21.data(), points21.size() * sizeof(std::uint64_t));
+  Write(packedNormals.data(), packedNormals.size() * sizeof(std::uint32_t));
+  if (header.flags & TexCoordsFlag)
+    Write(texCoords.data(), texCoords.size() * sizeof(glm::dvec2));
+  Write(meshlets.data(), meshlets.size() * sizeof(PagedMeshlet));
+  Write(indexes.data(), indexes.size() * sizeof(std::uint32_t));
+  Write(localIndexes.data(), localIndexes.size() * sizeof(std::uint8_t));
+  Write(materials.data(), materials.size() * sizeof(TMaterialId));
+}
+
+
+void PagedMeshWriter::Write(const void *data, std::size_t size)
+{
+  if (!ok || !size)
+    return;
+  if (std::fwrite(data, size, 1, file) != 1) {
+    ok = false;
+    return;
+  }
+  fileOffset += size;
+}
+
+
+// === PagedMesh ===
+PagedMesh::PagedMesh(std::size_t b)
+  : file(nullptr), numFaces(0), clusters(b), pageIns(0), bytesRead(0),
+    readNanoseconds(0)
+{
+}
+
+
+PagedMesh::~PagedMesh()
+{
+  if (file)
+    std::fclose(file);
+}
+
+
+bool PagedMesh::Open(const std::string &path)
+{
+  assert(!file && "Paged mesh is already open!");
+  std::FILE *f = std::fopen(path.c_str(), "rb");
+  if (!f)
+    return false;
+
+  FileHeader header;
+  std::vector<PagedClusterInfo> entries;
+  bool valid = std::fread(&header, sizeof(header), 1, f) == 1 &&
+               header.magic == Magic && header.version == Version &&
+               std::fseek(f, 0, SEEK_END) == 0;
+  long size = valid ? std::ftell(f) : 0;
+  valid = valid && header.directoryOffset >= sizeof(header) &&
+          header.directoryOffset + header.numClusters * sizeof(PagedClusterInfo) ==
+            static_cast<std::uint64_t>(size);
+  if (valid) {
+    entries.resize(header.numClusters);
+    valid = std::fseek(f, static_cast<long>(header.directoryOffset), SEEK_SET) == 0 &&
+            (entries.empty() ||
+             std::fread(entries.data(), entries.size() * sizeof(PagedClusterInfo),
+                        1, f) == 1);
+  }
+  // Truncated clusters would only fail when they're needed.
+  for (const PagedClusterInfo &entry : entries) {
+    valid = valid && entry.offset >= sizeof(header) &&
+            entry.offset + entry.bytes <= header.directoryOffset;
+  }
+  if (!valid) {
+    std::fclose(f);
+    return false;
+  }
+
+  file = f;
+  directory.swap(entries);
+  numFaces = 0;
+  std::vector<glm::dvec3> clusterMin(directory.size()), clusterMax(directory.size());
+  for (std::size_t c = 0; c < directory.size(); ++c) {
+    const PagedClusterInfo &entry = directory[c];
+    clusterMin[c] = glm::dvec3(entry.boundsMin[0], entry.boundsMin[1], entry.boundsMin[2]);
+    clusterMax[c] = glm::dvec3(entry.boundsMax[0], entry.boundsMax[1], entry.boundsMax[2]);
+    numFaces += entry.numFaces;
+  }
+  BuildBvh(clusterMin, clusterMax, 1, nodes, clusterOrder);
+  clusters.AddPages(directory.size());
+  return true;
+}
+
+
+IntersectionResult PagedMesh::Intersect(const Ray &ray) const
+{
+  #ifndef NDEBUG
+  ray.AssertNormalized();
+  #endif // !NDEBUG
+
+  IntersectionResult result;
+  double maxDistance = std::numeric_limits<double>::infinity();
+  TraverseBvh(nodes, ray, maxDistance,
+              [&](std::uint32_t first, std::uint32_t count) {
+    for (std::uint32_t i = first; i < first + count; ++i) {
+      std::shared_ptr<const Cluster> cluster = GetCluster(clusterOrder[i]);
+      if (cluster)
+        IntersectCluster(*cluster, ray, maxDistance, result);
+    }
+  });
+  return result;
+}
+
+
+void PagedMesh::Clear()
+{
+  clusters.Clear();
+}
+
+
+std::size_t PagedMesh::GetDirectoryBytes() const
+{
+  return VectorBytes(directory) + VectorBytes(nodes) + VectorBytes(clusterOrder) +
+         clusters.GetSlotBytes();
+}
+
+
+GeometryStats PagedMesh::GetStats() const
+{
+  GeometryStats stats;
+  stats.pageIns = pageIns;
+  stats.bytesRead = bytesRead;
+  stats.evictions = clusters.GetNumEvictions();
+  stats.readSeconds = readNanoseconds * 1.0e-9;
+  return stats;
+}
+
+
+void PagedMesh::ResetStats()
+{
+  pageIns = 0;
+  bytesRead = 0;
+  clusters.ResetNumEvictions();
+  readNanoseconds = 0;
+}
+
+
+std::shared_ptr<const PagedMesh::Cluster>
+PagedMesh::GetCluster(std::uint32_t index) const
+{
+  assert(index < directory.size() && "Cluster index out of bounds!");
+  bool hit;
+  return clusters.Get(index,
+    [&](std::size_t &bytes) -> std::shared_ptr<Cluster> {
+      std::shared_ptr<Cluster> cluster = ReadCluster(index);
+      bytes = cluster->bytes;
+      return cluster;
+    },
+    [this, index](PageLoader *) { GetCluster(index); },
+    nullptr, hit);
+}
+
+
+std::shared_ptr<PagedMesh::Cluster> PagedMesh::ReadCluster(std::uint32_t index) const
+{
+  auto start = std::chrono::steady_clock::now();
+  const PagedClusterInfo &entry = directory[index];
+  std::vector<std::uint8_t> data(entry.bytes);
+  bool valid;
+  {
+    std::lock_guard<std::mutex> fileLock(fileMutex);
+    valid = std::fseek(file, static_cast<long>(entry.offset), SEEK_SET) == 0 &&
+            std::fread(data.data(), data.size(), 1, file) == 1;
+  }
+
+  std::shared_ptr<Cluster> cluster = std::make_shared<Cluster>();
+  ClusterHeader header;
+  if (valid && data.size() >= sizeof(header)) {
+    std::memcpy(&header, data.data(), sizeof(header));
+    valid = ClusterBytes(header) == data.size() && header.numFaces == entry.numFaces;
+  } else {
+    valid = false;
+  }
+  // A cluster which can't be read is empty.
+  if (valid) {
+    const std::uint8_t *in = data.data() + sizeof(header);
+    cluster->format = GetVertexFormat(header.flags);
+    cluster->interpolateNormals = (header.flags & InterpolateNormalsFlag) != 0;
+    cluster->hasTexCoords = (header.flags & TexCoordsFlag) != 0;
+    if (cluster->format != VertexFormat::Exact) {
+      QuantizationHeader grid;
+      std::memcpy(&grid, in, sizeof(grid));
+      in += sizeof(grid);
+      cluster->gridOrigin = glm::dvec3(grid.origin[0], grid.origin[1], grid.origin[2]);
+      cluster->gridStep = grid.step;
+      std::copy(grid.cell, grid.cell + 3, cluster->gridCell);
+    }
+    cluster->nodes.resize(header.numNodes);
+    switch (cluster->format) {
+    case VertexFormat::Exact:
+      cluster->points.resize(header.numVertexes);
+      cluster->normals.resize(header.numVertexes);
+      break;
+    case VertexFormat::Quantized16:
+      cluster->points16.resize(3 * static_cast<std::size_t>(header.numVertexes));
+      break;
+    case VertexFormat::Quantized21:
+      cluster->points21.resize(header.numVertexes);
+      break;
+    }
+    if (cluster->format != VertexFormat::Exact && cluster->interpolateNormals)
+      cluster->packedNormals.resize(header.numVertexes);
+    cluster->texCoords.resize(cluster->hasTexCoords ? header.numVertexes : 0);
+    bool meshlets = (header.flags & MeshletsFlag) != 0;
+    cluster->meshlets.resize(meshlets ? header.numMeshlets + 1 : 0);
+    std::size_t numIndexes = 3 * static_cast<std::size_t>(header.numFaces);
+    cluster->indexes.resize(meshlets ? 0 : numIndexes);
+    cluster->localIndexes.resize(meshlets ? numIndexes : 0);
+    cluster->materials.resize(header.numFaces);
+    Read(in, cluster->nodes);
+    Read(in, cluster->points);
+    Read(in, cluster->normals);
+    Read(in, cluster->points16);
+    Read(in, cluster->points21);
+    Read(in, cluster->packedNormals);
+    Read(in, cluster->texCoords);
+    Read(in, cluster->meshlets);
+    Read(in, cluster->indexes);
+    Read(in, cluster->localIndexes);
+    Read(in, cluster->materials);
+    for (std::uint32_t i : cluster->indexes)
+      valid = valid && i < header.numVertexes;
+    // Meshlets must cover the faces and vertexes in order, and their
+    // indexes stay within them.
+    for (std::size_t m = 0; valid && m + 1 < cluster->meshlets.size(); ++m) {
+      const PagedMeshlet &meshlet = cluster->meshlets[m], &next = cluster->meshlets[m + 1];
+      valid = meshlet.firstVertex <= next.firstVertex &&
+              meshlet.firstFace <= next.firstFace &&
+              (m || (meshlet.firstVertex == 0 && meshlet.firstFace == 0));
+      for (std::size_t i = 3 * static_cast<std::size_t>(meshlet.firstFace);
+           valid && i < 3 * static_cast<std::size_t>(next.firstFace); ++i)
+        valid = cluster->localIndexes[i] < next.firstVertex - meshlet.firstVertex;
+    }
+    if (meshlets) {
+      valid = valid && cluster->meshlets.back().firstVertex == header.numVertexes &&
+              cluster->meshlets.back().firstFace == header.numFaces;
+    }
+  }
+  if (!valid)
+    *cluster = Cluster();
+  cluster->bytes = sizeof(Cluster) + VectorBytes(cluster->nodes) +
+                   VectorBytes(cluster->points) + VectorBytes(cluster->normals) +
+                   VectorBytes(cluster->points16) + VectorBytes(cluster->points21) +
+                   VectorBytes(cluster->packedNormals) +
+                   VectorBytes(cluster->texCoords) + VectorBytes(cluster->indexes) +
+                   VectorBytes(cluster->meshlets) + VectorBytes(cluster->localIndexes) +
+                   VectorBytes(cluster->materials);
+
+  ++pageIns;
+  bytesRead += data.size();
+  readNanoseconds += static_cast<std::uint64_t>(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start).count());
+  return cluster;
+}
+
+
+glm::dvec3 PagedMesh::Cluster::GetPoint(std::uint32_t v) const
+{
+  std::int64_t cell[3];
+  switch (format) {
+  case VertexFormat::Exact:
+    return points[v];
+  case VertexFormat::Quantized16:
+    for (unsigned a = 0; a < 3; ++a)
+      cell[a] = gridCell[a] + points16[3 * static_cast<std::size_t>(v) + a];
+    break;
+  case VertexFormat::Quantized21:
+    for (unsigned a = 0; a < 3; ++a)
+      cell[a] = gridCell[a] + static_cast<std::int64_t>((points21[v] >> (21 * a)) & Mask21);
+    break;
+  }
+  // The same cell gives the same point in every cluster.
+  return gridOrigin + glm::dvec3(static_cast<double>(cell[0]), static_cast<double>(cell[1]),
+                                 static_cast<double>(cell[2])) * gridStep;
+}
+
+
+glm::dvec3 PagedMesh::Cluster::GetNormal(std::uint32_t v) const
+{
+  return format == VertexFormat::Exact ? normals[v] : UnpackOctahedral(packedNormals[v]);
+}
+
+
+void PagedMesh::IntersectCluster(const Cluster &cluster, const Ray &ray,
+                                 double &maxDistance, IntersectionResult &hit)
+{
+  std::uint32_t hitFace = std::numeric_limits<std::uint32_t>::max();
+  std::uint32_t face[3] = { 0, 0, 0 };
+  double hitU = 0.0, hitV = 0.0;
+  auto intersectFace = [&](std::uint32_t f, std::uint32_t v0, std::uint32_t v1,
+                           std::uint32_t v2) {
+    double d, u, v;
+    if (IntersectTriangle(ray, cluster.GetPoint(v0), cluster.GetPoint(v1),
+                          cluster.GetPoint(v2), d, u, v) &&
+        d < maxDistance) {
+      maxDistance = d;
+      hitFace = f;
+      face[0] = v0;
+      face[1] = v1;
+      face[2] = v2;
+      hitU = u;
+      hitV = v;
+    }
+  };
+  if (cluster.meshlets.empty()) {
+    TraverseBvh(cluster.nodes, ray, maxDistance,
+                [&](std::uint32_t first, std::uint32_t count) {
+      for (std::uint32_t f = first; f < first + count; ++f) {
+        const std::uint32_t *indexes = &cluster.indexes[3 * static_cast<std::size_t>(f)];
+        intersectFace(f, indexes[0], indexes[1], indexes[2]);
+      }
+    });
+  } else {
+    TraverseBvh(cluster.nodes, ray, maxDistance,
+                [&](std::uint32_t first, std::uint32_t count) {
+      for (std::uint32_t m = first; m < first + count; ++m) {
+        std::uint32_t base = cluster.meshlets[m].firstVertex;
+        for (std::uint32_t f = cluster.meshlets[m].firstFace;
+             f < cluster.meshlets[m + 1].firstFace; ++f) {
+          const std::uint8_t *indexes = &cluster.localIndexes[3 * static_cast<std::size_t>(f)];
+          intersectFace(f, base + indexes[0], base + indexes[1], base + indexes[2]);
+        }
+      }
+    });
+  }
+  if (hitFace == std::numeric_limits<std::uint32_t>::max())
+    return;
+
+  // As MeshFace::Intersect().
+  const glm::dvec3 P[3] = { cluster.GetPoint(face[0]), cluster.GetPoint(face[1]),
+                            cluster.GetPoint(face[2]) };
+  glm::dvec3 normal;
+  if (cluster.interpolateNormals) {
+    normal = glm::normalize((1.0 - hitU - hitV) * cluster.GetNormal(face[0]) +
+                            hitU * cluster.GetNormal(face[1]) +
+                            hitV * cluster.GetNormal(face[2]));
+  } else {
+    normal = glm::normalize(glm::cross(P[0] - P[1], P[2] - P[1]));
+  }
+  hit = IntersectionResult(ray, maxDistance, normal, cluster.materials[hitFace]);
+  if (cluster.hasTexCoords) {
+    const glm::dvec2 T[3] = { cluster.texCoords[face[0]], cluster.texCoords[face[1]],
+                              cluster.texCoords[face[2]] };
+    SetTriangleTexCoord(hit, P, T, hitU, hitV);
+  }
+}
@@ -0,0 +1,249 @@
+#pragma once
+
+#include "Bvh.h"
+#include "Mesh.h"
+#include "Object3d.h"
+#include "PageCache.h"
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Paging activity of a PagedMesh.
+struct GeometryStats {
+  GeometryStats() :
+    pageIns(0), bytesRead(0), evictions(0), readSeconds(0.0) {}
+
+  // Clusters read from the file, their size, and clusters evicted.
+  std::uint64_t pageIns;
+  std::uint64_t bytesRead;
+  std::uint64_t evictions;
+
+  // Time spent reading clusters, summed over threads.
+  double readSeconds;
+};
+
+// Storage of the vertexes of a paged mesh's clusters.
+enum class VertexFormat {
+  // Points, normals and texture coordinates as doubles: 48 bytes plus 16
+  // for texture coordinates.
+  Exact,
+  // Points snapped to a grid and stored as 16 (or 21) bits per coordinate
+  // relative to their cluster's corner on it, normals octahedral-encoded
+  // into two 16-bit values (only for interpolated normals): 10 (or 12)
+  // bytes plus texture coordinates. The grid is shared by the clusters of
+  // a mesh, its step set by the largest cluster, so vertexes shared by
+  // clusters are the same in all of them and the surface stays
+  // watertight. Cluster bounds are those of the snapped points.
+  Quantized16,
+  Quantized21,
+};
+
+// Limits of a meshlet: its faces' vertexes are indexed with 8 bits.
+const unsigned MaxMeshletVertexes = 64;
+const unsigned MaxMeshletFaces = 128;
+
+struct PagedMeshSettings {
+  PagedMeshSettings() :
+    clusterFaces(1024), leafFaces(4), vertexFormat(VertexFormat::Exact),
+    meshlets(false) {}
+
+  // Faces of a mesh are split into spatial clusters of at most this many
+  // faces: the unit of paging.
+  unsigned clusterFaces;
+
+  // Leaves of the BVH of every cluster hold at most this many faces.
+  unsigned leafFaces;
+
+  VertexFormat vertexFormat;
+
+  // Split the faces of every cluster into meshlets: spatially coherent
+  // groups of at most MaxMeshletFaces faces over at most
+  // MaxMeshletVertexes vertexes, each with its own block of vertexes,
+  // which its faces index with 8 bits (rather than 32). Meshlets are the
+  // leaves of the cluster's BVH (leafFaces is ignored), so there are far
+  // fewer nodes, and a leaf's faces and vertexes are contiguous. Vertexes
+  // shared by meshlets are stored by each of them.
+  bool meshlets;
+};
+
+// Entry of the cluster directory of a paged mesh file: the cluster's
+// bounds (as those of BVH nodes), where it is and how many faces it has.
+struct PagedClusterInfo {
+  float boundsMin[3];
+  float boundsMax[3];
+  std::uint64_t offset;
+  std::uint32_t bytes;
+  std::uint32_t numFaces;
+};
+
+// Meshlet of a cluster: its vertexes and faces start at these, and end
+// where the next meshlet's start.
+struct PagedMeshlet {
+  std::uint32_t firstVertex;
+  std::uint32_t firstFace;
+};
+
+// Writes meshes to a file of spatial clusters, for PagedMesh.
+//
+// Every cluster is stored with its own vertexes and its faces in the order
+// of its BVH, whose nodes are stored too: a cluster is usable as soon as
+// it's read. Meshes are written cluster by cluster as they're added, so
+// only one of them needs to be in memory at a time, and the file may hold
+// more geometry than fits in memory.
+class PagedMeshWriter {
+public:
+  explicit PagedMeshWriter(const PagedMeshSettings &s = PagedMeshSettings());
+  // Close()s the file.
+  ~PagedMeshWriter();
+  PagedMeshWriter(const PagedMeshWriter &other) = delete;
+  PagedMeshWriter& operator= (const PagedMeshWriter &other) = delete;
+
+  // Create file \p path. Returns false if it can't be created.
+  bool Open(const std::string &path);
+
+  // Split the faces of \p mesh into clusters and write them.
+  void AddMesh(const Mesh &mesh);
+
+  // Write the cluster directory and close the file. Returns false if
+  // anything failed to be written.
+  bool Close();
+
+public:
+  std::size_t GetNumClusters() const { return directory.size(); }
+  std::uint64_t GetNumFaces() const { return numFaces; }
+
+private:
+  // Write the cluster of faces \p faces[0 .. count) of \p mesh.
+  void WriteCluster(const Mesh &mesh, const std::uint32_t *faces,
+                    std::uint32_t count);
+  void Write(const void *data, std::size_t size);
+
+  PagedMeshSettings settings;
+  // Quantization grid of the mesh being added: its point (i, j, k) is at
+  // gridOrigin + (i, j, k) * gridStep.
+  glm::dvec3 gridOrigin;
+  double gridStep;
+  std::FILE *file;
+  bool ok;
+  std::uint64_t fileOffset;
+  std::uint64_t numFaces;
+  std::vector<PagedClusterInfo> directory;
+};
+
+// Mesh paged in from a file written by PagedMeshWriter, a cluster at a time.
+//
+// The directory of clusters and a BVH over their bounds are resident. A
+// cluster is read when a ray first reaches its bounds, so only geometry
+// near rays is ever loaded. Resident clusters share a budget of bytes,
+// kept like TextureCache keeps its tiles: when a load takes the mesh over
+// the budget, the least recently used clusters are evicted down to 7/8
+// of it, and rays keep references to clusters they're intersecting.
+//
+// Intersect() may be called by any number of threads. Within a
+// PageMissScope, clusters which aren't resident are read by its loader
+// and treated as empty meanwhile.
+class PagedMesh : public IObject3D {
+public:
+  explicit PagedMesh(std::size_t budget = DefaultBudget);
+  ~PagedMesh() override;
+  PagedMesh(const PagedMesh &other) = delete;
+  PagedMesh& operator= (const PagedMesh &other) = delete;
+
+  // Open file \p path and read its directory. Returns false if it can't
+  // be read. No clusters are read yet.
+  bool Open(const std::string &path);
+
+  IntersectionResult Intersect(const Ray &ray) const override;
+
+  // Evict all clusters.
+  void Clear();
+
+public:
+  std::size_t GetNumClusters() const { return directory.size(); }
+  std::uint64_t GetNumFaces() const { return numFaces; }
+
+  // A smaller budget is enforced by the next load.
+  void SetBudget(std::size_t b) { clusters.SetBudget(b); }
+  std::size_t GetBudget() const { return clusters.GetBudget(); }
+  std::size_t GetResidentBytes() const { return clusters.GetResidentBytes(); }
+  // Bytes of the directory and the BVH over it, always resident.
+  std::size_t GetDirectoryBytes() const;
+
+  GeometryStats GetStats() const;
+  void ResetStats();
+
+  static const std::size_t DefaultBudget = std::size_t(1) << 30;
+
+private:
+  // Geometry of a cluster: vertexes, and faces (3 local vertex indexes
+  // each) in the order of the leaves of its BVH.
+  struct Cluster {
+    Cluster() :
+      format(VertexFormat::Exact), interpolateNormals(false),
+      hasTexCoords(false), gridStep(0.0), bytes(0) {}
+
+    // Point and normal of vertex \p v, decoded.
+    glm::dvec3 GetPoint(std::uint32_t v) const;
+    glm::dvec3 GetNormal(std::uint32_t v) const;
+
+    VertexFormat format;
+    bool interpolateNormals;
+    bool hasTexCoords;
+    std::vector<BvhNode> nodes;
+    // VertexFormat::Exact.
+    std::vector<glm::dvec3> points;
+    std::vector<glm::dvec3> normals;
+    // Quantized formats: grid points relative to the cluster's corner
+    // gridCell (3 values per vertex, or 21 bits each of one), on the grid
+    // of PagedMeshWriter. Octahedral normals.
+    glm::dvec3 gridOrigin;
+    double gridStep;
+    std::int64_t gridCell[3];
+    std::vector<std::uint16_t> points16;
+    std::vector<std::uint64_t> points21;
+    std::vector<std::uint32_t> packedNormals;
+    std::vector<glm::dvec2> texCoords;
+    // Without meshlets: 3 vertex indexes per face. With them: meshlets
+    // (and an end marker), and 3 indexes per face within its meshlet's
+    // vertexes.
+    std::vector<std::uint32_t> indexes;
+    std::vector<PagedMeshlet> meshlets;
+    std::vector<std::uint8_t> localIndexes;
+    std::vector<TMaterialId> materials;
+    // Memory held by the vectors above.
+    std::size_t bytes;
+  };
+
+  // Reference to cluster \p index, read if it isn't resident. Null if it
+  // isn't and a PageMissScope defers the read.
+  std::shared_ptr<const Cluster> GetCluster(std::uint32_t index) const;
+  // Read and decode cluster \p index. Empty if it can't be read.
+  std::shared_ptr<Cluster> ReadCluster(std::uint32_t index) const;
+
+  // Closest hit of \p ray with a face of \p cluster closer than
+  // \p maxDistance. If found, it's stored in \p hit and \p maxDistance
+  // lowered to its distance.
+  static void IntersectCluster(const Cluster &cluster, const Ray &ray,
+                               double &maxDistance, IntersectionResult &hit);
+
+  std::FILE *file;
+  // Serializes seeks and reads of file.
+  mutable std::mutex fileMutex;
+  std::uint64_t numFaces;
+
+  std::vector<PagedClusterInfo> directory;
+  // BVH over the bounds of the clusters, a cluster per leaf, and the
+  // clusters in the order of its leaves.
+  std::vector<BvhNode> nodes;
+  std::vector<std::uint32_t> clusterOrder;
+  // A page per cluster.
+  PageCache<Cluster> clusters;
+
+  mutable std::atomic<std::uint64_t> pageIns;
+  mutable std::atomic<std::uint64_t> bytesRead;
+  mutable std::atomic<std::uint64_t> readNanoseconds;
+};
@@ -0,0 +1,473 @@
+#include "PathTracer.h"
+#include "glm/gtc/constants.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+const double InvPi = glm::one_over_pi<double>();
+
+double MaxComponent(const glm::dvec3 &v) {
+  return std::max(v.r, std::max(v.g, v.b));
+}
+
+// Unit vectors \p t and \p b completing unit \p n to an orthonormal basis
+// (Duff et al., "Building an orthonormal basis, revisited").
+void OrthonormalBasis(const glm::dvec3 &n, glm::dvec3 &t, glm::dvec3 &b) {
+  double sign = std::copysign(1.0, n.z);
+  double a = -1.0 / (sign + n.z);
+  double c = n.x * n.y * a;
+  t = glm::dvec3(1.0 + sign * n.x * n.x * a, sign * c, -sign * n.x);
+  b = glm::dvec3(c, sign + n.y * n.y * a, -n.y);
+}
+
+// Direction at angle acos(\p cosine) to \p axis and azimuth 2 pi \p u.
+glm::dvec3 DirectionAround(const glm::dvec3 &axis, double cosine, double u) {
+  glm::dvec3 t, b;
+  OrthonormalBasis(axis, t, b);
+  double sine = std::sqrt(std::max(1.0 - cosine * cosine, 0.0));
+  double phi = glm::two_pi<double>() * u;
+  return sine * std::cos(phi) * t + sine * std::sin(phi) * b + cosine * axis;
+}
+
+// Angle a cone of rays spreads by when reflected by a cos^n lobe: about
+// the lobe's angular deviation (n = 1 for diffuse reflection).
+double LobeSpread(double exponent) {
+  return std::sqrt(2.0 / (exponent + 2.0));
+}
+
+// Sampler dimensions of a path: position within the pixel, then for every
+// bounce the fixed dimensions below followed by light picks.
+const std::uint32_t FirstBounceDimension = 2;
+
+enum BounceDimension : std::uint32_t {
+  LobeDimension,
+  DirectionDimension1,
+  DirectionDimension2,
+  EnvironmentDimension1,
+  EnvironmentDimension2,
+  RouletteDimension,
+  BounceDimensions
+};
+
+std::uint32_t FirstDimension(unsigned depth, unsigned samplesPerHit) {
+  return FirstBounceDimension + depth * (BounceDimensions + samplesPerHit);
+}
+
+// Sampler dimensions of a photon: light pick and direction, then for
+// every bounce the roulette decision and the reflected direction.
+const std::uint32_t EmissionDimensions = 3;
+const std::uint32_t PhotonBounceDimensions = 3;
+
+} // anonymous namespace
+
+
+// === Sampling ===
+glm::dvec3 SampleCosineHemisphere(const glm::dvec3 &normal, double u1,
+                                  double u2)
+{
+  return DirectionAround(normal, std::sqrt(1.0 - u1), u2);
+}
+
+
+glm::dvec3 SamplePhongLobe(const glm::dvec3 &axis, double exponent,
+                           double u1, double u2)
+{
+  // Inverse of the CDF of cos(alpha): 1 - cos^(n + 1).
+  return DirectionAround(axis, std::pow(1.0 - u1, 1.0 / (exponent + 1.0)), u2);
+}
+
+
+double PhongLobePdf(const glm::dvec3 &axis, double exponent,
+                    const glm::dvec3 &dir)
+{
+  double cosine = glm::dot(axis, dir);
+  if (cosine <= 0.0)
+    return 0.0;
+  return (exponent + 1.0) * 0.5 * InvPi * std::pow(cosine, exponent);
+}
+
+
+// === PathTracer ===
+
+// Modified Phong BRDF at a path vertex. \p tint multiplies the diffuse
+// color.
+struct PathTracer::Brdf {
+  Brdf(const MaterialManager &materials, TMaterialId mat,
+       const glm::dvec3 &n, const glm::dvec3 &v,
+       const glm::dvec3 &tint = glm::dvec3(1.0)) :
+    diffuse(materials.GetDiffuse(mat) * tint),
+    specular(materials.GetSpecular(mat)),
+    exponent(materials.GetShininess(mat)), normal(n),
+    mirror(2.0 * glm::dot(n, v) * n - v)
+  {
+    double diffuseWeight = diffuse.r + diffuse.g + diffuse.b;
+    double specularWeight = specular.r + specular.g + specular.b;
+    double total = diffuseWeight + specularWeight;
+    diffuseProbability = total > 0.0 ? diffuseWeight / total : 0.0;
+    black = total <= 0.0;
+  }
+
+  // Leave the diffuse lobe only.
+  void RemoveSpecular() {
+    specular = glm::dvec3(0.0);
+    diffuseProbability = 1.0;
+    black = diffuse.r + diffuse.g + diffuse.b <= 0.0;
+  }
+
+  // Leave the specular lobe only.
+  void RemoveDiffuse() {
+    diffuse = glm::dvec3(0.0);
+    diffuseProbability = 0.0;
+    black = specular.r + specular.g + specular.b <= 0.0;
+  }
+
+  // Specular lobe for light coming from \p dir, without the color.
+  double SpecularLobe(const glm::dvec3 &dir) const {
+    double cosine = glm::dot(mirror, dir);
+    if (cosine <= 0.0)
+      return 0.0;
+    return (exponent + 2.0) * 0.5 * InvPi * std::pow(cosine, exponent);
+  }
+
+  glm::dvec3 Eval(const glm::dvec3 &dir) const {
+    return diffuse * InvPi + specular * SpecularLobe(dir);
+  }
+
+  // Density of Sample() producing \p dir.
+  double Pdf(const glm::dvec3 &dir) const {
+    double cosine = std::max(glm::dot(normal, dir), 0.0);
+    return diffuseProbability * cosine * InvPi +
+           (1.0 - diffuseProbability) * PhongLobePdf(mirror, exponent, dir);
+  }
+
+  // Direction of the next path segment. Returns false if the BRDF is black
+  // or the direction points below the surface.
+  bool Sample(double uLobe, double u1, double u2, glm::dvec3 &dir) const {
+    if (black)
+      return false;
+    if (uLobe < diffuseProbability)
+      dir = SampleCosineHemisphere(normal, u1, u2);
+    else
+      dir = SamplePhongLobe(mirror, exponent, u1, u2);
+    return glm::dot(normal, dir) > 0.0;
+  }
+
+  glm::dvec3 diffuse;
+  glm::dvec3 specular;
+  double exponent;
+  glm::dvec3 normal;
+  glm::dvec3 mirror;
+  double diffuseProbability;
+  bool black;
+};
+
+
+glm::dvec3 PathTracer::Trace(const Ray &cameraRay, const glm::uvec2 &pixel,
+                             std::uint32_t index, RenderStats &stats,
+                             IntersectionResult *primaryHit) const
+{
+  const MaterialManager &materials = scene.GetMaterials();
+  glm::dvec3 background = scene.GetBackground();
+  bool environment = MaxComponent(background) > 0.0;
+
+  glm::dvec3 radiance(0.0);
+  glm::dvec3 throughput(1.0);
+  Ray ray = cameraRay;
+  // Densities of the BRDF and environment strategies of the direction of
+  // the current ray, for MIS if it escapes. Camera rays have none.
+  double brdfPdf = 0.0;
+  double environmentPdf = 0.0;
+  // The path went through a diffuse lobe: reflections of point lights by
+  // specular lobes from here on are in the caustic map.
+  bool afterDiffuse = false;
+
+  for (unsigned depth = 0;; ++depth) {
+    IntersectionResult hit = scene.Intersect(ray);
+    if (!hit) {
+      double weight = depth ? PowerHeuristic(brdfPdf, environmentPdf) : 1.0;
+      radiance += throughput * background * weight;
+      break;
+    }
+    if (depth == 0 && primaryHit)
+      *primaryHit = hit;
+
+    glm::dvec3 normal = hit.GetFacingNormal();
+    glm::dvec3 point = hit.GetIntersectionPoint() + RayBias * normal;
+    Brdf brdf(materials, hit.GetMaterialId(), normal, -ray.GetDirection(),
+              scene.GetDiffuseTint(hit, stats.textures));
+
+    std::uint32_t firstDim = FirstDimension(depth, settings.lightSamplesPerHit);
+    double u[BounceDimensions];
+    sampler.Generate(pixel, index, firstDim, BounceDimensions, u);
+
+    // Cached diffuse lighting at the camera ray's hit.
+    bool cached = false;
+    if (depth == 0 && cache && brdf.diffuseProbability > 0.0) {
+      glm::dvec3 irradiance;
+      cached = cache->Lookup(point, normal, irradiance);
+      if (cached)
+        radiance += throughput * brdf.diffuse * InvPi * irradiance;
+      else
+        ++stats.irradianceMisses;
+    }
+
+    // Next-event estimation.
+    Brdf lightBrdf = brdf;
+    if (caustics && afterDiffuse)
+      lightBrdf.RemoveSpecular();
+    radiance += throughput * SamplePointLights(lightBrdf, point, pixel, index,
+                                               firstDim + BounceDimensions,
+                                               stats);
+    if (cached)
+      brdf.RemoveDiffuse();
+    if (caustics && brdf.diffuseProbability > 0.0) {
+      const PhotonMapSettings &mapSettings = settings.photonMap;
+      radiance += throughput * brdf.diffuse * InvPi *
+                  caustics->EstimateIrradiance(hit.GetIntersectionPoint(), normal,
+                                               mapSettings.neighbours,
+                                               mapSettings.maxRadius);
+    }
+    if (environment && !brdf.black) {
+      glm::dvec3 dir = SampleCosineHemisphere(normal, u[EnvironmentDimension1],
+                                              u[EnvironmentDimension2]);
+      double cosine = glm::dot(normal, dir);
+      if (cosine > 0.0) {
+        ++stats.shadowRays;
+        if (!scene.IsOccluded(Ray(point, dir),
+                              std::numeric_limits<double>::infinity())) {
+          double pdf = cosine * InvPi;
+          double weight = PowerHeuristic(pdf, brdf.Pdf(dir));
+          radiance += throughput * brdf.Eval(dir) * background *
+                      (cosine * weight / pdf);
+        }
+      }
+    }
+
+    // Continue the path.
+    if (depth >= settings.maxDepth)
+      break;
+    glm::dvec3 dir;
+    if (!brdf.Sample(u[LobeDimension], u[DirectionDimension1],
+                     u[DirectionDimension2], dir))
+      break;
+    double cosine = glm::dot(normal, dir);
+    brdfPdf = brdf.Pdf(dir);
+    if (brdfPdf <= 0.0)
+      break;
+    bool diffuseLobe = u[LobeDimension] < brdf.diffuseProbability;
+    if (caustics) {
+      // Weighted by the picked lobe only.
+      if (diffuseLobe) {
+        throughput *= brdf.diffuse / brdf.diffuseProbability;
+      } else {
+        double lobePdf = (1.0 - brdf.diffuseProbability) *
+                         PhongLobePdf(brdf.mirror, brdf.exponent, dir);
+        if (lobePdf <= 0.0)
+          break;
+        throughput *= brdf.specular * (brdf.SpecularLobe(dir) * cosine / lobePdf);
+      }
+      afterDiffuse = afterDiffuse || diffuseLobe;
+    } else {
+      throughput *= brdf.Eval(dir) * (cosine / brdfPdf);
+    }
+    environmentPdf = environment ? cosine * InvPi : 0.0;
+
+    double maxThroughput = MaxComponent(throughput);
+    if (maxThroughput < settings.throughputCutoff) {
+      ++stats.pathsCutOff;
+      break;
+    }
+    if (depth + 1 >= settings.rouletteDepth &&
+        maxThroughput < settings.rouletteThroughput) {
+      double survival = maxThroughput / settings.rouletteThroughput;
+      if (u[RouletteDimension] >= survival) {
+        ++stats.pathsTerminated;
+        break;
+      }
+      throughput /= survival;
+    }
+
+    // The cone widens by the lobe's spread, and specular reflection by
+    // curved surfaces spreads it as mirrors do.
+    ++stats.reflectionRays;
+    double footprint = hit.GetFootprint();
+    double spread = ray.GetConeSpread();
+    if (diffuseLobe)
+      spread += LobeSpread(1.0);
+    else
+      spread += LobeSpread(brdf.exponent) + 2.0 * hit.GetFacingCurvature() * footprint;
+    ray = Ray(point, dir, footprint, spread);
+  }
+
+  return radiance;
+}
+
+
+IrradianceRecord PathTracer::GatherIrradiance(const glm::dvec3 &point,
+                                              const glm::dvec3 &normal,
+                                              const glm::uvec2 &pixel,
+                                              double minRadius,
+                                              double maxRadius,
+                                              RenderStats &stats) const
+{
+  glm::dvec3 t, b;
+  OrthonormalBasis(normal, t, b);
+  IrradianceGather gather(point, normal, t, b,
+                          settings.irradianceCache.gatherRays);
+
+  // Every cell's path is a sample of its own index: the first two
+  // dimensions (unused by Trace) place the ray within the cell. Its cone
+  // covers the cell (of projected solid angle pi / cells).
+  double cellSpread = std::sqrt(glm::pi<double>() / gather.GetNumCells());
+  for (unsigned j = 0; j < gather.thetaStrata; ++j) {
+    for (unsigned k = 0; k < gather.phiStrata; ++k) {
+      std::uint32_t cell = j * gather.phiStrata + k;
+      double u[FirstBounceDimension];
+      sampler.Generate(pixel, cell, 0, FirstBounceDimension, u);
+      Ray ray(point, gather.GetDirection(j, k, u[0], u[1]), 0.0, cellSpread);
+      IntersectionResult hit;
+      ++stats.reflectionRays;
+      gather.radiance[cell] = Trace(ray, pixel, cell, stats, &hit);
+      gather.distance[cell] = hit ? hit.GetDistance()
+                                  : std::numeric_limits<double>::infinity();
+    }
+  }
+  ++stats.irradianceRecords;
+  return ComputeIrradianceRecord(gather, minRadius, maxRadius);
+}
+
+
+void PathTracer::TracePhotons(std::uint32_t first, std::uint32_t count,
+                              std::vector<Photon> &photons,
+                              RenderStats &stats) const
+{
+  const std::vector<PointLight> &lights = scene.GetLights();
+  if (lights.empty())
+    return;
+  const MaterialManager &materials = scene.GetMaterials();
+  const glm::uvec2 pixel(0);
+  const double numLights = static_cast<double>(lights.size());
+
+  for (std::uint32_t index = first; index - first < count; ++index) {
+    ++stats.photonsEmitted;
+    double u[EmissionDimensions];
+    sampler.Generate(pixel, index, 0, EmissionDimensions, u);
+    std::size_t l = std::min(static_cast<std::size_t>(u[0] * numLights),
+                             lights.size() - 1);
+    const PointLight &light = lights[l];
+    Ray ray(light.position,
+            DirectionAround(glm::dvec3(0.0, 0.0, 1.0), 1.0 - 2.0 * u[1], u[2]));
+
+    glm::dvec3 power(0.0);
+    for (unsigned depth = 0;; ++depth) {
+      IntersectionResult hit = scene.Intersect(ray);
+      if (!hit)
+        break;
+      glm::dvec3 normal = hit.GetFacingNormal();
+      glm::dvec3 point = hit.GetIntersectionPoint();
+      Brdf brdf(materials, hit.GetMaterialId(), normal, -ray.GetDirection());
+
+      if (depth == 0) {
+        // The first bounce is specular: the light's specular color times
+        // pi, as in next-event estimation. Lights don't fall off with the
+        // square of distance here, so the photon carries the attenuation
+        // times distance squared. Over the density of the light and of
+        // the direction (1 / (4 pi)).
+        double d = hit.GetDistance();
+        power = light.specularColor *
+                (4.0 * glm::pi<double>() * glm::pi<double>() * numLights *
+                 light.GetAttenuation(d) * d * d);
+      } else if (brdf.diffuseProbability > 0.0) {
+        photons.push_back({ glm::vec3(point), glm::vec3(ray.GetDirection()),
+                            glm::vec3(power) });
+        ++stats.photonsStored;
+      }
+      if (depth >= settings.maxDepth)
+        break;
+
+      double v[PhotonBounceDimensions];
+      sampler.Generate(pixel, index,
+                       EmissionDimensions + depth * PhotonBounceDimensions,
+                       PhotonBounceDimensions, v);
+      double survival = std::min(MaxComponent(brdf.specular), 1.0);
+      if (v[0] >= survival)
+        break;
+      glm::dvec3 dir = SamplePhongLobe(brdf.mirror, brdf.exponent, v[1], v[2]);
+      double cosine = glm::dot(normal, dir);
+      double pdf = PhongLobePdf(brdf.mirror, brdf.exponent, dir);
+      if (cosine <= 0.0 || pdf <= 0.0)
+        break;
+      power *= brdf.specular * (brdf.SpecularLobe(dir) * cosine / (pdf * survival));
+      if (MaxComponent(power) <= 0.0)
+        break;
+      ray = Ray(point + RayBias * normal, dir);
+    }
+  }
+}
+
+
+glm::dvec3 PathTracer::SamplePointLights(const Brdf &brdf,
+                                         const glm::dvec3 &point,
+                                         const glm::uvec2 &pixel,
+                                         std::uint32_t index,
+                                         std::uint32_t firstDim,
+                                         RenderStats &stats) const
+{
+  glm::dvec3 result(0.0);
+  if (brdf.black)
+    return result;
+
+  if (settings.directLighting == DirectLighting::SampledLights) {
+    for (unsigned s = 0; s < settings.lightSamplesPerHit; ++s) {
+      std::uint32_t l;
+      double pdf;
+      double u = sampler.Get(pixel, index, firstDim + s);
+      if (lightTree.Sample(point, brdf.normal, u, l, pdf)) {
+        result += PointLightContribution(
+          brdf, l, 1.0 / (pdf * settings.lightSamplesPerHit), point, stats);
+      }
+    }
+  } else if (settings.lightCulling) {
+    lightGrid.ForEachLight(point, [&](std::uint32_t l) {
+      result += PointLightContribution(brdf, l, 1.0, point, stats);
+    });
+  } else {
+    for (std::uint32_t l = 0; l < scene.GetLights().size(); ++l)
+      result += PointLightContribution(brdf, l, 1.0, point, stats);
+  }
+  return result;
+}
+
+
+glm::dvec3 PathTracer::PointLightContribution(const Brdf &brdf,
+                                              std::uint32_t l, double weight,
+                                              const glm::dvec3 &point,
+                                              RenderStats &stats) const
+{
+  const PointLight &light = scene.GetLights()[l];
+  glm::dvec3 toLight = light.position - point;
+  double dist = glm::length(toLight);
+  glm::dvec3 dir = toLight / dist;
+  double cosine = glm::dot(brdf.normal, dir);
+  double attenuation = light.GetAttenuation(dist);
+  if (cosine <= 0.0 || attenuation <= 0.0)
+    return glm::dvec3(0.0);
+
+  // Lobes times pi times the light's colors.
+  ++stats.lightSamples;
+  glm::dvec3 contribution =
+    (brdf.diffuse * light.diffuseColor +
+     glm::pi<double>() * brdf.SpecularLobe(dir) * brdf.specular *
+     light.specularColor) * (cosine * attenuation * weight);
+
+  // Same cutoff as in the Whitted renderer.
+  if (MaxComponent(contribution) <= settings.lightCutoff)
+    return glm::dvec3(0.0);
+  ++stats.shadowRays;
+  if (scene.IsOccluded(Ray(point, toLight), dist))
+    return glm::dvec3(0.0);
+  return contribution;
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#include "IrradianceCache.h"
+#include "LightGrid.h"
+#include "LightTree.h"
+#include "PhotonMap.h"
+#include "Renderer.h"
+#include "Sampler.h"
+#include "Scene.h"
+#include <cstdint>
+#include <vector>
+
+// === Sampling ===
+
+// Direction in the hemisphere around \p normal with density cos(theta) / pi,
+// theta being the angle to the normal, from uniform numbers \p u1, \p u2.
+glm::dvec3 SampleCosineHemisphere(const glm::dvec3 &normal, double u1,
+                                  double u2);
+
+// Direction around \p axis with density (n + 1) / (2 pi) * cos^n(alpha),
+// alpha being the angle to the axis and n \p exponent. May point below the
+// surface the lobe belongs to.
+glm::dvec3 SamplePhongLobe(const glm::dvec3 &axis, double exponent,
+                           double u1, double u2);
+
+// Density of SamplePhongLobe producing \p dir.
+double PhongLobePdf(const glm::dvec3 &axis, double exponent,
+                    const glm::dvec3 &dir);
+
+// Multiple importance sampling weight of a sample drawn with density
+// \p pdf, when the other strategy would have drawn it with density
+// \p otherPdf (power heuristic, beta = 2).
+inline double PowerHeuristic(double pdf, double otherPdf) {
+  double a = pdf * pdf;
+  double b = otherPdf * otherPdf;
+  return a + b > 0.0 ? a / (a + b) : 0.0;
+}
+
+// Unidirectional path tracer with next-event estimation.
+//
+// Materials are energy-normalized (modified) Phong BRDFs: diffuse color
+// over pi plus specular color times (n + 2) / (2 pi) * cos^n of the angle
+// between the mirror direction and the light. High shininess gives nearly
+// perfect mirrors. Ambient terms are ignored: indirect light replaces them.
+//
+// Light comes from point lights and from the background, which acts as a
+// uniform environment. At every vertex:
+//   - point lights are sampled the same way as direct lighting of the
+//     Whitted renderer (all lights, light grid, or light tree picks). The
+//     diffuse lobe is lit by the light's diffuse color times pi, the
+//     specular one by its specular color times pi, so direct diffuse
+//     lighting matches the Whitted renderer;
+//   - the environment is sampled with a cosine-weighted direction;
+//   - the path continues in a direction sampled from the BRDF: a lobe is
+//     picked in proportion to its color, then a cosine or Phong-lobe
+//     direction. The density is the mixture of both lobes.
+// Environment light reaches a vertex through both of the last two
+// strategies, which are combined with MIS weights.
+//
+// Paths end by maxDepth, the throughput cutoff and Russian roulette, the
+// same as in the Whitted renderer.
+//
+// With an irradiance cache, the diffuse lobe of camera ray hits is lit by
+// cached irradiance (everything but point lights) where the cache has
+// records, instead of by the environment sample and the path. The path
+// then only continues through the specular lobe.
+//
+// With a caustic photon map (photons which reached a diffuse surface from
+// point lights through specular bounces), the diffuse lobe of every vertex
+// is also lit by the map's irradiance estimate, and specular reflections
+// of point lights are no longer sampled at vertices after a diffuse
+// bounce: those paths (light, specular bounces, diffuse bounce) are the
+// ones the map holds. The path then picks its lobe with the same
+// probabilities, but is weighted by the picked lobe only, so it can tell
+// which lobe it went through.
+//
+// The tracer is not modified by tracing and may be used by several threads
+// at once.
+class PathTracer {
+public:
+  PathTracer(const Scene &s, const RenderSettings &rs, const Sampler &smp,
+             const LightTree &tree, const LightGrid &grid,
+             const IrradianceCache *ic = nullptr,
+             const PhotonMap *pm = nullptr) :
+    scene(s), settings(rs), sampler(smp), lightTree(tree), lightGrid(grid),
+    cache(ic), caustics(pm) {}
+
+  // Radiance along camera \p ray of \p pixel, for sample \p index. Rays
+  // are counted in \p stats. If \p primaryHit is not null, it receives the
+  // camera ray's intersection.
+  glm::dvec3 Trace(const Ray &ray, const glm::uvec2 &pixel,
+                   std::uint32_t index, RenderStats &stats,
+                   IntersectionResult *primaryHit = nullptr) const;
+
+  // New irradiance cache record at \p point with \p normal: incoming light
+  // is gathered by paths traced through settings.irradianceCache.gatherRays
+  // strata of the hemisphere, with sample indices of \p pixel. The record's
+  // radius is limited to [\p minRadius, \p maxRadius].
+  IrradianceRecord GatherIrradiance(const glm::dvec3 &point,
+                                    const glm::dvec3 &normal,
+                                    const glm::uvec2 &pixel, double minRadius,
+                                    double maxRadius, RenderStats &stats) const;
+
+  // Emit photons [\p first, \p first + \p count) from the scene's point
+  // lights (a uniformly picked light each) and add those which reach a
+  // diffuse surface after at least one specular bounce to \p photons, with
+  // their power for a single emitted photon. Photons are reflected
+  // specularly up to settings.maxDepth times, with Russian roulette
+  // against the specular color. Sample values come from photon indices.
+  void TracePhotons(std::uint32_t first, std::uint32_t count,
+                    std::vector<Photon> &photons, RenderStats &stats) const;
+
+private:
+  // BRDF at a path vertex.
+  struct Brdf;
+
+  // Light of point lights reflected by \p brdf at \p point, with random
+  // numbers for light picks starting at dimension \p firstDim.
+  glm::dvec3 SamplePointLights(const Brdf &brdf, const glm::dvec3 &point,
+                               const glm::uvec2 &pixel, std::uint32_t index,
+                               std::uint32_t firstDim,
+                               RenderStats &stats) const;
+
+  // Contribution of point light \p l, weighted by \p weight.
+  glm::dvec3 PointLightContribution(const Brdf &brdf, std::uint32_t l,
+                                    double weight, const glm::dvec3 &point,
+                                    RenderStats &stats) const;
+
+  const Scene &scene;
+  const RenderSettings &settings;
+  const Sampler &sampler;
+  const LightTree &lightTree;
+  const LightGrid &lightGrid;
+  const IrradianceCache *cache;
+  const PhotonMap *caustics;
+};
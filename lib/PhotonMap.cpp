@@ -0,0 +1,205 @@
+#include "PhotonMap.h"
+#include "glm/gtc/constants.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+
+namespace {
+
+// Deeper than any balanced tree over 2^32 photons.
+const unsigned MaxStackDepth = 64;
+
+} // anonymous namespace
+
+
+void PhotonMap::Build(const std::vector<Photon> &photons, double scale)
+{
+  assert(photons.size() < 0xFFFFFFFFu && "Too many photons!");
+
+  nodes.clear();
+  std::size_t n = photons.size();
+  for (std::vector<float> *plane : { &posX, &posY, &posZ, &dirX, &dirY, &dirZ,
+                                     &powerR, &powerG, &powerB })
+    plane->resize(n);
+  if (!n)
+    return;
+
+  std::vector<std::uint32_t> order(n);
+  std::iota(order.begin(), order.end(), 0u);
+  nodes.reserve(2 * (n / LeafSize + 1));
+  BuildNode(photons, order.data(), order.data() + n, order.data());
+
+  float s = static_cast<float>(scale);
+  for (std::size_t i = 0; i < n; ++i) {
+    const Photon &p = photons[order[i]];
+    posX[i] = p.position.x;
+    posY[i] = p.position.y;
+    posZ[i] = p.position.z;
+    dirX[i] = p.direction.x;
+    dirY[i] = p.direction.y;
+    dirZ[i] = p.direction.z;
+    powerR[i] = p.power.r * s;
+    powerG[i] = p.power.g * s;
+    powerB[i] = p.power.b * s;
+  }
+}
+
+
+std::uint32_t PhotonMap::BuildNode(const std::vector<Photon> &photons,
+                                   std::uint32_t *begin, std::uint32_t *end,
+                                   std::uint32_t *first)
+{
+  std::uint32_t index = static_cast<std::uint32_t>(nodes.size());
+  nodes.push_back(Node());
+  std::uint32_t count = static_cast<std::uint32_t>(end - begin);
+  if (count <= LeafSize) {
+    Node &leaf = nodes[index];
+    leaf.isLeaf = true;
+    leaf.index = static_cast<std::uint32_t>(begin - first);
+    leaf.count = count;
+    leaf.axis = 0;
+    leaf.split = 0.0f;
+    return index;
+  }
+
+  glm::vec3 lo(photons[*begin].position);
+  glm::vec3 hi(lo);
+  for (const std::uint32_t *i = begin; i != end; ++i) {
+    lo = glm::min(lo, photons[*i].position);
+    hi = glm::max(hi, photons[*i].position);
+  }
+  glm::vec3 extent = hi - lo;
+  int axis = 0;
+  if (extent.y > extent[axis])
+    axis = 1;
+  if (extent.z > extent[axis])
+    axis = 2;
+
+  std::uint32_t *mid = begin + count / 2;
+  std::nth_element(begin, mid, end, [&](std::uint32_t a, std::uint32_t b) {
+    return photons[a].position[axis] < photons[b].position[axis];
+  });
+
+  // Filled in after the children: references into nodes don't survive
+  // their push_backs.
+  float split = photons[*mid].position[axis];
+  BuildNode(photons, begin, mid, first);
+  std::uint32_t second = BuildNode(photons, mid, end, first);
+
+  Node &node = nodes[index];
+  node.isLeaf = false;
+  node.axis = static_cast<std::uint8_t>(axis);
+  node.split = split;
+  node.index = second;
+  node.count = count;
+  return index;
+}
+
+
+unsigned PhotonMap::GatherNearest(const glm::dvec3 &point, unsigned k,
+                                  double maxRadius,
+                                  std::pair<float, std::uint32_t> *heap) const
+{
+  k = std::min(k, MaxNeighbours);
+  if (nodes.empty() || !k)
+    return 0;
+
+  const glm::vec3 p(point);
+  const float maxDist2 = static_cast<float>(maxRadius * maxRadius);
+  unsigned found = 0;
+  auto bound = [&]() { return found == k ? heap[0].first : maxDist2; };
+
+  // Subtrees still to visit and their squared distance from the point
+  // (to the split plane they lie behind).
+  std::uint32_t stackNodes[MaxStackDepth];
+  float stackDist2[MaxStackDepth];
+  unsigned top = 0;
+  stackNodes[top] = 0;
+  stackDist2[top++] = 0.0f;
+
+  float dist2[LeafSize];
+  while (top) {
+    --top;
+    if (stackDist2[top] >= bound())
+      continue;
+    std::uint32_t n = stackNodes[top];
+
+    // Down to the leaf on the point's side, deferring the other sides.
+    while (!nodes[n].isLeaf) {
+      const Node &node = nodes[n];
+      float d = p[node.axis] - node.split;
+      std::uint32_t nearChild = d < 0.0f ? n + 1 : node.index;
+      std::uint32_t farChild = d < 0.0f ? node.index : n + 1;
+      if (d * d < bound()) {
+        assert(top < MaxStackDepth && "Photon map too deep!");
+        stackNodes[top] = farChild;
+        stackDist2[top++] = d * d;
+      }
+      n = nearChild;
+    }
+
+    // Distances to all photons of the leaf, then the heap.
+    const Node &leaf = nodes[n];
+    const float *x = &posX[leaf.index];
+    const float *y = &posY[leaf.index];
+    const float *z = &posZ[leaf.index];
+    for (std::uint32_t i = 0; i < leaf.count; ++i) {
+      float dx = x[i] - p.x, dy = y[i] - p.y, dz = z[i] - p.z;
+      dist2[i] = dx * dx + dy * dy + dz * dz;
+    }
+    for (std::uint32_t i = 0; i < leaf.count; ++i) {
+      if (dist2[i] >= bound())
+        continue;
+      if (found == k) {
+        std::pop_heap(heap, heap + found);
+        --found;
+      }
+      heap[found++] = std::make_pair(dist2[i], leaf.index + i);
+      std::push_heap(heap, heap + found);
+    }
+  }
+  return found;
+}
+
+
+void PhotonMap::FindNearest(const glm::dvec3 &point, unsigned k,
+                            double maxRadius,
+                            std::vector<std::uint32_t> &indices,
+                            std::vector<float> &distances2) const
+{
+  std::pair<float, std::uint32_t> heap[MaxNeighbours];
+  unsigned found = GatherNearest(point, k, maxRadius, heap);
+  std::sort_heap(heap, heap + found);
+  indices.resize(found);
+  distances2.resize(found);
+  for (unsigned i = 0; i < found; ++i) {
+    distances2[i] = heap[i].first;
+    indices[i] = heap[i].second;
+  }
+}
+
+
+glm::dvec3 PhotonMap::EstimateIrradiance(const glm::dvec3 &point,
+                                         const glm::dvec3 &normal,
+                                         unsigned neighbours,
+                                         double maxRadius) const
+{
+  std::pair<float, std::uint32_t> heap[MaxNeighbours];
+  unsigned found = GatherNearest(point, neighbours, maxRadius, heap);
+  if (!found)
+    return glm::dvec3(0.0);
+
+  glm::dvec3 sum(0.0);
+  for (unsigned i = 0; i < found; ++i) {
+    std::uint32_t p = heap[i].second;
+    if (dirX[p] * normal.x + dirY[p] * normal.y + dirZ[p] * normal.z < 0.0)
+      sum += glm::dvec3(powerR[p], powerG[p], powerB[p]);
+  }
+
+  // Disc through the farthest photon if all neighbours were found, the
+  // whole search disc otherwise (few photons around: low density).
+  double radius2 = found == std::min(neighbours, MaxNeighbours)
+                     ? static_cast<double>(heap[0].first) : maxRadius * maxRadius;
+  return sum / (glm::pi<double>() * std::max(radius2, 1.0e-12));
+}
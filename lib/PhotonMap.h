@@ -0,0 +1,99 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+struct PhotonMapSettings {
+  PhotonMapSettings() :
+    maxPhotons(200000), maxEmitted(4000000), neighbours(50),
+    maxRadius(0.25) {}
+
+  // Budget of stored photons, which bounds the map's memory (36 bytes per
+  // photon). Photons are emitted in batches until the budget is reached or
+  // maxEmitted photons have been emitted.
+  std::size_t maxPhotons;
+  std::size_t maxEmitted;
+
+  // Density estimation: irradiance at a point is the power of its nearest
+  // photons (up to neighbours, within maxRadius) over the area of the disc
+  // holding them.
+  unsigned neighbours;
+  double maxRadius;
+};
+
+// Photon hit: where it landed, the direction it came along, and its power.
+struct Photon {
+  glm::vec3 position;
+  glm::vec3 direction;
+  glm::vec3 power;
+};
+
+// Photons stored in a kd-tree for nearest-neighbour density estimation.
+//
+// Nodes are split at the median of the longest axis of their photons, so
+// the tree is balanced. Leaves hold up to LeafSize photons, contiguous in
+// planar arrays: distances to all photons of a leaf are computed at once by
+// a loop the compiler vectorizes.
+class PhotonMap {
+public:
+  // (Re)build the map from \p photons. Their powers are multiplied by
+  // \p scale (1 / number of emitted photons).
+  void Build(const std::vector<Photon> &photons, double scale);
+
+  // Irradiance at \p point on a surface with normal \p normal, from photons
+  // which arrived at its front side.
+  glm::dvec3 EstimateIrradiance(const glm::dvec3 &point,
+                                const glm::dvec3 &normal,
+                                unsigned neighbours, double maxRadius) const;
+
+  // Indices of up to \p k (at most MaxNeighbours) photons nearest to
+  // \p point within \p maxRadius, nearest first, with their squared
+  // distances.
+  void FindNearest(const glm::dvec3 &point, unsigned k, double maxRadius,
+                   std::vector<std::uint32_t> &indices,
+                   std::vector<float> &distances2) const;
+
+public:
+  std::size_t GetNumPhotons() const { return posX.size(); }
+  std::size_t GetNumNodes() const { return nodes.size(); }
+  bool Empty() const { return posX.empty(); }
+
+  glm::dvec3 GetPosition(std::size_t i) const {
+    return glm::dvec3(posX[i], posY[i], posZ[i]);
+  }
+
+  static const unsigned LeafSize = 16;
+  static const unsigned MaxNeighbours = 256;
+
+private:
+  struct Node {
+    // Inner node: split plane; the first child (photons below the plane)
+    // follows the node itself, index is the second child. Leaf: photons
+    // [index, index + count).
+    float split;
+    std::uint32_t index;
+    std::uint32_t count;
+    std::uint8_t axis;
+    bool isLeaf;
+  };
+
+  std::uint32_t BuildNode(const std::vector<Photon> &photons,
+                          std::uint32_t *begin, std::uint32_t *end,
+                          std::uint32_t *first);
+
+  // Fill \p heap (max-heap of squared distance and photon index) with up
+  // to \p k photons nearest to \p point within \p maxRadius. Returns the
+  // number found.
+  unsigned GatherNearest(const glm::dvec3 &point, unsigned k,
+                         double maxRadius,
+                         std::pair<float, std::uint32_t> *heap) const;
+
+  std::vector<Node> nodes;
+
+  // Photons, in leaf order.
+  std::vector<float> posX, posY, posZ;
+  std::vector<float> dirX, dirY, dirZ;
+  std::vector<float> powerR, powerG, powerB;
+};
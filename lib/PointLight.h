@@ -2,23 +2,53 @@
 
 #include "glm/glm.hpp"
 
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+// Distance falloff of a light with influence radius 1 / \p invRadius:
+// a smooth window which is 1 at the light and reaches 0 at the radius.
+// Unbounded lights (invRadius == 0) are not attenuated.
+inline double LightFalloff(double distance, double invRadius) {
+  double x = distance * invRadius;
+  double x2 = x * x;
+  double window = std::max(1.0 - x2 * x2, 0.0);
+  return window * window;
+}
+
 struct PointLight {
   PointLight(glm::dvec3 p) :
     position(p), ambientColor(0.0, 0.0, 0.0),
-    specularColor(0.0, 0.0, 0.0), diffuseColor(0.0, 0.0, 0.0) {}
+    specularColor(0.0, 0.0, 0.0), diffuseColor(0.0, 0.0, 0.0),
+    radius(std::numeric_limits<double>::infinity()) {}
 
+  // \p r is the influence radius: the light doesn't affect anything
+  // farther than that. Infinite by default.
   PointLight(const glm::dvec3 &p, const glm::dvec3 &a,
-             const glm::dvec3 &s, const glm::dvec3 &d) :
-    position(p), ambientColor(a), specularColor(s), diffuseColor(d) {
+             const glm::dvec3 &s, const glm::dvec3 &d,
+             double r = std::numeric_limits<double>::infinity()) :
+    position(p), ambientColor(a), specularColor(s), diffuseColor(d),
+    radius(r) {
     #ifndef NDEBUG
     AssertValueBounds();
     #endif // !NDEBUG
   }
 
+  bool IsBounded() const { return radius < std::numeric_limits<double>::infinity(); }
+
+  // 0 for unbounded lights.
+  double GetInvRadius() const { return IsBounded() ? 1.0 / radius : 0.0; }
+
+  double GetAttenuation(double distance) const {
+    return LightFalloff(distance, GetInvRadius());
+  }
+
   glm::dvec3 position;
   glm::dvec3 ambientColor;
   glm::dvec3 specularColor;
   glm::dvec3 diffuseColor;
+  // Influence radius.
+  double radius;
 
   #ifndef NDEBUG
   void AssertValueBounds() const {
@@ -34,6 +64,7 @@ struct PointLight {
            diffuseColor.g >= 0.0 && diffuseColor.g <= 1.0 &&
            diffuseColor.b >= 0.0 && diffuseColor.b <= 1.0 &&
            "Light's diffuse color values out of bounds!");
+    assert(radius > 0.0 && "Light's influence radius must be positive!");
   }
   #endif // !NDEBUG
 };
\ No newline at end of file
@@ -1,10 +1,12 @@
 #include "Ray.h"
 
-Ray::Ray(const glm::dvec3 &orig, const glm::dvec3 &dir)
-  : origin(orig), direction(glm::normalize(dir)) {
+Ray::Ray(const glm::dvec3 &orig, const glm::dvec3 &dir, double width,
+         double spread)
+  : origin(orig), direction(glm::normalize(dir)), coneWidth(width),
+    coneSpread(spread) {
 }
 
-Ray Ray::Reflect(const Ray &normalRay) const {
+Ray Ray::Reflect(const Ray &normalRay, double curvature) const {
   // i - incident ray (*this).
   // r - reflected ray (result).
   // r = i - 2*(i,n)*n
@@ -17,5 +19,7 @@ Ray Ray::Reflect(const Ray &normalRay) const {
 
   auto IDotN = glm::dot(direction, normalRay.direction);
   glm::dvec3 resDirection = direction - 2 * IDotN * normalRay.direction;
-  return Ray(normalRay.origin, resDirection);
+  double width = GetWidthAt(glm::length(normalRay.origin - origin));
+  return Ray(normalRay.origin, resDirection, width,
+             coneSpread + 2.0 * curvature * width);
 }
@@ -3,10 +3,21 @@
 #include "glm/glm.hpp"
 
 #include <cassert>
+#include <cmath>
 
+// Secondary rays start this far above the surface to avoid hitting it again.
+const double RayBias = 1.0e-6;
+
+// Rays are cones (Akenine-Moeller et al., "Texture level of detail
+// strategies for real-time ray tracing"): besides the origin and direction
+// they carry the width of their footprint at the origin and the angle it
+// spreads by, so the size of the area a ray stands for is known at every
+// hit. Surfaces and textures can use it to pick a level of detail. Rays
+// built without a cone are infinitely thin.
 class Ray {
 public:
-  Ray(const glm::dvec3 &orig, const glm::dvec3 &dir);
+  Ray(const glm::dvec3 &orig, const glm::dvec3 &dir, double width = 0.0,
+      double spread = 0.0);
 
 public:
   // Cast a reflection ray using origin and direction of \p normalRay.
@@ -17,7 +28,11 @@ public:
   // Postcondition:
   //   1. Origin of resulting ray is the same as normalRay's.
   //   2. Direction of resulting ray is normalized.
-  Ray Reflect(const Ray &normalRay) const;
+  //   3. Width of resulting ray is this ray's width at normalRay's origin.
+  //      Its spread grows by twice the turn of the normal across that
+  //      width on a surface of \p curvature (1 / radius, positive where
+  //      the surface bulges towards the normal).
+  Ray Reflect(const Ray &normalRay, double curvature = 0.0) const;
 
 public:
   void SetOrigin(const glm::dvec3 &o) { origin = o; }
@@ -26,6 +41,19 @@ public:
   void SetDirection(const glm::dvec3 &d) { direction = glm::normalize(d); }
   glm::dvec3 GetDirection() const { return direction; }
 
+  void SetCone(double width, double spread) {
+    coneWidth = width;
+    coneSpread = spread;
+  }
+  double GetConeWidth() const { return coneWidth; }
+  double GetConeSpread() const { return coneSpread; }
+
+  // Width of the footprint at \p distance from the origin, across the
+  // ray. A converging cone narrows, then widens again past its apex.
+  double GetWidthAt(double distance) const {
+    return std::abs(coneWidth + distance * coneSpread);
+  }
+
   // Debug assertion: ray's direction must be normalized.
   #ifndef NDEBUG
   void AssertNormalized() const {
@@ -37,4 +65,7 @@ public:
 private:
   glm::dvec3 origin;
   glm::dvec3 direction;
+  double coneWidth;
+  // Radians, negative for converging cones.
+  double coneSpread;
 };
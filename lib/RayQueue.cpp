@@ -0,0 +1,136 @@
+#include "RayQueue.h"
+#include "Morton.h"
+
+#include <cassert>
+
+
+namespace {
+
+// Rays are binned by 3 bits of direction octant and the top 9 bits of
+// origin's Morton code (8x8x8 cells).
+const unsigned MortonBinBits = 9;
+const std::size_t NumBins = 8u << MortonBinBits;
+
+} // anonymous namespace
+
+RayQueue::RayQueue(std::size_t cap)
+  : capacity(cap)
+{
+  assert(capacity > 0 && "RayQueue capacity must be positive!");
+  assert(capacity <= 0xFFFFFFFFu && "RayQueue capacity is too large!");
+
+  originX.reserve(capacity);     originY.reserve(capacity);     originZ.reserve(capacity);
+  directionX.reserve(capacity);  directionY.reserve(capacity);  directionZ.reserve(capacity);
+  coneWidths.reserve(capacity);  coneSpreads.reserve(capacity);
+  throughputR.reserve(capacity); throughputG.reserve(capacity); throughputB.reserve(capacity);
+  pixels.reserve(capacity);
+  depths.reserve(capacity);
+  scratchDoubles.reserve(capacity);
+  scratchInts.reserve(capacity);
+}
+
+
+void RayQueue::Clear()
+{
+  originX.clear();     originY.clear();     originZ.clear();
+  directionX.clear();  directionY.clear();  directionZ.clear();
+  coneWidths.clear();  coneSpreads.clear();
+  throughputR.clear(); throughputG.clear(); throughputB.clear();
+  pixels.clear();
+  depths.clear();
+}
+
+
+void RayQueue::Push(const Ray &ray, const glm::dvec3 &throughput,
+                    std::uint32_t pixel, std::uint32_t depth)
+{
+  assert(!Full() && "RayQueue overflow!");
+
+  glm::dvec3 o = ray.GetOrigin();
+  glm::dvec3 d = ray.GetDirection();
+  originX.push_back(o.x);           originY.push_back(o.y);           originZ.push_back(o.z);
+  directionX.push_back(d.x);        directionY.push_back(d.y);        directionZ.push_back(d.z);
+  coneWidths.push_back(ray.GetConeWidth());
+  coneSpreads.push_back(ray.GetConeSpread());
+  throughputR.push_back(throughput.r);
+  throughputG.push_back(throughput.g);
+  throughputB.push_back(throughput.b);
+  pixels.push_back(pixel);
+  depths.push_back(depth);
+}
+
+
+std::size_t RayQueue::BytesPerRay()
+{
+  // 11 doubles and 2 ints of payload, bin and permutation index, scratch
+  // space for one double and one int array.
+  return 12 * sizeof(double) + 3 * sizeof(std::uint32_t) +
+         sizeof(std::uint16_t) + sizeof(std::uint32_t);
+}
+
+
+template <typename T>
+void RayQueue::Permute(std::vector<T> &values, std::vector<T> &scratch)
+{
+  scratch.resize(values.size());
+  for (std::size_t i = 0; i < values.size(); ++i)
+    scratch[i] = values[order[i]];
+  values.swap(scratch);
+}
+
+
+void RayQueue::SortCoherent()
+{
+  if (Size() < 2)
+    return;
+
+  // Bounds of all origins.
+  glm::dvec3 lo(originX[0], originY[0], originZ[0]);
+  glm::dvec3 hi = lo;
+  for (std::size_t i = 1; i < Size(); ++i) {
+    glm::dvec3 o(originX[i], originY[i], originZ[i]);
+    lo = glm::min(lo, o);
+    hi = glm::max(hi, o);
+  }
+  glm::dvec3 extent = hi - lo;
+  glm::dvec3 scale(extent.x > 0.0 ? 1023.0 / extent.x : 0.0,
+                   extent.y > 0.0 ? 1023.0 / extent.y : 0.0,
+                   extent.z > 0.0 ? 1023.0 / extent.z : 0.0);
+
+  // Bin: | 3 bits octant | top bits of 30-bit Morton code |.
+  bins.resize(Size());
+  binOffsets.assign(NumBins + 1, 0);
+  for (std::size_t i = 0; i < Size(); ++i) {
+    unsigned octant = (directionX[i] < 0.0 ? 4 : 0) |
+                      (directionY[i] < 0.0 ? 2 : 0) |
+                      (directionZ[i] < 0.0 ? 1 : 0);
+    std::uint32_t morton = MortonCode3D(
+      static_cast<std::uint32_t>((originX[i] - lo.x) * scale.x),
+      static_cast<std::uint32_t>((originY[i] - lo.y) * scale.y),
+      static_cast<std::uint32_t>((originZ[i] - lo.z) * scale.z));
+    bins[i] = static_cast<std::uint16_t>(
+      (octant << MortonBinBits) | (morton >> (30 - MortonBinBits)));
+    ++binOffsets[bins[i] + 1];
+  }
+
+  // Counting sort: stable and linear in the number of rays.
+  for (std::size_t b = 1; b <= NumBins; ++b)
+    binOffsets[b] += binOffsets[b - 1];
+  order.resize(Size());
+  for (std::size_t i = 0; i < Size(); ++i)
+    order[binOffsets[bins[i]]++] = static_cast<std::uint32_t>(i);
+
+  Permute(originX, scratchDoubles);
+  Permute(originY, scratchDoubles);
+  Permute(originZ, scratchDoubles);
+  Permute(directionX, scratchDoubles);
+  Permute(directionY, scratchDoubles);
+  Permute(directionZ, scratchDoubles);
+  Permute(coneWidths, scratchDoubles);
+  Permute(coneSpreads, scratchDoubles);
+  Permute(throughputR, scratchDoubles);
+  Permute(throughputG, scratchDoubles);
+  Permute(throughputB, scratchDoubles);
+  Permute(pixels, scratchInts);
+  Permute(depths, scratchInts);
+}
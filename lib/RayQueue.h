@@ -0,0 +1,69 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#include "Ray.h"
+#include <cstdint>
+#include <vector>
+
+// Fixed-capacity queue of rays for breadth-first (wavefront) tracing,
+// stored as a structure of arrays.
+//
+// Besides the ray itself (with its cone) every entry carries the state needed to continue
+// the path: the pixel it contributes to, its throughput (product of the
+// reflectances along the path so far) and its bounce depth.
+class RayQueue {
+public:
+  explicit RayQueue(std::size_t capacity);
+
+  void Clear();
+
+  // Append a ray. The queue must not be full.
+  void Push(const Ray &ray, const glm::dvec3 &throughput,
+            std::uint32_t pixel, std::uint32_t depth);
+
+  // Reorder rays so that coherent rays are adjacent: rays are binned by
+  // direction octant, then by Morton code of the origin (quantized within
+  // the bounds of all origins in the queue). Binning is a counting sort,
+  // so the cost is linear in the number of rays.
+  void SortCoherent();
+
+  // Memory used by one queue entry, including sorting scratch space.
+  static std::size_t BytesPerRay();
+
+public:
+  std::size_t Size() const { return pixels.size(); }
+  std::size_t GetCapacity() const { return capacity; }
+  bool Empty() const { return pixels.empty(); }
+  bool Full() const { return pixels.size() >= capacity; }
+
+  Ray GetRay(std::size_t i) const {
+    return Ray(glm::dvec3(originX[i], originY[i], originZ[i]),
+               glm::dvec3(directionX[i], directionY[i], directionZ[i]),
+               coneWidths[i], coneSpreads[i]);
+  }
+  glm::dvec3 GetThroughput(std::size_t i) const {
+    return glm::dvec3(throughputR[i], throughputG[i], throughputB[i]);
+  }
+  std::uint32_t GetPixel(std::size_t i) const { return pixels[i]; }
+  std::uint32_t GetDepth(std::size_t i) const { return depths[i]; }
+
+private:
+  template <typename T>
+  void Permute(std::vector<T> &values, std::vector<T> &scratch);
+
+  std::size_t capacity;
+
+  std::vector<double> originX, originY, originZ;
+  std::vector<double> directionX, directionY, directionZ;
+  std::vector<double> coneWidths, coneSpreads;
+  std::vector<double> throughputR, throughputG, throughputB;
+  std::vector<std::uint32_t> pixels;
+  std::vector<std::uint32_t> depths;
+
+  // Sorting scratch space, kept to avoid reallocations between waves.
+  std::vector<std::uint16_t> bins;
+  std::vector<std::size_t> binOffsets;
+  std::vector<std::uint32_t> order;
+  std::vector<double> scratchDoubles;
+  std::vector<std::uint32_t> scratchInts;
+};
@@ -0,0 +1,1012 @@
+#include "Renderer.h"
+#include "PageLoader.h"
+#include "PathTracer.h"
+#include "RayQueue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <limits>
+#include <thread>
+
+namespace {
+
+bool IsReflective(const glm::dvec3 &reflectance) {
+  return reflectance.r > 0.0 || reflectance.g > 0.0 || reflectance.b > 0.0;
+}
+
+double MaxComponent(const glm::dvec3 &v) {
+  return std::max(v.r, std::max(v.g, v.b));
+}
+
+// Mirror reflection of the hit's ray, slightly lifted above the surface.
+Ray ReflectedRay(const IntersectionResult &hit, const glm::dvec3 &normal) {
+  Ray reflected = hit.GetRay().Reflect(Ray(hit.GetIntersectionPoint(), normal),
+                                       hit.GetFacingCurvature());
+  reflected.SetOrigin(reflected.GetOrigin() + RayBias * normal);
+  return reflected;
+}
+
+// Sampler dimensions of a path: position within the pixel, then light
+// picks and the roulette decision of every bounce.
+const std::uint32_t PixelDimensions = 2;
+
+std::uint32_t LightDimension(std::uint32_t depth, unsigned samplesPerHit) {
+  return PixelDimensions + depth * (samplesPerHit + 1);
+}
+
+std::uint32_t RouletteDimension(std::uint32_t depth, unsigned samplesPerHit) {
+  return LightDimension(depth, samplesPerHit) + samplesPerHit;
+}
+
+// Photons are emitted in rounds of batches traced in parallel.
+const std::uint32_t PhotonBatchSize = 4096;
+const unsigned PhotonBatchesPerRound = 16;
+
+// Pixel sample suspended by a page miss with asyncPaging, to be traced
+// again once load ticket is done.
+struct ParkedSample {
+  glm::uvec2 pixel;
+  PageLoader::TTicket ticket;
+  unsigned attempts;
+};
+
+// A sample suspended this many times (its pages evicted before it could
+// resume, under a tight budget) is traced waiting for pages, so it can't
+// starve.
+const unsigned MaxSampleAttempts = 4;
+
+// Call \p body(item, stats) for items [0, count) from \p numThreads threads
+// (0 for one per hardware thread). Items are handed out one at a time, so
+// threads finishing cheap items take more. Every thread counts rays in its
+// own stats, which are added to \p stats at the end.
+template <typename TBody>
+void ParallelFor(unsigned numThreads, unsigned count, RenderStats &stats,
+                 TBody body) {
+  if (!numThreads)
+    numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+  numThreads = std::min(numThreads, std::max(count, 1u));
+
+  std::atomic<unsigned> next(0);
+  std::vector<RenderStats> threadStats(numThreads);
+  auto run = [&](RenderStats &s) {
+    for (unsigned item = next++; item < count; item = next++)
+      body(item, s);
+  };
+
+  if (numThreads == 1) {
+    run(threadStats[0]);
+  } else {
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < numThreads; ++t)
+      threads.push_back(std::thread(run, std::ref(threadStats[t])));
+    for (std::thread &thread : threads)
+      thread.join();
+  }
+
+  for (const RenderStats &s : threadStats)
+    stats += s;
+}
+
+} // anonymous namespace
+
+
+// === RenderStats ===
+void RenderStats::Reset()
+{
+  primaryRays = 0;
+  reflectionRays = 0;
+  shadowRays = 0;
+  pathsCutOff = 0;
+  pathsTerminated = 0;
+  lightSamples = 0;
+  irradianceRecords = 0;
+  irradianceMisses = 0;
+  photonsEmitted = 0;
+  photonsStored = 0;
+  textures = TextureStats();
+  suspendedSamples = 0;
+  pageLoads = 0;
+  samples = 0;
+  samplesSaved = 0;
+  passes = 0;
+  samplesPerPixel = 0.0;
+  outOfTime = false;
+  waves = 0;
+  intersectionSeconds = 0.0;
+  shadowSeconds = 0.0;
+  shadingSeconds = 0.0;
+  renderSeconds = 0.0;
+}
+
+
+RenderStats &RenderStats::operator+=(const RenderStats &other)
+{
+  primaryRays += other.primaryRays;
+  reflectionRays += other.reflectionRays;
+  shadowRays += other.shadowRays;
+  pathsCutOff += other.pathsCutOff;
+  pathsTerminated += other.pathsTerminated;
+  lightSamples += other.lightSamples;
+  irradianceRecords += other.irradianceRecords;
+  irradianceMisses += other.irradianceMisses;
+  photonsEmitted += other.photonsEmitted;
+  photonsStored += other.photonsStored;
+  textures += other.textures;
+  suspendedSamples += other.suspendedSamples;
+  pageLoads += other.pageLoads;
+  samples += other.samples;
+  samplesSaved += other.samplesSaved;
+  passes += other.passes;
+  outOfTime = outOfTime || other.outOfTime;
+  waves += other.waves;
+  intersectionSeconds += other.intersectionSeconds;
+  shadowSeconds += other.shadowSeconds;
+  shadingSeconds += other.shadingSeconds;
+  renderSeconds += other.renderSeconds;
+  return *this;
+}
+
+
+std::ostream &operator<<(std::ostream &os, const RenderStats &stats)
+{
+  os << "Primary rays:    " << stats.primaryRays << "\n"
+     << "Reflection rays: " << stats.reflectionRays << "\n"
+     << "Shadow rays:     " << stats.shadowRays << "\n"
+     << "Paths ended:     " << stats.pathsCutOff << " cut off, "
+     << stats.pathsTerminated << " by roulette\n"
+     << "Light samples:   " << stats.lightSamples << "\n";
+  if (stats.irradianceRecords) {
+    os << "Irradiance:      " << stats.irradianceRecords << " records, "
+       << stats.irradianceMisses << " misses\n";
+  }
+  if (stats.photonsEmitted) {
+    os << "Photons:         " << stats.photonsEmitted << " emitted, "
+       << stats.photonsStored << " stored\n";
+  }
+  std::uint64_t tileLookups = stats.textures.tileHits + stats.textures.tileMisses;
+  if (tileLookups) {
+    os << "Texture tiles:   " << stats.textures.tileHits << " hits, "
+       << stats.textures.tileMisses << " misses ("
+       << 100.0 * stats.textures.tileHits / tileLookups << "% hit rate), "
+       << stats.textures.bytesRead << " bytes read\n";
+  }
+  if (stats.suspendedSamples) {
+    os << "Page misses:     " << stats.suspendedSamples
+       << " samples suspended, " << stats.pageLoads << " loads\n";
+  }
+  os
+     << "Pixel samples:   " << stats.samples << " (" << stats.samplesSaved
+     << " saved, " << stats.passes << " passes)\n"
+     << "Samples/pixel:   " << stats.samplesPerPixel
+     << (stats.outOfTime ? " (out of time)" : "") << "\n";
+  if (stats.waves) {
+    os << "Waves:           " << stats.waves << "\n"
+       << "Intersect time:  " << stats.intersectionSeconds << " s\n"
+       << "Shadow time:     " << stats.shadowSeconds << " s\n"
+       << "Shading time:    " << stats.shadingSeconds << " s\n";
+  }
+  os << "Render time:     " << stats.renderSeconds << " s\n";
+  return os;
+}
+
+
+// === Renderer ===
+Renderer::Renderer(const RenderSettings &s)
+  : settings(s), useIrradianceCache(false), usePhotonMap(false),
+    sampleIndex(0),
+    guideBuffers(nullptr), aovBuffers(nullptr)
+{
+}
+
+
+// Out of line: RayQueue is incomplete in the header.
+Renderer::~Renderer()
+{
+}
+
+
+void Renderer::Render(const Scene &scene, const Camera &camera,
+                      Framebuffer &fb, GuideBuffers *guides,
+                      AovBuffers *aovs)
+{
+  assert(fb.GetWidth() == camera.GetResolution().x &&
+         fb.GetHeight() == camera.GetResolution().y &&
+         "Framebuffer size doesn't match camera resolution!");
+  assert(scene.GetMaterials().IsFrozen() && "Scene must be frozen!");
+  assert(settings.minSamples > 0 && settings.minSamples <= settings.maxSamples &&
+         "Invalid number of samples per pixel!");
+
+  stats.Reset();
+  fb.Clear();
+  auto start = std::chrono::steady_clock::now();
+
+  if (settings.directLighting == DirectLighting::SampledLights)
+    lightTree.Build(scene.GetLights());
+  else if (settings.lightCulling)
+    lightGrid.Build(scene.GetLights());
+  sampler = Sampler(settings.sampler);
+  sampler.SetPixelOffset(camera.GetRegionOffset());
+  useIrradianceCache = settings.integrator == Integrator::PathTracing &&
+                       settings.irradianceCaching && settings.maxDepth > 0;
+  usePhotonMap = settings.integrator == Integrator::PathTracing &&
+                 settings.photonMapping && !scene.GetLights().empty();
+  if (usePhotonMap)
+    BuildPhotonMap(scene);
+  if (useIrradianceCache)
+    BuildIrradianceCache(scene, camera);
+
+  std::size_t numPixels = fb.GetNumPixels();
+  accumulator.Reset(numPixels);
+  activePixels.assign(numPixels, 1);
+  Framebuffer sampleFb(fb.GetWidth(), fb.GetHeight());
+  guideBuffers = guides;
+  if (guides)
+    guides->Reset(fb.GetWidth(), fb.GetHeight());
+  aovBuffers = aovs;
+  if (aovs)
+    aovs->Reset(fb.GetWidth(), fb.GetHeight());
+
+  double lastPassSeconds = 0.0;
+  for (std::uint32_t sample = 0; sample < settings.maxSamples; ++sample) {
+    auto passStart = std::chrono::steady_clock::now();
+    if (settings.timeBudget > 0.0 && sample > 0) {
+      double elapsed = std::chrono::duration<double>(passStart - start).count();
+      if (elapsed + lastPassSeconds > settings.timeBudget) {
+        stats.outOfTime = true;
+        break;
+      }
+    }
+
+    sampleFb.Clear();
+    sampleIndex = sample;
+    RenderPass(scene, camera, sampleFb);
+    ++stats.passes;
+
+    // Add the new samples, then keep only pixels which aren't converged.
+    std::size_t numActive = 0;
+    for (std::size_t i = 0; i < numPixels; ++i) {
+      if (!activePixels[i])
+        continue;
+      accumulator.AddSample(i, sampleFb[i]);
+      ++stats.samples;
+      activePixels[i] = sample + 1 < settings.minSamples ||
+                        accumulator.GetError(i) > settings.errorThreshold;
+      if (activePixels[i])
+        ++numActive;
+      else
+        stats.samplesSaved += settings.maxSamples - (sample + 1);
+    }
+    if (!numActive)
+      break;
+
+    lastPassSeconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - passStart).count();
+  }
+
+  accumulator.Resolve(fb);
+  stats.samplesPerPixel = static_cast<double>(stats.samples) / numPixels;
+
+  // Guide sums to means, and noise estimates.
+  if (guides) {
+    for (std::size_t i = 0; i < numPixels; ++i) {
+      unsigned n = accumulator.GetNumSamples(i);
+      float scale = 1.0f / n;
+      guides->normalX[i] *= scale;
+      guides->normalY[i] *= scale;
+      guides->normalZ[i] *= scale;
+      guides->albedoR[i] *= scale;
+      guides->albedoG[i] *= scale;
+      guides->albedoB[i] *= scale;
+      guides->depth[i] *= scale;
+      guides->error[i] = n > 1 ? static_cast<float>(accumulator.GetError(i)) : 0.0f;
+    }
+  }
+  guideBuffers = nullptr;
+  if (aovs)
+    aovs->Resolve();
+  aovBuffers = nullptr;
+
+  auto end = std::chrono::steady_clock::now();
+  stats.renderSeconds = std::chrono::duration<double>(end - start).count();
+}
+
+
+void Renderer::ComputeVisibility(const Scene &scene, const HitBatch &hits,
+                                 std::vector<double> &vis)
+{
+  const auto &lights = scene.GetLights();
+  std::size_t n = hits.Size();
+  vis.resize(lights.size() * n);
+  stats.lightSamples += lights.size() * n;
+
+  for (std::size_t l = 0; l < lights.size(); ++l) {
+    for (std::size_t i = 0; i < n; ++i) {
+      glm::dvec3 point(hits.pointX[i], hits.pointY[i], hits.pointZ[i]);
+      glm::dvec3 normal(hits.normalX[i], hits.normalY[i], hits.normalZ[i]);
+      glm::dvec3 toLight = lights[l].position - point;
+
+      if (!NeedsShadowRay(scene.GetMaterials(), hits.materialIds[i],
+                          lights[l], normal, toLight)) {
+        vis[l * n + i] = 0.0;
+        continue;
+      }
+
+      ++stats.shadowRays;
+      Ray shadowRay(point + RayBias * normal, toLight);
+      vis[l * n + i] = scene.IsOccluded(shadowRay, glm::length(toLight))
+                       ? 0.0 : 1.0;
+    }
+  }
+}
+
+
+void Renderer::ComputeLightLists(const Scene &scene, const HitBatch &hits,
+                                 const std::vector<glm::uvec2> &pixels,
+                                 const std::vector<std::uint32_t> &depths,
+                                 HitLights &lists)
+{
+  const auto &lights = scene.GetLights();
+  lists.Clear();
+
+  for (std::size_t i = 0; i < hits.Size(); ++i) {
+    glm::dvec3 point(hits.pointX[i], hits.pointY[i], hits.pointZ[i]);
+
+    if (settings.directLighting == DirectLighting::SampledLights) {
+      glm::dvec3 normal(hits.normalX[i], hits.normalY[i], hits.normalZ[i]);
+      std::uint32_t firstDim = LightDimension(depths[i], settings.lightSamplesPerHit);
+      for (unsigned s = 0; s < settings.lightSamplesPerHit; ++s) {
+        std::uint32_t l;
+        double pdf;
+        double u = sampler.Get(pixels[i], sampleIndex, firstDim + s);
+        if (lightTree.Sample(point, normal, u, l, pdf))
+          AddLightToList(scene, hits, i, l,
+                         1.0 / (pdf * settings.lightSamplesPerHit), lists);
+      }
+    } else {
+      lightGrid.ForEachLight(point, [&](std::uint32_t l) {
+        // The grid cell may be only partially covered by the light.
+        if (lights[l].GetAttenuation(glm::length(lights[l].position - point)) > 0.0)
+          AddLightToList(scene, hits, i, l, 1.0, lists);
+      });
+    }
+    lists.EndHit();
+  }
+}
+
+
+void Renderer::AddLightToList(const Scene &scene, const HitBatch &hits,
+                              std::size_t i, std::uint32_t l, double weight,
+                              HitLights &lists)
+{
+  const PointLight &light = scene.GetLights()[l];
+  glm::dvec3 point(hits.pointX[i], hits.pointY[i], hits.pointZ[i]);
+  glm::dvec3 normal(hits.normalX[i], hits.normalY[i], hits.normalZ[i]);
+  glm::dvec3 toLight = light.position - point;
+
+  ++stats.lightSamples;
+  double vis = 0.0;
+  if (NeedsShadowRay(scene.GetMaterials(), hits.materialIds[i], light,
+                     normal, toLight)) {
+    ++stats.shadowRays;
+    Ray shadowRay(point + RayBias * normal, toLight);
+    vis = scene.IsOccluded(shadowRay, glm::length(toLight)) ? 0.0 : 1.0;
+  }
+  lists.Add(l, vis, weight);
+}
+
+
+bool Renderer::NeedsShadowRay(const MaterialManager &materials,
+                              TMaterialId mat, const PointLight &light,
+                              const glm::dvec3 &normal,
+                              const glm::dvec3 &toLight) const
+{
+  // Lights behind the surface contribute nothing anyway.
+  double dist = glm::length(toLight);
+  double NdotL = glm::dot(normal, toLight) / dist;
+  if (NdotL <= 0.0)
+    return false;
+
+  // pow(N.H, shininess) is at most 1.
+  double bound = light.GetAttenuation(dist) *
+    (NdotL * MaxComponent(materials.GetDiffuse(mat) * light.diffuseColor) +
+     MaxComponent(materials.GetSpecular(mat) * light.specularColor));
+  return bound > settings.lightCutoff;
+}
+
+
+Ray Renderer::GetSampleRay(const Camera &camera, unsigned x, unsigned y) const
+{
+  if (settings.maxSamples == 1)
+    return camera.GetPrimaryRay(x + 0.5, y + 0.5);
+
+  double offset[PixelDimensions];
+  sampler.Generate(glm::uvec2(x, y), sampleIndex, 0, PixelDimensions, offset);
+  return camera.GetPrimaryRay(x + offset[0], y + offset[1]);
+}
+
+
+void Renderer::RenderPass(const Scene &scene, const Camera &camera,
+                          Framebuffer &fb)
+{
+  if (settings.integrator == Integrator::PathTracing) {
+    RenderPaths(scene, camera, fb);
+    return;
+  }
+
+  switch (settings.mode) {
+  case RenderMode::Recursive:
+    RenderRecursive(scene, camera, fb);
+    break;
+  case RenderMode::Wavefront:
+    RenderWavefront(scene, camera, fb);
+    break;
+  case RenderMode::Deferred:
+    RenderDeferred(scene, camera, fb);
+    break;
+  }
+}
+
+
+// === Recursive mode ===
+void Renderer::RenderRecursive(const Scene &scene, const Camera &camera,
+                               Framebuffer &fb)
+{
+  for (unsigned y = 0; y < fb.GetHeight(); ++y) {
+    for (unsigned x = 0; x < fb.GetWidth(); ++x) {
+      if (!activePixels[static_cast<std::size_t>(y) * fb.GetWidth() + x])
+        continue;
+      ++stats.primaryRays;
+      fb.At(x, y) = Trace(scene, GetSampleRay(camera, x, y), glm::uvec2(x, y));
+    }
+  }
+}
+
+
+glm::dvec3 Renderer::Trace(const Scene &scene, const Ray &ray,
+                           const glm::uvec2 &pixel)
+{
+  // Iterative: the path is followed bounce by bounce, so deep reflection
+  // chains don't grow the stack.
+  glm::dvec3 color(0.0);
+  glm::dvec3 throughput(1.0);
+  Ray current = ray;
+  for (unsigned depth = 0;; ++depth) {
+    IntersectionResult hit = scene.Intersect(current);
+    if (!hit) {
+      color += throughput * scene.GetBackground();
+      break;
+    }
+
+    glm::dvec3 normal = hit.GetFacingNormal();
+    glm::dvec3 tint = scene.GetDiffuseTint(hit, stats.textures);
+    if (depth == 0)
+      RecordPrimaryHit(scene.GetMaterials(), pixel, hit, normal, tint);
+
+    // Shade a batch of one hit.
+    hitBatch.Clear();
+    hitBatch.Add(hit.GetIntersectionPoint(), normal, -current.GetDirection(),
+                 hit.GetMaterialId(), tint);
+    if (UsesLightLists()) {
+      hitPixels.assign(1, pixel);
+      hitDepths.assign(1, depth);
+      ComputeLightLists(scene, hitBatch, hitPixels, hitDepths, hitLights);
+      ShadeBlinnPhongCulled(scene.GetMaterials(), scene.GetLights(), hitBatch,
+                            hitLights, colors, settings.powMode);
+    } else {
+      ComputeVisibility(scene, hitBatch, visibility);
+      ShadeBlinnPhong(scene.GetMaterials(), scene.GetLights(), hitBatch, colors,
+                      settings.powMode, &visibility);
+    }
+    color += throughput * colors[0];
+
+    glm::dvec3 reflectance = scene.GetMaterials().GetSpecular(hit.GetMaterialId());
+    if (!ContinuePath(pixel, depth, reflectance, throughput))
+      break;
+    ++stats.reflectionRays;
+    current = ReflectedRay(hit, normal);
+  }
+
+  return color;
+}
+
+
+void Renderer::RecordPrimaryHit(const MaterialManager &materials,
+                                const glm::uvec2 &pixel,
+                                const IntersectionResult &hit,
+                                const glm::dvec3 &normal,
+                                const glm::dvec3 &tint)
+{
+  if (!guideBuffers && !aovBuffers)
+    return;
+
+  glm::dvec3 albedo = materials.GetDiffuse(hit.GetMaterialId()) * tint;
+  if (aovBuffers) {
+    aovBuffers->AddHit(static_cast<std::size_t>(pixel.y) * aovBuffers->GetWidth() +
+                       pixel.x, hit, normal, albedo);
+  }
+  if (!guideBuffers)
+    return;
+
+  std::size_t i = static_cast<std::size_t>(pixel.y) * guideBuffers->GetWidth() +
+                  pixel.x;
+  guideBuffers->normalX[i] += static_cast<float>(normal.x);
+  guideBuffers->normalY[i] += static_cast<float>(normal.y);
+  guideBuffers->normalZ[i] += static_cast<float>(normal.z);
+  guideBuffers->albedoR[i] += static_cast<float>(albedo.r);
+  guideBuffers->albedoG[i] += static_cast<float>(albedo.g);
+  guideBuffers->albedoB[i] += static_cast<float>(albedo.b);
+  guideBuffers->depth[i] += static_cast<float>(hit.GetDistance());
+}
+
+
+bool Renderer::ContinuePath(const glm::uvec2 &pixel, unsigned depth,
+                            const glm::dvec3 &reflectance,
+                            glm::dvec3 &throughput)
+{
+  if (depth >= settings.maxDepth || !IsReflective(reflectance))
+    return false;
+
+  throughput *= reflectance;
+  double maxThroughput = MaxComponent(throughput);
+  if (maxThroughput < settings.throughputCutoff) {
+    ++stats.pathsCutOff;
+    return false;
+  }
+
+  if (depth + 1 >= settings.rouletteDepth &&
+      maxThroughput < settings.rouletteThroughput) {
+    double survival = maxThroughput / settings.rouletteThroughput;
+    double u = sampler.Get(pixel, sampleIndex,
+                           RouletteDimension(depth, settings.lightSamplesPerHit));
+    if (u >= survival) {
+      ++stats.pathsTerminated;
+      return false;
+    }
+    throughput /= survival;
+  }
+  return true;
+}
+
+
+// === Path tracing ===
+void Renderer::RenderPaths(const Scene &scene, const Camera &camera,
+                           Framebuffer &fb)
+{
+  PathTracer tracer(scene, settings, sampler, lightTree, lightGrid,
+                    useIrradianceCache ? &irradianceCache : nullptr,
+                    usePhotonMap ? &photonMap : nullptr);
+  unsigned width = fb.GetWidth(), height = fb.GetHeight();
+
+  // Trace the sample of pixel (x, y) into fb, counting rays in
+  // sampleStats. If a page miss was deferred meanwhile, the sample is
+  // discarded (nothing is written) and false returned.
+  auto traceSample = [&](unsigned x, unsigned y,
+                         RenderStats &sampleStats) -> bool {
+    ++sampleStats.primaryRays;
+    glm::uvec2 pixel(x, y);
+    IntersectionResult hit;
+    glm::dvec3 color = tracer.Trace(GetSampleRay(camera, x, y), pixel,
+                                    sampleIndex, sampleStats,
+                                    guideBuffers || aovBuffers ? &hit : nullptr);
+    glm::dvec3 tint(1.0);
+    if (hit)
+      tint = scene.GetDiffuseTint(hit, sampleStats.textures);
+    PageMissScope *scope = PageMissScope::Current();
+    if (scope && scope->Missed())
+      return false;
+    fb.At(x, y) = color;
+    if (hit)
+      RecordPrimaryHit(scene.GetMaterials(), pixel, hit, hit.GetFacingNormal(), tint);
+    return true;
+  };
+
+  // Row by row. Pixels (and their guides) are written by one thread only.
+  if (!settings.asyncPaging) {
+    ParallelFor(settings.numThreads, height, stats,
+                [&](unsigned y, RenderStats &rowStats) {
+      for (unsigned x = 0; x < width; ++x) {
+        if (activePixels[static_cast<std::size_t>(y) * width + x])
+          traceSample(x, y, rowStats);
+      }
+    });
+    return;
+  }
+
+  // Every worker takes rows until none are left, parking samples which
+  // miss a page. Before every row, it resumes those whose pages arrived;
+  // it only waits for the loader when it has nothing else to trace.
+  PageLoader loader;
+  std::atomic<unsigned> nextRow(0);
+  unsigned numWorkers = settings.numThreads ? settings.numThreads :
+                        std::max(std::thread::hardware_concurrency(), 1u);
+  ParallelFor(numWorkers, numWorkers, stats,
+              [&](unsigned, RenderStats &workerStats) {
+    std::deque<ParkedSample> parked;
+    auto attempt = [&](ParkedSample sample) {
+      RenderStats sampleStats;
+      PageMissScope scope(sample.attempts < MaxSampleAttempts ? &loader : nullptr);
+      if (traceSample(sample.pixel.x, sample.pixel.y, sampleStats)) {
+        workerStats += sampleStats;
+        return;
+      }
+      ++workerStats.suspendedSamples;
+      sample.ticket = scope.GetTicket();
+      ++sample.attempts;
+      parked.push_back(sample);
+    };
+
+    for (;;) {
+      for (std::size_t n = parked.size(); n; --n) {
+        ParkedSample sample = parked.front();
+        parked.pop_front();
+        if (loader.IsDone(sample.ticket))
+          attempt(sample);
+        else
+          parked.push_back(sample);
+      }
+
+      unsigned y = nextRow++;
+      if (y < height) {
+        for (unsigned x = 0; x < width; ++x) {
+          if (activePixels[static_cast<std::size_t>(y) * width + x])
+            attempt(ParkedSample{ glm::uvec2(x, y), 0, 0 });
+        }
+      } else if (parked.empty()) {
+        break;
+      } else {
+        loader.Wait(parked.front().ticket);
+      }
+    }
+  });
+
+  // Every load was waited for by the sample which requested it.
+  stats.textures += loader.GetTextureStats();
+  stats.pageLoads += loader.GetNumLoads();
+}
+
+
+void Renderer::BuildIrradianceCache(const Scene &scene, const Camera &camera)
+{
+  const MaterialManager &materials = scene.GetMaterials();
+  const IrradianceCacheSettings &cacheSettings = settings.irradianceCache;
+  glm::uvec2 resolution = camera.GetResolution();
+
+  // Gather paths start one bounce into camera paths: one bounce less to
+  // go. Their own sampler keeps them independent of pixel samples.
+  RenderSettings gatherSettings = settings;
+  gatherSettings.maxDepth = settings.maxDepth - 1;
+  gatherSettings.rouletteDepth = settings.rouletteDepth ? settings.rouletteDepth - 1 : 0;
+  Sampler gatherSampler(settings.sampler, 1);
+  PathTracer gatherTracer(scene, gatherSettings, gatherSampler, lightTree,
+                          lightGrid, nullptr,
+                          usePhotonMap ? &photonMap : nullptr);
+
+  // Octree bounds: primary hits of all pixel centers, which is where
+  // records go.
+  glm::dvec3 lo(std::numeric_limits<double>::max());
+  glm::dvec3 hi(-std::numeric_limits<double>::max());
+  for (unsigned y = 0; y < resolution.y; ++y) {
+    for (unsigned x = 0; x < resolution.x; ++x) {
+      IntersectionResult hit = scene.Intersect(camera.GetPrimaryRay(x + 0.5, y + 0.5));
+      ++stats.primaryRays;
+      if (hit) {
+        lo = glm::min(lo, hit.GetIntersectionPoint());
+        hi = glm::max(hi, hit.GetIntersectionPoint());
+      }
+    }
+  }
+  glm::dvec3 margin = 0.01 * (hi - lo) + glm::dvec3(RayBias);
+  irradianceCache = IrradianceCache(cacheSettings.accuracy);
+  irradianceCache.Reset(lo - margin, hi + margin);
+
+  // Hits of a level which no record reaches. Their records are gathered in
+  // parallel, then added in order.
+  struct Candidate {
+    glm::dvec3 point;
+    glm::dvec3 normal;
+    glm::uvec2 pixel;
+    // Size of a pixel at the hit: the camera ray's footprint.
+    double pixelSize;
+  };
+  std::vector<Candidate> candidates;
+  std::vector<IrradianceRecord> newRecords;
+
+  for (unsigned step = std::max(cacheSettings.prepassStep, 1u); step; step /= 2) {
+    candidates.clear();
+    for (unsigned y = step / 2; y < resolution.y; y += step) {
+      for (unsigned x = step / 2; x < resolution.x; x += step) {
+        Ray ray = camera.GetPrimaryRay(x + 0.5, y + 0.5);
+        IntersectionResult hit = scene.Intersect(ray);
+        ++stats.primaryRays;
+        if (!hit || !IsReflective(materials.GetDiffuse(hit.GetMaterialId())))
+          continue;
+        glm::dvec3 normal = hit.GetFacingNormal();
+        glm::dvec3 point = hit.GetIntersectionPoint() + RayBias * normal;
+        glm::dvec3 irradiance;
+        if (irradianceCache.Lookup(point, normal, irradiance))
+          continue;
+        candidates.push_back({ point, normal, glm::uvec2(x, y), hit.GetFootprint() });
+      }
+    }
+
+    newRecords.resize(candidates.size());
+    ParallelFor(settings.numThreads, static_cast<unsigned>(candidates.size()),
+                stats, [&](unsigned i, RenderStats &recordStats) {
+      const Candidate &c = candidates[i];
+      double pixelRadius = c.pixelSize / cacheSettings.accuracy;
+      newRecords[i] = gatherTracer.GatherIrradiance(
+        c.point, c.normal, c.pixel, cacheSettings.minPixelRadius * pixelRadius,
+        cacheSettings.maxPixelRadius * pixelRadius, recordStats);
+    });
+    for (const IrradianceRecord &record : newRecords)
+      irradianceCache.Add(record);
+  }
+}
+
+
+void Renderer::BuildPhotonMap(const Scene &scene)
+{
+  const PhotonMapSettings &mapSettings = settings.photonMap;
+  // Own sampler: photons are independent of pixel samples and gather
+  // paths.
+  Sampler photonSampler(settings.sampler, 2);
+  PathTracer photonTracer(scene, settings, photonSampler, lightTree, lightGrid);
+
+  // Batches are kept whole and in order while they fit the budget, so the
+  // map doesn't depend on the number of threads. Photons of the batches
+  // that don't fit are dropped, and so are their emitted counts.
+  std::vector<Photon> photons;
+  std::vector<std::vector<Photon>> batches(PhotonBatchesPerRound);
+  std::size_t emitted = 0;
+  bool full = false;
+  RenderStats photonStats;
+  // The last batch may be cut short by maxEmitted.
+  auto batchCount = [&](std::size_t roundStart, unsigned b) {
+    return static_cast<std::uint32_t>(std::min<std::size_t>(
+      PhotonBatchSize, mapSettings.maxEmitted - roundStart - b * PhotonBatchSize));
+  };
+  while (!full && emitted < mapSettings.maxEmitted) {
+    std::size_t roundStart = emitted;
+    std::size_t left = (mapSettings.maxEmitted - emitted + PhotonBatchSize - 1) /
+                       PhotonBatchSize;
+    unsigned numBatches = static_cast<unsigned>(
+      std::min<std::size_t>(left, PhotonBatchesPerRound));
+    ParallelFor(settings.numThreads, numBatches, photonStats,
+                [&](unsigned b, RenderStats &batchStats) {
+      batches[b].clear();
+      photonTracer.TracePhotons(
+        static_cast<std::uint32_t>(roundStart + b * PhotonBatchSize),
+        batchCount(roundStart, b), batches[b], batchStats);
+    });
+    for (unsigned b = 0; b < numBatches && !full; ++b) {
+      full = photons.size() + batches[b].size() > mapSettings.maxPhotons;
+      if (!full) {
+        photons.insert(photons.end(), batches[b].begin(), batches[b].end());
+        emitted += batchCount(roundStart, b);
+      }
+    }
+  }
+
+  photonMap.Build(photons, emitted ? 1.0 / emitted : 0.0);
+  stats.photonsEmitted += emitted;
+  stats.photonsStored += photons.size();
+}
+
+
+// === Wavefront and deferred modes ===
+std::size_t Renderer::GetWavefrontCapacity(std::size_t lightsPerHit) const
+{
+  // Two ray queues (current and next bounce), intersection result, hit
+  // batch entry with its binning index, shaded color and shadow mask or
+  // light list.
+  std::size_t bytesPerRay = 2 * RayQueue::BytesPerRay() +
+                            sizeof(IntersectionResult) +
+                            9 * sizeof(double) + sizeof(TMaterialId) +
+                            sizeof(std::uint32_t) +
+                            sizeof(glm::dvec3) +
+                            lightsPerHit * (sizeof(double) + sizeof(std::uint32_t));
+  std::size_t capacity = settings.wavefrontMemoryBudget / bytesPerRay;
+  return std::min<std::size_t>(std::max<std::size_t>(capacity, 1), 0x7FFFFFFF);
+}
+
+
+void Renderer::RenderWavefront(const Scene &scene, const Camera &camera,
+                               Framebuffer &fb)
+{
+  assert(fb.GetNumPixels() <= 0xFFFFFFFFu && "Image is too large!");
+
+  std::size_t lightsPerHit = scene.GetLights().size();
+  if (settings.directLighting == DirectLighting::SampledLights)
+    lightsPerHit = settings.lightSamplesPerHit;
+  else if (settings.lightCulling)
+    lightsPerHit = static_cast<std::size_t>(std::ceil(lightGrid.GetMeanLightsPerCell()));
+  PrepareQueues(GetWavefrontCapacity(lightsPerHit));
+  RayQueue &queue = *rayQueue;
+  RayQueue &next = *nextQueue;
+
+  std::size_t numPixels = fb.GetNumPixels();
+  std::size_t pixel = 0;
+  while (pixel < numPixels) {
+    // Generate as many primary rays as fit into the queue.
+    queue.Clear();
+    for (; pixel < numPixels && !queue.Full(); ++pixel) {
+      if (!activePixels[pixel])
+        continue;
+      unsigned x = pixel % fb.GetWidth();
+      unsigned y = pixel / fb.GetWidth();
+      queue.Push(GetSampleRay(camera, x, y), glm::dvec3(1.0, 1.0, 1.0),
+                 static_cast<std::uint32_t>(pixel), 0);
+      ++stats.primaryRays;
+    }
+
+    TraceQueue(scene, queue, next, fb);
+  }
+}
+
+
+void Renderer::RenderDeferred(const Scene &scene, const Camera &camera,
+                              Framebuffer &fb)
+{
+  assert(settings.tileSize > 0 && "Tile size must be positive!");
+
+  PrepareQueues(settings.tileSize * settings.tileSize);
+  RayQueue &queue = *rayQueue;
+  RayQueue &next = *nextQueue;
+
+  for (unsigned tileY = 0; tileY < fb.GetHeight(); tileY += settings.tileSize) {
+    for (unsigned tileX = 0; tileX < fb.GetWidth(); tileX += settings.tileSize) {
+      unsigned endX = std::min(tileX + settings.tileSize, fb.GetWidth());
+      unsigned endY = std::min(tileY + settings.tileSize, fb.GetHeight());
+
+      queue.Clear();
+      for (unsigned y = tileY; y < endY; ++y) {
+        for (unsigned x = tileX; x < endX; ++x) {
+          std::size_t pixel = static_cast<std::size_t>(y) * fb.GetWidth() + x;
+          if (!activePixels[pixel])
+            continue;
+          queue.Push(GetSampleRay(camera, x, y),
+                     glm::dvec3(1.0, 1.0, 1.0),
+                     static_cast<std::uint32_t>(pixel), 0);
+          ++stats.primaryRays;
+        }
+      }
+
+      // Tiles of converged pixels are skipped.
+      if (!queue.Empty())
+        TraceQueue(scene, queue, next, fb);
+    }
+  }
+}
+
+
+void Renderer::PrepareQueues(std::size_t capacity)
+{
+  if (rayQueue && rayQueue->GetCapacity() == capacity)
+    return;
+  rayQueue.reset(new RayQueue(capacity));
+  nextQueue.reset(new RayQueue(capacity));
+}
+
+
+void Renderer::TraceQueue(const Scene &scene, RayQueue &queue, RayQueue &next,
+                          Framebuffer &fb)
+{
+  // Every ray spawns at most one reflected ray, so \p next never overflows.
+  while (!queue.Empty()) {
+    next.Clear();
+    ProcessWave(scene, queue, next, fb);
+    std::swap(queue, next);
+  }
+}
+
+
+void Renderer::ProcessWave(const Scene &scene, RayQueue &queue, RayQueue &next,
+                           Framebuffer &fb)
+{
+  const MaterialManager &materials = scene.GetMaterials();
+  ++stats.waves;
+
+  // A deferred tile is coherent already.
+  if (settings.mode == RenderMode::Wavefront)
+    queue.SortCoherent();
+
+  // Bulk intersection fills the hit buffer.
+  auto intersectionStart = std::chrono::steady_clock::now();
+  waveHits.resize(queue.Size());
+  for (std::size_t i = 0; i < queue.Size(); ++i)
+    waveHits[i] = scene.Intersect(queue.GetRay(i));
+  auto intersectionEnd = std::chrono::steady_clock::now();
+  stats.intersectionSeconds +=
+    std::chrono::duration<double>(intersectionEnd - intersectionStart).count();
+
+  // Resolve misses, count hits per material.
+  binOffsets.assign(materials.GetNumMaterials() + 1, 0);
+  for (std::size_t i = 0; i < queue.Size(); ++i) {
+    if (waveHits[i])
+      ++binOffsets[waveHits[i].GetMaterialId() + 1];
+    else
+      fb[queue.GetPixel(i)] += queue.GetThroughput(i) * scene.GetBackground();
+  }
+
+  // Counting sort of hits by material. After the scatter, bucket of
+  // material m is [binOffsets[m - 1], binOffsets[m]).
+  for (std::size_t m = 1; m < binOffsets.size(); ++m)
+    binOffsets[m] += binOffsets[m - 1];
+  binnedRays.resize(binOffsets.back());
+  for (std::size_t i = 0; i < queue.Size(); ++i) {
+    if (waveHits[i])
+      binnedRays[binOffsets[waveHits[i].GetMaterialId()]++] =
+        static_cast<std::uint32_t>(i);
+  }
+
+  hitBatch.Clear();
+  hitPixels.clear();
+  hitDepths.clear();
+  for (std::uint32_t i : binnedRays) {
+    const IntersectionResult &hit = waveHits[i];
+    hitBatch.Add(hit.GetIntersectionPoint(), hit.GetFacingNormal(),
+                 -hit.GetRay().GetDirection(), hit.GetMaterialId(),
+                 scene.GetDiffuseTint(hit, stats.textures));
+    hitPixels.push_back(glm::uvec2(queue.GetPixel(i) % fb.GetWidth(),
+                                   queue.GetPixel(i) / fb.GetWidth()));
+    hitDepths.push_back(queue.GetDepth(i));
+    if (queue.GetDepth(i) == 0) {
+      RecordPrimaryHit(materials, hitPixels.back(), hit,
+                       glm::dvec3(hitBatch.normalX.back(),
+                                  hitBatch.normalY.back(),
+                                  hitBatch.normalZ.back()),
+                       glm::dvec3(hitBatch.tintR.back(), hitBatch.tintG.back(),
+                                  hitBatch.tintB.back()));
+    }
+  }
+
+  auto shadowStart = std::chrono::steady_clock::now();
+  if (UsesLightLists())
+    ComputeLightLists(scene, hitBatch, hitPixels, hitDepths, hitLights);
+  else
+    ComputeVisibility(scene, hitBatch, visibility);
+  auto shadowEnd = std::chrono::steady_clock::now();
+  stats.shadowSeconds +=
+    std::chrono::duration<double>(shadowEnd - shadowStart).count();
+
+  // Shade bucket by bucket. With culled lights every hit has its own
+  // lights anyway, and the batch is shaded at once.
+  colors.resize(hitBatch.Size());
+  if (UsesLightLists()) {
+    ShadeBlinnPhongCulled(materials, scene.GetLights(), hitBatch, hitLights,
+                          colors, settings.powMode);
+  } else {
+    for (std::size_t m = 0; m + 1 < binOffsets.size(); ++m) {
+      std::size_t begin = m ? binOffsets[m - 1] : 0;
+      std::size_t end = binOffsets[m];
+      if (begin < end) {
+        ShadeBlinnPhongBucket(materials, static_cast<TMaterialId>(m),
+                              scene.GetLights(), hitBatch, begin, end, colors,
+                              settings.powMode, &visibility);
+      }
+    }
+  }
+  auto shadingEnd = std::chrono::steady_clock::now();
+  stats.shadingSeconds +=
+    std::chrono::duration<double>(shadingEnd - shadowEnd).count();
+
+  // Accumulate and spawn reflections.
+  for (std::size_t j = 0; j < binnedRays.size(); ++j) {
+    std::uint32_t i = binnedRays[j];
+    const IntersectionResult &hit = waveHits[i];
+    glm::dvec3 throughput = queue.GetThroughput(i);
+    fb[queue.GetPixel(i)] += throughput * colors[j];
+
+    glm::dvec3 reflectance = materials.GetSpecular(hit.GetMaterialId());
+    if (ContinuePath(hitPixels[j], queue.GetDepth(i), reflectance, throughput)) {
+      ++stats.reflectionRays;
+      glm::dvec3 normal(hitBatch.normalX[j], hitBatch.normalY[j],
+                        hitBatch.normalZ[j]);
+      next.Push(ReflectedRay(hit, normal), throughput, queue.GetPixel(i),
+                queue.GetDepth(i) + 1);
+    }
+  }
+}
@@ -0,0 +1,386 @@
+#pragma once
+
+#include "AovBuffers.h"
+#include "Camera.h"
+#include "Denoiser.h"
+#include "Framebuffer.h"
+#include "IrradianceCache.h"
+#include "LightGrid.h"
+#include "LightTree.h"
+#include "PhotonMap.h"
+#include "SampleAccumulator.h"
+#include "Sampler.h"
+#include "Scene.h"
+#include "Shading.h"
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+class RayQueue;
+
+// How the image is traced.
+enum class RenderMode {
+  // Depth-first: every primary ray is traced through all of its
+  // reflections before the next pixel is started.
+  Recursive,
+  // Breadth-first: rays are traced in large queues, one bounce at a time.
+  // Queues are sorted by direction and origin before intersection, and hits
+  // are binned by material before shading.
+  Wavefront,
+  // Tile by tile: all rays of a tile are intersected first, filling a hit
+  // buffer (G-buffer), which is then bucketed by material and shaded bucket
+  // by bucket. Reflections of the tile are handled the same way.
+  Deferred,
+};
+
+// How direct lighting of a hit is computed.
+enum class DirectLighting {
+  // Every light reaching the hit is evaluated and gets a shadow ray.
+  AllLights,
+  // A few lights per hit are picked at random from a light tree, in
+  // proportion to their estimated contribution, and weighted by inverse
+  // probability. Unbiased but noisy; the number of shadow rays doesn't
+  // depend on the number of lights.
+  SampledLights,
+};
+
+// Light transport simulated by the renderer.
+enum class Integrator {
+  // Whitted-style: Blinn-Phong direct lighting plus ambient, and perfect
+  // mirror reflections weighted by the specular color.
+  Whitted,
+  // Monte Carlo path tracing with next-event estimation (see PathTracer):
+  // glossy and diffuse interreflections, soft environment lighting.
+  // Converges with many samples per pixel.
+  PathTracing,
+};
+
+struct RenderSettings {
+  RenderSettings() :
+    integrator(Integrator::Whitted), numThreads(0), asyncPaging(false),
+    irradianceCaching(false), photonMapping(false),
+    mode(RenderMode::Recursive), maxDepth(4),
+    throughputCutoff(1.0 / 1024.0), rouletteDepth(2),
+    rouletteThroughput(0.5),
+    powMode(SpecularPowMode::Exact),
+    wavefrontMemoryBudget(4 << 20), tileSize(32),
+    lightCulling(true), lightCutoff(1.0 / 1024.0),
+    directLighting(DirectLighting::AllLights), lightSamplesPerHit(1),
+    minSamples(1), maxSamples(1), errorThreshold(1.0 / 256.0),
+    timeBudget(0.0), sampler(SamplerType::Sobol) {}
+
+  Integrator integrator;
+
+  // Threads tracing rows of the image with Integrator::PathTracing, 0 for
+  // one per hardware thread. Paths are traced one at a time by each
+  // thread: mode is ignored.
+  unsigned numThreads;
+
+  // Path tracing threads don't wait for mesh clusters or texture tiles
+  // which aren't resident: a sample which misses one is suspended while a
+  // loader thread reads it, and the thread goes on with other pixels and
+  // rows. The sample is resumed by tracing it again once its pages are
+  // loaded (samples are deterministic, so it's the same path), which
+  // keeps threads busy during out-of-core renders. Doesn't change the
+  // image.
+  bool asyncPaging;
+
+  // Light the diffuse lobe of camera ray hits from an irradiance cache with
+  // Integrator::PathTracing. Records are placed by a prepass before the
+  // first sample, and the cache is kept for all samples of the render.
+  // Biased (interpolation smooths the lighting) but much cheaper for
+  // mostly diffuse scenes; hits no record reaches are path traced.
+  bool irradianceCaching;
+  IrradianceCacheSettings irradianceCache;
+
+  // Light caustics (point lights seen through specular bounces from diffuse
+  // surfaces) from a photon map with Integrator::PathTracing. Photons are
+  // emitted before the first sample, in parallel, until the budget of
+  // photonMap.maxPhotons is filled. Biased (density estimation blurs
+  // caustics over the photons' disc) but converges much faster than
+  // paths, which rarely find caustics from point lights.
+  bool photonMapping;
+  PhotonMapSettings photonMap;
+
+  RenderMode mode;
+
+  // Maximal number of reflection bounces after the primary hit.
+  unsigned maxDepth;
+
+  // Paths are traced bounce by bounce, carrying their throughput (product
+  // of reflectances so far). A path whose throughput drops below
+  // throughputCutoff (in every channel) is ended: it can't add more than
+  // that fraction of the light it would gather.
+  double throughputCutoff;
+
+  // Russian roulette: after rouletteDepth bounces, a path whose throughput
+  // is below rouletteThroughput continues with probability
+  // throughput / rouletteThroughput, and its throughput is divided by that
+  // probability if it does. Unbiased: dim paths are traced less often but
+  // count more. 0 disables roulette.
+  unsigned rouletteDepth;
+  double rouletteThroughput;
+
+  SpecularPowMode powMode;
+
+  // Upper bound of memory (bytes) used by wavefront ray queues and
+  // per-ray temporaries. Defines how many rays are in flight at once.
+  std::size_t wavefrontMemoryBudget;
+
+  // Side of a square tile (pixels) in deferred mode.
+  unsigned tileSize;
+
+  // Look up the lights of each hit in a grid over their spheres of
+  // influence, so lighting cost depends on the number of lights around a
+  // point rather than in the scene. Doesn't change the image.
+  bool lightCulling;
+
+  // Shadow rays are not traced towards lights whose diffuse and specular
+  // contribution to a hit can't exceed this value (in any channel): such
+  // lights are treated as occluded.
+  double lightCutoff;
+
+  DirectLighting directLighting;
+
+  // Number of lights sampled per hit with DirectLighting::SampledLights.
+  unsigned lightSamplesPerHit;
+
+  // Adaptive sampling: every pixel gets at least minSamples samples, then
+  // more are taken, one per pass, only for pixels whose estimated error
+  // (standard error of the mean luminance) is above errorThreshold, up to
+  // maxSamples. With a single sample per pixel rays go through pixel
+  // centers, otherwise through points picked by the sampler.
+  unsigned minSamples;
+  unsigned maxSamples;
+  double errorThreshold;
+
+  // Wall-clock limit of a render (seconds), 0 for none. Passes are
+  // progressive: each one refines the image, and a pass isn't started if
+  // it's expected to end after the deadline (judging by the previous one).
+  // The first pass is always made. The image holds the mean of all
+  // samples taken when the render stops.
+  double timeBudget;
+
+  // Generator of pixel positions and light picks. A sample's value only
+  // depends on its pixel, index and dimension, so renders are
+  // deterministic.
+  SamplerType sampler;
+};
+
+struct RenderStats {
+  RenderStats() { Reset(); }
+  void Reset();
+
+  // Add the counters and times of \p other (e.g. of another region of the
+  // same image). samplesPerPixel isn't additive: it's left as is.
+  RenderStats &operator+=(const RenderStats &other);
+
+  std::uint64_t primaryRays;
+  std::uint64_t reflectionRays;
+  std::uint64_t shadowRays;
+
+  // Paths ended before maxDepth by the throughput cutoff and by Russian
+  // roulette.
+  std::uint64_t pathsCutOff;
+  std::uint64_t pathsTerminated;
+
+  // Number of (hit, light) pairs evaluated by shading.
+  std::uint64_t lightSamples;
+
+  // Irradiance cache records computed by the prepass (their gather rays
+  // count as reflection rays), and camera ray hits no record reached.
+  std::uint64_t irradianceRecords;
+  std::uint64_t irradianceMisses;
+
+  // Photons emitted and stored in the photon map.
+  std::uint64_t photonsEmitted;
+  std::uint64_t photonsStored;
+
+  // Tiles of textured materials found in the scene's texture cache or read
+  // from their files by lookups.
+  TextureStats textures;
+
+  // Samples suspended on a page miss with asyncPaging (a sample may be
+  // suspended more than once), and loads made for them.
+  std::uint64_t suspendedSamples;
+  std::uint64_t pageLoads;
+
+  // Pixel samples taken, and samples not taken because pixels converged
+  // before maxSamples. Number of sampling passes over the image.
+  std::uint64_t samples;
+  std::uint64_t samplesSaved;
+  std::uint64_t passes;
+
+  // Mean number of samples per pixel achieved.
+  double samplesPerPixel;
+
+  // The render was stopped by the time budget.
+  bool outOfTime;
+
+  // Number of queue passes made by the wavefront and deferred renderers.
+  std::uint64_t waves;
+
+  // Time split of the wavefront and deferred renderers: intersection of
+  // camera and reflection rays, shadow rays, and evaluation of lighting.
+  // Not measured in recursive mode, where per-ray timers would cost more
+  // than the work itself.
+  double intersectionSeconds;
+  double shadowSeconds;
+  double shadingSeconds;
+
+  // Wall-clock time of the whole render.
+  double renderSeconds;
+};
+
+std::ostream &operator<<(std::ostream &os, const RenderStats &stats);
+
+// Ray tracer. By default Whitted-style: Blinn-Phong shading with shadows
+// and mirror reflections, a material's specular color being used as its
+// reflectance. Or a path tracer (see Integrator).
+class Renderer {
+public:
+  explicit Renderer(const RenderSettings &s = RenderSettings());
+  ~Renderer();
+
+  // Render \p scene as seen by \p camera into \p fb.
+  // Framebuffer's size must match camera's resolution.
+  // If \p guides is not null, it's filled with the features of primary
+  // hits, for the denoiser. If \p aovs is not null, its AOVs are filled
+  // from the same primary hits: they cost no extra rays.
+  void Render(const Scene &scene, const Camera &camera, Framebuffer &fb,
+              GuideBuffers *guides = nullptr, AovBuffers *aovs = nullptr);
+
+public:
+  const RenderSettings &GetSettings() const { return settings; }
+  const RenderStats &GetStats() const { return stats; }
+
+  // Number of rays kept in flight by the wavefront renderer when every hit
+  // is lit by \p lightsPerHit lights, derived from the memory budget.
+  std::size_t GetWavefrontCapacity(std::size_t lightsPerHit) const;
+
+private:
+  // Ray through pixel (\p x, \p y) for the current sample.
+  Ray GetSampleRay(const Camera &camera, unsigned x, unsigned y) const;
+
+  // Render the current sample of every active pixel into \p fb.
+  void RenderPass(const Scene &scene, const Camera &camera, Framebuffer &fb);
+
+  // === Recursive mode ===
+  void RenderRecursive(const Scene &scene, const Camera &camera,
+                       Framebuffer &fb);
+  // Color seen along \p ray, the primary ray of \p pixel, with all of its
+  // reflections.
+  glm::dvec3 Trace(const Scene &scene, const Ray &ray, const glm::uvec2 &pixel);
+
+  // === Path tracing ===
+  void RenderPaths(const Scene &scene, const Camera &camera, Framebuffer &fb);
+  // Place irradiance cache records at primary hits of pixel centers, coarse
+  // to fine.
+  void BuildIrradianceCache(const Scene &scene, const Camera &camera);
+  // Emit photons in batches until the photon budget is filled, and build
+  // the caustic map from them.
+  void BuildPhotonMap(const Scene &scene);
+
+  // === Wavefront and deferred modes ===
+  void RenderWavefront(const Scene &scene, const Camera &camera,
+                       Framebuffer &fb);
+  void RenderDeferred(const Scene &scene, const Camera &camera,
+                      Framebuffer &fb);
+  // Make sure ray queues of \p capacity rays are allocated. They are kept
+  // between passes and renders.
+  void PrepareQueues(std::size_t capacity);
+  // Trace all rays of \p queue and their reflections, adding their
+  // contribution to \p fb. \p next is scratch space of the same capacity.
+  void TraceQueue(const Scene &scene, RayQueue &queue, RayQueue &next,
+                  Framebuffer &fb);
+  // Trace all rays of \p queue one bounce, add their contribution to \p fb
+  // and push reflected rays to \p next.
+  void ProcessWave(const Scene &scene, RayQueue &queue, RayQueue &next,
+                   Framebuffer &fb);
+
+  // Fill visibility mask of \p hits against all lights of \p scene
+  // (the layout expected by ShadeBlinnPhong).
+  void ComputeVisibility(const Scene &scene, const HitBatch &hits,
+                         std::vector<double> &visibility);
+
+  // Fill \p lists with the lights of each hit of \p hits and their
+  // visibility: all lights reaching it, found in the light grid, or a few
+  // lights sampled from the light tree. \p pixels and \p depths are the
+  // pixel and bounce of every hit's path, for the sampler.
+  void ComputeLightLists(const Scene &scene, const HitBatch &hits,
+                         const std::vector<glm::uvec2> &pixels,
+                         const std::vector<std::uint32_t> &depths,
+                         HitLights &lists);
+  // Add light \p l to the list of hit \p i, tracing its shadow ray.
+  void AddLightToList(const Scene &scene, const HitBatch &hits, std::size_t i,
+                      std::uint32_t l, double weight, HitLights &lists);
+
+  // Add features of \p hit, the primary hit of \p pixel, to the guide
+  // buffers and AOVs which are requested. \p tint multiplies the albedo.
+  void RecordPrimaryHit(const MaterialManager &materials,
+                        const glm::uvec2 &pixel, const IntersectionResult &hit,
+                        const glm::dvec3 &normal, const glm::dvec3 &tint);
+
+  // Whether the path of \p pixel continues after bounce \p depth off a
+  // surface of \p reflectance. If so, \p throughput is updated for the
+  // reflected ray (including the roulette weight).
+  bool ContinuePath(const glm::uvec2 &pixel, unsigned depth,
+                    const glm::dvec3 &reflectance, glm::dvec3 &throughput);
+
+  // Whether hits are lit by per-hit light lists rather than by all lights.
+  bool UsesLightLists() const {
+    return settings.lightCulling ||
+           settings.directLighting == DirectLighting::SampledLights;
+  }
+
+  // Shadow rays are skipped for lights which can't add more than the
+  // cutoff to a hit with material \p mat, normal \p normal at \p toLight.
+  bool NeedsShadowRay(const MaterialManager &materials, TMaterialId mat,
+                      const PointLight &light, const glm::dvec3 &normal,
+                      const glm::dvec3 &toLight) const;
+
+  RenderSettings settings;
+  RenderStats stats;
+
+  // Built for the scene being rendered if light culling or light
+  // sampling is on.
+  LightGrid lightGrid;
+  LightTree lightTree;
+  // Built for the scene being rendered if irradiance caching is on.
+  IrradianceCache irradianceCache;
+  bool useIrradianceCache;
+  // Built for the scene being rendered if photon mapping is on.
+  PhotonMap photonMap;
+  bool usePhotonMap;
+  // Pixel and light sampling, and index of the sample being rendered
+  // (every pass renders one sample of the active pixels).
+  Sampler sampler;
+  std::uint32_t sampleIndex;
+
+  // Per-pixel estimates over all passes, and pixels which still need
+  // samples.
+  SampleAccumulator accumulator;
+  std::vector<std::uint8_t> activePixels;
+
+  // Sums of primary hit features over the samples of the render in
+  // progress, null if not requested.
+  GuideBuffers *guideBuffers;
+  AovBuffers *aovBuffers;
+
+  // Ray queues of the wavefront and deferred modes.
+  std::unique_ptr<RayQueue> rayQueue;
+  std::unique_ptr<RayQueue> nextQueue;
+
+  // Scratch buffers reused between calls.
+  HitBatch hitBatch;
+  std::vector<double> visibility;
+  HitLights hitLights;
+  // Path of every hit of hitBatch.
+  std::vector<glm::uvec2> hitPixels;
+  std::vector<std::uint32_t> hitDepths;
+  std::vector<glm::dvec3> colors;
+  std::vector<IntersectionResult> waveHits;
+  std::vector<std::size_t> binOffsets;
+  std::vector<std::uint32_t> binnedRays;
+};
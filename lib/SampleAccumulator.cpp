@@ -0,0 +1,52 @@
+#include "SampleAccumulator.h"
+
+#include <cmath>
+#include <limits>
+
+
+void SampleAccumulator::Reset(std::size_t numPixels)
+{
+  means.assign(numPixels, glm::dvec3(0.0, 0.0, 0.0));
+  meanLuminances.assign(numPixels, 0.0);
+  squaredDiffs.assign(numPixels, 0.0);
+  counts.assign(numPixels, 0);
+}
+
+
+void SampleAccumulator::AddSample(std::size_t pixel, const glm::dvec3 &color)
+{
+  assert(pixel < counts.size() && "Pixel index out of bounds!");
+
+  std::uint32_t n = ++counts[pixel];
+  means[pixel] += (color - means[pixel]) / static_cast<double>(n);
+
+  double lum = Luminance(color);
+  double delta = lum - meanLuminances[pixel];
+  meanLuminances[pixel] += delta / n;
+  squaredDiffs[pixel] += delta * (lum - meanLuminances[pixel]);
+}
+
+
+void SampleAccumulator::Resolve(Framebuffer &fb) const
+{
+  assert(fb.GetNumPixels() == means.size() &&
+         "Framebuffer size doesn't match the accumulator!");
+  for (std::size_t i = 0; i < means.size(); ++i)
+    fb[i] = means[i];
+}
+
+
+double SampleAccumulator::GetVariance(std::size_t pixel) const
+{
+  std::uint32_t n = counts[pixel];
+  return n < 2 ? 0.0 : squaredDiffs[pixel] / (n - 1);
+}
+
+
+double SampleAccumulator::GetError(std::size_t pixel) const
+{
+  std::uint32_t n = counts[pixel];
+  if (n < 2)
+    return std::numeric_limits<double>::infinity();
+  return std::sqrt(GetVariance(pixel) / n);
+}
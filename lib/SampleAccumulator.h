@@ -0,0 +1,46 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#include "Framebuffer.h"
+#include <cstdint>
+#include <vector>
+
+// Running per-pixel estimates of a multi-sample render: mean color, and
+// mean and variance of luminance, updated sample by sample (Welford's
+// algorithm), so no samples are stored.
+class SampleAccumulator {
+public:
+  explicit SampleAccumulator(std::size_t numPixels = 0) { Reset(numPixels); }
+
+  // Forget all samples, and resize to \p numPixels pixels.
+  void Reset(std::size_t numPixels);
+
+  void AddSample(std::size_t pixel, const glm::dvec3 &color);
+
+  // Write mean colors to \p fb, which must have as many pixels.
+  void Resolve(Framebuffer &fb) const;
+
+public:
+  std::size_t GetNumPixels() const { return counts.size(); }
+
+  std::uint32_t GetNumSamples(std::size_t pixel) const { return counts[pixel]; }
+  glm::dvec3 GetMean(std::size_t pixel) const { return means[pixel]; }
+
+  // Sample variance of the pixel's luminance. 0 with less than 2 samples.
+  double GetVariance(std::size_t pixel) const;
+
+  // Standard error of the pixel's mean luminance: how far it's expected to
+  // be from the converged value. Infinite with less than 2 samples.
+  double GetError(std::size_t pixel) const;
+
+  static double Luminance(const glm::dvec3 &color) {
+    return 0.2126 * color.r + 0.7152 * color.g + 0.0722 * color.b;
+  }
+
+private:
+  std::vector<glm::dvec3> means;
+  std::vector<double> meanLuminances;
+  // Sum of squared differences from the mean luminance.
+  std::vector<double> squaredDiffs;
+  std::vector<std::uint32_t> counts;
+};
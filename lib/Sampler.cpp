@@ -0,0 +1,378 @@
+#include "Sampler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+
+namespace {
+
+// 2^-32: maps 32-bit fractions to [0, 1).
+const double FractionScale = 1.0 / 4294967296.0;
+
+// Integer hash with good avalanche (Wellons' "lowbias32").
+inline std::uint32_t Hash(std::uint32_t x) {
+  x ^= x >> 16;
+  x *= 0x7FEB352Du;
+  x ^= x >> 15;
+  x *= 0x846CA68Bu;
+  x ^= x >> 16;
+  return x;
+}
+
+inline std::uint32_t HashCombine(std::uint32_t seed, std::uint32_t v) {
+  return seed ^ (Hash(v) + 0x9E3779B9u + (seed << 6) + (seed >> 2));
+}
+
+inline std::uint32_t ReverseBits(std::uint32_t x) {
+  x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+  x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+  x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+  x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+  return (x >> 16) | (x << 16);
+}
+
+
+// === Philox ===
+const std::uint32_t PhiloxM0 = 0xD2511F53u;
+const std::uint32_t PhiloxM1 = 0xCD9E8D57u;
+const std::uint32_t PhiloxW0 = 0x9E3779B9u;
+const std::uint32_t PhiloxW1 = 0xBB67AE85u;
+const unsigned PhiloxRounds = 10;
+
+// Number of Philox blocks computed at once: one block per SIMD lane.
+const std::size_t PhiloxLanes = 16;
+
+// Philox4x32-10 of \p count counters stored as a structure of arrays.
+// Lanes are independent, so the loops vectorize.
+void PhiloxLanesInPlace(std::uint32_t *c0, std::uint32_t *c1,
+                        std::uint32_t *c2, std::uint32_t *c3,
+                        std::size_t count, std::uint32_t key0,
+                        std::uint32_t key1)
+{
+  for (unsigned round = 0; round < PhiloxRounds; ++round) {
+    for (std::size_t i = 0; i < count; ++i) {
+      std::uint64_t p0 = static_cast<std::uint64_t>(PhiloxM0) * c0[i];
+      std::uint64_t p1 = static_cast<std::uint64_t>(PhiloxM1) * c2[i];
+      std::uint32_t x0 = static_cast<std::uint32_t>(p1 >> 32) ^ c1[i] ^ key0;
+      std::uint32_t x1 = static_cast<std::uint32_t>(p1);
+      std::uint32_t x2 = static_cast<std::uint32_t>(p0 >> 32) ^ c3[i] ^ key1;
+      std::uint32_t x3 = static_cast<std::uint32_t>(p0);
+      c0[i] = x0; c1[i] = x1; c2[i] = x2; c3[i] = x3;
+    }
+    key0 += PhiloxW0;
+    key1 += PhiloxW1;
+  }
+}
+
+
+// === Sobol ===
+// Direction numbers of the first SobolDimensions dimensions, built from
+// the primitive polynomials and initial numbers of Joe and Kuo.
+struct SobolDirections {
+  SobolDirections() {
+    // Degree s, polynomial coefficients a and initial numbers m per
+    // dimension. The first dimension is the van der Corput sequence.
+    const unsigned degrees[SobolDimensions] = { 0, 1, 2, 3 };
+    const unsigned coefficients[SobolDimensions] = { 0, 0, 1, 1 };
+    const std::uint32_t initial[SobolDimensions][3] = {
+      { 0, 0, 0 }, { 1, 0, 0 }, { 1, 3, 0 }, { 1, 3, 1 }
+    };
+
+    for (unsigned i = 0; i < 32; ++i)
+      v[0][i] = 1u << (31 - i);
+
+    for (unsigned d = 1; d < SobolDimensions; ++d) {
+      unsigned s = degrees[d];
+      for (unsigned i = 0; i < s; ++i)
+        v[d][i] = initial[d][i] << (31 - i);
+      for (unsigned i = s; i < 32; ++i) {
+        v[d][i] = v[d][i - s] ^ (v[d][i - s] >> s);
+        for (unsigned k = 1; k < s; ++k)
+          v[d][i] ^= ((coefficients[d] >> (s - 1 - k)) & 1u) * v[d][i - k];
+      }
+    }
+  }
+
+  std::uint32_t v[SobolDimensions][32];
+};
+
+
+// Owen-scrambled Sobol: dimension \p dim (< SobolDimensions) of point
+// \p index, with the index shuffled by the same scrambling, so that sets
+// with different seeds are decorrelated.
+double ScrambledSobol(std::uint32_t index, unsigned dim, std::uint32_t seed) {
+  std::uint32_t shuffled = OwenScramble(index, seed);
+  std::uint32_t x = OwenScramble(SobolSample(shuffled, dim),
+                                 HashCombine(seed, dim));
+  return x * FractionScale;
+}
+
+
+// === Blue noise ===
+class BlueNoiseMask {
+public:
+  BlueNoiseMask();
+
+  double Get(unsigned x, unsigned y) const {
+    return values[(y % BlueNoiseSize) * BlueNoiseSize + x % BlueNoiseSize];
+  }
+
+private:
+  static const std::size_t Size = BlueNoiseSize * BlueNoiseSize;
+
+  // Add \p sign times the energy kernel centered at \p p to \p energy.
+  void Splat(std::vector<double> &energy, std::size_t p, double sign) const;
+
+  // Index of the largest (\p largest) or smallest energy among pixels
+  // whose pattern value is \p value.
+  static std::size_t Extreme(const std::vector<double> &energy,
+                             const std::vector<std::uint8_t> &pattern,
+                             std::uint8_t value, bool largest);
+
+  // Gaussian of toroidal distance, indexed by (dy, dx).
+  std::vector<double> kernel;
+  std::vector<double> values;
+};
+
+
+BlueNoiseMask::BlueNoiseMask()
+  : kernel(Size), values(Size)
+{
+  const double Sigma = 1.5;
+  for (unsigned dy = 0; dy < BlueNoiseSize; ++dy) {
+    for (unsigned dx = 0; dx < BlueNoiseSize; ++dx) {
+      double tx = std::min(dx, BlueNoiseSize - dx);
+      double ty = std::min(dy, BlueNoiseSize - dy);
+      kernel[dy * BlueNoiseSize + dx] =
+        std::exp(-(tx * tx + ty * ty) / (2.0 * Sigma * Sigma));
+    }
+  }
+
+  // Initial pattern: a tenth of the pixels, picked by hashing, then
+  // spread evenly by moving the tightest cluster into the largest void.
+  std::vector<std::uint8_t> pattern(Size, 0);
+  std::vector<double> energy(Size, 0.0);
+  std::size_t numOnes = 0;
+  for (std::uint32_t i = 0; numOnes < Size / 10; ++i) {
+    std::size_t p = Hash(i) % Size;
+    if (pattern[p])
+      continue;
+    pattern[p] = 1;
+    Splat(energy, p, 1.0);
+    ++numOnes;
+  }
+  for (;;) {
+    std::size_t cluster = Extreme(energy, pattern, 1, true);
+    pattern[cluster] = 0;
+    Splat(energy, cluster, -1.0);
+    std::size_t gap = Extreme(energy, pattern, 0, false);
+    pattern[gap] = 1;
+    Splat(energy, gap, 1.0);
+    if (gap == cluster)
+      break;
+  }
+
+  std::vector<std::size_t> ranks(Size);
+
+  // Phase 1: rank the initial pattern by removing tightest clusters.
+  std::vector<std::uint8_t> work = pattern;
+  std::vector<double> workEnergy = energy;
+  for (std::size_t rank = numOnes; rank-- > 0;) {
+    std::size_t cluster = Extreme(workEnergy, work, 1, true);
+    work[cluster] = 0;
+    Splat(workEnergy, cluster, -1.0);
+    ranks[cluster] = rank;
+  }
+
+  // Phase 2: fill largest voids up to half of the pixels.
+  std::size_t rank = numOnes;
+  for (; rank < Size / 2; ++rank) {
+    std::size_t gap = Extreme(energy, pattern, 0, false);
+    pattern[gap] = 1;
+    Splat(energy, gap, 1.0);
+    ranks[gap] = rank;
+  }
+
+  // Phase 3: zeros are the minority now. Fill their tightest clusters.
+  std::vector<double> zeroEnergy(Size, 0.0);
+  for (std::size_t p = 0; p < Size; ++p) {
+    if (!pattern[p])
+      Splat(zeroEnergy, p, 1.0);
+  }
+  for (; rank < Size; ++rank) {
+    std::size_t cluster = Extreme(zeroEnergy, pattern, 0, true);
+    pattern[cluster] = 1;
+    Splat(zeroEnergy, cluster, -1.0);
+    ranks[cluster] = rank;
+  }
+
+  for (std::size_t p = 0; p < Size; ++p)
+    values[p] = (ranks[p] + 0.5) / Size;
+}
+
+
+void BlueNoiseMask::Splat(std::vector<double> &energy, std::size_t p,
+                          double sign) const
+{
+  unsigned px = p % BlueNoiseSize;
+  unsigned py = p / BlueNoiseSize;
+  for (unsigned y = 0; y < BlueNoiseSize; ++y) {
+    unsigned dy = (y + BlueNoiseSize - py) % BlueNoiseSize;
+    for (unsigned x = 0; x < BlueNoiseSize; ++x) {
+      unsigned dx = (x + BlueNoiseSize - px) % BlueNoiseSize;
+      energy[y * BlueNoiseSize + x] += sign * kernel[dy * BlueNoiseSize + dx];
+    }
+  }
+}
+
+
+std::size_t BlueNoiseMask::Extreme(const std::vector<double> &energy,
+                                   const std::vector<std::uint8_t> &pattern,
+                                   std::uint8_t value, bool largest)
+{
+  std::size_t best = Size;
+  for (std::size_t p = 0; p < Size; ++p) {
+    if (pattern[p] != value)
+      continue;
+    if (best == Size || (largest ? energy[p] > energy[best]
+                                 : energy[p] < energy[best]))
+      best = p;
+  }
+  assert(best < Size && "No pixel with the requested value!");
+  return best;
+}
+
+
+const BlueNoiseMask &GetBlueNoiseMask() {
+  // Built once, thread-safe since C++11.
+  static const BlueNoiseMask mask;
+  return mask;
+}
+
+} // anonymous namespace
+
+
+// === Building blocks ===
+void Philox4x32(const std::uint32_t counter[4], const std::uint32_t key[2],
+                std::uint32_t result[4])
+{
+  std::uint32_t c0 = counter[0], c1 = counter[1];
+  std::uint32_t c2 = counter[2], c3 = counter[3];
+  PhiloxLanesInPlace(&c0, &c1, &c2, &c3, 1, key[0], key[1]);
+  result[0] = c0; result[1] = c1; result[2] = c2; result[3] = c3;
+}
+
+
+std::uint32_t SobolSample(std::uint32_t index, unsigned dim)
+{
+  assert(dim < SobolDimensions && "Sobol dimension out of range!");
+
+  static const SobolDirections directions;
+  // Branch-free: scrambled indices have random bits.
+  std::uint32_t x = 0;
+  for (unsigned bit = 0; index; index >>= 1, ++bit)
+    x ^= directions.v[dim][bit] & (0u - (index & 1u));
+  return x;
+}
+
+
+std::uint32_t OwenScramble(std::uint32_t x, std::uint32_t seed)
+{
+  // Laine-Karras permutation on reversed bits: every bit is flipped
+  // depending only on the bits above it.
+  x = ReverseBits(x);
+  x += seed;
+  x ^= x * 0x6C50B47Cu;
+  x ^= x * 0xB82F1E52u;
+  x ^= x * 0xC7AFE638u;
+  x ^= x * 0x8D22F6E6u;
+  return ReverseBits(x);
+}
+
+
+double BlueNoise(unsigned x, unsigned y)
+{
+  return GetBlueNoiseMask().Get(x, y);
+}
+
+
+// === Sampler ===
+double Sampler::Get(const glm::uvec2 &regionPixel, std::uint32_t index,
+                    std::uint32_t dim) const
+{
+  const glm::uvec2 pixel = regionPixel + pixelOffset;
+  switch (type) {
+  case SamplerType::Random: {
+    std::uint32_t counter[4] = { dim / 4, index, pixel.x, pixel.y };
+    std::uint32_t key[2] = { seed, 0 };
+    std::uint32_t result[4];
+    Philox4x32(counter, key, result);
+    return result[dim % 4] * FractionScale;
+  }
+
+  case SamplerType::Sobol: {
+    // Dimensions are taken in groups of SobolDimensions, each with its
+    // own scrambling.
+    std::uint32_t pixelSeed = HashCombine(HashCombine(Hash(seed), pixel.x), pixel.y);
+    std::uint32_t groupSeed = HashCombine(pixelSeed, dim / SobolDimensions);
+    return ScrambledSobol(index, dim % SobolDimensions, groupSeed);
+  }
+
+  case SamplerType::BlueNoise: {
+    std::uint32_t groupSeed = HashCombine(Hash(seed), dim / SobolDimensions);
+    double value = ScrambledSobol(index, dim % SobolDimensions, groupSeed);
+
+    // Cranley-Patterson rotation by the mask, shifted differently for
+    // every dimension.
+    std::uint32_t shift = Hash(dim ^ seed);
+    double rotation = BlueNoise(pixel.x + (shift & 0xFFFF), pixel.y + (shift >> 16));
+    value += rotation;
+    return value < 1.0 ? value : value - 1.0;
+  }
+  }
+
+  assert(false && "Unknown sampler type!");
+  return 0.0;
+}
+
+
+void Sampler::Generate(const glm::uvec2 &regionPixel, std::uint32_t index,
+                       std::uint32_t firstDim, std::size_t count,
+                       double *values) const
+{
+  if (type != SamplerType::Random) {
+    for (std::size_t i = 0; i < count; ++i)
+      values[i] = Get(regionPixel, index, firstDim + static_cast<std::uint32_t>(i));
+    return;
+  }
+
+  const glm::uvec2 pixel = regionPixel + pixelOffset;
+  // Philox blocks of 4 dimensions, PhiloxLanes blocks at a time.
+  std::uint32_t c0[PhiloxLanes], c1[PhiloxLanes];
+  std::uint32_t c2[PhiloxLanes], c3[PhiloxLanes];
+  std::uint32_t block = firstDim / 4;
+  std::uint32_t endBlock = static_cast<std::uint32_t>((firstDim + count + 3) / 4);
+  std::size_t out = 0;
+  std::uint32_t skip = firstDim % 4;
+
+  while (block < endBlock) {
+    std::size_t lanes = std::min<std::size_t>(PhiloxLanes, endBlock - block);
+    for (std::size_t i = 0; i < lanes; ++i) {
+      c0[i] = block + static_cast<std::uint32_t>(i);
+      c1[i] = index;
+      c2[i] = pixel.x;
+      c3[i] = pixel.y;
+    }
+    PhiloxLanesInPlace(c0, c1, c2, c3, lanes, seed, 0);
+
+    for (std::size_t i = 0; i < lanes; ++i) {
+      const std::uint32_t words[4] = { c0[i], c1[i], c2[i], c3[i] };
+      for (std::uint32_t w = skip; w < 4 && out < count; ++w)
+        values[out++] = words[w] * FractionScale;
+      skip = 0;
+    }
+    block += static_cast<std::uint32_t>(lanes);
+  }
+}
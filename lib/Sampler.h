@@ -0,0 +1,81 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#include <cstdint>
+
+// Sample generators for Monte Carlo rendering.
+//
+// A sample is addressed by pixel, sample index and dimension, and its value
+// depends on nothing else: no generator state is carried between samples,
+// so images don't depend on the order pixels are rendered in.
+
+enum class SamplerType {
+  // Counter-based random numbers (Philox4x32-10).
+  Random,
+  // Sobol sequence with Owen scrambling, scrambled differently for every
+  // pixel. Converges faster than random numbers for smooth integrands.
+  Sobol,
+  // One Owen-scrambled Sobol sequence shared by all pixels and rotated per
+  // pixel by a blue-noise mask: remaining error looks like high-frequency
+  // noise, which is less visible and easier to filter.
+  BlueNoise,
+};
+
+class Sampler {
+public:
+  explicit Sampler(SamplerType t = SamplerType::Sobol, std::uint32_t s = 0) :
+    type(t), seed(s), pixelOffset(0, 0) {}
+
+  // Pixels passed to Get() and Generate() are relative to \p offset: a
+  // region of an image (see Camera::SetRegion()) gets the samples of the
+  // whole image's pixels.
+  void SetPixelOffset(const glm::uvec2 &offset) { pixelOffset = offset; }
+
+  // Dimension \p dim of sample \p index of \p pixel, in [0, 1).
+  double Get(const glm::uvec2 &pixel, std::uint32_t index,
+             std::uint32_t dim) const;
+
+  // Dimensions [firstDim, firstDim + count) of a sample, written to
+  // \p values. Generated in blocks, the random sampler produces 4 dimensions
+  // per block with SIMD code.
+  void Generate(const glm::uvec2 &pixel, std::uint32_t index,
+                std::uint32_t firstDim, std::size_t count,
+                double *values) const;
+
+public:
+  SamplerType GetType() const { return type; }
+  std::uint32_t GetSeed() const { return seed; }
+  glm::uvec2 GetPixelOffset() const { return pixelOffset; }
+
+private:
+  SamplerType type;
+  std::uint32_t seed;
+  glm::uvec2 pixelOffset;
+};
+
+// === Building blocks ===
+
+// Philox4x32-10 counter-based generator (Salmon et al., "Parallel random
+// numbers: as easy as 1, 2, 3"): 4 random words for a 4-word counter.
+void Philox4x32(const std::uint32_t counter[4], const std::uint32_t key[2],
+                std::uint32_t result[4]);
+
+// Number of dimensions SobolSample supports.
+const unsigned SobolDimensions = 4;
+
+// Dimension \p dim of point \p index of the Sobol sequence, as a 32-bit
+// fixed-point fraction.
+std::uint32_t SobolSample(std::uint32_t index, unsigned dim);
+
+// Nested uniform (Owen) scrambling of a 32-bit fixed-point fraction,
+// hash-based (Burley, "Practical Hash-based Owen Scrambling").
+// Preserves stratification of Sobol points.
+std::uint32_t OwenScramble(std::uint32_t x, std::uint32_t seed);
+
+// Side of the blue-noise mask (pixels). It tiles the screen.
+const unsigned BlueNoiseSize = 64;
+
+// Value of the blue-noise mask at (\p x, \p y), in (0, 1). Every value
+// occurs once per tile. The mask is made by the void-and-cluster method
+// (Ulichney) on first use.
+double BlueNoise(unsigned x, unsigned y);
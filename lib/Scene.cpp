@@ -0,0 +1,49 @@
+#include "Scene.h"
+
+#include <algorithm>
+#include <cmath>
+
+IntersectionResult Scene::Intersect(const Ray &ray) const
+{
+  IntersectionResult finalResult;
+  for (std::size_t i = 0; i < objects.size(); ++i) {
+    IntersectionResult currentResult = objects[i]->Intersect(ray);
+    if (currentResult &&
+        (!finalResult || currentResult < finalResult)) {
+      finalResult = currentResult;
+      finalResult.SetObjectId(static_cast<TObjectId>(i));
+    }
+  }
+
+  return finalResult;
+}
+
+
+bool Scene::IsOccluded(const Ray &ray, double maxDistance) const
+{
+  for (const auto &object : objects) {
+    IntersectionResult result = object->Intersect(ray);
+    if (result && result.GetDistance() < maxDistance)
+      return true;
+  }
+
+  return false;
+}
+
+
+glm::dvec3 Scene::GetDiffuseTint(const IntersectionResult &hit,
+                                 TextureStats &stats) const
+{
+  TTextureId texture = materials.GetDiffuseTexture(hit.GetMaterialId());
+  if (texture == InvalidTextureId || hit.GetTexCoordScale() <= 0.0)
+    return glm::dvec3(1.0);
+
+  // The footprint is stretched by 1 / |cos| along the ray's direction on
+  // the surface. Its geometric mean keeps the filtered area, blurring less
+  // than the long axis at grazing angles; the clamp bounds the blur.
+  double cosine = std::abs(glm::dot(hit.GetNormalVector(),
+                                    hit.GetRay().GetDirection()));
+  double footprint = hit.GetFootprint() / std::sqrt(std::max(cosine, 1.0 / 64.0));
+  return textures.Sample(texture, hit.GetTexCoord(),
+                         footprint * hit.GetTexCoordScale(), stats);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "IntersectionResult.h"
+#include "MaterialManager.h"
+#include "Object3d.h"
+#include "PointLight.h"
+#include "Texture.h"
+#include <memory>
+#include <vector>
+
+// A scene: objects, lights, and the materials and textures they refer to.
+//
+// Scene is built single-threaded. Once Freeze() is called it is read-only
+// (but for its texture cache, which is thread-safe), and any number of
+// render threads may query it concurrently.
+class Scene {
+public:
+  Scene() : background(0.0, 0.0, 0.0) {}
+  Scene(const Scene &other) = delete;
+  Scene& operator= (const Scene &other) = delete;
+
+  MaterialManager &GetMaterials() { return materials; }
+  const MaterialManager &GetMaterials() const { return materials; }
+
+  TextureCache &GetTextures() { return textures; }
+  const TextureCache &GetTextures() const { return textures; }
+
+  // Scene takes ownership of \p object. Returns a pointer to it.
+  template <typename TObject>
+  TObject *AddObject(std::unique_ptr<TObject> object) {
+    TObject *result = object.get();
+    objects.push_back(std::move(object));
+    return result;
+  }
+
+  void AddLight(const PointLight &light) { lights.push_back(light); }
+
+  // Make the scene (and its materials) read-only.
+  void Freeze() { materials.Freeze(); }
+
+  // Closest intersection of \p ray with any object.
+  IntersectionResult Intersect(const Ray &ray) const;
+
+  // Returns true if something intersects \p ray closer than \p maxDistance.
+  bool IsOccluded(const Ray &ray, double maxDistance) const;
+
+  // Factor of the diffuse color of \p hit's material at the hit: its
+  // diffuse texture filtered over the hit's ray footprint, or 1 if the
+  // material has no texture or the surface no texture coordinates.
+  glm::dvec3 GetDiffuseTint(const IntersectionResult &hit,
+                            TextureStats &stats) const;
+
+public:
+  const std::vector<PointLight> &GetLights() const { return lights; }
+  std::size_t GetNumObjects() const { return objects.size(); }
+
+  // Color of rays which hit nothing.
+  void SetBackground(const glm::dvec3 &color) { background = color; }
+  glm::dvec3 GetBackground() const { return background; }
+
+private:
+  MaterialManager materials;
+  TextureCache textures;
+  std::vector<std::unique_ptr<IObject3D>> objects;
+  std::vector<PointLight> lights;
+  glm::dvec3 background;
+};
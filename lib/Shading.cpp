@@ -0,0 +1,434 @@
+#include "Shading.h"
+
+#include <algorithm>
+#include <cmath>
+
+// === HitBatch ===
+void HitBatch::Reserve(std::size_t n)
+{
+  pointX.reserve(n);  pointY.reserve(n);  pointZ.reserve(n);
+  normalX.reserve(n); normalY.reserve(n); normalZ.reserve(n);
+  viewX.reserve(n);   viewY.reserve(n);   viewZ.reserve(n);
+  tintR.reserve(n);   tintG.reserve(n);   tintB.reserve(n);
+  materialIds.reserve(n);
+}
+
+
+void HitBatch::Clear()
+{
+  pointX.clear();  pointY.clear();  pointZ.clear();
+  normalX.clear(); normalY.clear(); normalZ.clear();
+  viewX.clear();   viewY.clear();   viewZ.clear();
+  tintR.clear();   tintG.clear();   tintB.clear();
+  materialIds.clear();
+}
+
+
+void HitBatch::Add(const glm::dvec3 &point, const glm::dvec3 &normal,
+                   const glm::dvec3 &view, TMaterialId mat,
+                   const glm::dvec3 &tint)
+{
+  pointX.push_back(point.x);   pointY.push_back(point.y);   pointZ.push_back(point.z);
+  normalX.push_back(normal.x); normalY.push_back(normal.y); normalZ.push_back(normal.z);
+  viewX.push_back(view.x);     viewY.push_back(view.y);     viewZ.push_back(view.z);
+  tintR.push_back(tint.r);     tintG.push_back(tint.g);     tintB.push_back(tint.b);
+  materialIds.push_back(mat);
+}
+
+
+// === HitLights ===
+void HitLights::Clear()
+{
+  offsets.assign(1, 0);
+  lights.clear();
+  visibility.clear();
+  weights.clear();
+}
+
+
+// === Blinn-Phong kernel ===
+namespace {
+
+// Number of hits processed at once. Chunk temporaries stay in L1.
+const std::size_t ChunkSize = 64;
+
+template <SpecularPowMode Mode>
+inline double SpecularPow(double x, double n);
+
+template <>
+inline double SpecularPow<SpecularPowMode::Exact>(double x, double n)
+{
+  return std::pow(x, n);
+}
+
+template <>
+inline double SpecularPow<SpecularPowMode::Fast>(double x, double n)
+{
+  return x / (n - n * x + x);
+}
+
+
+// Lighting factors of a light at offset (lx, ly, lz) from a surface point
+// with normal \p n and view direction \p v: distance falloff, and diffuse
+// and specular factors (already scaled by visibility \p vis).
+// Branch-free, so loops calling it vectorize.
+template <SpecularPowMode Mode>
+inline void LightFactors(double lx, double ly, double lz,
+                         double nx, double ny, double nz,
+                         double vx, double vy, double vz,
+                         double shininess, double vis, double invRadius,
+                         double &falloff, double &diffuse, double &specular)
+{
+  double dist = std::sqrt(lx * lx + ly * ly + lz * lz);
+  falloff = LightFalloff(dist, invRadius);
+
+  // Direction to the light.
+  double invLen = 1.0 / dist;
+  lx *= invLen; ly *= invLen; lz *= invLen;
+
+  double NdotL = nx * lx + ny * ly + nz * lz;
+  // Points facing away from the light get neither term.
+  double facing = NdotL > 0.0 ? vis : 0.0;
+  diffuse = std::max(NdotL, 0.0) * vis;
+
+  // Half vector.
+  double hx = lx + vx;
+  double hy = ly + vy;
+  double hz = lz + vz;
+  // Clamp avoids a branch for L == -V (zero-length half vector).
+  double hLen2 = std::max(hx * hx + hy * hy + hz * hz, 1.0e-300);
+  double invHLen = 1.0 / std::sqrt(hLen2);
+  double NdotH = (nx * hx + ny * hy + nz * hz) * invHLen;
+  NdotH = std::max(NdotH, 0.0);
+
+  specular = facing * SpecularPow<Mode>(NdotH, shininess);
+}
+
+
+// Material channels of a chunk where every hit has its own material:
+// gathered from the table into per-hit arrays, diffuse times the hit's
+// tint.
+class GatheredMaterials {
+public:
+  GatheredMaterials(const MaterialManager &materials, const HitBatch &hits,
+                    std::size_t begin, std::size_t count) {
+    for (std::size_t i = 0; i < count; ++i) {
+      TMaterialId id = hits.materialIds[begin + i];
+      const glm::dvec3 &ka = materials.GetAmbient(id);
+      const glm::dvec3 &kd = materials.GetDiffuse(id);
+      const glm::dvec3 &ks = materials.GetSpecular(id);
+      kaR[i] = ka.r; kaG[i] = ka.g; kaB[i] = ka.b;
+      kdR[i] = kd.r * hits.tintR[begin + i];
+      kdG[i] = kd.g * hits.tintG[begin + i];
+      kdB[i] = kd.b * hits.tintB[begin + i];
+      ksR[i] = ks.r; ksG[i] = ks.g; ksB[i] = ks.b;
+      shine[i] = materials.GetShininess(id);
+    }
+  }
+
+  double AmbientR(std::size_t i) const { return kaR[i]; }
+  double AmbientG(std::size_t i) const { return kaG[i]; }
+  double AmbientB(std::size_t i) const { return kaB[i]; }
+  double DiffuseR(std::size_t i) const { return kdR[i]; }
+  double DiffuseG(std::size_t i) const { return kdG[i]; }
+  double DiffuseB(std::size_t i) const { return kdB[i]; }
+  double SpecularR(std::size_t i) const { return ksR[i]; }
+  double SpecularG(std::size_t i) const { return ksG[i]; }
+  double SpecularB(std::size_t i) const { return ksB[i]; }
+  double Shininess(std::size_t i) const { return shine[i]; }
+
+private:
+  double kaR[ChunkSize], kaG[ChunkSize], kaB[ChunkSize];
+  double kdR[ChunkSize], kdG[ChunkSize], kdB[ChunkSize];
+  double ksR[ChunkSize], ksG[ChunkSize], ksB[ChunkSize];
+  double shine[ChunkSize];
+};
+
+// Material channels of a chunk where all hits share one material:
+// loaded once and broadcast. Only the diffuse tint is read per hit.
+class UniformMaterial {
+public:
+  UniformMaterial(const MaterialManager &materials, TMaterialId id,
+                  const HitBatch &hits, std::size_t begin) :
+    ka(materials.GetAmbient(id)), kd(materials.GetDiffuse(id)),
+    ks(materials.GetSpecular(id)), shine(materials.GetShininess(id)),
+    tintR(&hits.tintR[begin]), tintG(&hits.tintG[begin]),
+    tintB(&hits.tintB[begin]) {}
+
+  double AmbientR(std::size_t) const { return ka.r; }
+  double AmbientG(std::size_t) const { return ka.g; }
+  double AmbientB(std::size_t) const { return ka.b; }
+  double DiffuseR(std::size_t i) const { return kd.r * tintR[i]; }
+  double DiffuseG(std::size_t i) const { return kd.g * tintG[i]; }
+  double DiffuseB(std::size_t i) const { return kd.b * tintB[i]; }
+  double SpecularR(std::size_t) const { return ks.r; }
+  double SpecularG(std::size_t) const { return ks.g; }
+  double SpecularB(std::size_t) const { return ks.b; }
+  double Shininess(std::size_t) const { return shine; }
+
+private:
+  glm::dvec3 ka, kd, ks;
+  double shine;
+  const double *tintR, *tintG, *tintB;
+};
+
+
+template <SpecularPowMode Mode, typename TMaterials>
+void ShadeChunk(const TMaterials &mat,
+                const std::vector<PointLight> &lights,
+                const HitBatch &hits,
+                const std::vector<double> *visibility,
+                std::size_t begin, std::size_t count,
+                std::vector<glm::dvec3> &colors)
+{
+  // Used instead of a shadow mask row when there is no mask.
+  double allVisible[ChunkSize];
+  std::fill(allVisible, allVisible + count, 1.0);
+
+  // Accumulated color.
+  double accR[ChunkSize], accG[ChunkSize], accB[ChunkSize];
+  std::fill(accR, accR + count, 0.0);
+  std::fill(accG, accG + count, 0.0);
+  std::fill(accB, accB + count, 0.0);
+
+  const double *px = &hits.pointX[begin];
+  const double *py = &hits.pointY[begin];
+  const double *pz = &hits.pointZ[begin];
+  const double *nx = &hits.normalX[begin];
+  const double *ny = &hits.normalY[begin];
+  const double *nz = &hits.normalZ[begin];
+  const double *vx = &hits.viewX[begin];
+  const double *vy = &hits.viewY[begin];
+  const double *vz = &hits.viewZ[begin];
+
+  for (std::size_t l = 0; l < lights.size(); ++l) {
+    const glm::dvec3 lp = lights[l].position;
+    const glm::dvec3 la = lights[l].ambientColor;
+    const glm::dvec3 ld = lights[l].diffuseColor;
+    const glm::dvec3 ls = lights[l].specularColor;
+    const double invRadius = lights[l].GetInvRadius();
+    const double *vis = visibility
+      ? &(*visibility)[l * hits.Size() + begin]
+      : allVisible;
+
+    for (std::size_t i = 0; i < count; ++i) {
+      double falloff, diffuse, spec;
+      LightFactors<Mode>(lp.x - px[i], lp.y - py[i], lp.z - pz[i],
+                         nx[i], ny[i], nz[i], vx[i], vy[i], vz[i],
+                         mat.Shininess(i), vis[i], invRadius,
+                         falloff, diffuse, spec);
+
+      accR[i] += falloff * (mat.AmbientR(i) * la.r + mat.DiffuseR(i) * ld.r * diffuse +
+                            mat.SpecularR(i) * ls.r * spec);
+      accG[i] += falloff * (mat.AmbientG(i) * la.g + mat.DiffuseG(i) * ld.g * diffuse +
+                            mat.SpecularG(i) * ls.g * spec);
+      accB[i] += falloff * (mat.AmbientB(i) * la.b + mat.DiffuseB(i) * ld.b * diffuse +
+                            mat.SpecularB(i) * ls.b * spec);
+    }
+  }
+
+  for (std::size_t i = 0; i < count; ++i)
+    colors[begin + i] = glm::dvec3(accR[i], accG[i], accB[i]);
+}
+
+
+// Shade hits [begin, end) chunk by chunk.
+// If \p uniformId is a valid id, all hits use that material.
+template <SpecularPowMode Mode>
+void ShadeRange(const MaterialManager &materials,
+                TMaterialId uniformId,
+                const std::vector<PointLight> &lights,
+                const HitBatch &hits,
+                const std::vector<double> *visibility,
+                std::size_t begin, std::size_t end,
+                std::vector<glm::dvec3> &colors)
+{
+  for (std::size_t chunk = begin; chunk < end; chunk += ChunkSize) {
+    std::size_t count = std::min(ChunkSize, end - chunk);
+    if (uniformId != InvalidMaterialId) {
+      UniformMaterial mat(materials, uniformId, hits, chunk);
+      ShadeChunk<Mode>(mat, lights, hits, visibility,
+                       chunk, count, colors);
+    } else {
+      GatheredMaterials mat(materials, hits, chunk, count);
+      ShadeChunk<Mode>(mat, lights, hits, visibility,
+                       chunk, count, colors);
+    }
+  }
+}
+
+
+void Shade(const MaterialManager &materials,
+           TMaterialId uniformId,
+           const std::vector<PointLight> &lights,
+           const HitBatch &hits,
+           std::size_t begin, std::size_t end,
+           std::vector<glm::dvec3> &colors,
+           SpecularPowMode powMode,
+           const std::vector<double> *visibility)
+{
+  assert((!visibility || visibility->size() == lights.size() * hits.Size()) &&
+         "Shadow mask size doesn't match the batch!");
+  assert(begin <= end && end <= hits.Size() && "Hit range out of bounds!");
+
+  switch (powMode) {
+  case SpecularPowMode::Exact:
+    ShadeRange<SpecularPowMode::Exact>(materials, uniformId, lights, hits,
+                                       visibility, begin, end, colors);
+    break;
+  case SpecularPowMode::Fast:
+    ShadeRange<SpecularPowMode::Fast>(materials, uniformId, lights, hits,
+                                      visibility, begin, end, colors);
+    break;
+  }
+}
+
+
+// A chunk of (hit, light) pairs for the culled kernel: everything the
+// lighting loop needs, gathered into arrays.
+struct PairChunk {
+  std::size_t count;
+  std::uint32_t hit[ChunkSize];
+  double lx[ChunkSize], ly[ChunkSize], lz[ChunkSize];
+  double nx[ChunkSize], ny[ChunkSize], nz[ChunkSize];
+  double vx[ChunkSize], vy[ChunkSize], vz[ChunkSize];
+  double shine[ChunkSize], vis[ChunkSize], invRadius[ChunkSize];
+  // Material color times light color times pair's weight, per term.
+  double ambR[ChunkSize], ambG[ChunkSize], ambB[ChunkSize];
+  double difR[ChunkSize], difG[ChunkSize], difB[ChunkSize];
+  double speR[ChunkSize], speG[ChunkSize], speB[ChunkSize];
+};
+
+
+template <SpecularPowMode Mode>
+void ShadePairChunk(const PairChunk &pairs, std::vector<glm::dvec3> &colors)
+{
+  double outR[ChunkSize], outG[ChunkSize], outB[ChunkSize];
+  for (std::size_t k = 0; k < pairs.count; ++k) {
+    double falloff, diffuse, spec;
+    LightFactors<Mode>(pairs.lx[k], pairs.ly[k], pairs.lz[k],
+                       pairs.nx[k], pairs.ny[k], pairs.nz[k],
+                       pairs.vx[k], pairs.vy[k], pairs.vz[k],
+                       pairs.shine[k], pairs.vis[k], pairs.invRadius[k],
+                       falloff, diffuse, spec);
+    outR[k] = falloff * (pairs.ambR[k] + pairs.difR[k] * diffuse + pairs.speR[k] * spec);
+    outG[k] = falloff * (pairs.ambG[k] + pairs.difG[k] * diffuse + pairs.speG[k] * spec);
+    outB[k] = falloff * (pairs.ambB[k] + pairs.difB[k] * diffuse + pairs.speB[k] * spec);
+  }
+
+  // Scatter. Pairs of one hit are adjacent, but may span chunks.
+  for (std::size_t k = 0; k < pairs.count; ++k)
+    colors[pairs.hit[k]] += glm::dvec3(outR[k], outG[k], outB[k]);
+}
+
+
+template <SpecularPowMode Mode>
+void ShadeCulled(const MaterialManager &materials,
+                 const std::vector<PointLight> &lights,
+                 const HitBatch &hits,
+                 const HitLights &hitLights,
+                 std::vector<glm::dvec3> &colors)
+{
+  colors.assign(hits.Size(), glm::dvec3(0.0, 0.0, 0.0));
+
+  PairChunk pairs;
+  pairs.count = 0;
+  for (std::size_t i = 0; i < hits.Size(); ++i) {
+    TMaterialId mat = hits.materialIds[i];
+    const glm::dvec3 &ka = materials.GetAmbient(mat);
+    const glm::dvec3 kd = materials.GetDiffuse(mat) *
+      glm::dvec3(hits.tintR[i], hits.tintG[i], hits.tintB[i]);
+    const glm::dvec3 &ks = materials.GetSpecular(mat);
+    double shine = materials.GetShininess(mat);
+
+    for (std::uint32_t j = hitLights.offsets[i]; j < hitLights.offsets[i + 1]; ++j) {
+      const PointLight &light = lights[hitLights.lights[j]];
+      const glm::dvec3 la = hitLights.weights[j] * light.ambientColor;
+      const glm::dvec3 ld = hitLights.weights[j] * light.diffuseColor;
+      const glm::dvec3 ls = hitLights.weights[j] * light.specularColor;
+      std::size_t k = pairs.count++;
+      pairs.hit[k] = static_cast<std::uint32_t>(i);
+      pairs.lx[k] = light.position.x - hits.pointX[i];
+      pairs.ly[k] = light.position.y - hits.pointY[i];
+      pairs.lz[k] = light.position.z - hits.pointZ[i];
+      pairs.nx[k] = hits.normalX[i]; pairs.ny[k] = hits.normalY[i]; pairs.nz[k] = hits.normalZ[i];
+      pairs.vx[k] = hits.viewX[i];   pairs.vy[k] = hits.viewY[i];   pairs.vz[k] = hits.viewZ[i];
+      pairs.shine[k] = shine;
+      pairs.vis[k] = hitLights.visibility[j];
+      pairs.invRadius[k] = light.GetInvRadius();
+      pairs.ambR[k] = ka.r * la.r; pairs.ambG[k] = ka.g * la.g; pairs.ambB[k] = ka.b * la.b;
+      pairs.difR[k] = kd.r * ld.r; pairs.difG[k] = kd.g * ld.g; pairs.difB[k] = kd.b * ld.b;
+      pairs.speR[k] = ks.r * ls.r; pairs.speG[k] = ks.g * ls.g; pairs.speB[k] = ks.b * ls.b;
+
+      if (pairs.count == ChunkSize) {
+        ShadePairChunk<Mode>(pairs, colors);
+        pairs.count = 0;
+      }
+    }
+  }
+
+  if (pairs.count)
+    ShadePairChunk<Mode>(pairs, colors);
+}
+
+} // anonymous namespace
+
+
+void ShadeBlinnPhong(const MaterialManager &materials,
+                     const std::vector<PointLight> &lights,
+                     const HitBatch &hits,
+                     std::vector<glm::dvec3> &colors,
+                     SpecularPowMode powMode,
+                     const std::vector<double> *visibility)
+{
+  colors.resize(hits.Size());
+  Shade(materials, InvalidMaterialId, lights, hits, 0, hits.Size(), colors,
+        powMode, visibility);
+}
+
+
+void ShadeBlinnPhongBucket(const MaterialManager &materials,
+                           TMaterialId mat,
+                           const std::vector<PointLight> &lights,
+                           const HitBatch &hits,
+                           std::size_t begin, std::size_t end,
+                           std::vector<glm::dvec3> &colors,
+                           SpecularPowMode powMode,
+                           const std::vector<double> *visibility)
+{
+  assert(mat != InvalidMaterialId && "Bucket must have a valid material!");
+  assert(colors.size() == hits.Size() && "Colors must be sized to the batch!");
+  #ifndef NDEBUG
+  for (std::size_t i = begin; i < end; ++i)
+    assert(hits.materialIds[i] == mat && "Bucket contains another material!");
+  #endif // !NDEBUG
+
+  Shade(materials, mat, lights, hits, begin, end, colors, powMode, visibility);
+}
+
+
+void ShadeBlinnPhongCulled(const MaterialManager &materials,
+                           const std::vector<PointLight> &lights,
+                           const HitBatch &hits,
+                           const HitLights &hitLights,
+                           std::vector<glm::dvec3> &colors,
+                           SpecularPowMode powMode)
+{
+  assert(hitLights.NumHits() == hits.Size() &&
+         "Light lists don't match the batch!");
+  #ifndef NDEBUG
+  for (std::uint32_t l : hitLights.lights)
+    assert(l < lights.size() && "Light index out of bounds!");
+  #endif // !NDEBUG
+
+  switch (powMode) {
+  case SpecularPowMode::Exact:
+    ShadeCulled<SpecularPowMode::Exact>(materials, lights, hits, hitLights,
+                                        colors);
+    break;
+  case SpecularPowMode::Fast:
+    ShadeCulled<SpecularPowMode::Fast>(materials, lights, hits, hitLights,
+                                       colors);
+    break;
+  }
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#include "MaterialManager.h"
+#include "PointLight.h"
+#include <cstdint>
+#include <vector>
+
+// How pow(N.H, shininess) is evaluated in the specular term.
+enum class SpecularPowMode {
+  // std::pow, reference quality.
+  Exact,
+  // Schlick's rational approximation x / (n - n*x + x).
+  // No transcendental calls, so the light loop vectorizes fully.
+  Fast,
+};
+
+// A batch of surface hits to be shaded, stored as a structure of arrays.
+// All arrays have the same size.
+class HitBatch {
+public:
+  void Reserve(std::size_t n);
+  void Clear();
+
+  // Append a hit. \p normal and \p view must be normalized;
+  // \p view points from the surface towards the viewer. \p tint multiplies
+  // the diffuse color of the hit's material (e.g. its texture's color).
+  void Add(const glm::dvec3 &point, const glm::dvec3 &normal,
+           const glm::dvec3 &view, TMaterialId mat,
+           const glm::dvec3 &tint = glm::dvec3(1.0));
+
+  std::size_t Size() const { return materialIds.size(); }
+  bool Empty() const { return materialIds.empty(); }
+
+  std::vector<double> pointX, pointY, pointZ;
+  std::vector<double> normalX, normalY, normalZ;
+  std::vector<double> viewX, viewY, viewZ;
+  std::vector<double> tintR, tintG, tintB;
+  std::vector<TMaterialId> materialIds;
+};
+
+// Lights assigned to the hits of a batch, for shading with light culling
+// or light sampling. Lights of hit i are entries [offsets[i], offsets[i + 1])
+// of the other arrays: index of the light, its visibility (1.0 if the light
+// is visible from the hit, 0.0 if occluded) and a weight scaling all of its
+// terms (e.g. inverse probability of a sampled light).
+class HitLights {
+public:
+  HitLights() : offsets(1, 0) {}
+
+  void Clear();
+
+  // Add a light to the current hit.
+  void Add(std::uint32_t light, double vis, double weight = 1.0) {
+    lights.push_back(light);
+    visibility.push_back(vis);
+    weights.push_back(weight);
+  }
+
+  // Close the current hit's list and start the next one.
+  void EndHit() { offsets.push_back(static_cast<std::uint32_t>(lights.size())); }
+
+  std::size_t NumHits() const { return offsets.size() - 1; }
+  std::size_t Size() const { return lights.size(); }
+
+  std::vector<std::uint32_t> offsets;
+  std::vector<std::uint32_t> lights;
+  std::vector<double> visibility;
+  std::vector<double> weights;
+};
+
+// Evaluate Blinn-Phong lighting for every hit of \p hits against every light
+// of \p lights. Resulting colors are written to \p colors (resized to
+// hits.Size()), in the same order as the hits.
+//
+// If \p visibility is not null, it is a shadow mask of lights.size() rows
+// by hits.Size() values: visibility[l * hits.Size() + i] is 1.0 if light l
+// is visible from hit i, 0.0 otherwise. Occluded lights only contribute
+// their ambient term. All terms are scaled by the light's distance falloff.
+//
+// Hits are processed in fixed-size chunks: material channels are gathered
+// once per chunk, then each light is applied with a branch-free loop over
+// the chunk's arrays, which the compiler turns into SIMD code.
+void ShadeBlinnPhong(const MaterialManager &materials,
+                     const std::vector<PointLight> &lights,
+                     const HitBatch &hits,
+                     std::vector<glm::dvec3> &colors,
+                     SpecularPowMode powMode = SpecularPowMode::Exact,
+                     const std::vector<double> *visibility = nullptr);
+
+// Same as ShadeBlinnPhong, for hits [begin, end) of \p hits which all use
+// material \p mat (a bucket of a material-sorted batch). Material channels
+// are loaded once for the whole bucket instead of gathered per hit.
+// \p colors must already have hits.Size() elements; only [begin, end) is
+// written.
+void ShadeBlinnPhongBucket(const MaterialManager &materials,
+                           TMaterialId mat,
+                           const std::vector<PointLight> &lights,
+                           const HitBatch &hits,
+                           std::size_t begin, std::size_t end,
+                           std::vector<glm::dvec3> &colors,
+                           SpecularPowMode powMode = SpecularPowMode::Exact,
+                           const std::vector<double> *visibility = nullptr);
+
+// Same as ShadeBlinnPhong, but hit i is only lit by its own lights listed in
+// \p hitLights, which must have a list for every hit. Cost is proportional
+// to the number of (hit, light) pairs rather than hits times lights.
+//
+// Pairs are processed in chunks: hit, material and light data of a chunk
+// are gathered into arrays, lit with the same branch-free loop as in
+// ShadeBlinnPhong, and the results are added to their hits' colors.
+void ShadeBlinnPhongCulled(const MaterialManager &materials,
+                           const std::vector<PointLight> &lights,
+                           const HitBatch &hits,
+                           const HitLights &hitLights,
+                           std::vector<glm::dvec3> &colors,
+                           SpecularPowMode powMode = SpecularPowMode::Exact);
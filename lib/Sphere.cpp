@@ -1,4 +1,7 @@
 #include "Sphere.h"
+#include "glm/gtc/constants.hpp"
+
+#include <cmath>
 
 
 IntersectionResult Sphere::Intersect(const Ray &ray) const {
@@ -34,5 +37,11 @@ IntersectionResult Sphere::Intersect(const Ray &ray) const {
   // Normal vector for sphere's surface.
   glm::dvec3 normal = glm::normalize(intersectionPoint - center);
 
-  return IntersectionResult(ray, dist, normal, &material);
+  // Longitude and latitude, v = 0 at the top.
+  IntersectionResult result(ray, dist, normal, material, 1.0 / radius);
+  const double pi = glm::pi<double>();
+  result.SetTexCoord(glm::dvec2(0.5 + std::atan2(normal.z, normal.x) / (2.0 * pi),
+                                std::acos(glm::clamp(normal.y, -1.0, 1.0)) / pi),
+                     1.0 / (pi * radius));
+  return result;
 }
@@ -5,7 +5,7 @@
 
 class Sphere : public IObject3D {
 public:
-  Sphere(const glm::dvec3 c, double r, const Material &mat)
+  Sphere(const glm::dvec3 c, double r, TMaterialId mat)
     : center(c)
     , radius(r)
     , material(mat)
@@ -15,9 +15,10 @@ public:
 
 public:
   double GetRadius() const { return radius; }
+  TMaterialId GetMaterialId() const { return material; }
 
 private:
   glm::dvec3 center;
   double radius;
-  const Material &material;
+  TMaterialId material;
 };
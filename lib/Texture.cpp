@@ -0,0 +1,483 @@
+#include "Texture.h"
+#include "PageLoader.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+namespace {
+
+// File layout: header of HeaderWords 32-bit words, then tiles of all levels,
+// finest level first, each level's tiles row by row. Every tile holds
+// tileSize x tileSize texels (RGBA row by row, or BC1 blocks row by row);
+// tiles over the edge of their level are padded with edge texels.
+const std::uint32_t Magic = 0x50494D54; // "TMIP"
+const std::uint32_t Version = 2;
+const unsigned HeaderWords = 7;
+const unsigned BytesPerTexel = 4;
+const unsigned BlockSize = 4;
+const unsigned BytesPerBlock = 8;
+
+// Position of a BC1 texel's color between the block's endpoints, by index.
+const double BC1Weights[4] = { 0.0, 1.0, 1.0 / 3.0, 2.0 / 3.0 };
+
+std::size_t TileBytes(TextureFormat format, unsigned tileSize)
+{
+  std::size_t texels = static_cast<std::size_t>(tileSize) * tileSize;
+  switch (format) {
+  case TextureFormat::RGBA8:
+    return texels * BytesPerTexel;
+  case TextureFormat::BC1:
+    return texels / (BlockSize * BlockSize) * BytesPerBlock;
+  }
+  return 0;
+}
+
+// Number of levels of a pyramid down to 1 x 1.
+unsigned NumLevels(unsigned width, unsigned height)
+{
+  unsigned levels = 1;
+  for (unsigned size = std::max(width, height); size > 1; size /= 2)
+    ++levels;
+  return levels;
+}
+
+
+std::uint8_t Quantize(float value)
+{
+  return static_cast<std::uint8_t>(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+
+std::uint16_t PackRGB565(const glm::vec3 &c)
+{
+  auto bits = [](float value, float levels) {
+    return static_cast<std::uint16_t>(std::min(std::max(value, 0.0f), 1.0f) * levels + 0.5f);
+  };
+  return static_cast<std::uint16_t>((bits(c.r, 31.0f) << 11) | (bits(c.g, 63.0f) << 5) |
+                                    bits(c.b, 31.0f));
+}
+
+
+glm::vec3 UnpackRGB565(std::uint16_t c)
+{
+  return glm::vec3((c >> 11) / 31.0f, ((c >> 5) & 63) / 63.0f, (c & 31) / 31.0f);
+}
+
+
+// Encode 4 x 4 \p texels (row by row) as a BC1 block at \p out.
+void EncodeBC1Block(const glm::vec3 *texels, std::uint8_t *out)
+{
+  const unsigned N = BlockSize * BlockSize;
+
+  // Endpoints: the extreme colors along the principal axis of the block's
+  // colors, found by power iteration on their covariance.
+  glm::vec3 mean(0.0f);
+  for (unsigned i = 0; i < N; ++i)
+    mean += texels[i];
+  mean /= static_cast<float>(N);
+  glm::mat3 covariance(0.0f);
+  for (unsigned i = 0; i < N; ++i) {
+    glm::vec3 d = texels[i] - mean;
+    covariance += glm::outerProduct(d, d);
+  }
+  glm::vec3 axis(1.0f, 1.0f, 1.0f);
+  for (int iteration = 0; iteration < 8; ++iteration) {
+    glm::vec3 next = covariance * axis;
+    float length = glm::length(next);
+    if (length < 1.0e-12f)
+      break;
+    axis = next / length;
+  }
+  unsigned lo = 0, hi = 0;
+  for (unsigned i = 1; i < N; ++i) {
+    float t = glm::dot(texels[i] - mean, axis);
+    if (t < glm::dot(texels[lo] - mean, axis))
+      lo = i;
+    if (t > glm::dot(texels[hi] - mean, axis))
+      hi = i;
+  }
+
+  // The first endpoint must be the greater for four-color blocks. Equal
+  // endpoints make a block of one color (index 0).
+  std::uint16_t c0 = PackRGB565(texels[hi]);
+  std::uint16_t c1 = PackRGB565(texels[lo]);
+  if (c0 < c1)
+    std::swap(c0, c1);
+  glm::vec3 e0 = UnpackRGB565(c0), e1 = UnpackRGB565(c1);
+
+  std::uint32_t indices = 0;
+  if (c0 != c1) {
+    for (unsigned i = 0; i < N; ++i) {
+      unsigned best = 0;
+      float bestDist = std::numeric_limits<float>::max();
+      for (unsigned k = 0; k < 4; ++k) {
+        glm::vec3 d = texels[i] - glm::mix(e0, e1, static_cast<float>(BC1Weights[k]));
+        float dist = glm::dot(d, d);
+        if (dist < bestDist) {
+          bestDist = dist;
+          best = k;
+        }
+      }
+      indices |= best << (2 * i);
+    }
+  }
+
+  out[0] = static_cast<std::uint8_t>(c0);
+  out[1] = static_cast<std::uint8_t>(c0 >> 8);
+  out[2] = static_cast<std::uint8_t>(c1);
+  out[3] = static_cast<std::uint8_t>(c1 >> 8);
+  for (unsigned b = 0; b < 4; ++b)
+    out[4 + b] = static_cast<std::uint8_t>(indices >> (8 * b));
+}
+
+
+// Encode \p texels of a tile (row by row) in \p format at \p out.
+void EncodeTile(TextureFormat format, unsigned tileSize,
+                const std::vector<glm::vec3> &texels, std::uint8_t *out)
+{
+  switch (format) {
+  case TextureFormat::RGBA8:
+    for (const glm::vec3 &c : texels) {
+      *out++ = Quantize(c.r);
+      *out++ = Quantize(c.g);
+      *out++ = Quantize(c.b);
+      *out++ = 255;
+    }
+    break;
+  case TextureFormat::BC1:
+    for (unsigned by = 0; by < tileSize; by += BlockSize) {
+      for (unsigned bx = 0; bx < tileSize; bx += BlockSize) {
+        glm::vec3 block[BlockSize * BlockSize];
+        for (unsigned y = 0; y < BlockSize; ++y) {
+          for (unsigned x = 0; x < BlockSize; ++x)
+            block[y * BlockSize + x] = texels[static_cast<std::size_t>(by + y) * tileSize + bx + x];
+        }
+        EncodeBC1Block(block, out);
+        out += BytesPerBlock;
+      }
+    }
+    break;
+  }
+}
+
+
+// Colors of 4 texels at (\p xs[k], \p ys[k]) within tiles \p tiles[k].
+// Decoding is the same arithmetic for every texel, without branches, so
+// the loops are vectorizable.
+void DecodeTexels(TextureFormat format, unsigned tileSize,
+                  const std::uint8_t *const *tiles,
+                  const unsigned *xs, const unsigned *ys,
+                  double *r, double *g, double *b)
+{
+  switch (format) {
+  case TextureFormat::RGBA8:
+    for (unsigned k = 0; k < 4; ++k) {
+      const std::uint8_t *p = tiles[k] +
+        ((ys[k] % tileSize) * tileSize + xs[k] % tileSize) * BytesPerTexel;
+      r[k] = p[0] * (1.0 / 255.0);
+      g[k] = p[1] * (1.0 / 255.0);
+      b[k] = p[2] * (1.0 / 255.0);
+    }
+    break;
+  case TextureFormat::BC1: {
+    const unsigned blocksPerRow = tileSize / BlockSize;
+    for (unsigned k = 0; k < 4; ++k) {
+      unsigned x = xs[k] % tileSize, y = ys[k] % tileSize;
+      const std::uint8_t *block = tiles[k] +
+        ((y / BlockSize) * blocksPerRow + x / BlockSize) * BytesPerBlock;
+      unsigned c0 = block[0] | (block[1] << 8);
+      unsigned c1 = block[2] | (block[3] << 8);
+      std::uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) |
+                              (static_cast<std::uint32_t>(block[7]) << 24);
+      unsigned texel = (y % BlockSize) * BlockSize + x % BlockSize;
+      double w = BC1Weights[(indices >> (2 * texel)) & 3];
+      r[k] = ((1.0 - w) * (c0 >> 11) + w * (c1 >> 11)) * (1.0 / 31.0);
+      g[k] = ((1.0 - w) * ((c0 >> 5) & 63) + w * ((c1 >> 5) & 63)) * (1.0 / 63.0);
+      b[k] = ((1.0 - w) * (c0 & 31) + w * (c1 & 31)) * (1.0 / 31.0);
+    }
+    break;
+  }
+  }
+}
+
+} // anonymous namespace
+
+
+bool WriteTexture(const std::string &path, unsigned width, unsigned height,
+                  const std::vector<glm::vec3> &texels, unsigned tileSize,
+                  TextureFormat format)
+{
+  assert(width && height && "Texture must not be empty!");
+  assert(texels.size() == static_cast<std::size_t>(width) * height &&
+         "Texel count doesn't match the texture's size!");
+  assert(tileSize && "Tiles must not be empty!");
+  assert((format != TextureFormat::BC1 || tileSize % BlockSize == 0) &&
+         "BC1 tiles must be made of whole blocks!");
+
+  std::FILE *file = std::fopen(path.c_str(), "wb");
+  if (!file)
+    return false;
+
+  unsigned numLevels = NumLevels(width, height);
+  std::uint32_t header[HeaderWords] = { Magic, Version, width, height,
+                                        tileSize, numLevels,
+                                        static_cast<std::uint32_t>(format) };
+  bool ok = std::fwrite(header, sizeof(header), 1, file) == 1;
+
+  std::vector<glm::vec3> level(texels);
+  std::vector<glm::vec3> tileTexels(static_cast<std::size_t>(tileSize) * tileSize);
+  std::vector<std::uint8_t> tile(TileBytes(format, tileSize));
+  unsigned w = width, h = height;
+  for (unsigned l = 0; l < numLevels && ok; ++l) {
+    if (l) {
+      // Box filter of 2 x 2 texels, the last row or column of odd sizes
+      // repeated.
+      unsigned nw = std::max(w / 2, 1u), nh = std::max(h / 2, 1u);
+      std::vector<glm::vec3> next(static_cast<std::size_t>(nw) * nh);
+      for (unsigned y = 0; y < nh; ++y) {
+        unsigned y0 = std::min(2 * y, h - 1), y1 = std::min(2 * y + 1, h - 1);
+        for (unsigned x = 0; x < nw; ++x) {
+          unsigned x0 = std::min(2 * x, w - 1), x1 = std::min(2 * x + 1, w - 1);
+          next[static_cast<std::size_t>(y) * nw + x] =
+            0.25f * (level[static_cast<std::size_t>(y0) * w + x0] +
+                     level[static_cast<std::size_t>(y0) * w + x1] +
+                     level[static_cast<std::size_t>(y1) * w + x0] +
+                     level[static_cast<std::size_t>(y1) * w + x1]);
+        }
+      }
+      level.swap(next);
+      w = nw;
+      h = nh;
+    }
+
+    for (unsigned ty = 0; ty * tileSize < h && ok; ++ty) {
+      for (unsigned tx = 0; tx * tileSize < w && ok; ++tx) {
+        for (unsigned y = 0; y < tileSize; ++y) {
+          unsigned sy = std::min(ty * tileSize + y, h - 1);
+          for (unsigned x = 0; x < tileSize; ++x) {
+            unsigned sx = std::min(tx * tileSize + x, w - 1);
+            tileTexels[static_cast<std::size_t>(y) * tileSize + x] =
+              level[static_cast<std::size_t>(sy) * w + sx];
+          }
+        }
+        EncodeTile(format, tileSize, tileTexels, tile.data());
+        ok = std::fwrite(tile.data(), tile.size(), 1, file) == 1;
+      }
+    }
+  }
+
+  return std::fclose(file) == 0 && ok;
+}
+
+
+// === TextureCache ===
+class TextureCache::TileMemo {
+public:
+  TileMemo(const TextureCache &c, const Texture &t, TextureStats &s) :
+    cache(c), texture(t), stats(s), count(0) {}
+
+  // Texels of tile \p index.
+  const std::uint8_t *Get(std::size_t index) {
+    for (unsigned i = 0; i < count; ++i) {
+      if (indices[i] == index)
+        return tiles[i]->data();
+    }
+    assert(count < MaxTiles && "Lookup touches too many tiles!");
+    indices[count] = index;
+    tiles[count] = cache.GetTile(texture, index, stats);
+    return tiles[count++]->data();
+  }
+
+private:
+  // Two levels of 2 x 2 texels.
+  static const unsigned MaxTiles = 8;
+
+  const TextureCache &cache;
+  const Texture &texture;
+  TextureStats &stats;
+  unsigned count;
+  std::size_t indices[MaxTiles];
+  std::shared_ptr<const Tile> tiles[MaxTiles];
+};
+
+
+TextureCache::TextureCache(std::size_t b)
+  : tiles(b)
+{
+}
+
+
+TextureCache::~TextureCache()
+{
+  for (const std::unique_ptr<Texture> &texture : textures)
+    std::fclose(texture->file);
+}
+
+
+TTextureId TextureCache::AddTexture(const std::string &path)
+{
+  assert(textures.size() < InvalidTextureId && "Too many textures!");
+
+  std::FILE *file = std::fopen(path.c_str(), "rb");
+  if (!file)
+    return InvalidTextureId;
+
+  std::uint32_t header[HeaderWords];
+  if (std::fread(header, sizeof(header), 1, file) != 1 ||
+      header[0] != Magic || header[1] != Version ||
+      !header[2] || !header[3] || !header[4] ||
+      header[5] != NumLevels(header[2], header[3]) ||
+      header[6] > static_cast<std::uint32_t>(TextureFormat::BC1) ||
+      (header[6] == static_cast<std::uint32_t>(TextureFormat::BC1) &&
+       header[4] % BlockSize)) {
+    std::fclose(file);
+    return InvalidTextureId;
+  }
+
+  std::unique_ptr<Texture> texture(new Texture());
+  texture->file = file;
+  texture->width = header[2];
+  texture->height = header[3];
+  texture->tileSize = header[4];
+  texture->format = static_cast<TextureFormat>(header[6]);
+  texture->tileBytes = TileBytes(texture->format, texture->tileSize);
+  texture->numTiles = 0;
+  unsigned w = texture->width, h = texture->height;
+  for (unsigned l = 0; l < header[5]; ++l) {
+    Level level;
+    level.width = w;
+    level.height = h;
+    level.tilesX = (w + texture->tileSize - 1) / texture->tileSize;
+    level.tilesY = (h + texture->tileSize - 1) / texture->tileSize;
+    level.firstTile = texture->numTiles;
+    texture->levels.push_back(level);
+    texture->numTiles += static_cast<std::size_t>(level.tilesX) * level.tilesY;
+    w = std::max(w / 2, 1u);
+    h = std::max(h / 2, 1u);
+  }
+
+  // Truncated files would only fail when their tiles are needed.
+  long expected = static_cast<long>(sizeof(header) +
+                                    texture->numTiles * texture->tileBytes);
+  if (std::fseek(file, 0, SEEK_END) != 0 || std::ftell(file) != expected) {
+    std::fclose(file);
+    return InvalidTextureId;
+  }
+
+  texture->firstPage = tiles.AddPages(texture->numTiles);
+  texture->black = std::make_shared<Tile>(texture->tileBytes, 0);
+  textures.push_back(std::move(texture));
+  return static_cast<TTextureId>(textures.size() - 1);
+}
+
+
+void TextureCache::Clear()
+{
+  tiles.Clear();
+}
+
+
+glm::dvec3 TextureCache::Sample(TTextureId id, const glm::dvec2 &uv,
+                                double footprint, TextureStats &stats) const
+{
+  assert(id < textures.size() && "Texture id out of bounds!");
+  const Texture &texture = *textures[id];
+  glm::dvec2 wrapped = uv - glm::floor(uv);
+
+  // Level whose texels are as wide as the footprint.
+  double maxLevel = static_cast<double>(texture.levels.size() - 1);
+  double texels = footprint * std::max(texture.width, texture.height);
+  double lod = std::min(std::log2(std::max(texels, 1.0)), maxLevel);
+  unsigned level = static_cast<unsigned>(lod);
+  double t = lod - level;
+
+  TileMemo memo(*this, texture, stats);
+  glm::dvec3 color = SampleLevel(texture, level, wrapped, memo);
+  if (t > 0.0)
+    color = glm::mix(color, SampleLevel(texture, level + 1, wrapped, memo), t);
+  return color;
+}
+
+
+glm::dvec3 TextureCache::SampleLevel(const Texture &texture, unsigned level,
+                                     const glm::dvec2 &uv, TileMemo &memo) const
+{
+  const Level &lv = texture.levels[level];
+  const unsigned tileSize = texture.tileSize;
+
+  // Texel centers around the point, wrapped.
+  double x = uv.x * lv.width - 0.5;
+  double y = uv.y * lv.height - 0.5;
+  double fx = std::floor(x), fy = std::floor(y);
+  double wx = x - fx, wy = y - fy;
+  unsigned x0 = fx < 0.0 ? lv.width - 1 : static_cast<unsigned>(fx);
+  unsigned y0 = fy < 0.0 ? lv.height - 1 : static_cast<unsigned>(fy);
+  unsigned x1 = x0 + 1 < lv.width ? x0 + 1 : 0;
+  unsigned y1 = y0 + 1 < lv.height ? y0 + 1 : 0;
+
+  // The 4 texels, decoded together.
+  const unsigned xs[4] = { x0, x1, x0, x1 };
+  const unsigned ys[4] = { y0, y0, y1, y1 };
+  const std::uint8_t *tiles[4];
+  for (unsigned i = 0; i < 4; ++i) {
+    tiles[i] = memo.Get(lv.firstTile +
+                        static_cast<std::size_t>(ys[i] / tileSize) * lv.tilesX +
+                        xs[i] / tileSize);
+  }
+  double r[4], g[4], b[4];
+  DecodeTexels(texture.format, tileSize, tiles, xs, ys, r, g, b);
+
+  const double w[4] = { (1.0 - wx) * (1.0 - wy), wx * (1.0 - wy),
+                        (1.0 - wx) * wy, wx * wy };
+  glm::dvec3 color(0.0);
+  for (unsigned i = 0; i < 4; ++i)
+    color += w[i] * glm::dvec3(r[i], g[i], b[i]);
+  return color;
+}
+
+
+std::shared_ptr<const TextureCache::Tile>
+TextureCache::GetTile(const Texture &texture, std::size_t index,
+                      TextureStats &stats) const
+{
+  assert(index < texture.numTiles && "Tile index out of bounds!");
+  // Deferred loads count their reads in the loader's stats.
+  bool hit;
+  std::shared_ptr<const Tile> tile = tiles.Get(texture.firstPage + index,
+    [&](std::size_t &bytes) -> std::shared_ptr<Tile> {
+      bytes = texture.tileBytes;
+      return ReadTile(texture, index, stats);
+    },
+    [this, &texture, index](PageLoader *loader) {
+      GetTile(texture, index, loader->GetTextureStats());
+    },
+    texture.black, hit);
+  if (hit)
+    ++stats.tileHits;
+  return tile;
+}
+
+
+std::shared_ptr<TextureCache::Tile>
+TextureCache::ReadTile(const Texture &texture, std::size_t index,
+                       TextureStats &stats) const
+{
+  std::size_t tileBytes = texture.tileBytes;
+  std::shared_ptr<Tile> tile = std::make_shared<Tile>(tileBytes, 0);
+  {
+    std::lock_guard<std::mutex> fileLock(texture.fileMutex);
+    long offset = static_cast<long>(HeaderWords * sizeof(std::uint32_t) +
+                                    index * tileBytes);
+    // The size was checked when the texture was added: a failed read
+    // leaves the tile black.
+    if (std::fseek(texture.file, offset, SEEK_SET) != 0 ||
+        std::fread(tile->data(), tileBytes, 1, texture.file) != 1)
+      std::fill(tile->begin(), tile->end(), 0);
+  }
+  ++stats.tileMisses;
+  stats.bytesRead += tileBytes;
+  return tile;
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include "PageCache.h"
+#include "glm/glm.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Dense texture identifier, assigned by TextureCache.
+using TTextureId = std::uint32_t;
+
+// Id which doesn't refer to any texture.
+const TTextureId InvalidTextureId = std::numeric_limits<TTextureId>::max();
+
+// Storage of a texture's tiles.
+enum class TextureFormat : std::uint32_t {
+  // 8 bits per channel, 4 bytes per texel.
+  RGBA8,
+  // Blocks of 4 x 4 texels in 8 bytes (BC1 / DXT1 without transparency):
+  // two RGB565 endpoints and a 2-bit index per texel into the endpoints and
+  // the two colors a third and two thirds of the way between them. 8 times
+  // smaller than RGBA8, decoded texel by texel when sampled.
+  BC1,
+};
+
+// Texture cache activity of a render (or of one thread's part of it).
+struct TextureStats {
+  TextureStats() : tileHits(0), tileMisses(0), bytesRead(0) {}
+
+  TextureStats &operator+=(const TextureStats &other) {
+    tileHits += other.tileHits;
+    tileMisses += other.tileMisses;
+    bytesRead += other.bytesRead;
+    return *this;
+  }
+
+  // Tile accesses of lookups which found the tile resident, and which had
+  // to read it from its file.
+  std::uint64_t tileHits;
+  std::uint64_t tileMisses;
+  std::uint64_t bytesRead;
+};
+
+// Write a texture of \p width x \p height linear colors in [0, 1] (row by
+// row from the top, v = 0) to \p path as a tiled MIP pyramid: every level
+// halves the previous one with a box filter, down to 1 x 1, and is cut
+// into tiles of \p tileSize x \p tileSize texels stored in \p format
+// (tileSize must be a multiple of 4 for BC1). Returns false if the file
+// can't be written.
+bool WriteTexture(const std::string &path, unsigned width, unsigned height,
+                  const std::vector<glm::vec3> &texels,
+                  unsigned tileSize = 64,
+                  TextureFormat format = TextureFormat::RGBA8);
+
+// Textures of a scene, read from tiled MIP pyramid files (see WriteTexture)
+// a tile at a time, on first access.
+//
+// Resident tiles of all textures share a budget of bytes. When a load
+// takes the cache over the budget, the least recently used tiles are
+// evicted down to 7/8 of it by whichever thread gets there first; others
+// don't wait for it. Recency is counted in loads, so lookups of resident
+// tiles don't advance a shared clock.
+//
+// Every tile has its own lock, held while it's looked up or loaded: threads
+// only wait for each other when they want the same tile at once. A
+// lookup keeps a reference to the tiles it reads, so a tile evicted under
+// it stays valid until the lookup is done.
+//
+// Textures are added while the scene is built. Lookups may then be made
+// by any number of threads. Within a PageMissScope, tiles which aren't
+// resident are read by its loader and sampled as black meanwhile.
+class TextureCache {
+public:
+  explicit TextureCache(std::size_t budget = DefaultBudget);
+  ~TextureCache();
+  TextureCache(const TextureCache &other) = delete;
+  TextureCache& operator= (const TextureCache &other) = delete;
+
+  // Open texture file \p path and return its id, or InvalidTextureId if
+  // it can't be read. No tiles are read yet.
+  TTextureId AddTexture(const std::string &path);
+
+  // Trilinearly filtered color at \p uv (wrapped to [0, 1)), for a lookup
+  // covering \p footprint of the texture's width in u and v: the MIP
+  // levels whose texels are about that size are blended. Tile accesses
+  // are counted in \p stats.
+  glm::dvec3 Sample(TTextureId id, const glm::dvec2 &uv, double footprint,
+                    TextureStats &stats) const;
+
+  // Evict all tiles.
+  void Clear();
+
+public:
+  std::size_t GetNumTextures() const { return textures.size(); }
+  unsigned GetWidth(TTextureId id) const { return textures[id]->width; }
+  unsigned GetHeight(TTextureId id) const { return textures[id]->height; }
+  unsigned GetNumLevels(TTextureId id) const {
+    return static_cast<unsigned>(textures[id]->levels.size());
+  }
+  TextureFormat GetFormat(TTextureId id) const { return textures[id]->format; }
+
+  // A smaller budget is enforced by the next load.
+  void SetBudget(std::size_t b) { tiles.SetBudget(b); }
+  std::size_t GetBudget() const { return tiles.GetBudget(); }
+  std::size_t GetResidentBytes() const { return tiles.GetResidentBytes(); }
+
+  static const std::size_t DefaultBudget = std::size_t(256) << 20;
+
+private:
+  // Texels of a tile, in the texture's format.
+  using Tile = std::vector<std::uint8_t>;
+
+  struct Level {
+    unsigned width, height;
+    unsigned tilesX, tilesY;
+    // Index of the level's first tile among all tiles of the texture.
+    std::size_t firstTile;
+  };
+
+  struct Texture {
+    std::FILE *file;
+    // Serializes seeks and reads of file.
+    mutable std::mutex fileMutex;
+    unsigned width, height, tileSize;
+    TextureFormat format;
+    std::size_t tileBytes;
+    std::vector<Level> levels;
+    std::size_t numTiles;
+    // Page of the texture's first tile in the cache.
+    std::size_t firstPage;
+    // Seen in place of tiles whose load a PageMissScope defers.
+    std::shared_ptr<const Tile> black;
+  };
+
+  // Tiles looked up by one Sample() call, so texels sharing a tile don't
+  // lock it again.
+  class TileMemo;
+
+  // Reference to tile \p index of \p texture, loaded if it isn't resident.
+  // Black if it isn't and a PageMissScope defers the load.
+  std::shared_ptr<const Tile> GetTile(const Texture &texture,
+                                      std::size_t index,
+                                      TextureStats &stats) const;
+  // Read tile \p index of \p texture. Black if it can't be read.
+  std::shared_ptr<Tile> ReadTile(const Texture &texture, std::size_t index,
+                                 TextureStats &stats) const;
+
+  // Bilinearly filtered color of MIP level \p level at \p uv.
+  glm::dvec3 SampleLevel(const Texture &texture, unsigned level,
+                         const glm::dvec2 &uv, TileMemo &memo) const;
+
+  std::vector<std::unique_ptr<Texture>> textures;
+  // Tiles of all textures.
+  PageCache<Tile> tiles;
+};
@@ -1,5 +1,237 @@
+#include "Renderer.h"
+#include "ImageWriter.h"
+#include "Mesh.h"
+#include "Sphere.h"
 
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
 
-int main() {
+namespace {
+
+void PrintUsage(const char *program) {
+  std::cerr << "Usage: " << program << " [options]\n"
+            << "Options:\n"
+            << "  --wavefront          Use wavefront (ray queue) renderer\n"
+            << "  --deferred           Use tiled deferred renderer\n"
+            << "  --path-trace         Monte Carlo path tracing (use with --spp)\n"
+            << "  --threads <N>        Path tracing threads (default: all cores)\n"
+            << "  --async-paging       Suspend samples waiting for geometry or\n"
+            << "                       texture pages (with --path-trace)\n"
+            << "  --irradiance-cache   Cache diffuse lighting (with --path-trace)\n"
+            << "  --photons <N>        Light caustics from a photon map of up to N\n"
+            << "                       photons (with --path-trace)\n"
+            << "  --fast-pow           Approximate specular pow()\n"
+            << "  --depth <N>          Maximal number of reflection bounces\n"
+            << "  --no-roulette        Trace every path to full depth\n"
+            << "  --no-light-grid      Light every hit by all lights\n"
+            << "  --light-samples <N>  Sample N lights per hit from a light tree\n"
+            << "  --size <W> <H>       Image resolution\n"
+            << "  --spp <MIN> <MAX>    Adaptive number of samples per pixel\n"
+            << "  --time-budget <S>    Stop refining after S seconds (with --spp)\n"
+            << "  --denoise            Filter the image guided by primary hits\n"
+            << "  --floor-texture <F>  Texture the floor with tiled MIP file F\n"
+            << "  --texture-cache <MB> Memory budget of texture tiles\n"
+            << "  --output <F>         Write the image to F (.ppm, .png or .exr)\n"
+            << "  --aov <LIST>         Also write AOVs of the primary hits to the .exr\n"
+            << "                       output: comma separated depth, normal, albedo, id\n"
+            << "  --bands <N>          Render bands of N rows, streamed to the output\n"
+            << "                       while the next ones render (not with --denoise)\n";
+}
+
+// Demo scene: a checker of spheres over a reflective floor, textured with
+// \p floorTexture if it isn't empty.
+bool BuildDemoScene(Scene &scene, const std::string &floorTexture) {
+  MaterialManager &materials = scene.GetMaterials();
+  Material floorMaterial(glm::dvec3(0.1), glm::dvec3(0.3), glm::dvec3(0.5), 20.0);
+  if (!floorTexture.empty()) {
+    TTextureId texture = scene.GetTextures().AddTexture(floorTexture);
+    if (texture == InvalidTextureId) {
+      std::cerr << "Can't read texture " << floorTexture << "\n";
+      return false;
+    }
+    // Brighter, as the texture darkens it.
+    floorMaterial = Material(glm::dvec3(0.1), glm::dvec3(0.3), glm::dvec3(0.9), 20.0);
+    floorMaterial.SetDiffuseTexture(texture);
+  }
+  TMaterialId floor = materials.AddMaterial("floor", floorMaterial);
+  TMaterialId mirror = materials.AddMaterial("mirror",
+    Material(glm::dvec3(0.0), glm::dvec3(0.9), glm::dvec3(0.05), 200.0));
+  TMaterialId red = materials.AddMaterial("red",
+    Material(glm::dvec3(0.1, 0.0, 0.0), glm::dvec3(0.2), glm::dvec3(0.8, 0.1, 0.1), 30.0));
+  TMaterialId blue = materials.AddMaterial("blue",
+    Material(glm::dvec3(0.0, 0.0, 0.1), glm::dvec3(0.2), glm::dvec3(0.1, 0.2, 0.8), 30.0));
+
+  // The texture repeats every 4 units.
+  std::unique_ptr<Mesh> plane(new Mesh(false, floor));
+  const glm::dvec3 corners[4] = {
+    glm::dvec3(-20.0, 0.0, -20.0), glm::dvec3(-20.0, 0.0, 20.0),
+    glm::dvec3(20.0, 0.0, 20.0), glm::dvec3(20.0, 0.0, -20.0) };
+  TMeshIndex v[4];
+  for (int i = 0; i < 4; ++i) {
+    v[i] = plane->AddVertex(corners[i]);
+    plane->SetTexCoord(v[i], glm::dvec2(corners[i].x + 20.0, corners[i].z + 20.0) / 4.0);
+  }
+  plane->AddQuadFace(v[0], v[1], v[2], v[3]);
+  plane->CalculateNormals();
+  scene.AddObject(std::move(plane));
+
+  const TMaterialId sphereMaterials[] = { mirror, red, blue };
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      scene.AddObject(std::unique_ptr<Sphere>(new Sphere(
+        glm::dvec3(3.0 * (i - 1), 1.0, 3.0 * j), 1.0,
+        sphereMaterials[(i + j) % 3])));
+    }
+  }
+
+  scene.AddLight(PointLight(glm::dvec3(-5.0, 10.0, -5.0), glm::dvec3(0.1),
+                            glm::dvec3(0.7), glm::dvec3(0.7)));
+  scene.AddLight(PointLight(glm::dvec3(8.0, 6.0, 0.0), glm::dvec3(0.0),
+                            glm::dvec3(0.3), glm::dvec3(0.3)));
+  scene.SetBackground(glm::dvec3(0.3, 0.5, 0.8));
+  scene.Freeze();
+  return true;
+}
+
+} // anonymous namespace
+
+
+int main(int argc, char **argv) {
+  RenderSettings settings;
+  unsigned width = 640, height = 480;
+  bool denoise = false;
+  std::string output;
+  TAovMask aovMask = 0;
+  unsigned bandRows = 0;
+  std::string floorTexture;
+  std::size_t textureCacheBytes = TextureCache::DefaultBudget;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--wavefront")) {
+      settings.mode = RenderMode::Wavefront;
+    } else if (!std::strcmp(argv[i], "--deferred")) {
+      settings.mode = RenderMode::Deferred;
+    } else if (!std::strcmp(argv[i], "--path-trace")) {
+      settings.integrator = Integrator::PathTracing;
+    } else if (!std::strcmp(argv[i], "--irradiance-cache")) {
+      settings.irradianceCaching = true;
+    } else if (!std::strcmp(argv[i], "--photons") && i + 1 < argc) {
+      settings.photonMapping = true;
+      settings.photonMap.maxPhotons = std::atoi(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--threads") && i + 1 < argc) {
+      settings.numThreads = std::atoi(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--async-paging")) {
+      settings.asyncPaging = true;
+    } else if (!std::strcmp(argv[i], "--fast-pow")) {
+      settings.powMode = SpecularPowMode::Fast;
+    } else if (!std::strcmp(argv[i], "--depth") && i + 1 < argc) {
+      settings.maxDepth = std::atoi(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--no-roulette")) {
+      settings.throughputCutoff = 0.0;
+      settings.rouletteThroughput = 0.0;
+    } else if (!std::strcmp(argv[i], "--no-light-grid")) {
+      settings.lightCulling = false;
+    } else if (!std::strcmp(argv[i], "--light-samples") && i + 1 < argc) {
+      settings.directLighting = DirectLighting::SampledLights;
+      settings.lightSamplesPerHit = std::atoi(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--spp") && i + 2 < argc) {
+      settings.minSamples = std::atoi(argv[++i]);
+      settings.maxSamples = std::atoi(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--time-budget") && i + 1 < argc) {
+      settings.timeBudget = std::atof(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--denoise")) {
+      denoise = true;
+    } else if (!std::strcmp(argv[i], "--floor-texture") && i + 1 < argc) {
+      floorTexture = argv[++i];
+    } else if (!std::strcmp(argv[i], "--texture-cache") && i + 1 < argc) {
+      textureCacheBytes = static_cast<std::size_t>(std::atoi(argv[++i])) << 20;
+    } else if (!std::strcmp(argv[i], "--output") && i + 1 < argc) {
+      output = argv[++i];
+    } else if (!std::strcmp(argv[i], "--aov") && i + 1 < argc) {
+      if (!ParseAovs(argv[++i], aovMask)) {
+        std::cerr << "Unknown AOV in " << argv[i] << "\n";
+        return 1;
+      }
+    } else if (!std::strcmp(argv[i], "--bands") && i + 1 < argc) {
+      bandRows = std::atoi(argv[++i]);
+    } else if (!std::strcmp(argv[i], "--size") && i + 2 < argc) {
+      width = std::atoi(argv[++i]);
+      height = std::atoi(argv[++i]);
+    } else {
+      PrintUsage(argv[0]);
+      return 1;
+    }
+  }
+
+  Scene scene;
+  scene.GetTextures().SetBudget(textureCacheBytes);
+  if (!BuildDemoScene(scene, floorTexture))
+    return 1;
+  Camera camera(glm::dvec3(0.0, 4.0, -10.0), glm::dvec3(0.0, -0.3, 1.0),
+                glm::uvec2(width, height));
+
+  ImageFormat format = ImageFormat::PPM;
+  if (!output.empty() && !GetImageFormat(output, format)) {
+    std::cerr << "Unknown image format of " << output << "\n";
+    return 1;
+  }
+  if (aovMask && (output.empty() || format != ImageFormat::EXR)) {
+    std::cerr << "AOVs need an .exr output\n";
+    return 1;
+  }
+  Renderer renderer(settings);
+
+  // Bands: only one band's framebuffer is in memory, and each one is
+  // encoded and written while the next renders.
+  if (bandRows && !output.empty() && !denoise) {
+    ImageWriter writer;
+    if (!writer.Open(output, format, width, height, aovMask)) {
+      std::cerr << "Can't write " << output << "\n";
+      return 1;
+    }
+    RenderStats stats;
+    for (unsigned y = 0; y < height; y += bandRows) {
+      unsigned rows = std::min(bandRows, height - y);
+      Camera band = camera;
+      band.SetRegion(glm::uvec2(0, y), glm::uvec2(width, rows));
+      Framebuffer fb(width, rows);
+      AovBuffers aovs(aovMask);
+      renderer.Render(scene, band, fb, nullptr, aovMask ? &aovs : nullptr);
+      stats += renderer.GetStats();
+      writer.WriteRegion(0, y, fb, aovMask ? &aovs : nullptr);
+    }
+    stats.samplesPerPixel = static_cast<double>(stats.samples) / (std::size_t(width) * height);
+    std::cout << stats;
+    bool written = writer.Close();
+    const ImageWriterStats &writeStats = writer.GetStats();
+    std::cout << "Output:          " << writeStats.bytesWritten << " bytes, "
+              << writeStats.writeSeconds << " s writing, "
+              << writeStats.peakBufferedBytes << " bytes buffered at most\n";
+    if (!written) {
+      std::cerr << "Can't write " << output << "\n";
+      return 1;
+    }
+    return 0;
+  }
+
+  Framebuffer fb(width, height);
+  GuideBuffers guides;
+  AovBuffers aovs(aovMask);
+  renderer.Render(scene, camera, fb, denoise ? &guides : nullptr,
+                  aovMask ? &aovs : nullptr);
+
+  std::cout << renderer.GetStats();
+  if (denoise) {
+    Denoiser denoiser;
+    denoiser.Denoise(fb, guides, fb);
+    std::cout << "Denoise time:    " << denoiser.GetSeconds() << " s\n";
+  }
+  if (!output.empty() &&
+      !(aovMask ? WriteImage(output, fb, aovs) : WriteImage(output, fb))) {
+    std::cerr << "Can't write " << output << "\n";
+    return 1;
+  }
   return 0;
-}
\ No newline at end of file
+}
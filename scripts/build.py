@@ -23,6 +23,11 @@ def parse_args():
                       default=False,
                       help='Run tests after successful build')
 
+  parser.add_argument('-b', '--bench',
+                      action='store_true',
+                      default=False,
+                      help='Run benchmarks after successful build')
+
   parser.add_argument('-c', '--compiler',
                       default=None,
                       help='C++ compiler to use')
@@ -86,10 +91,15 @@ def build(args):
 
       subprocess.check_call(cmd_list)
 
+  def run_benchmarks():
+    if args.bench:
+      subprocess.check_call([os.path.join('bench', 'Benchmarks')])
+
   goto_build_dir()
   run_cmake()
   run_make()
   run_tests()
+  run_benchmarks()
 
 
 def main():
@@ -0,0 +1,71 @@
+#include "Tests.h"
+#include "AovBuffers.h"
+
+#include <cmath>
+#include <string>
+
+namespace {
+
+IntersectionResult Hit(double distance, TObjectId object) {
+  IntersectionResult hit(Ray(ZERO_VEC, Z_NORM_VEC), distance, -Z_NORM_VEC,
+                         testMaterialId1);
+  hit.SetObjectId(object);
+  return hit;
+}
+
+} // anonymous namespace
+
+// === AovBuffers tests ===
+TEST(AovBuffersTests, ParseTest) {
+  TAovMask mask;
+  ASSERT_TRUE(ParseAovs("depth", mask));
+  ASSERT_EQ(mask, AovBit(Aov::Depth));
+  ASSERT_TRUE(ParseAovs("id,albedo,normal", mask));
+  ASSERT_EQ(mask, AovBit(Aov::ObjectId) | AovBit(Aov::Albedo) |
+                  AovBit(Aov::Normal));
+  ASSERT_FALSE(ParseAovs("depth,color", mask));
+  ASSERT_FALSE(ParseAovs("", mask));
+  ASSERT_FALSE(ParseAovs("depth,", mask));
+}
+
+TEST(AovBuffersTests, ChannelTest) {
+  AovBuffers aovs(AovBit(Aov::ObjectId) | AovBit(Aov::Normal));
+  aovs.Reset(3, 2);
+  ASSERT_EQ(aovs.GetNumPixels(), 6u);
+  ASSERT_EQ(aovs.GetNumChannels(), 4u);
+  const char *const names[] = { "N.X", "N.Y", "N.Z", "id" };
+  const std::vector<float> *planes[] = {
+    &aovs.normalX, &aovs.normalY, &aovs.normalZ, &aovs.objectId };
+  for (unsigned c = 0; c < 4; ++c) {
+    ASSERT_EQ(std::string(aovs.GetChannelName(c)), names[c]);
+    ASSERT_EQ(&aovs.GetChannel(c), planes[c]);
+    ASSERT_EQ(aovs.GetChannel(c).size(), 6u);
+  }
+  ASSERT_TRUE(aovs.depth.empty() && aovs.albedoG.empty());
+  ASSERT_EQ(AovBuffers::GetNumChannels(AovBit(Aov::Albedo)), 3u);
+  ASSERT_EQ(std::string(AovBuffers::GetChannelName(AovBit(Aov::Depth), 0)), "Z");
+}
+
+TEST(AovBuffersTests, ResolveTest) {
+  AovBuffers aovs(AovBit(Aov::Depth) | AovBit(Aov::Normal) |
+                  AovBit(Aov::Albedo) | AovBit(Aov::ObjectId));
+  aovs.Reset(2, 1);
+  // Pixel 0: two samples hit objects 3 and 5, pixel 1: nothing.
+  aovs.AddHit(0, Hit(2.0, 3), Y_NORM_VEC, glm::dvec3(0.2, 0.4, 0.6));
+  aovs.AddHit(0, Hit(4.0, 5), X_NORM_VEC, glm::dvec3(0.4, 0.4, 0.4));
+  aovs.Resolve();
+
+  ASSERT_FLOAT_EQ(aovs.depth[0], 3.0f);
+  ASSERT_FLOAT_EQ(aovs.normalX[0], 0.5f);
+  ASSERT_FLOAT_EQ(aovs.normalY[0], 0.5f);
+  ASSERT_FLOAT_EQ(aovs.normalZ[0], 0.0f);
+  ASSERT_FLOAT_EQ(aovs.albedoR[0], 0.3f);
+  ASSERT_FLOAT_EQ(aovs.albedoB[0], 0.5f);
+  // The first hit's object, not a mean.
+  ASSERT_EQ(aovs.objectId[0], 3.0f);
+
+  ASSERT_TRUE(std::isinf(aovs.depth[1]));
+  ASSERT_EQ(aovs.normalY[1], 0.0f);
+  ASSERT_EQ(aovs.albedoG[1], 0.0f);
+  ASSERT_EQ(aovs.objectId[1], -1.0f);
+}
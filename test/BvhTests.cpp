@@ -0,0 +1,125 @@
+#include "Tests.h"
+#include "Bvh.h"
+
+#include <algorithm>
+#include <random>
+#include <set>
+
+namespace {
+
+// Random boxes of up to 1 unit in [-10, 10]^3, some of them flat.
+void RandomBoxes(unsigned count, std::vector<glm::dvec3> &boxMin,
+                 std::vector<glm::dvec3> &boxMax) {
+  std::mt19937 rng(3);
+  std::uniform_real_distribution<double> position(-10.0, 10.0);
+  std::uniform_real_distribution<double> size(0.0, 1.0);
+  for (unsigned i = 0; i < count; ++i) {
+    glm::dvec3 lo(position(rng), position(rng), position(rng));
+    glm::dvec3 extent(size(rng), size(rng), i % 3 ? size(rng) : 0.0);
+    boxMin.push_back(lo);
+    boxMax.push_back(lo + extent);
+  }
+}
+
+bool Contains(const BvhNode &node, const glm::dvec3 &lo, const glm::dvec3 &hi) {
+  for (int a = 0; a < 3; ++a) {
+    if (node.boundsMin[a] > lo[a] || node.boundsMax[a] < hi[a])
+      return false;
+  }
+  return true;
+}
+
+} // anonymous namespace
+
+// === BVH tests ===
+TEST(BvhTests, BuildTest) {
+  std::vector<glm::dvec3> boxMin, boxMax;
+  RandomBoxes(1000, boxMin, boxMax);
+  std::vector<BvhNode> nodes;
+  std::vector<std::uint32_t> order;
+  BuildBvh(boxMin, boxMax, 4, nodes, order);
+
+  // Every item in exactly one leaf, within its bounds and those of the
+  // nodes above.
+  std::vector<std::uint32_t> sorted(order);
+  std::sort(sorted.begin(), sorted.end());
+  for (std::uint32_t i = 0; i < sorted.size(); ++i)
+    ASSERT_EQ(sorted[i], i);
+  std::vector<std::uint32_t> parents(1, 0);
+  std::size_t leafItems = 0;
+  for (std::uint32_t n = 0; n < nodes.size(); ++n) {
+    const BvhNode &node = nodes[n];
+    if (node.IsLeaf()) {
+      ASSERT_LE(node.count, 4u);
+      leafItems += node.count;
+      for (std::uint32_t i = node.index; i < node.index + node.count; ++i)
+        ASSERT_TRUE(Contains(node, boxMin[order[i]], boxMax[order[i]]));
+    } else {
+      ASSERT_GT(node.index, n + 1);
+      ASSERT_LT(node.index, nodes.size());
+    }
+  }
+  ASSERT_EQ(leafItems, order.size());
+
+  BuildBvh(std::vector<glm::dvec3>(), std::vector<glm::dvec3>(), 4, nodes, order);
+  ASSERT_TRUE(nodes.empty() && order.empty());
+}
+
+TEST(BvhTests, TraverseTest) {
+  std::vector<glm::dvec3> boxMin, boxMax;
+  RandomBoxes(1000, boxMin, boxMax);
+  std::vector<BvhNode> nodes;
+  std::vector<std::uint32_t> order;
+  BuildBvh(boxMin, boxMax, 2, nodes, order);
+
+  std::mt19937 rng(5);
+  std::uniform_real_distribution<double> dist(-1.0, 1.0);
+  for (int r = 0; r < 200; ++r) {
+    glm::dvec3 direction(dist(rng), dist(rng), dist(rng));
+    // Some rays along axes, through flat boxes.
+    if (r % 4 == 0)
+      direction = glm::dvec3(0.0, 0.0, r % 8 ? 1.0 : -1.0);
+    Ray ray(glm::dvec3(dist(rng), dist(rng), dist(rng)) * 12.0,
+            glm::normalize(direction));
+
+    // Items whose boxes the ray passes through, by brute force.
+    std::set<std::uint32_t> expected;
+    for (std::uint32_t i = 0; i < boxMin.size(); ++i) {
+      double tNear = 0.0, tFar = 1.0e30;
+      for (int a = 0; a < 3; ++a) {
+        double o = ray.GetOrigin()[a], d = ray.GetDirection()[a];
+        if (d == 0.0) {
+          if (o < boxMin[i][a] || o > boxMax[i][a])
+            tNear = 2.0e30;
+          continue;
+        }
+        double t0 = (boxMin[i][a] - o) / d, t1 = (boxMax[i][a] - o) / d;
+        tNear = std::max(tNear, std::min(t0, t1));
+        tFar = std::min(tFar, std::max(t0, t1));
+      }
+      if (tNear <= tFar)
+        expected.insert(i);
+    }
+
+    std::set<std::uint32_t> visited;
+    double maxDistance = 1.0e30;
+    TraverseBvh(nodes, ray, maxDistance,
+                [&](std::uint32_t first, std::uint32_t count) {
+      for (std::uint32_t i = first; i < first + count; ++i)
+        visited.insert(order[i]);
+    });
+    for (std::uint32_t i : expected)
+      ASSERT_TRUE(visited.count(i));
+
+    // Lowering the distance prunes the walk: nothing beyond the first leaf
+    // hit.
+    maxDistance = 1.0e30;
+    unsigned leaves = 0;
+    TraverseBvh(nodes, ray, maxDistance,
+                [&](std::uint32_t, std::uint32_t) {
+      ++leaves;
+      maxDistance = -1.0;
+    });
+    ASSERT_LE(leaves, 1u);
+  }
+}
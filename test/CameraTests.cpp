@@ -55,3 +55,61 @@ TEST(CameraTests, MoveTest) {
   ASSERT_VEC_NEAR(camera.GetDirection(), -Y_NORM_VEC, EPS_STRONG);
   ASSERT_VEC_NEAR(camera.GetPosition(), glm::dvec3(0.0, -5.0, 0.0), EPS_STRONG);
 }
+
+TEST(CameraTests, PrimaryRayTest) {
+  glm::uvec2 cameraRes(640, 480);
+  Camera camera(ZERO_VEC, Z_NORM_VEC, cameraRes, 90.0);
+
+  // Center of the image looks along camera's direction.
+  Ray center = camera.GetPrimaryRay(320.0, 240.0);
+  ASSERT_VEC_NEAR(center.GetOrigin(), ZERO_VEC, EPS_STRONG);
+  ASSERT_VEC_NEAR(center.GetDirection(), Z_NORM_VEC, EPS_STRONG);
+
+  // Top edge is 45 degrees up (fov = 90), bottom edge 45 degrees down.
+  Ray top = camera.GetPrimaryRay(320.0, 0.0);
+  ASSERT_VEC_NEAR(top.GetDirection(), glm::normalize(Y_NORM_VEC + Z_NORM_VEC), EPS_WEAK);
+  Ray bottom = camera.GetPrimaryRay(320.0, 480.0);
+  ASSERT_VEC_NEAR(bottom.GetDirection(), glm::normalize(Z_NORM_VEC - Y_NORM_VEC), EPS_WEAK);
+
+  // Left and right edges are symmetric.
+  Ray left = camera.GetPrimaryRay(0.0, 240.0);
+  Ray right = camera.GetPrimaryRay(640.0, 240.0);
+  ASSERT_NEAR(left.GetDirection().x, -right.GetDirection().x, EPS_STRONG);
+  ASSERT_NEAR(left.GetDirection().z, right.GetDirection().z, EPS_STRONG);
+}
+
+TEST(CameraTests, FootprintTest) {
+  glm::uvec2 cameraRes(640, 480);
+  Camera camera(ZERO_VEC, Z_NORM_VEC, cameraRes, 90.0);
+
+  // At the center of the image, the footprint is as wide as a pixel: the
+  // distance between the hits of neighbouring rays on a plane facing the
+  // camera.
+  const double Distance = 50.0;
+  Ray center = camera.GetPrimaryRay(320.5, 240.5);
+  Ray next = camera.GetPrimaryRay(321.5, 240.5);
+  glm::dvec3 a = center.GetDirection() * (Distance / center.GetDirection().z);
+  glm::dvec3 b = next.GetDirection() * (Distance / next.GetDirection().z);
+  ASSERT_NEAR(center.GetWidthAt(glm::length(a)), glm::length(b - a), 1.0e-4);
+  ASSERT_NEAR(camera.GetPixelSpread(), 2.0 / 480.0, 1.0e-6);
+}
+
+TEST(CameraTests, RegionTest) {
+  glm::uvec2 cameraRes(640, 480);
+  Camera camera(ZERO_VEC, Z_NORM_VEC, cameraRes, 90.0);
+  Camera region = camera;
+  region.SetRegion(glm::uvec2(100, 200), glm::uvec2(64, 32));
+  ASSERT_EQ(region.GetResolution(), glm::uvec2(64, 32));
+  ASSERT_EQ(region.GetImageResolution(), cameraRes);
+  ASSERT_EQ(region.GetRegionOffset(), glm::uvec2(100, 200));
+
+  // Rays of the region are those of the whole image, shifted.
+  for (double x : { 0.0, 10.5, 64.0 }) {
+    for (double y : { 0.0, 31.5 }) {
+      ASSERT_VEC_NEAR(region.GetPrimaryRay(x, y).GetDirection(),
+                      camera.GetPrimaryRay(x + 100.0, y + 200.0).GetDirection(),
+                      EPS_STRONG);
+    }
+  }
+  ASSERT_NEAR(region.GetPixelSpread(), camera.GetPixelSpread(), EPS_STRONG);
+}
@@ -0,0 +1,100 @@
+#include "Tests.h"
+#include "Denoiser.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+// Image of two flat surfaces meeting at a vertical edge: left half faces
+// +Y with gray 0.2, right half faces +X with gray 0.8. Every pixel gets
+// uniform noise of amplitude \p noise, and the matching error estimate.
+class DenoiserTests : public ::testing::Test {
+protected:
+  void SetUp() override {
+    guides.Reset(Size, Size);
+    for (unsigned y = 0; y < Size; ++y) {
+      for (unsigned x = 0; x < Size; ++x) {
+        std::size_t i = y * Size + x;
+        bool left = x < Size / 2;
+        guides.normalX[i] = left ? 0.0f : 1.0f;
+        guides.normalY[i] = left ? 1.0f : 0.0f;
+        guides.albedoR[i] = guides.albedoG[i] = guides.albedoB[i] = 0.5f;
+        guides.depth[i] = 10.0f;
+      }
+    }
+  }
+
+  static double Truth(unsigned x) { return x < Size / 2 ? 0.2 : 0.8; }
+
+  Framebuffer NoisyImage(double noise) {
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<double> dist(-noise, noise);
+    Framebuffer fb(Size, Size);
+    for (unsigned y = 0; y < Size; ++y)
+      for (unsigned x = 0; x < Size; ++x)
+        fb.At(x, y) = glm::dvec3(Truth(x) + dist(rng));
+    std::fill(guides.error.begin(), guides.error.end(),
+              static_cast<float>(noise / std::sqrt(3.0)));
+    return fb;
+  }
+
+  double RMSE(const Framebuffer &fb) {
+    double sum = 0.0;
+    for (unsigned y = 0; y < Size; ++y)
+      for (unsigned x = 0; x < Size; ++x)
+        sum += std::pow(fb.At(x, y).g - Truth(x), 2.0);
+    return std::sqrt(sum / fb.GetNumPixels());
+  }
+
+  static const unsigned Size = 64;
+
+  GuideBuffers guides;
+};
+
+// === Denoiser tests ===
+TEST_F(DenoiserTests, NoiseFreeTest) {
+  Framebuffer clean = NoisyImage(0.0);
+  Framebuffer fb(Size, Size);
+  Denoiser().Denoise(clean, guides, fb);
+  ASSERT_LT(RMSE(fb), 1.0e-6);
+}
+
+TEST_F(DenoiserTests, NoiseReductionTest) {
+  Framebuffer noisy = NoisyImage(0.2);
+  Framebuffer fb(Size, Size);
+  Denoiser denoiser;
+  denoiser.Denoise(noisy, guides, fb);
+  ASSERT_GT(denoiser.GetSeconds(), 0.0);
+  ASSERT_LT(4.0 * RMSE(fb), RMSE(noisy));
+
+  // The edge is kept: columns next to it don't bleed into each other
+  // (which would pull them towards 0.5).
+  for (unsigned x : { Size / 2 - 1, Size / 2 }) {
+    double mean = 0.0;
+    for (unsigned y = 0; y < Size; ++y)
+      mean += fb.At(x, y).g / Size;
+    ASSERT_NEAR(mean, Truth(x), 0.05);
+  }
+
+  // In place.
+  denoiser.Denoise(noisy, guides, noisy);
+  for (std::size_t i = 0; i < fb.GetNumPixels(); ++i)
+    ASSERT_VEC_NEAR(noisy[i], fb[i], EPS_STRONG);
+}
+
+TEST_F(DenoiserTests, ThreadsTest) {
+  Framebuffer noisy = NoisyImage(0.2);
+  DenoiseSettings settings;
+  settings.numThreads = 1;
+  Framebuffer single(Size, Size);
+  Denoiser(settings).Denoise(noisy, guides, single);
+
+  // More threads than rows too.
+  for (unsigned threads : { 3u, 100u }) {
+    settings.numThreads = threads;
+    Framebuffer parallel(Size, Size);
+    Denoiser(settings).Denoise(noisy, guides, parallel);
+    for (std::size_t i = 0; i < single.GetNumPixels(); ++i)
+      ASSERT_VEC_NEAR(single[i], parallel[i], EPS_STRONG);
+  }
+}
@@ -0,0 +1,563 @@
+#include "Tests.h"
+#include "ImageWriter.h"
+#include "Renderer.h"
+#include "Mesh.h"
+#include "Sphere.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+const unsigned Width = 101;
+const unsigned Height = 77;
+
+// Smooth colors, with values out of [0, 1] in a corner.
+Framebuffer TestImage() {
+  Framebuffer fb(Width, Height);
+  for (unsigned y = 0; y < Height; ++y) {
+    for (unsigned x = 0; x < Width; ++x) {
+      fb.At(x, y) = glm::dvec3(static_cast<double>(x) / Width,
+                               static_cast<double>(y) / Height,
+                               0.5 + 0.5 * std::sin(0.1 * x) * std::cos(0.2 * y));
+    }
+  }
+  fb.At(0, 0) = glm::dvec3(-1.0, 2.0, 8.0);
+  return fb;
+}
+
+// Region of \p fb of \p w x \p h pixels from (\p x, \p y).
+Framebuffer Crop(const Framebuffer &fb, unsigned x, unsigned y, unsigned w,
+                 unsigned h) {
+  Framebuffer region(w, h);
+  for (unsigned j = 0; j < h; ++j) {
+    for (unsigned i = 0; i < w; ++i)
+      region.At(i, j) = fb.At(x + i, y + j);
+  }
+  return region;
+}
+
+std::vector<std::uint8_t> ReadFile(const std::string &path) {
+  std::vector<std::uint8_t> data;
+  std::FILE *file = std::fopen(path.c_str(), "rb");
+  if (!file)
+    return data;
+  std::uint8_t buffer[4096];
+  for (std::size_t n; (n = std::fread(buffer, 1, sizeof(buffer), file)) > 0;)
+    data.insert(data.end(), buffer, buffer + n);
+  std::fclose(file);
+  return data;
+}
+
+std::uint32_t GetBE32(const std::uint8_t *p) {
+  return (std::uint32_t(p[0]) << 24) | (std::uint32_t(p[1]) << 16) |
+         (std::uint32_t(p[2]) << 8) | p[3];
+}
+
+std::uint32_t GetLE32(const std::uint8_t *p) {
+  return (std::uint32_t(p[3]) << 24) | (std::uint32_t(p[2]) << 16) |
+         (std::uint32_t(p[1]) << 8) | p[0];
+}
+
+std::uint32_t Crc32(const std::uint8_t *data, std::size_t size) {
+  std::uint32_t crc = ~0u;
+  for (std::size_t i = 0; i < size; ++i) {
+    crc ^= data[i];
+    for (int k = 0; k < 8; ++k)
+      crc = crc & 1 ? 0xEDB88320u ^ (crc >> 1) : crc >> 1;
+  }
+  return ~crc;
+}
+
+// Decoder of the deflate streams ImageWriter makes: stored blocks and
+// blocks of fixed Huffman codes. Returns false if the stream is invalid.
+bool Inflate(const std::vector<std::uint8_t> &in, std::vector<std::uint8_t> &out) {
+  static const unsigned LengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+  static const unsigned LengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+  static const unsigned DistanceBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+  static const unsigned DistanceExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+  std::size_t bit = 0;
+  auto bits = [&](unsigned n) {
+    unsigned value = 0;
+    for (unsigned i = 0; i < n; ++i, ++bit) {
+      if (bit / 8 < in.size())
+        value |= ((in[bit / 8] >> (bit % 8)) & 1u) << i;
+    }
+    return value;
+  };
+  auto code = [&](unsigned n, unsigned value) {
+    for (unsigned i = 0; i < n; ++i)
+      value = (value << 1) | bits(1);
+    return value;
+  };
+
+  for (;;) {
+    unsigned final = bits(1), type = bits(2);
+    if (type == 0) {
+      bit = (bit + 7) / 8 * 8;
+      unsigned length = bits(16), complement = bits(16);
+      if (length != (~complement & 0xFFFF) || bit / 8 + length > in.size())
+        return false;
+      out.insert(out.end(), in.begin() + bit / 8, in.begin() + bit / 8 + length);
+      bit += 8 * length;
+    } else if (type == 1) {
+      for (;;) {
+        unsigned symbol = code(7, 0);
+        if (symbol <= 0x17) {
+          symbol += 256;
+        } else {
+          symbol = code(1, symbol);
+          if (symbol >= 0x30 && symbol <= 0xBF)
+            symbol -= 0x30;
+          else if (symbol >= 0xC0 && symbol <= 0xC7)
+            symbol = symbol - 0xC0 + 280;
+          else
+            symbol = code(1, symbol) - 0x190 + 144;
+        }
+        if (symbol < 256) {
+          out.push_back(static_cast<std::uint8_t>(symbol));
+          continue;
+        }
+        if (symbol == 256)
+          break;
+        if (symbol > 285)
+          return false;
+        unsigned length = LengthBase[symbol - 257] + bits(LengthExtra[symbol - 257]);
+        unsigned distanceCode = code(5, 0);
+        if (distanceCode >= 30)
+          return false;
+        unsigned distance = DistanceBase[distanceCode] + bits(DistanceExtra[distanceCode]);
+        if (distance > out.size())
+          return false;
+        for (unsigned i = 0; i < length; ++i)
+          out.push_back(out[out.size() - distance]);
+      }
+    } else {
+      return false;
+    }
+    if (final)
+      return bit <= 8 * in.size();
+  }
+}
+
+// Image files written by a test, removed when it ends.
+class ImageWriterTests : public ::testing::Test {
+protected:
+  void TearDown() override {
+    for (const std::string &path : paths)
+      std::remove(path.c_str());
+  }
+
+  std::string Path(const std::string &name) {
+    paths.push_back("ImageWriterTests_" + name);
+    return paths.back();
+  }
+
+  std::vector<std::string> paths;
+};
+
+} // anonymous namespace
+
+TEST_F(ImageWriterTests, FormatTest) {
+  ImageFormat format;
+  ASSERT_TRUE(GetImageFormat("out.ppm", format));
+  ASSERT_EQ(format, ImageFormat::PPM);
+  ASSERT_TRUE(GetImageFormat("dir.v2/OUT.PNG", format));
+  ASSERT_EQ(format, ImageFormat::PNG);
+  ASSERT_TRUE(GetImageFormat("out.exr", format));
+  ASSERT_EQ(format, ImageFormat::EXR);
+  ASSERT_FALSE(GetImageFormat("out.jpg", format));
+  ASSERT_FALSE(GetImageFormat("out", format));
+  ASSERT_FALSE(WriteImage(Path("out.jpg"), TestImage()));
+}
+
+TEST_F(ImageWriterTests, PPMTest) {
+  Framebuffer image = TestImage();
+  std::string whole = Path("whole.ppm");
+  ASSERT_TRUE(WriteImage(whole, image));
+  std::vector<std::uint8_t> data = ReadFile(whole);
+  const char Header[] = "P6\n101 77\n255\n";
+  const std::size_t HeaderSize = sizeof(Header) - 1;
+  ASSERT_EQ(data.size(), HeaderSize + Width * Height * 3);
+  ASSERT_EQ(std::memcmp(data.data(), Header, HeaderSize), 0);
+
+  // sRGB, clamped.
+  const std::uint8_t *pixels = &data[HeaderSize];
+  ASSERT_EQ(pixels[0], 0);
+  ASSERT_EQ(pixels[1], 255);
+  ASSERT_EQ(pixels[2], 255);
+  for (unsigned y : { 5u, 40u, 76u }) {
+    for (unsigned x : { 1u, 50u, 100u }) {
+      for (int c = 0; c < 3; ++c) {
+        double linear = image.At(x, y)[c];
+        double srgb = linear <= 0.0031308 ? 12.92 * linear :
+                      1.055 * std::pow(linear, 1.0 / 2.4) - 0.055;
+        ASSERT_NEAR(pixels[(y * Width + x) * 3 + c], srgb * 255.0, 0.51);
+      }
+    }
+  }
+
+  // Tiles in reverse order, in small bands, make the same file.
+  ImageWriterSettings settings;
+  settings.bandHeight = 8;
+  ImageWriter writer(settings);
+  std::string tiled = Path("tiled.ppm");
+  ASSERT_TRUE(writer.Open(tiled, ImageFormat::PPM, Width, Height));
+  for (unsigned y = 0; y < Height; y += 20) {
+    for (unsigned x = 0; x < Width; x += 30) {
+      unsigned tx = (Width - 1) / 30 * 30 - x, ty = (Height - 1) / 20 * 20 - y;
+      writer.WriteRegion(tx, ty, Crop(image, tx, ty, std::min(30u, Width - tx),
+                                      std::min(20u, Height - ty)));
+    }
+  }
+  ASSERT_TRUE(writer.Close());
+  ASSERT_EQ(ReadFile(tiled), data);
+  ASSERT_EQ(writer.GetStats().bytesWritten, data.size());
+
+  // Pixels no region covers are black.
+  std::string partial = Path("partial.ppm");
+  ASSERT_TRUE(writer.Open(partial, ImageFormat::PPM, Width, Height));
+  writer.WriteRegion(0, 10, Crop(image, 0, 10, Width, 5));
+  ASSERT_TRUE(writer.Close());
+  std::vector<std::uint8_t> partialData = ReadFile(partial);
+  ASSERT_EQ(partialData.size(), data.size());
+  for (std::size_t i = HeaderSize; i < data.size(); ++i) {
+    std::size_t y = (i - HeaderSize) / (Width * 3);
+    ASSERT_EQ(partialData[i], y >= 10 && y < 15 ? data[i] : 0);
+  }
+}
+
+TEST_F(ImageWriterTests, PNGTest) {
+  Framebuffer image = TestImage();
+  std::string ppm = Path("reference.ppm");
+  ASSERT_TRUE(WriteImage(ppm, image));
+  std::vector<std::uint8_t> expected = ReadFile(ppm);
+  expected.erase(expected.begin(), expected.end() - Width * Height * 3);
+
+  // Bands of 16 rows in chunks of 3 rows compressed by 3 threads, written
+  // in reverse order.
+  ImageWriterSettings settings;
+  settings.bandHeight = 16;
+  settings.chunkRows = 3;
+  settings.numThreads = 3;
+  ImageWriter writer(settings);
+  std::string path = Path("image.png");
+  ASSERT_TRUE(writer.Open(path, ImageFormat::PNG, Width, Height));
+  for (unsigned y = Height; y > 0; y -= std::min(y, 10u)) {
+    unsigned rows = std::min(y, 10u);
+    writer.WriteRegion(0, y - rows, Crop(image, 0, y - rows, Width, rows));
+  }
+  ASSERT_TRUE(writer.Close());
+
+  // Chunks with valid CRCs, IDAT chunks making a zlib stream.
+  std::vector<std::uint8_t> data = ReadFile(path);
+  const std::uint8_t Signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+  ASSERT_GT(data.size(), 8u);
+  ASSERT_EQ(std::memcmp(data.data(), Signature, 8), 0);
+  std::vector<std::uint8_t> zlib;
+  std::vector<std::string> types;
+  for (std::size_t pos = 8; pos < data.size();) {
+    ASSERT_LE(pos + 12, data.size());
+    std::uint32_t size = GetBE32(&data[pos]);
+    ASSERT_LE(pos + 12 + size, data.size());
+    ASSERT_EQ(Crc32(&data[pos + 4], size + 4), GetBE32(&data[pos + 8 + size]));
+    std::string type(data.begin() + pos + 4, data.begin() + pos + 8);
+    if (type == "IHDR") {
+      ASSERT_EQ(GetBE32(&data[pos + 8]), Width);
+      ASSERT_EQ(GetBE32(&data[pos + 12]), Height);
+    }
+    if (type == "IDAT")
+      zlib.insert(zlib.end(), data.begin() + pos + 8, data.begin() + pos + 8 + size);
+    if (types.empty() || types.back() != type)
+      types.push_back(type);
+    pos += 12 + size;
+  }
+  ASSERT_EQ(types, std::vector<std::string>({ "IHDR", "IDAT", "IEND" }));
+  ASSERT_GT(zlib.size(), 6u);
+  ASSERT_EQ((zlib[0] * 256 + zlib[1]) % 31, 0);
+  std::vector<std::uint8_t> deflated(zlib.begin() + 2, zlib.end() - 4);
+  std::vector<std::uint8_t> filtered;
+  ASSERT_TRUE(Inflate(deflated, filtered));
+  ASSERT_EQ(filtered.size(), Height * (Width * 3 + 1));
+  // Compressed.
+  ASSERT_LT(data.size(), filtered.size());
+
+  std::uint32_t a = 1, b = 0;
+  for (std::uint8_t byte : filtered) {
+    a = (a + byte) % 65521;
+    b = (b + a) % 65521;
+  }
+  ASSERT_EQ((b << 16) | a, GetBE32(&zlib[zlib.size() - 4]));
+
+  // Rows unfiltered are the PPM's pixels.
+  const std::size_t RowBytes = Width * 3;
+  std::vector<std::uint8_t> pixels(Height * RowBytes);
+  for (unsigned y = 0; y < Height; ++y) {
+    const std::uint8_t *row = &filtered[y * (RowBytes + 1)];
+    std::uint8_t *out = &pixels[y * RowBytes];
+    const std::uint8_t *above = y ? &pixels[(y - 1) * RowBytes] : nullptr;
+    for (std::size_t i = 0; i < RowBytes; ++i) {
+      int left = i >= 3 ? out[i - 3] : 0;
+      int up = above ? above[i] : 0;
+      int upLeft = above && i >= 3 ? above[i - 3] : 0;
+      int predicted = 0;
+      switch (row[0]) {
+      case 0: break;
+      case 1: predicted = left; break;
+      case 2: predicted = up; break;
+      case 3: predicted = (left + up) / 2; break;
+      case 4: {
+        int p = left + up - upLeft;
+        int pa = std::abs(p - left), pb = std::abs(p - up), pc = std::abs(p - upLeft);
+        predicted = pa <= pb && pa <= pc ? left : pb <= pc ? up : upLeft;
+        break;
+      }
+      default: FAIL() << "Invalid filter type";
+      }
+      out[i] = static_cast<std::uint8_t>(row[1 + i] + predicted);
+    }
+  }
+  ASSERT_EQ(pixels, expected);
+}
+
+TEST_F(ImageWriterTests, EXRTest) {
+  Framebuffer image = TestImage();
+  ImageWriterSettings settings;
+  settings.bandHeight = 32;
+  ImageWriter writer(settings);
+  std::string path = Path("image.exr");
+  ASSERT_TRUE(writer.Open(path, ImageFormat::EXR, Width, Height));
+  // Bottom band first: tiles are written as bands are done.
+  writer.WriteRegion(0, 64, Crop(image, 0, 64, Width, Height - 64));
+  writer.WriteRegion(0, 0, Crop(image, 0, 0, Width, 64));
+  ASSERT_TRUE(writer.Close());
+
+  std::vector<std::uint8_t> data = ReadFile(path);
+  ASSERT_GT(data.size(), 8u);
+  ASSERT_EQ(GetLE32(&data[0]), 20000630u);
+  ASSERT_EQ(GetLE32(&data[4]), 2u | 0x200u);
+
+  // Attributes, up to the empty name ending them.
+  std::size_t pos = 8;
+  std::vector<std::string> names;
+  while (pos < data.size() && data[pos]) {
+    std::string name(reinterpret_cast<const char *>(&data[pos]));
+    pos += name.size() + 1;
+    std::string type(reinterpret_cast<const char *>(&data[pos]));
+    pos += type.size() + 1;
+    std::uint32_t size = GetLE32(&data[pos]);
+    pos += 4;
+    if (name == "tiles") {
+      ASSERT_EQ(GetLE32(&data[pos]), 32u);
+      ASSERT_EQ(GetLE32(&data[pos + 4]), 32u);
+    }
+    if (name == "dataWindow") {
+      ASSERT_EQ(GetLE32(&data[pos + 8]), Width - 1);
+      ASSERT_EQ(GetLE32(&data[pos + 12]), Height - 1);
+    }
+    names.push_back(name);
+    pos += size;
+  }
+  ++pos;
+  std::sort(names.begin(), names.end());
+  ASSERT_EQ(names, std::vector<std::string>({
+    "channels", "compression", "dataWindow", "displayWindow", "lineOrder",
+    "pixelAspectRatio", "screenWindowCenter", "screenWindowWidth", "tiles" }));
+
+  // Every tile through the offset table: lines of B, G and R halves.
+  const unsigned TilesX = 4, TilesY = 3;
+  for (unsigned t = 0; t < TilesX * TilesY; ++t) {
+    std::size_t offset = GetLE32(&data[pos + 8 * t]) +
+                         (std::size_t(GetLE32(&data[pos + 8 * t + 4])) << 32);
+    ASSERT_LT(offset, data.size());
+    const std::uint8_t *tile = &data[offset];
+    unsigned tx = GetLE32(tile), ty = GetLE32(tile + 4);
+    ASSERT_EQ(ty * TilesX + tx, t);
+    unsigned w = std::min(32u, Width - tx * 32), h = std::min(32u, Height - ty * 32);
+    ASSERT_EQ(GetLE32(tile + 16), w * h * 6);
+    ASSERT_LE(offset + 20 + w * h * 6, data.size());
+    const std::uint8_t *halves = tile + 20;
+    for (unsigned y = 0; y < h; ++y) {
+      for (int c = 2; c >= 0; --c) {
+        for (unsigned x = 0; x < w; ++x, halves += 2) {
+          float value = glm::unpackHalf2x16(halves[0] | (halves[1] << 8)).x;
+          double expected = image.At(tx * 32 + x, ty * 32 + y)[c];
+          ASSERT_NEAR(value, expected, 1.0e-3 * std::max(1.0, std::abs(expected)));
+        }
+      }
+    }
+  }
+}
+
+TEST_F(ImageWriterTests, EXRAovTest) {
+  Framebuffer image = TestImage();
+  AovBuffers aovs(AovBit(Aov::Depth) | AovBit(Aov::Normal) |
+                  AovBit(Aov::ObjectId));
+  aovs.Reset(Width, Height);
+  for (std::size_t i = 0; i < aovs.GetNumPixels(); ++i) {
+    aovs.depth[i] = 0.25f * i;
+    aovs.normalX[i] = 1.0f;
+    aovs.normalY[i] = -0.5f;
+    aovs.normalZ[i] = 1.0e-3f * i;
+    aovs.objectId[i] = static_cast<float>(i % 7);
+  }
+  ImageWriterSettings settings;
+  settings.bandHeight = 32;
+  std::string path = Path("aovs.exr");
+  ASSERT_FALSE(WriteImage(Path("aovs.png"), image, aovs, settings));
+  ASSERT_TRUE(WriteImage(path, image, aovs, settings));
+
+  // Channels: names in alphabetical order, and their types.
+  std::vector<std::uint8_t> data = ReadFile(path);
+  std::size_t pos = 8;
+  std::vector<std::string> channels;
+  std::vector<std::uint32_t> types;
+  while (pos < data.size() && data[pos]) {
+    std::string name(reinterpret_cast<const char *>(&data[pos]));
+    pos += name.size() + 1;
+    std::string type(reinterpret_cast<const char *>(&data[pos]));
+    pos += type.size() + 1;
+    std::uint32_t size = GetLE32(&data[pos]);
+    pos += 4;
+    if (name == "channels") {
+      for (std::size_t p = pos; data[p]; p += 16) {
+        channels.push_back(reinterpret_cast<const char *>(&data[p]));
+        p += channels.back().size() + 1;
+        types.push_back(GetLE32(&data[p]));
+      }
+    }
+    pos += size;
+  }
+  ++pos;
+  ASSERT_EQ(channels, std::vector<std::string>({
+    "B", "G", "N.X", "N.Y", "N.Z", "R", "Z", "id" }));
+  ASSERT_EQ(types, std::vector<std::uint32_t>({ 1, 1, 2, 2, 2, 1, 2, 2 }));
+
+  // Every tile: lines of halves and floats, channel by channel.
+  const unsigned TilesX = 4, TilesY = 3;
+  for (unsigned t = 0; t < TilesX * TilesY; ++t) {
+    std::size_t offset = GetLE32(&data[pos + 8 * t]);
+    const std::uint8_t *tile = &data[offset];
+    unsigned tx = GetLE32(tile), ty = GetLE32(tile + 4);
+    unsigned w = std::min(32u, Width - tx * 32), h = std::min(32u, Height - ty * 32);
+    ASSERT_EQ(GetLE32(tile + 16), w * h * (3 * 2 + 5 * 4));
+    const std::uint8_t *p = tile + 20;
+    for (unsigned y = 0; y < h; ++y) {
+      for (std::size_t c = 0; c < channels.size(); ++c) {
+        for (unsigned x = 0; x < w; ++x) {
+          unsigned px = tx * 32 + x, py = ty * 32 + y;
+          std::size_t i = static_cast<std::size_t>(py) * Width + px;
+          const std::string &name = channels[c];
+          if (types[c] == 1) {
+            float value = glm::unpackHalf2x16(p[0] | (p[1] << 8)).x;
+            double expected = image.At(px, py)[name == "R" ? 0 : name == "G" ? 1 : 2];
+            ASSERT_NEAR(value, expected, 1.0e-3 * std::max(1.0, std::abs(expected)));
+            p += 2;
+          } else {
+            float value;
+            std::uint32_t bits = GetLE32(p);
+            std::memcpy(&value, &bits, sizeof(value));
+            float expected = name == "Z" ? aovs.depth[i] :
+                             name == "N.X" ? aovs.normalX[i] :
+                             name == "N.Y" ? aovs.normalY[i] :
+                             name == "N.Z" ? aovs.normalZ[i] : aovs.objectId[i];
+            ASSERT_EQ(value, expected);
+            p += 4;
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST_F(ImageWriterTests, MemoryTest) {
+  // A tall image written band by band holds a few bands at most.
+  const unsigned W = 64, H = 2048, Rows = 16;
+  ImageWriterSettings settings;
+  settings.bandHeight = Rows;
+  settings.maxQueuedBytes = 2 * W * Rows * 3 * sizeof(float);
+  for (const char *name : { "tall.ppm", "tall.png", "tall.exr" }) {
+    ImageFormat format;
+    ASSERT_TRUE(GetImageFormat(name, format));
+    ImageWriter writer(settings);
+    ASSERT_TRUE(writer.Open(Path(name), format, W, H));
+    Framebuffer band(W, Rows);
+    for (unsigned y = 0; y < H; y += Rows) {
+      band.Clear(glm::dvec3(static_cast<double>(y) / H));
+      writer.WriteRegion(0, y, band);
+    }
+    ASSERT_TRUE(writer.Close());
+    std::size_t imageBytes = std::size_t(W) * H * 3 * sizeof(float);
+    ASSERT_GT(writer.GetStats().peakBufferedBytes, 0u);
+    ASSERT_LE(writer.GetStats().peakBufferedBytes,
+              settings.maxQueuedBytes + 2 * W * Rows * 3 * sizeof(float));
+    ASSERT_LT(writer.GetStats().peakBufferedBytes, imageBytes / 16);
+  }
+}
+
+TEST_F(ImageWriterTests, RenderTest) {
+  // An image rendered band by band through camera regions and streamed
+  // out is the image rendered whole, samples included.
+  Scene scene;
+  TMaterialId material = scene.GetMaterials().AddMaterial("material", testMaterial1);
+  std::unique_ptr<Mesh> floor(new Mesh(false, material));
+  floor->AddQuadFace(floor->AddVertex(glm::dvec3(-5.0, 0.0, -5.0)),
+                     floor->AddVertex(glm::dvec3(-5.0, 0.0, 5.0)),
+                     floor->AddVertex(glm::dvec3(5.0, 0.0, 5.0)),
+                     floor->AddVertex(glm::dvec3(5.0, 0.0, -5.0)));
+  floor->CalculateNormals();
+  scene.AddObject(std::move(floor));
+  scene.AddObject(std::unique_ptr<Sphere>(
+    new Sphere(glm::dvec3(0.0, 1.0, 0.0), 1.0, material)));
+  scene.AddLight(PointLight(glm::dvec3(2.0, 5.0, -3.0), glm::dvec3(0.2),
+                            glm::dvec3(0.9), glm::dvec3(0.9)));
+  scene.SetBackground(glm::dvec3(0.1, 0.2, 0.3));
+  scene.Freeze();
+
+  const unsigned W = 48, H = 36, Rows = 10;
+  Camera camera(glm::dvec3(0.0, 2.0, -6.0), glm::dvec3(0.0, -0.3, 1.0),
+                glm::uvec2(W, H));
+  RenderSettings whitted, paths;
+  paths.integrator = Integrator::PathTracing;
+  paths.numThreads = 2;
+  paths.minSamples = 2;
+  paths.maxSamples = 4;
+  ImageWriterSettings settings;
+  settings.bandHeight = 8;
+  for (const RenderSettings &renderSettings : { whitted, paths }) {
+    Renderer renderer(renderSettings);
+    Framebuffer whole(W, H);
+    renderer.Render(scene, camera, whole);
+    std::string reference = Path("whole.png");
+    ASSERT_TRUE(WriteImage(reference, whole, settings));
+
+    ImageWriter writer(settings);
+    std::string streamed = Path("bands.png");
+    ASSERT_TRUE(writer.Open(streamed, ImageFormat::PNG, W, H));
+    for (unsigned y = 0; y < H; y += Rows) {
+      unsigned rows = std::min(Rows, H - y);
+      Camera region = camera;
+      region.SetRegion(glm::uvec2(0, y), glm::uvec2(W, rows));
+      Framebuffer band(W, rows);
+      renderer.Render(scene, region, band);
+      for (unsigned j = 0; j < rows; ++j) {
+        for (unsigned i = 0; i < W; ++i)
+          ASSERT_VEC_NEAR(band.At(i, j), whole.At(i, y + j), EPS_STRONG);
+      }
+      writer.WriteRegion(0, y, band);
+    }
+    ASSERT_TRUE(writer.Close());
+    ASSERT_EQ(ReadFile(streamed), ReadFile(reference));
+  }
+}
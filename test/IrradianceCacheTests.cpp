@@ -0,0 +1,172 @@
+#include "Tests.h"
+#include "IrradianceCache.h"
+#include "glm/gtc/constants.hpp"
+
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// A lit wall: rectangle x = WallX, 0 <= y <= WallHeight, |z| <= WallHalfWidth
+// of radiance WallRadiance. Nothing else is visible.
+const double WallX = 2.0;
+const double WallHeight = 1.5;
+const double WallHalfWidth = 3.0;
+const glm::dvec3 WallRadiance(1.0, 0.5, 0.25);
+
+// Fill \p gather with the wall, rays through cell centers.
+void GatherWall(IrradianceGather &gather) {
+  for (unsigned j = 0; j < gather.thetaStrata; ++j) {
+    for (unsigned k = 0; k < gather.phiStrata; ++k) {
+      unsigned i = j * gather.phiStrata + k;
+      glm::dvec3 dir = gather.GetDirection(j, k, 0.5, 0.5);
+      gather.radiance[i] = glm::dvec3(0.0);
+      gather.distance[i] = std::numeric_limits<double>::infinity();
+      if (dir.x <= 0.0)
+        continue;
+      double t = (WallX - gather.position.x) / dir.x;
+      glm::dvec3 hit = gather.position + t * dir;
+      if (hit.y >= 0.0 && hit.y <= WallHeight && std::abs(hit.z) <= WallHalfWidth) {
+        gather.radiance[i] = WallRadiance;
+        gather.distance[i] = t;
+      }
+    }
+  }
+}
+
+IrradianceRecord WallRecord(const glm::dvec3 &p, const glm::dvec3 &n,
+                            unsigned rays) {
+  // Any basis around the normal.
+  glm::dvec3 t = glm::normalize(glm::cross(n, Z_NORM_VEC));
+  IrradianceGather gather(p, n, t, glm::cross(n, t), rays);
+  GatherWall(gather);
+  return ComputeIrradianceRecord(gather, 0.0, 1.0e9);
+}
+
+} // anonymous namespace
+
+// === Record tests ===
+TEST(IrradianceCacheTests, GatherTest) {
+  IrradianceGather gather(ZERO_VEC, Y_NORM_VEC, X_NORM_VEC, -Z_NORM_VEC, 256);
+  ASSERT_GT(gather.phiStrata, 2 * gather.thetaStrata);
+  ASSERT_LE(gather.GetNumCells(), 256u);
+  ASSERT_GT(gather.GetNumCells(), 240u);
+
+  // Uniform sky of radiance 1: irradiance pi, no gradients, no distance
+  // limit.
+  for (unsigned i = 0; i < gather.GetNumCells(); ++i) {
+    gather.radiance[i] = glm::dvec3(1.0);
+    gather.distance[i] = std::numeric_limits<double>::infinity();
+  }
+  IrradianceRecord record = ComputeIrradianceRecord(gather, 0.1, 10.0);
+  ASSERT_VEC_NEAR(record.irradiance, glm::dvec3(glm::pi<double>()), EPS_WEAK);
+  ASSERT_DOUBLE_EQ(record.radius, 10.0);
+  for (int c = 0; c < 3; ++c) {
+    ASSERT_VEC_NEAR(record.rotationGradient[c], ZERO_VEC, EPS_WEAK);
+    ASSERT_VEC_NEAR(record.translationGradient[c], ZERO_VEC, EPS_WEAK);
+  }
+
+  // Everything one unit away.
+  for (unsigned i = 0; i < gather.GetNumCells(); ++i)
+    gather.distance[i] = 1.0;
+  ASSERT_DOUBLE_EQ(ComputeIrradianceRecord(gather, 0.1, 10.0).radius, 1.0);
+  ASSERT_DOUBLE_EQ(ComputeIrradianceRecord(gather, 2.0, 10.0).radius, 2.0);
+}
+
+TEST(IrradianceCacheTests, GradientsTest) {
+  IrradianceRecord record = WallRecord(ZERO_VEC, Y_NORM_VEC, 1024);
+  ASSERT_GT(record.irradiance.r, 0.0);
+
+  // Moving towards the wall, or turning to face it, gets more light.
+  // Gradients predict the change seen by dense gathers.
+  const double step = 0.05;
+  glm::dvec3 moved = WallRecord(glm::dvec3(step, 0.0, 0.0), Y_NORM_VEC, 16384).irradiance;
+  glm::dvec3 reference = WallRecord(ZERO_VEC, Y_NORM_VEC, 16384).irradiance;
+  glm::dvec3 predicted = glm::dvec3(step, 0.0, 0.0) * record.translationGradient;
+  ASSERT_GT(predicted.r, 0.0);
+  ASSERT_NEAR(predicted.r, (moved - reference).r, 0.2 * (moved - reference).r);
+
+  glm::dvec3 turned(std::sin(step), std::cos(step), 0.0);
+  glm::dvec3 rotated = WallRecord(ZERO_VEC, turned, 16384).irradiance;
+  predicted = glm::cross(Y_NORM_VEC, turned) * record.rotationGradient;
+  ASSERT_GT(predicted.r, 0.0);
+  ASSERT_NEAR(predicted.r, (rotated - reference).r, 0.2 * (rotated - reference).r);
+
+  // Sideways (along the wall) nothing changes much.
+  predicted = glm::dvec3(0.0, 0.0, step) * record.translationGradient;
+  ASSERT_LT(std::abs(predicted.r), 0.1 * (moved - reference).r);
+}
+
+// === Cache tests ===
+TEST(IrradianceCacheTests, LookupTest) {
+  IrradianceCache cache(0.5);
+  cache.Reset(glm::dvec3(-10.0), glm::dvec3(10.0));
+  glm::dvec3 irradiance;
+  ASSERT_FALSE(cache.Lookup(ZERO_VEC, Y_NORM_VEC, irradiance));
+
+  IrradianceRecord record;
+  record.position = ZERO_VEC;
+  record.normal = Y_NORM_VEC;
+  record.irradiance = glm::dvec3(1.0, 2.0, 3.0);
+  record.radius = 1.0;
+  record.rotationGradient = glm::dmat3(0.0);
+  record.translationGradient = glm::dmat3(0.0);
+  record.translationGradient[0] = X_NORM_VEC;
+  cache.Add(record);
+  ASSERT_EQ(cache.GetNumRecords(), 1u);
+
+  // Within accuracy * radius, extrapolated by the gradient.
+  ASSERT_TRUE(cache.Lookup(glm::dvec3(0.1, 0.0, 0.0), Y_NORM_VEC, irradiance));
+  ASSERT_VEC_NEAR(irradiance, glm::dvec3(1.1, 2.0, 3.0), EPS_WEAK);
+  // Too far, normal too different, or behind a record.
+  ASSERT_FALSE(cache.Lookup(glm::dvec3(0.6, 0.0, 0.0), Y_NORM_VEC, irradiance));
+  ASSERT_FALSE(cache.Lookup(ZERO_VEC, X_NORM_VEC, irradiance));
+  ASSERT_FALSE(cache.Lookup(glm::dvec3(0.0, -0.1, 0.0), Y_NORM_VEC, irradiance));
+
+  // Nearby records are blended, closer ones weigh more.
+  record.position = glm::dvec3(0.3, 0.0, 0.0);
+  record.irradiance = glm::dvec3(3.0);
+  record.translationGradient = glm::dmat3(0.0);
+  cache.Add(record);
+  ASSERT_TRUE(cache.Lookup(glm::dvec3(0.2, 0.0, 0.0), Y_NORM_VEC, irradiance));
+  ASSERT_GT(irradiance.r, 2.0);
+  ASSERT_LT(irradiance.r, 3.0);
+}
+
+TEST(IrradianceCacheTests, OctreeTest) {
+  // Many small records over a plane, and a large one: lookups find the
+  // same records as a search over all of them.
+  IrradianceCache cache(0.3);
+  cache.Reset(glm::dvec3(-8.0), glm::dvec3(8.0));
+  for (int i = 0; i <= 40; ++i) {
+    for (int j = 0; j <= 40; ++j) {
+      IrradianceRecord record;
+      record.position = glm::dvec3(-10.0 + 0.5 * i, 0.0, -10.0 + 0.5 * j);
+      record.normal = Y_NORM_VEC;
+      record.irradiance = glm::dvec3(i + j);
+      record.radius = 0.5 + 0.1 * ((i * 7 + j * 3) % 10);
+      record.rotationGradient = glm::dmat3(0.0);
+      record.translationGradient = glm::dmat3(0.0);
+      cache.Add(record);
+    }
+  }
+
+  for (int i = 0; i < 100; ++i) {
+    glm::dvec3 point(-7.9 + 0.157 * i, 0.0, 7.9 - 0.149 * i);
+    glm::dvec3 expected(0.0);
+    double weightSum = 0.0;
+    for (std::size_t r = 0; r < cache.GetNumRecords(); ++r) {
+      const IrradianceRecord &record = cache.GetRecord(r);
+      double error = glm::length(point - record.position) / record.radius;
+      if (error < cache.GetAccuracy()) {
+        double weight = 1.0 / error - 1.0 / cache.GetAccuracy();
+        expected += weight * record.irradiance;
+        weightSum += weight;
+      }
+    }
+    glm::dvec3 irradiance;
+    ASSERT_EQ(cache.Lookup(point, Y_NORM_VEC, irradiance), weightSum > 0.0);
+    if (weightSum > 0.0)
+      ASSERT_VEC_NEAR(irradiance, expected / weightSum, EPS_WEAK);
+  }
+}
@@ -0,0 +1,77 @@
+#include "Tests.h"
+#include "LightGrid.h"
+
+#include <algorithm>
+
+namespace {
+
+// Lights whose sphere of influence contains \p point, found by brute force.
+std::vector<std::uint32_t> LightsReaching(const std::vector<PointLight> &lights,
+                                          const glm::dvec3 &point) {
+  std::vector<std::uint32_t> result;
+  for (std::size_t l = 0; l < lights.size(); ++l) {
+    if (glm::length(lights[l].position - point) < lights[l].radius)
+      result.push_back(static_cast<std::uint32_t>(l));
+  }
+  return result;
+}
+
+PointLight MakeLight(const glm::dvec3 &position, double radius) {
+  return PointLight(position, glm::dvec3(0.0), glm::dvec3(0.5),
+                    glm::dvec3(0.5), radius);
+}
+
+} // anonymous namespace
+
+// === LightGrid tests ===
+TEST(LightGridTests, EmptyTest) {
+  LightGrid grid;
+  grid.Build(std::vector<PointLight>());
+  ASSERT_EQ(grid.GetNumCells(), 0);
+
+  std::size_t calls = 0;
+  grid.ForEachLight(ZERO_VEC, [&](std::uint32_t) { ++calls; });
+  ASSERT_EQ(calls, 0);
+}
+
+TEST(LightGridTests, UnboundedTest) {
+  std::vector<PointLight> lights;
+  lights.push_back(PointLight(glm::dvec3(0.0, 10.0, 0.0)));
+  lights.push_back(MakeLight(ZERO_VEC, 1.0));
+
+  LightGrid grid;
+  grid.Build(lights);
+  ASSERT_EQ(grid.GetNumUnbounded(), 1);
+
+  // Far from the bounded light: only the unbounded one.
+  std::vector<std::uint32_t> found;
+  grid.ForEachLight(glm::dvec3(100.0, 0.0, 0.0),
+                    [&](std::uint32_t l) { found.push_back(l); });
+  ASSERT_EQ(found, std::vector<std::uint32_t>(1, 0));
+}
+
+TEST(LightGridTests, MatchesBruteForceTest) {
+  // A 20x20 grid of street lamps with different radii.
+  std::vector<PointLight> lights;
+  for (int i = 0; i < 400; ++i) {
+    glm::dvec3 position(3.0 * (i % 20), 2.0, 3.0 * (i / 20));
+    lights.push_back(MakeLight(position, 2.0 + (i % 3)));
+  }
+
+  LightGrid grid;
+  grid.Build(lights);
+  ASSERT_GT(grid.GetNumCells(), 1);
+  // Each point only sees a neighbourhood.
+  ASSERT_LT(grid.GetMeanLightsPerCell(), 40.0);
+
+  for (int i = 0; i < 1000; ++i) {
+    glm::dvec3 point(0.061 * i - 2.0, 0.5 + 0.003 * i, 0.047 * i - 1.0);
+    std::vector<std::uint32_t> found;
+    grid.ForEachLight(point, [&](std::uint32_t l) { found.push_back(l); });
+
+    // Every light reaching the point must be found.
+    std::sort(found.begin(), found.end());
+    for (std::uint32_t l : LightsReaching(lights, point))
+      ASSERT_TRUE(std::binary_search(found.begin(), found.end(), l));
+  }
+}
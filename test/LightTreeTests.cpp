@@ -0,0 +1,84 @@
+#include "Tests.h"
+#include "LightTree.h"
+
+class LightTreeTests : public ::testing::Test {
+protected:
+  void SetUp() override {
+    // A row of lights of growing power and radius above the XZ plane, and
+    // an unbounded one.
+    for (int i = 0; i < 37; ++i) {
+      glm::dvec3 color(0.01 * (i + 1));
+      lights.push_back(PointLight(glm::dvec3(1.0 * i, 2.0, 0.5 * (i % 3)),
+                                  glm::dvec3(0.0), color, color,
+                                  /*radius=*/3.0 + 0.1 * i));
+    }
+    lights.push_back(PointLight(glm::dvec3(10.0, 20.0, 0.0), glm::dvec3(0.0),
+                                glm::dvec3(0.2), glm::dvec3(0.2)));
+    tree.Build(lights);
+  }
+
+  std::vector<PointLight> lights;
+  LightTree tree;
+};
+
+// === LightTree tests ===
+TEST_F(LightTreeTests, BuildTest) {
+  ASSERT_EQ(tree.GetNumNodes(), 2 * lights.size() - 1);
+
+  LightTree empty;
+  empty.Build(std::vector<PointLight>());
+  ASSERT_TRUE(empty.Empty());
+  std::uint32_t light;
+  double pdf;
+  ASSERT_FALSE(empty.Sample(ZERO_VEC, Y_NORM_VEC, 0.5, light, pdf));
+}
+
+TEST_F(LightTreeTests, PdfTest) {
+  glm::dvec3 point(5.0, 0.0, 0.0);
+  double sum = 0.0;
+  for (std::uint32_t l = 0; l < lights.size(); ++l) {
+    double pdf = tree.Pdf(point, Y_NORM_VEC, l);
+    // Lights which reach the point can be picked, others are never picked.
+    if (glm::length(lights[l].position - point) < lights[l].radius)
+      ASSERT_GT(pdf, 0.0);
+    else
+      ASSERT_EQ(pdf, 0.0);
+    sum += pdf;
+  }
+  // Some walks end in nodes whose bounds overestimate their lights.
+  ASSERT_GT(sum, 0.0);
+  ASSERT_LE(sum, 1.0 + EPS_STRONG);
+
+  // Far below only the unbounded light reaches, and the surface faces
+  // away from it.
+  std::uint32_t light;
+  double pdf;
+  ASSERT_FALSE(tree.Sample(glm::dvec3(5.0, -50.0, 0.0), -Y_NORM_VEC, 0.5,
+                           light, pdf));
+  ASSERT_TRUE(tree.Sample(glm::dvec3(5.0, -50.0, 0.0), Y_NORM_VEC, 0.5,
+                          light, pdf));
+  ASSERT_EQ(light, lights.size() - 1);
+  ASSERT_EQ(pdf, 1.0);
+}
+
+TEST_F(LightTreeTests, SampleMatchesPdfTest) {
+  glm::dvec3 point(20.0, 0.0, 1.0);
+  glm::dvec3 normal = glm::normalize(glm::dvec3(0.3, 1.0, 0.0));
+
+  const int numSamples = 20000;
+  std::vector<int> counts(lights.size(), 0);
+  for (int s = 0; s < numSamples; ++s) {
+    std::uint32_t light;
+    double pdf;
+    ASSERT_TRUE(tree.Sample(point, normal, (s + 0.5) / numSamples, light, pdf));
+    ASSERT_NEAR(pdf, tree.Pdf(point, normal, light), EPS_STRONG);
+    ++counts[light];
+  }
+
+  // Far from the ends of the row every walk finds a light, and with
+  // stratified u frequencies match probabilities closely.
+  for (std::uint32_t l = 0; l < lights.size(); ++l) {
+    ASSERT_NEAR(static_cast<double>(counts[l]) / numSamples,
+                tree.Pdf(point, normal, l), 1.0e-3);
+  }
+}
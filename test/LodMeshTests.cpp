@@ -0,0 +1,125 @@
+#include "Tests.h"
+#include "LodMesh.h"
+
+#include <cmath>
+#include <random>
+
+namespace {
+
+double Flat(double, double) { return 0.0; }
+
+double Hills(double x, double z) { return std::sin(0.5 * x) * std::cos(0.3 * z); }
+
+} // anonymous namespace
+
+// === SimplifyMesh tests ===
+TEST(LodMeshTests, FlatTest) {
+  std::unique_ptr<Mesh> mesh = Terrain(20, true, testMaterialId1, Flat);
+  double error;
+  std::unique_ptr<Mesh> simple = SimplifyMesh(*mesh, 200, error);
+  ASSERT_LE(simple->GetNumFaces(), 200u);
+  ASSERT_NEAR(error, 0.0, EPS_WEAK);
+
+  // The outline is kept: the plane is covered as before.
+  std::mt19937 rng(3);
+  std::uniform_real_distribution<double> dist(-9.99, 9.99);
+  for (unsigned r = 0; r < 200; ++r) {
+    glm::dvec3 target(dist(rng), 0.0, dist(rng));
+    IntersectionResult hit = simple->Intersect(Ray(target + 2.0 * Y_NORM_VEC,
+                                                   -Y_NORM_VEC));
+    ASSERT_TRUE(hit);
+    ASSERT_NEAR(hit.GetDistance(), 2.0, EPS_WEAK);
+    ASSERT_VEC_NEAR(hit.GetNormalRay().GetDirection(),
+                    mesh->Intersect(hit.GetRay()).GetNormalRay().GetDirection(),
+                    EPS_WEAK);
+    ASSERT_VEC_NEAR(hit.GetTexCoord(), glm::dvec2(target.x, target.z) / 8.0,
+                    EPS_WEAK);
+  }
+}
+
+TEST(LodMeshTests, RegionsTest) {
+  std::unique_ptr<Mesh> mesh = Terrain(30, true, testMaterialId1, Hills);
+  SimplifySettings settings;
+  settings.regionFaces = 300;
+  settings.numThreads = 1;
+  double error;
+  std::unique_ptr<Mesh> serial = SimplifyMesh(*mesh, 900, error, settings);
+  ASSERT_GT(error, 0.0);
+  ASSERT_LT(error, 0.1);
+  ASSERT_LE(serial->GetNumFaces(), 900u);
+  ASSERT_GT(serial->GetNumFaces(), 850u);
+
+  // Regions don't depend on each other: threads give the same mesh.
+  settings.numThreads = 4;
+  double parallelError;
+  std::unique_ptr<Mesh> parallel = SimplifyMesh(*mesh, 900, parallelError,
+                                                settings);
+  ASSERT_EQ(parallelError, error);
+  ASSERT_EQ(parallel->GetNumFaces(), serial->GetNumFaces());
+  ASSERT_EQ(parallel->GetNumVertexes(), serial->GetNumVertexes());
+  for (std::size_t v = 0; v < serial->GetNumVertexes(); ++v)
+    ASSERT_EQ(parallel->GetVertexes()[v].point, serial->GetVertexes()[v].point);
+
+  // The surface stays close to the original one.
+  std::mt19937 rng(5);
+  std::uniform_real_distribution<double> dist(-9.5, 9.5);
+  for (unsigned r = 0; r < 200; ++r) {
+    Ray ray(glm::dvec3(dist(rng), 5.0, dist(rng)), -Y_NORM_VEC);
+    IntersectionResult before = mesh->Intersect(ray);
+    IntersectionResult after = serial->Intersect(ray);
+    ASSERT_TRUE(before && after);
+    ASSERT_NEAR(after.GetDistance(), before.GetDistance(), 2.0 * error);
+  }
+}
+
+// === LodMesh tests ===
+TEST(LodMeshTests, ChainTest) {
+  LodSettings settings;
+  settings.simplify.regionFaces = 1024;
+  LodMesh lod(Terrain(40, true, testMaterialId1, Hills), settings);
+  ASSERT_GE(lod.GetNumLevels(), 4u);
+  ASSERT_EQ(lod.GetMesh(0)->GetNumFaces(), 3200u);
+  ASSERT_EQ(lod.GetError(0), 0.0);
+  ASSERT_EQ(lod.GetMesh(1)->GetNumFaces(), 1600u);
+  for (unsigned l = 1; l < lod.GetNumLevels(); ++l) {
+    ASSERT_LT(lod.GetMesh(l)->GetNumFaces(), lod.GetMesh(l - 1)->GetNumFaces());
+    ASSERT_GE(lod.GetError(l), lod.GetError(l - 1));
+  }
+  unsigned last = lod.GetNumLevels() - 1;
+  ASSERT_EQ(lod.GetLevelForWidth(0.0), 0u);
+  ASSERT_EQ(lod.GetLevelForWidth(1.0e6), last);
+
+  // Within the bounds the camera sees every face, from afar the coarsest
+  // level.
+  Camera camera(glm::dvec3(0.0, 2.0, -5.0), Z_NORM_VEC, glm::vec2(64, 64));
+  ASSERT_EQ(lod.SelectLevel(camera), 0u);
+  camera.MoveTo(glm::dvec3(0.0, 5.0, -20000.0));
+  ASSERT_EQ(lod.SelectLevel(camera), last);
+
+  // Cones pick their level; thin rays use the selected one.
+  glm::dvec3 target(1.0, Hills(1.0, 2.0), 2.0);
+  glm::dvec3 origin = target + glm::dvec3(0.0, 100.0, -100.0);
+  Ray thin(origin, target - origin);
+  Ray wide(origin, target - origin, 0.0, 0.1);
+  ASSERT_TRUE(lod.Intersect(thin));
+  ASSERT_TRUE(lod.Intersect(wide));
+  lod.SetLevel(0);
+  ASSERT_NEAR(lod.Intersect(thin).GetDistance(), glm::length(target - origin),
+              EPS_WEAK);
+  unsigned wideLevel = lod.GetLevelForWidth(0.1 * (glm::length(origin) - 15.0));
+  ASSERT_GT(wideLevel, 0u);
+  IntersectionResult coarse = lod.GetMesh(wideLevel)->Intersect(wide);
+  ASSERT_EQ(lod.Intersect(wide).GetDistance(), coarse.GetDistance());
+
+  // Far away, finer levels are never needed.
+  std::size_t bytes = lod.GetResidentBytes();
+  lod.SetLevel(2);
+  lod.ReleaseFinerLevels();
+  ASSERT_EQ(lod.GetMesh(0), nullptr);
+  ASSERT_EQ(lod.GetFirstResidentLevel(), 2u);
+  ASSERT_LT(lod.GetResidentBytes(), bytes / 2);
+  ASSERT_EQ(lod.GetLevelForWidth(0.0), 2u);
+  lod.SetLevel(0);
+  ASSERT_EQ(lod.GetLevel(), 2u);
+  ASSERT_TRUE(lod.Intersect(thin));
+}
@@ -0,0 +1,52 @@
+#include "Tests.h"
+#include "MaterialManager.h"
+#include "Sphere.h"
+
+const Material testMaterial2(/*ambient=*/glm::dvec3(0.1, 0.2, 0.3),
+                             /*specular=*/glm::dvec3(0.9, 0.9, 0.9),
+                             /*diffuse=*/glm::dvec3(0.5, 0.0, 0.0),
+                             /*shihiness=*/50.0);
+
+// === MaterialManager tests ===
+TEST(MaterialManagerTests, InterningTest) {
+  MaterialManager manager;
+
+  TMaterialId id1 = manager.AddMaterial("matte", testMaterial1);
+  TMaterialId id2 = manager.AddMaterial("shiny", testMaterial2);
+  ASSERT_EQ(id1, 0);
+  ASSERT_EQ(id2, 1);
+  ASSERT_EQ(manager.GetNumMaterials(), 2);
+
+  ASSERT_EQ(manager.GetMaterialId("matte"), id1);
+  ASSERT_EQ(manager.GetMaterialId("shiny"), id2);
+  ASSERT_EQ(manager.GetMaterialId("unknown"), InvalidMaterialId);
+  ASSERT_EQ(manager.GetName(id2), "shiny");
+
+  // Re-adding a known name keeps its id and overwrites the values.
+  TMaterialId id3 = manager.AddMaterial("matte", testMaterial2);
+  ASSERT_EQ(id3, id1);
+  ASSERT_EQ(manager.GetNumMaterials(), 2);
+  ASSERT_VEC_NEAR(manager.GetDiffuse(id1), testMaterial2.GetDiffuse(), EPS_STRONG);
+}
+
+TEST(MaterialManagerTests, TableLookupTest) {
+  MaterialManager manager;
+  TMaterialId id = manager.AddMaterial("shiny", testMaterial2);
+  manager.Freeze();
+  ASSERT_TRUE(manager.IsFrozen());
+
+  ASSERT_VEC_NEAR(manager.GetAmbient(id), testMaterial2.GetAmbient(), EPS_STRONG);
+  ASSERT_VEC_NEAR(manager.GetSpecular(id), testMaterial2.GetSpecular(), EPS_STRONG);
+  ASSERT_VEC_NEAR(manager.GetDiffuse(id), testMaterial2.GetDiffuse(), EPS_STRONG);
+  ASSERT_DOUBLE_EQ(manager.GetShininess(id), 50.0);
+
+  Material mat = manager.GetMaterialByName("shiny");
+  ASSERT_VEC_NEAR(mat.GetDiffuse(), testMaterial2.GetDiffuse(), EPS_STRONG);
+  ASSERT_DOUBLE_EQ(mat.GetShininess(), testMaterial2.GetShininess());
+
+  // Intersection reports the primitive's material id.
+  Sphere sphere(ZERO_VEC, 1.0, id);
+  IntersectionResult res = sphere.Intersect(Ray(glm::dvec3(5.0, 0.0, 0.0), -X_NORM_VEC));
+  ASSERT_TRUE(res);
+  ASSERT_EQ(res.GetMaterialId(), id);
+}
@@ -4,7 +4,7 @@
 class CubeMeshTests : public ::testing::Test {
 public:
   static void SetUpTestCase() {
-    Cube = new Mesh(false, &testMaterial1);
+    Cube = new Mesh(false, testMaterialId1);
 
     auto v0 = Cube->AddVertex(glm::dvec3(0.0, 0.0, 0.0));
     auto v1 = Cube->AddVertex(glm::dvec3(5.0, 0.0, 0.0));
@@ -41,8 +41,8 @@ TEST_F(CubeMeshTests, FaceSquaresTest) {
   // Test squares
   ASSERT_EQ(Cube->GetNumVertexes(), 8);
   ASSERT_EQ(Cube->GetNumFaces(), 12);
-  for (const auto &face : Cube->GetFaces()) {
-    ASSERT_DOUBLE_EQ(face.GetSquare(), 12.5);
+  for (TMeshIndex f = 0; f < Cube->GetNumFaces(); ++f) {
+    ASSERT_DOUBLE_EQ(Cube->GetFace(f).GetSquare(*Cube), 12.5);
   }
 }
 
@@ -70,3 +70,86 @@ TEST_F(CubeMeshTests, IntersectionTest) {
   ASSERT_DOUBLE_EQ(5.0, res.GetDistance());
   ASSERT_VEC_NEAR(X_NORM_VEC, (res.GetNormalRay().GetDirection()), EPS_WEAK);
 }
+
+TEST(MeshTests, TexCoordTest) {
+  // 4 x 2 quad mapped to the unit square.
+  Mesh quad(false, testMaterialId1);
+  auto v0 = quad.AddVertex(glm::dvec3(0.0, 0.0, 0.0));
+  auto v1 = quad.AddVertex(glm::dvec3(0.0, 2.0, 0.0));
+  auto v2 = quad.AddVertex(glm::dvec3(4.0, 2.0, 0.0));
+  auto v3 = quad.AddVertex(glm::dvec3(4.0, 0.0, 0.0));
+  quad.AddQuadFace(v0, v1, v2, v3);
+  quad.CalculateNormals();
+
+  // No coordinates yet.
+  Ray ray(glm::dvec3(1.0, 0.5, -1.0), Z_NORM_VEC);
+  IntersectionResult res = quad.Intersect(ray);
+  ASSERT_TRUE(res);
+  ASSERT_DOUBLE_EQ(res.GetTexCoordScale(), 0.0);
+
+  quad.SetTexCoord(v0, glm::dvec2(0.0, 0.0));
+  quad.SetTexCoord(v1, glm::dvec2(0.0, 1.0));
+  quad.SetTexCoord(v2, glm::dvec2(1.0, 1.0));
+  quad.SetTexCoord(v3, glm::dvec2(1.0, 0.0));
+  for (const glm::dvec3 &origin : { glm::dvec3(1.0, 0.5, -1.0),
+                                    glm::dvec3(3.0, 1.5, -1.0) }) {
+    res = quad.Intersect(Ray(origin, Z_NORM_VEC));
+    ASSERT_TRUE(res);
+    ASSERT_NEAR(res.GetTexCoord().x, origin.x / 4.0, EPS_WEAK);
+    ASSERT_NEAR(res.GetTexCoord().y, origin.y / 2.0, EPS_WEAK);
+    // Area of 1 over 8.
+    ASSERT_NEAR(res.GetTexCoordScale(), std::sqrt(1.0 / 8.0), EPS_WEAK);
+  }
+}
+
+TEST(MeshTests, IndexWidthTest) {
+  ASSERT_EQ(GetMeshIndexWidth(3), MeshIndexWidth::Bits16);
+  ASSERT_EQ(GetMeshIndexWidth(65536), MeshIndexWidth::Bits16);
+  ASSERT_EQ(GetMeshIndexWidth(65537), MeshIndexWidth::Bits32);
+  ASSERT_EQ(GetMeshIndexWidth(std::size_t(1) << 32), MeshIndexWidth::Bits32);
+  ASSERT_EQ(GetMeshIndexWidth((std::size_t(1) << 32) + 1),
+            MeshIndexWidth::Bits64);
+
+  // A bent quad with interpolated normals.
+  Mesh quad(true, testMaterialId1);
+  auto v0 = quad.AddVertex(glm::dvec3(0.0, 0.0, 0.0));
+  auto v1 = quad.AddVertex(glm::dvec3(0.0, 2.0, 0.0));
+  auto v2 = quad.AddVertex(glm::dvec3(4.0, 2.0, 1.0));
+  auto v3 = quad.AddVertex(glm::dvec3(4.0, 0.0, 0.0));
+  quad.AddQuadFace(v0, v1, v2, v3);
+  ASSERT_EQ(quad.GetIndexWidth(), MeshIndexWidth::Bits16);
+  ASSERT_EQ(quad.GetFaceBytes(), 2 * sizeof(MeshFace16));
+  // Three indexes and a material.
+  ASSERT_EQ(sizeof(MeshFace16), 8u);
+
+  Mesh wide(true, testMaterialId1);
+  for (unsigned i = 0; i < 4; ++i)
+    wide.AddVertex(quad.GetVertexes()[i].point);
+  wide.AddQuadFace(v0, v1, v2, v3);
+  // Unused vertexes push the count over 16 bits: faces are converted.
+  while (wide.GetNumVertexes() <= 65536)
+    wide.AddVertex(glm::dvec3(0.0, 0.0, 0.0));
+  ASSERT_EQ(wide.GetIndexWidth(), MeshIndexWidth::Bits32);
+  ASSERT_EQ(wide.GetNumFaces(), 2u);
+  auto v4 = wide.AddVertex(glm::dvec3(0.0, 0.0, -2.0));
+  wide.AddFace(v0, v4, v1);
+  ASSERT_EQ(wide.GetFace(2).vertexIndexes[1], 65537u);
+  ASSERT_EQ(wide.GetFace(0).vertexIndexes[2], v2);
+
+  quad.AddVertex(glm::dvec3(0.0, 0.0, -2.0));
+  quad.AddFace(v0, 4, v1);
+  quad.CalculateNormals();
+  wide.CalculateNormals();
+  for (unsigned i = 0; i < 4; ++i)
+    ASSERT_VEC_NEAR(quad.GetVertexes()[i].normal, wide.GetVertexes()[i].normal,
+                    EPS_WEAK);
+  for (const glm::dvec3 &origin : { glm::dvec3(1.0, 0.5, -1.0),
+                                    glm::dvec3(3.0, 1.5, -1.0) }) {
+    Ray ray(origin, Z_NORM_VEC);
+    IntersectionResult a = quad.Intersect(ray), b = wide.Intersect(ray);
+    ASSERT_TRUE(a && b);
+    ASSERT_DOUBLE_EQ(a.GetDistance(), b.GetDistance());
+    ASSERT_VEC_NEAR(a.GetNormalRay().GetDirection(),
+                    b.GetNormalRay().GetDirection(), EPS_WEAK);
+  }
+}
@@ -0,0 +1,208 @@
+#include "Tests.h"
+#include "PageLoader.h"
+#include "PagedMesh.h"
+#include "Renderer.h"
+
+#include <cstdio>
+#include <future>
+#include <vector>
+
+namespace {
+
+// Texels of a 64 x 64 checkerboard of 8 x 8 squares.
+std::vector<glm::vec3> CheckerTexels() {
+  std::vector<glm::vec3> texels;
+  for (unsigned y = 0; y < 64; ++y) {
+    for (unsigned x = 0; x < 64; ++x) {
+      texels.push_back((x / 8 + y / 8) % 2 ? glm::vec3(0.9f, 0.8f, 0.2f) :
+                                             glm::vec3(0.2f, 0.4f, 0.9f));
+    }
+  }
+  return texels;
+}
+
+// Mesh and texture files written by a test, removed when it ends.
+class PageLoaderTests : public ::testing::Test {
+protected:
+  void TearDown() override {
+    for (const std::string &path : paths)
+      std::remove(path.c_str());
+  }
+
+  std::string WriteMesh(const std::string &name, const Mesh &mesh) {
+    std::string path = "PageLoaderTests_" + name + ".pmesh";
+    paths.push_back(path);
+    PagedMeshSettings settings;
+    settings.clusterFaces = 32;
+    PagedMeshWriter writer(settings);
+    EXPECT_TRUE(writer.Open(path));
+    writer.AddMesh(mesh);
+    EXPECT_TRUE(writer.Close());
+    return path;
+  }
+
+  std::string WriteChecker(const std::string &name) {
+    std::string path = "PageLoaderTests_" + name + ".tmip";
+    paths.push_back(path);
+    EXPECT_TRUE(WriteTexture(path, 64, 64, CheckerTexels(), 16));
+    return path;
+  }
+
+  std::vector<std::string> paths;
+};
+
+} // anonymous namespace
+
+// === PageLoader tests ===
+TEST_F(PageLoaderTests, RequestTest) {
+  PageLoader loader;
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+  std::vector<int> order;
+
+  // The loader is held by the first load: the others stay queued.
+  PageLoader::TTicket first = loader.Request(this, 0, [&]() { released.wait(); });
+  PageLoader::TTicket a = loader.Request(this, 1, [&]() { order.push_back(1); });
+  PageLoader::TTicket b = loader.Request(this, 2, [&]() { order.push_back(2); });
+  // Already queued: no second load.
+  ASSERT_EQ(loader.Request(this, 1, [&]() { order.push_back(3); }), a);
+  // Another owner's page.
+  PageLoader::TTicket c = loader.Request(&loader, 1, [&]() { order.push_back(4); });
+  ASSERT_LT(first, a);
+  ASSERT_LT(a, b);
+  ASSERT_LT(b, c);
+  ASSERT_FALSE(loader.IsDone(a));
+
+  release.set_value();
+  loader.Wait(c);
+  ASSERT_TRUE(loader.IsDone(first) && loader.IsDone(b));
+  ASSERT_EQ(order, std::vector<int>({ 1, 2, 4 }));
+  ASSERT_EQ(loader.GetNumLoads(), 4u);
+
+  // Done: requested again.
+  ASSERT_GT(loader.Request(this, 1, [&]() { order.push_back(5); }), c);
+}
+
+TEST_F(PageLoaderTests, ScopeTest) {
+  ASSERT_EQ(PageMissScope::Current(), nullptr);
+  PageLoader loader;
+  {
+    PageMissScope deferring(&loader);
+    ASSERT_EQ(PageMissScope::Current(), &deferring);
+    {
+      // Blocking lookups within a deferring scope.
+      PageMissScope blocking(nullptr);
+      ASSERT_EQ(PageMissScope::Current(), nullptr);
+    }
+    ASSERT_EQ(PageMissScope::Current(), &deferring);
+    ASSERT_FALSE(deferring.Missed());
+    deferring.Miss(this, 7, []() {});
+    ASSERT_TRUE(deferring.Missed());
+    loader.Wait(deferring.GetTicket());
+  }
+  ASSERT_EQ(PageMissScope::Current(), nullptr);
+}
+
+TEST_F(PageLoaderTests, MeshMissTest) {
+  std::unique_ptr<Mesh> mesh = Terrain(20, true, 0, RollingHills);
+  PagedMesh paged;
+  ASSERT_TRUE(paged.Open(WriteMesh("miss", *mesh)));
+  PageLoader loader;
+  Ray down(glm::dvec3(0.3, 5.0, 0.2), -Y_NORM_VEC);
+
+  // Not resident: nothing is hit until the loader has read the cluster.
+  PageLoader::TTicket ticket;
+  {
+    PageMissScope scope(&loader);
+    ASSERT_FALSE(paged.Intersect(down));
+    ASSERT_TRUE(scope.Missed());
+    ticket = scope.GetTicket();
+  }
+  loader.Wait(ticket);
+  ASSERT_GT(paged.GetResidentBytes(), 0u);
+  {
+    PageMissScope scope(&loader);
+    IntersectionResult hit = paged.Intersect(down);
+    ASSERT_FALSE(scope.Missed());
+    ASSERT_TRUE(hit);
+    ASSERT_NEAR(hit.GetDistance(), mesh->Intersect(down).GetDistance(), EPS_STRONG);
+  }
+  ASSERT_EQ(paged.GetStats().pageIns, loader.GetNumLoads());
+}
+
+TEST_F(PageLoaderTests, TextureMissTest) {
+  TextureCache cache;
+  TTextureId id = cache.AddTexture(WriteChecker("miss"));
+  PageLoader loader;
+  TextureStats stats;
+  glm::dvec2 uv(0.3, 0.6);
+
+  PageLoader::TTicket ticket;
+  {
+    PageMissScope scope(&loader);
+    ASSERT_VEC_NEAR(cache.Sample(id, uv, 0.0, stats), ZERO_VEC, EPS_STRONG);
+    ASSERT_TRUE(scope.Missed());
+    ticket = scope.GetTicket();
+  }
+  loader.Wait(ticket);
+  ASSERT_EQ(stats.tileMisses, 0u);
+  ASSERT_EQ(loader.GetTextureStats().tileMisses, 1u);
+  {
+    PageMissScope scope(&loader);
+    glm::dvec3 color = cache.Sample(id, uv, 0.0, stats);
+    ASSERT_FALSE(scope.Missed());
+    ASSERT_VEC_NEAR(color, cache.Sample(id, uv, 0.0, stats), EPS_STRONG);
+    ASSERT_GT(color.b, 0.5);
+  }
+  ASSERT_EQ(stats.tileHits, 2u);
+}
+
+TEST_F(PageLoaderTests, RenderTest) {
+  // A textured paged terrain, path traced with threads waiting for pages
+  // and with threads suspending samples: the same image.
+  std::unique_ptr<Mesh> mesh = Terrain(30, true, 0, RollingHills);
+  std::string meshPath = WriteMesh("render", *mesh);
+  std::string texturePath = WriteChecker("render");
+
+  auto render = [&](bool async, RenderStats &stats) {
+    Scene scene;
+    Material material(glm::dvec3(0.1), glm::dvec3(0.8), glm::dvec3(0.2), 20.0);
+    material.SetDiffuseTexture(scene.GetTextures().AddTexture(texturePath));
+    scene.GetMaterials().AddMaterial("terrain", material);
+    // A few clusters at a time.
+    std::unique_ptr<PagedMesh> paged(new PagedMesh(16 << 10));
+    EXPECT_TRUE(paged->Open(meshPath));
+    scene.AddObject(std::move(paged));
+    scene.AddLight(PointLight(glm::dvec3(0.0, 10.0, -5.0), glm::dvec3(0.1),
+                              glm::dvec3(0.8), glm::dvec3(0.8)));
+    scene.SetBackground(glm::dvec3(0.3, 0.4, 0.5));
+    scene.Freeze();
+
+    RenderSettings settings;
+    settings.integrator = Integrator::PathTracing;
+    settings.numThreads = 3;
+    settings.maxDepth = 2;
+    settings.asyncPaging = async;
+    Camera camera(glm::dvec3(0.0, 6.0, -14.0), glm::dvec3(0.0, -0.4, 1.0),
+                  glm::uvec2(32, 24));
+    Framebuffer fb(32, 24);
+    Renderer renderer(settings);
+    renderer.Render(scene, camera, fb);
+    stats = renderer.GetStats();
+    return fb;
+  };
+
+  RenderStats blockingStats, asyncStats;
+  Framebuffer blocking = render(false, blockingStats);
+  Framebuffer async = render(true, asyncStats);
+  for (std::size_t i = 0; i < blocking.GetNumPixels(); ++i)
+    ASSERT_VEC_NEAR(blocking[i], async[i], EPS_STRONG);
+
+  ASSERT_EQ(blockingStats.suspendedSamples, 0u);
+  ASSERT_GT(asyncStats.suspendedSamples, 0u);
+  ASSERT_GT(asyncStats.pageLoads, 0u);
+  ASSERT_GT(asyncStats.textures.tileMisses, 0u);
+  // Suspended samples aren't counted.
+  ASSERT_EQ(asyncStats.primaryRays, blockingStats.primaryRays);
+  ASSERT_EQ(asyncStats.shadowRays, blockingStats.shadowRays);
+}
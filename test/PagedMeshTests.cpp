@@ -0,0 +1,306 @@
+#include "Tests.h"
+#include "PagedMesh.h"
+#include "Renderer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <thread>
+
+namespace {
+
+// Rolling hills raised above RollingHills().
+double RaisedHills(double x, double z) { return 5.0 + RollingHills(x, z); }
+
+// Rays from above the terrain, down at it at all angles.
+std::vector<Ray> DownRays(unsigned count) {
+  std::mt19937 rng(11);
+  std::uniform_real_distribution<double> dist(-1.0, 1.0);
+  std::vector<Ray> rays;
+  for (unsigned r = 0; r < count; ++r) {
+    glm::dvec3 origin(12.0 * dist(rng), 3.0 + dist(rng), 12.0 * dist(rng));
+    glm::dvec3 direction(dist(rng), -1.0 - dist(rng), dist(rng));
+    rays.push_back(Ray(origin, glm::normalize(direction)));
+  }
+  return rays;
+}
+
+void ExpectSameHit(const IntersectionResult &a, const IntersectionResult &b) {
+  ASSERT_EQ(static_cast<bool>(a), static_cast<bool>(b));
+  if (!a)
+    return;
+  ASSERT_NEAR(a.GetDistance(), b.GetDistance(), EPS_STRONG);
+  ASSERT_VEC_NEAR(a.GetNormalVector(), b.GetNormalVector(), EPS_WEAK);
+  ASSERT_EQ(a.GetMaterialId(), b.GetMaterialId());
+  ASSERT_VEC_NEAR(a.GetTexCoord(), b.GetTexCoord(), EPS_WEAK);
+  ASSERT_NEAR(a.GetTexCoordScale(), b.GetTexCoordScale(), EPS_WEAK);
+}
+
+// Paged mesh files written by a test, removed when it ends.
+class PagedMeshTests : public ::testing::Test {
+protected:
+  void TearDown() override {
+    for (const std::string &path : paths)
+      std::remove(path.c_str());
+  }
+
+  std::string Write(const std::string &name, const std::vector<const Mesh *> &meshes,
+                    unsigned clusterFaces,
+                    VertexFormat format = VertexFormat::Exact,
+                    bool meshlets = false) {
+    std::string path = "PagedMeshTests_" + name + ".pmesh";
+    paths.push_back(path);
+    PagedMeshSettings settings;
+    settings.clusterFaces = clusterFaces;
+    settings.vertexFormat = format;
+    settings.meshlets = meshlets;
+    PagedMeshWriter writer(settings);
+    EXPECT_TRUE(writer.Open(path));
+    for (const Mesh *mesh : meshes)
+      writer.AddMesh(*mesh);
+    EXPECT_TRUE(writer.Close());
+    return path;
+  }
+
+  std::vector<std::string> paths;
+};
+
+} // anonymous namespace
+
+// === PagedMesh tests ===
+TEST_F(PagedMeshTests, MatchesMeshTest) {
+  for (bool interpolate : { false, true }) {
+    std::unique_ptr<Mesh> mesh = Terrain(40, interpolate, 0, RollingHills, 1);
+    std::string path = Write(interpolate ? "smooth" : "flat", { mesh.get() }, 64);
+    PagedMesh paged;
+    ASSERT_TRUE(paged.Open(path));
+    ASSERT_EQ(paged.GetNumFaces(), mesh->GetNumFaces());
+    ASSERT_EQ(paged.GetNumClusters(), 64u);
+    ASSERT_EQ(paged.GetResidentBytes(), 0u);
+
+    for (const Ray &ray : DownRays(500))
+      ExpectSameHit(paged.Intersect(ray), mesh->Intersect(ray));
+    // Rays from below, and away from the terrain.
+    Ray up(glm::dvec3(0.3, -5.0, 0.2), Y_NORM_VEC);
+    ExpectSameHit(paged.Intersect(up), mesh->Intersect(up));
+    Ray away(glm::dvec3(0.3, 5.0, 0.2), Y_NORM_VEC);
+    ASSERT_FALSE(paged.Intersect(away));
+  }
+}
+
+TEST_F(PagedMeshTests, BudgetTest) {
+  std::unique_ptr<Mesh> mesh = Terrain(40, true, 0, RollingHills, 1);
+  std::string path = Write("budget", { mesh.get() }, 32);
+  std::vector<Ray> rays = DownRays(300);
+
+  // Unlimited: every cluster is read at most once.
+  PagedMesh paged;
+  ASSERT_TRUE(paged.Open(path));
+  for (int pass = 0; pass < 2; ++pass) {
+    for (const Ray &ray : rays)
+      paged.Intersect(ray);
+  }
+  GeometryStats stats = paged.GetStats();
+  ASSERT_GT(stats.pageIns, 0u);
+  ASSERT_LE(stats.pageIns, paged.GetNumClusters());
+  ASSERT_EQ(stats.evictions, 0u);
+  ASSERT_GT(stats.bytesRead, 0u);
+  std::size_t allBytes = paged.GetResidentBytes();
+  ASSERT_GT(allBytes, 0u);
+  ASSERT_GT(paged.GetDirectoryBytes(), 0u);
+  paged.Clear();
+  ASSERT_EQ(paged.GetResidentBytes(), 0u);
+
+  // A few clusters at a time: evicted and read again, same hits.
+  PagedMesh small(allBytes / 16);
+  ASSERT_TRUE(small.Open(path));
+  for (const Ray &ray : rays) {
+    ExpectSameHit(small.Intersect(ray), mesh->Intersect(ray));
+    ASSERT_LE(small.GetResidentBytes(), small.GetBudget());
+  }
+  stats = small.GetStats();
+  ASSERT_GT(stats.evictions, 0u);
+  ASSERT_GT(stats.pageIns, small.GetNumClusters());
+  small.ResetStats();
+  ASSERT_EQ(small.GetStats().pageIns, 0u);
+}
+
+TEST_F(PagedMeshTests, ThreadsTest) {
+  std::unique_ptr<Mesh> mesh = Terrain(40, true, 0, RollingHills, 1);
+  std::string path = Write("threads", { mesh.get() }, 32);
+  std::vector<Ray> rays = DownRays(400);
+  std::vector<IntersectionResult> expected;
+  for (const Ray &ray : rays)
+    expected.push_back(mesh->Intersect(ray));
+
+  // Bytes of the largest cluster a ray reads, at most.
+  std::size_t clusterBytes = 0;
+  PagedMesh unbounded;
+  ASSERT_TRUE(unbounded.Open(path));
+  for (const Ray &ray : rays) {
+    unbounded.Clear();
+    unbounded.Intersect(ray);
+    clusterBytes = std::max(clusterBytes, unbounded.GetResidentBytes());
+  }
+
+  // Clusters are evicted while other threads use them.
+  PagedMesh paged(32 << 10);
+  ASSERT_TRUE(paged.Open(path));
+  std::vector<IntersectionResult> results(rays.size());
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < 4; ++t) {
+    threads.push_back(std::thread([&, t]() {
+      for (int pass = 0; pass < 3; ++pass) {
+        for (std::size_t r = t; r < rays.size(); r += 4)
+          results[r] = paged.Intersect(rays[r]);
+      }
+    }));
+  }
+  for (std::thread &thread : threads)
+    thread.join();
+  for (std::size_t r = 0; r < rays.size(); ++r)
+    ExpectSameHit(results[r], expected[r]);
+  ASSERT_GT(paged.GetStats().evictions, 0u);
+  // Every thread may have read a cluster past the budget, no more.
+  ASSERT_LE(paged.GetResidentBytes(), paged.GetBudget() + 4 * clusterBytes);
+}
+
+TEST_F(PagedMeshTests, FileTest) {
+  PagedMesh paged;
+  ASSERT_FALSE(paged.Open("PagedMeshTests_missing.pmesh"));
+
+  // Several meshes in one file.
+  std::unique_ptr<Mesh> low = Terrain(10, false, 0, RollingHills, 1);
+  std::unique_ptr<Mesh> high = Terrain(12, true, 0, RaisedHills, 1);
+  std::string path = Write("two", { low.get(), high.get() }, 50);
+  ASSERT_TRUE(paged.Open(path));
+  ASSERT_EQ(paged.GetNumFaces(), low->GetNumFaces() + high->GetNumFaces());
+  Ray down(glm::dvec3(0.3, 10.0, 0.2), -Y_NORM_VEC);
+  ExpectSameHit(paged.Intersect(down), high->Intersect(down));
+
+  // Truncated.
+  std::FILE *in = std::fopen(path.c_str(), "rb");
+  ASSERT_TRUE(in);
+  std::vector<char> data(1 << 20);
+  data.resize(std::fread(data.data(), 1, data.size(), in));
+  std::fclose(in);
+  std::string truncated = "PagedMeshTests_truncated.pmesh";
+  paths.push_back(truncated);
+  std::FILE *out = std::fopen(truncated.c_str(), "wb");
+  ASSERT_TRUE(out);
+  std::fwrite(data.data(), 1, data.size() - 8, out);
+  std::fclose(out);
+  PagedMesh broken;
+  ASSERT_FALSE(broken.Open(truncated));
+}
+
+TEST_F(PagedMeshTests, QuantizedTest) {
+  std::unique_ptr<Mesh> mesh = Terrain(40, true, 0, RollingHills, 1);
+  std::vector<Ray> rays = DownRays(500);
+  // Straight down through every vertex and edge of the grid: seams
+  // between clusters would let some through.
+  std::vector<Ray> seamRays;
+  for (unsigned j = 0; j <= 80; ++j) {
+    for (unsigned i = 0; i <= 80; ++i) {
+      seamRays.push_back(Ray(glm::dvec3(-10.0 + 0.25 * i, 5.0, -10.0 + 0.25 * j),
+                             -Y_NORM_VEC));
+    }
+  }
+
+  PagedMesh exact;
+  ASSERT_TRUE(exact.Open(Write("exact", { mesh.get() }, 64)));
+  for (const Ray &ray : rays)
+    exact.Intersect(ray);
+  std::size_t exactBytes = exact.GetResidentBytes();
+
+  for (VertexFormat format : { VertexFormat::Quantized16, VertexFormat::Quantized21 }) {
+    bool use16 = format == VertexFormat::Quantized16;
+    PagedMesh paged;
+    ASSERT_TRUE(paged.Open(Write(use16 ? "q16" : "q21", { mesh.get() }, 64, format)));
+    ASSERT_EQ(paged.GetNumFaces(), mesh->GetNumFaces());
+    // Clusters span about 5 units: steps of 1e-4 and 3e-6.
+    double tolerance = use16 ? 1e-3 : 1e-4;
+    for (const Ray &ray : rays) {
+      IntersectionResult a = paged.Intersect(ray), b = mesh->Intersect(ray);
+      ASSERT_EQ(static_cast<bool>(a), static_cast<bool>(b));
+      if (!a)
+        continue;
+      ASSERT_NEAR(a.GetDistance(), b.GetDistance(), tolerance);
+      ASSERT_VEC_NEAR(a.GetNormalVector(), b.GetNormalVector(), 10.0 * tolerance);
+      ASSERT_EQ(a.GetMaterialId(), b.GetMaterialId());
+      ASSERT_VEC_NEAR(a.GetTexCoord(), b.GetTexCoord(), tolerance);
+    }
+    // Points, normals and texture coordinates: 64 bytes per vertex, 26
+    // or 28 quantized.
+    ASSERT_LT(paged.GetResidentBytes(), exactBytes * 3 / 4);
+
+    for (const Ray &ray : seamRays)
+      ASSERT_TRUE(paged.Intersect(ray));
+  }
+}
+
+TEST_F(PagedMeshTests, MeshletTest) {
+  std::unique_ptr<Mesh> flat = Terrain(40, false, 0, RollingHills, 1);
+  std::unique_ptr<Mesh> smooth = Terrain(40, true, 0, RollingHills, 1);
+  std::vector<Ray> rays = DownRays(500);
+
+  for (const Mesh *mesh : { flat.get(), smooth.get() }) {
+    bool interpolate = mesh->GetInterpolateNormals();
+    // Clusters of several meshlets, and of one.
+    for (unsigned clusterFaces : { 512u, 100u }) {
+      std::string name = "meshlets" + std::to_string(clusterFaces) +
+                         (interpolate ? "smooth" : "flat");
+      PagedMesh faces, meshlets;
+      ASSERT_TRUE(faces.Open(Write(name + "_faces", { mesh }, clusterFaces)));
+      ASSERT_TRUE(meshlets.Open(Write(name, { mesh }, clusterFaces,
+                                      VertexFormat::Exact, true)));
+      ASSERT_EQ(meshlets.GetNumFaces(), mesh->GetNumFaces());
+      for (const Ray &ray : rays) {
+        ExpectSameHit(meshlets.Intersect(ray), mesh->Intersect(ray));
+        faces.Intersect(ray);
+      }
+      // 8-bit indexes and fewer nodes, for a few vertexes stored twice.
+      ASSERT_LT(meshlets.GetResidentBytes(), faces.GetResidentBytes());
+    }
+  }
+
+  // With quantized vertexes: watertight.
+  PagedMesh quantized;
+  ASSERT_TRUE(quantized.Open(Write("meshletsq16", { smooth.get() }, 512,
+                                   VertexFormat::Quantized16, true)));
+  for (unsigned j = 0; j <= 80; ++j) {
+    for (unsigned i = 0; i <= 80; ++i) {
+      ASSERT_TRUE(quantized.Intersect(
+        Ray(glm::dvec3(-10.0 + 0.25 * i, 5.0, -10.0 + 0.25 * j), -Y_NORM_VEC)));
+    }
+  }
+}
+
+TEST_F(PagedMeshTests, RenderTest) {
+  // The same image from a scene with the mesh in memory and one with it
+  // paged, in the scene's object order.
+  std::unique_ptr<Mesh> mesh = Terrain(30, true, 0, RollingHills, 1);
+  std::string path = Write("render", { mesh.get() }, 64);
+  Scene inCore, paged;
+  for (Scene *scene : { &inCore, &paged }) {
+    scene->GetMaterials().AddMaterial("a", testMaterial1);
+    scene->GetMaterials().AddMaterial("b",
+      Material(glm::dvec3(0.1), glm::dvec3(0.5), glm::dvec3(0.2, 0.3, 0.9), 40.0));
+    scene->AddLight(PointLight(glm::dvec3(0.0, 10.0, -5.0), glm::dvec3(0.1),
+                               glm::dvec3(0.8), glm::dvec3(0.8)));
+  }
+  inCore.AddObject(Terrain(30, true, 0, RollingHills, 1));
+  std::unique_ptr<PagedMesh> pagedMesh(new PagedMesh());
+  ASSERT_TRUE(pagedMesh->Open(path));
+  paged.AddObject(std::move(pagedMesh));
+  inCore.Freeze();
+  paged.Freeze();
+
+  Camera camera(glm::dvec3(0.0, 6.0, -14.0), glm::dvec3(0.0, -0.4, 1.0),
+                glm::uvec2(48, 32));
+  Framebuffer a(48, 32), b(48, 32);
+  Renderer().Render(inCore, camera, a);
+  Renderer().Render(paged, camera, b);
+  for (std::size_t i = 0; i < a.GetNumPixels(); ++i)
+    ASSERT_VEC_NEAR(a[i], b[i], EPS_WEAK);
+}
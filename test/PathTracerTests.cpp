@@ -0,0 +1,287 @@
+#include "Tests.h"
+#include "PathTracer.h"
+#include "Renderer.h"
+#include "Mesh.h"
+#include "Sphere.h"
+#include "glm/gtc/constants.hpp"
+
+#include <cmath>
+#include <random>
+
+// Scenes without ambient light, seen by a camera looking down +Z.
+class PathTracerTests : public ::testing::Test {
+protected:
+  // Diffuse material with \p albedo, no ambient or specular light.
+  TMaterialId AddMatte(const std::string &name, double albedo) {
+    return scene.GetMaterials().AddMaterial(name,
+      Material(glm::dvec3(0.0), glm::dvec3(0.0), glm::dvec3(albedo), 1.0));
+  }
+
+  void AddFloor(TMaterialId mat) {
+    std::unique_ptr<Mesh> floor(new Mesh(false, mat));
+    auto v0 = floor->AddVertex(glm::dvec3(-10.0, 0.0, -10.0));
+    auto v1 = floor->AddVertex(glm::dvec3(-10.0, 0.0, 10.0));
+    auto v2 = floor->AddVertex(glm::dvec3(10.0, 0.0, 10.0));
+    auto v3 = floor->AddVertex(glm::dvec3(10.0, 0.0, -10.0));
+    floor->AddQuadFace(v0, v1, v2, v3);
+    floor->CalculateNormals();
+    scene.AddObject(std::move(floor));
+  }
+
+  Framebuffer Render(const RenderSettings &settings,
+                     RenderStats *stats = nullptr) {
+    Camera camera(glm::dvec3(0.0, 2.0, -8.0), glm::dvec3(0.0, -0.2, 1.0),
+                  glm::uvec2(Width, Height));
+    Framebuffer fb(Width, Height);
+    Renderer renderer(settings);
+    renderer.Render(scene, camera, fb);
+    if (stats)
+      *stats = renderer.GetStats();
+    return fb;
+  }
+
+  static RenderSettings PathSettings() {
+    RenderSettings settings;
+    settings.integrator = Integrator::PathTracing;
+    settings.numThreads = 1;
+    return settings;
+  }
+
+  static const unsigned Width = 32;
+  static const unsigned Height = 24;
+
+  Scene scene;
+};
+
+// === Sampling tests ===
+TEST(PathTracerSamplingTests, CosineHemisphereTest) {
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> dist(0.0, 1.0);
+  glm::dvec3 normal = glm::normalize(glm::dvec3(1.0, -2.0, 0.5));
+
+  // E[cos] = 2/3 for density cos / pi.
+  const int N = 100000;
+  double sum = 0.0;
+  for (int i = 0; i < N; ++i) {
+    glm::dvec3 dir = SampleCosineHemisphere(normal, dist(rng), dist(rng));
+    ASSERT_NEAR(glm::length(dir), 1.0, EPS_WEAK);
+    ASSERT_GE(glm::dot(dir, normal), -EPS_WEAK);
+    sum += glm::dot(dir, normal);
+  }
+  ASSERT_NEAR(sum / N, 2.0 / 3.0, 0.005);
+}
+
+TEST(PathTracerSamplingTests, PhongLobeTest) {
+  std::mt19937 rng(2);
+  std::uniform_real_distribution<double> dist(0.0, 1.0);
+  // Axis along -Z: the basis has a special case there.
+  for (const glm::dvec3 &axis : { -Z_NORM_VEC, glm::normalize(glm::dvec3(0.3, 0.4, 1.0)) }) {
+    // E[cos] = (n + 1) / (n + 2) for density (n + 1) / (2 pi) cos^n.
+    const double exponent = 20.0;
+    const int N = 100000;
+    double sum = 0.0;
+    for (int i = 0; i < N; ++i) {
+      glm::dvec3 dir = SamplePhongLobe(axis, exponent, dist(rng), dist(rng));
+      ASSERT_NEAR(glm::length(dir), 1.0, EPS_WEAK);
+      sum += glm::dot(dir, axis);
+    }
+    ASSERT_NEAR(sum / N, (exponent + 1.0) / (exponent + 2.0), 0.002);
+  }
+
+  // The density integrates to 1: mean of pdf / uniform density over the
+  // sphere.
+  const int N = 200000;
+  double sum = 0.0;
+  for (int i = 0; i < N; ++i) {
+    glm::dvec3 dir = SampleCosineHemisphere(Y_NORM_VEC, dist(rng), dist(rng));
+    if (dist(rng) < 0.5)
+      dir = -dir;
+    double pdf = 0.5 * std::abs(dir.y) / glm::pi<double>();
+    sum += PhongLobePdf(Y_NORM_VEC, 5.0, dir) / pdf;
+  }
+  ASSERT_NEAR(sum / N, 1.0, 0.02);
+}
+
+TEST(PathTracerSamplingTests, PowerHeuristicTest) {
+  ASSERT_NEAR(PowerHeuristic(1.0, 3.0) + PowerHeuristic(3.0, 1.0), 1.0,
+              EPS_STRONG);
+  ASSERT_NEAR(PowerHeuristic(2.0, 0.0), 1.0, EPS_STRONG);
+  ASSERT_NEAR(PowerHeuristic(0.0, 2.0), 0.0, EPS_STRONG);
+  ASSERT_NEAR(PowerHeuristic(0.0, 0.0), 0.0, EPS_STRONG);
+}
+
+// === Integrator tests ===
+
+// A convex diffuse object under a uniform sky only sees the sky: radiance
+// is albedo times sky. Both MIS strategies sample cosine-weighted
+// directions, so every sample is exact.
+TEST_F(PathTracerTests, FurnaceTest) {
+  scene.AddObject(std::unique_ptr<Sphere>(
+    new Sphere(glm::dvec3(0.0, 1.0, 0.0), 2.0, AddMatte("gray", 0.5))));
+  scene.SetBackground(glm::dvec3(1.0));
+  scene.Freeze();
+
+  RenderStats stats;
+  Framebuffer fb = Render(PathSettings(), &stats);
+  ASSERT_VEC_NEAR(fb.At(Width / 2, Height / 2), glm::dvec3(0.5), EPS_WEAK);
+  ASSERT_VEC_NEAR(fb.At(0, 0), glm::dvec3(1.0), EPS_STRONG);
+  ASSERT_EQ(stats.primaryRays, Width * Height);
+  ASSERT_GT(stats.reflectionRays, 0);
+}
+
+// Surfaces of albedo 1 under a sky of 1 have radiance 1 however they
+// occlude each other, as long as paths aren't cut short.
+TEST_F(PathTracerTests, WhiteFurnaceTest) {
+  TMaterialId white = AddMatte("white", 1.0);
+  AddFloor(white);
+  scene.AddObject(std::unique_ptr<Sphere>(
+    new Sphere(glm::dvec3(0.0, 1.0, 0.0), 1.0, white)));
+  scene.SetBackground(glm::dvec3(1.0));
+  scene.Freeze();
+
+  RenderSettings settings = PathSettings();
+  settings.maxDepth = 32;
+  settings.minSamples = settings.maxSamples = 16;
+  Framebuffer fb = Render(settings);
+  double mean = 0.0;
+  for (std::size_t i = 0; i < fb.GetNumPixels(); ++i)
+    mean += fb[i].g / fb.GetNumPixels();
+  ASSERT_NEAR(mean, 1.0, 0.01);
+}
+
+// Without bounces, sky and ambient light, direct diffuse lighting is the
+// same as the Whitted renderer's.
+TEST_F(PathTracerTests, DirectLightingMatchesWhittedTest) {
+  TMaterialId matte = AddMatte("matte", 0.8);
+  AddFloor(matte);
+  scene.AddObject(std::unique_ptr<Sphere>(
+    new Sphere(glm::dvec3(0.0, 1.0, 0.0), 1.0, matte)));
+  scene.AddLight(PointLight(glm::dvec3(0.0, 8.0, -4.0), glm::dvec3(0.0),
+                            glm::dvec3(0.8), glm::dvec3(0.8)));
+  scene.AddLight(PointLight(glm::dvec3(5.0, 3.0, -5.0), glm::dvec3(0.0),
+                            glm::dvec3(0.3), glm::dvec3(0.3)));
+  scene.SetBackground(glm::dvec3(0.0));
+  scene.Freeze();
+
+  RenderSettings settings;
+  settings.maxDepth = 0;
+  settings.lightCutoff = 0.0;
+  Framebuffer whitted = Render(settings);
+  settings.integrator = Integrator::PathTracing;
+  Framebuffer paths = Render(settings);
+  // Lights are seen from slightly different points: the path tracer lifts
+  // hits off the surface by RayBias.
+  for (std::size_t i = 0; i < whitted.GetNumPixels(); ++i)
+    ASSERT_VEC_NEAR(whitted[i], paths[i], 1.0e-5);
+  ASSERT_GT(paths.At(Width / 2, Height - 1).r, 0.0);
+}
+
+TEST_F(PathTracerTests, ThreadsTest) {
+  TMaterialId matte = AddMatte("matte", 0.7);
+  TMaterialId glossy = scene.GetMaterials().AddMaterial("glossy",
+    Material(glm::dvec3(0.0), glm::dvec3(0.5), glm::dvec3(0.2), 50.0));
+  AddFloor(matte);
+  scene.AddObject(std::unique_ptr<Sphere>(
+    new Sphere(glm::dvec3(0.0, 1.0, 0.0), 1.0, glossy)));
+  scene.AddLight(PointLight(glm::dvec3(0.0, 8.0, -4.0), glm::dvec3(0.0),
+                            glm::dvec3(0.8), glm::dvec3(0.8)));
+  scene.SetBackground(glm::dvec3(0.2, 0.3, 0.5));
+  scene.Freeze();
+
+  RenderSettings settings = PathSettings();
+  settings.minSamples = settings.maxSamples = 4;
+  RenderStats singleStats;
+  Framebuffer single = Render(settings, &singleStats);
+
+  // More threads than rows too.
+  for (unsigned threads : { 3u, 100u }) {
+    settings.numThreads = threads;
+    RenderStats parallelStats;
+    Framebuffer parallel = Render(settings, &parallelStats);
+    for (std::size_t i = 0; i < single.GetNumPixels(); ++i)
+      ASSERT_VEC_NEAR(single[i], parallel[i], EPS_STRONG);
+    ASSERT_EQ(singleStats.reflectionRays, parallelStats.reflectionRays);
+    ASSERT_EQ(singleStats.shadowRays, parallelStats.shadowRays);
+  }
+}
+
+// Cached diffuse lighting is close to path traced lighting.
+TEST_F(PathTracerTests, IrradianceCacheTest) {
+  TMaterialId matte = AddMatte("matte", 0.7);
+  AddFloor(matte);
+  scene.AddObject(std::unique_ptr<Sphere>(
+    new Sphere(glm::dvec3(0.0, 1.0, 0.0), 1.0, matte)));
+  scene.AddLight(PointLight(glm::dvec3(0.0, 8.0, -4.0), glm::dvec3(0.0),
+                            glm::dvec3(0.8), glm::dvec3(0.8)));
+  scene.SetBackground(glm::dvec3(0.2, 0.3, 0.5));
+  scene.Freeze();
+
+  RenderSettings settings = PathSettings();
+  settings.minSamples = settings.maxSamples = 64;
+  Framebuffer paths = Render(settings);
+
+  settings.irradianceCaching = true;
+  settings.irradianceCache.prepassStep = 4;
+  RenderStats cacheStats;
+  Framebuffer cached = Render(settings, &cacheStats);
+  ASSERT_GT(cacheStats.irradianceRecords, 0u);
+  ASSERT_LT(cacheStats.irradianceRecords, Width * Height / 4);
+  ASSERT_LT(cacheStats.irradianceMisses, cacheStats.samples / 100);
+
+  double meanDiff = 0.0;
+  for (std::size_t i = 0; i < paths.GetNumPixels(); ++i)
+    meanDiff += (cached[i].g - paths[i].g) / paths.GetNumPixels();
+  ASSERT_NEAR(meanDiff, 0.0, 0.01);
+}
+
+// Light reflected by a glossy wall onto the floor: lit from the photon
+// map, it adds up to about the light path traced paths find. The map
+// doesn't depend on the number of threads.
+TEST_F(PathTracerTests, PhotonMapTest) {
+  TMaterialId matte = AddMatte("matte", 0.7);
+  TMaterialId glossy = scene.GetMaterials().AddMaterial("glossy",
+    Material(glm::dvec3(0.0), glm::dvec3(0.9), glm::dvec3(0.0), 20.0));
+  AddFloor(matte);
+  std::unique_ptr<Mesh> wall(new Mesh(false, glossy));
+  wall->AddQuadFace(wall->AddVertex(glm::dvec3(-10.0, 0.0, 4.0)),
+                    wall->AddVertex(glm::dvec3(-10.0, 6.0, 4.0)),
+                    wall->AddVertex(glm::dvec3(10.0, 6.0, 4.0)),
+                    wall->AddVertex(glm::dvec3(10.0, 0.0, 4.0)));
+  wall->CalculateNormals();
+  scene.AddObject(std::move(wall));
+  scene.AddLight(PointLight(glm::dvec3(-1.0, 3.0, -1.0), glm::dvec3(0.0),
+                            glm::dvec3(0.8), glm::dvec3(0.8)));
+  scene.SetBackground(glm::dvec3(0.0));
+  scene.Freeze();
+
+  RenderSettings settings = PathSettings();
+  settings.minSamples = settings.maxSamples = 64;
+  Framebuffer paths = Render(settings);
+
+  settings.photonMapping = true;
+  settings.photonMap.maxEmitted = 400000;
+  RenderStats mapStats;
+  Framebuffer mapped = Render(settings, &mapStats);
+  ASSERT_EQ(mapStats.photonsEmitted, settings.photonMap.maxEmitted);
+  ASSERT_GT(mapStats.photonsStored, 1000u);
+
+  double meanDiff = 0.0;
+  for (std::size_t i = 0; i < paths.GetNumPixels(); ++i)
+    meanDiff += (mapped[i].g - paths[i].g) / paths.GetNumPixels();
+  ASSERT_NEAR(meanDiff, 0.0, 0.003);
+
+  settings.numThreads = 3;
+  RenderStats parallelStats;
+  Framebuffer parallel = Render(settings, &parallelStats);
+  ASSERT_EQ(mapStats.photonsStored, parallelStats.photonsStored);
+  for (std::size_t i = 0; i < mapped.GetNumPixels(); ++i)
+    ASSERT_VEC_NEAR(mapped[i], parallel[i], EPS_STRONG);
+
+  // Emission stops at the photon budget.
+  settings.photonMap.maxPhotons = 500;
+  RenderStats budgetStats;
+  Render(settings, &budgetStats);
+  ASSERT_LE(budgetStats.photonsStored, settings.photonMap.maxPhotons);
+  ASSERT_GT(budgetStats.photonsStored, 0u);
+  ASSERT_LT(budgetStats.photonsEmitted, settings.photonMap.maxEmitted);
+}
@@ -0,0 +1,123 @@
+#include "Tests.h"
+#include "PhotonMap.h"
+#include "glm/gtc/constants.hpp"
+
+#include <algorithm>
+#include <random>
+
+namespace {
+
+// Photons falling straight down on a grid of \p n x \p n points with
+// spacing \p spacing around the origin of the y = 0 plane, of power 1.
+std::vector<Photon> GridPhotons(int n, float spacing) {
+  std::vector<Photon> photons;
+  for (int i = 0; i < n; ++i) {
+    for (int j = 0; j < n; ++j) {
+      Photon p;
+      p.position = glm::vec3((i - n / 2) * spacing, 0.0f, (j - n / 2) * spacing);
+      p.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+      p.power = glm::vec3(1.0f, 0.5f, 0.25f);
+      photons.push_back(p);
+    }
+  }
+  return photons;
+}
+
+} // anonymous namespace
+
+TEST(PhotonMapTests, NearestTest) {
+  // Clusters and scattered photons, some at the same position: the
+  // nearest photons are those of a search over all of them.
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<float> uniform(-4.0f, 4.0f);
+  std::normal_distribution<float> normal(0.0f, 0.1f);
+  std::vector<Photon> photons(5000);
+  for (std::size_t i = 0; i < photons.size(); ++i) {
+    Photon &p = photons[i];
+    if (i % 3 == 0)
+      p.position = glm::vec3(uniform(rng), uniform(rng), uniform(rng));
+    else if (i % 3 == 1)
+      p.position = glm::vec3(1.0f + normal(rng), normal(rng), -2.0f + normal(rng));
+    else
+      p.position = photons[i - 1].position;
+    p.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+    p.power = glm::vec3(1.0f);
+  }
+
+  PhotonMap map;
+  map.Build(photons, 1.0);
+  ASSERT_EQ(map.GetNumPhotons(), photons.size());
+  ASSERT_LT(map.GetNumNodes(), photons.size() / 4);
+
+  std::vector<std::uint32_t> indices;
+  std::vector<float> distances2;
+  for (int q = 0; q < 200; ++q) {
+    glm::dvec3 point = q % 2 ? glm::dvec3(uniform(rng), uniform(rng), uniform(rng))
+                             : glm::dvec3(1.0 + normal(rng), 0.0, -2.0);
+    double radius = q % 4 < 2 ? 1.0 : 100.0;
+    unsigned k = 1 + q % 60;
+
+    std::vector<float> expected;
+    for (const Photon &p : photons) {
+      glm::vec3 d = p.position - glm::vec3(point);
+      if (glm::dot(d, d) < radius * radius)
+        expected.push_back(glm::dot(d, d));
+    }
+    std::sort(expected.begin(), expected.end());
+    expected.resize(std::min<std::size_t>(expected.size(), k));
+
+    map.FindNearest(point, k, radius, indices, distances2);
+    ASSERT_EQ(indices.size(), expected.size());
+    for (std::size_t i = 0; i < indices.size(); ++i) {
+      ASSERT_NEAR(distances2[i], expected[i], 1.0e-4);
+      glm::dvec3 d = map.GetPosition(indices[i]) - point;
+      ASSERT_NEAR(glm::dot(d, d), distances2[i], 1.0e-4);
+    }
+  }
+}
+
+TEST(PhotonMapTests, DensityTest) {
+  // 1 / spacing^2 photons per unit area, each of power scale.
+  const float spacing = 0.01f;
+  const double scale = 0.5;
+  PhotonMap map;
+  map.Build(GridPhotons(201, spacing), scale);
+  glm::dvec3 expected = glm::dvec3(1.0, 0.5, 0.25) * (scale / (spacing * spacing));
+
+  glm::dvec3 irradiance = map.EstimateIrradiance(glm::dvec3(0.003, 0.0, -0.002),
+                                                 Y_NORM_VEC, 200, 1.0);
+  ASSERT_VEC_NEAR(irradiance, expected, 0.05 * expected.r);
+
+  // Photons only light the side they come from.
+  irradiance = map.EstimateIrradiance(ZERO_VEC, -Y_NORM_VEC, 200, 1.0);
+  ASSERT_VEC_NEAR(irradiance, ZERO_VEC, EPS_STRONG);
+
+  // Fewer photons than neighbours within the radius: the whole disc.
+  irradiance = map.EstimateIrradiance(glm::dvec3(0.0, 0.0, 1.3), Y_NORM_VEC,
+                                      200, 0.5);
+  ASSERT_GT(irradiance.r, 0.0);
+  ASSERT_LT(irradiance.r, 0.5 * expected.r);
+
+  // Nothing around.
+  irradiance = map.EstimateIrradiance(glm::dvec3(0.0, 5.0, 0.0), Y_NORM_VEC,
+                                      200, 1.0);
+  ASSERT_VEC_NEAR(irradiance, ZERO_VEC, EPS_STRONG);
+}
+
+TEST(PhotonMapTests, EmptyTest) {
+  PhotonMap map;
+  map.Build(std::vector<Photon>(), 1.0);
+  ASSERT_TRUE(map.Empty());
+  ASSERT_VEC_NEAR(map.EstimateIrradiance(ZERO_VEC, Y_NORM_VEC, 50, 1.0),
+                  ZERO_VEC, EPS_STRONG);
+
+  // A single leaf.
+  map.Build(GridPhotons(3, 0.1f), 1.0);
+  ASSERT_EQ(map.GetNumNodes(), 1u);
+  std::vector<std::uint32_t> indices;
+  std::vector<float> distances2;
+  map.FindNearest(ZERO_VEC, 4, 1.0, indices, distances2);
+  ASSERT_EQ(indices.size(), 4u);
+  ASSERT_NEAR(distances2[0], 0.0f, 1.0e-6);
+  ASSERT_NEAR(distances2[3], 0.01f, 1.0e-6);
+}
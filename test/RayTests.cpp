@@ -19,3 +19,30 @@ TEST(RayTests, ReflectionTest) {
   ASSERT_VEC_NEAR(reflected2.GetOrigin(), normRay2.GetOrigin(), EPS_STRONG);
   ASSERT_VEC_NEAR(reflected2.GetDirection(), -1.0 * ray1.GetDirection(), EPS_STRONG);
 }
+
+TEST(RayTests, ConeTest) {
+  // Thin by default.
+  Ray thin(ZERO_VEC, X_NORM_VEC);
+  ASSERT_NEAR(thin.GetWidthAt(100.0), 0.0, EPS_STRONG);
+
+  Ray cone(ZERO_VEC, X_NORM_VEC, 0.5, 0.01);
+  ASSERT_NEAR(cone.GetWidthAt(0.0), 0.5, EPS_STRONG);
+  ASSERT_NEAR(cone.GetWidthAt(10.0), 0.6, EPS_STRONG);
+
+  // A flat mirror keeps the spread, the width is the one at the mirror.
+  Ray mirror(glm::dvec3(10.0, 0.0, 0.0), glm::dvec3(-1.0, 1.0, 0.0));
+  Ray reflected = cone.Reflect(mirror);
+  ASSERT_NEAR(reflected.GetConeWidth(), 0.6, EPS_STRONG);
+  ASSERT_NEAR(reflected.GetConeSpread(), 0.01, EPS_STRONG);
+  ASSERT_NEAR(reflected.GetWidthAt(10.0), 0.7, EPS_STRONG);
+
+  // Convex mirrors spread it more, concave ones focus it: past the focus
+  // the cone widens again.
+  Ray convex = cone.Reflect(mirror, 0.5);
+  ASSERT_NEAR(convex.GetConeSpread(), 0.01 + 2.0 * 0.5 * 0.6, EPS_STRONG);
+  Ray concave = cone.Reflect(mirror, -0.5);
+  ASSERT_LT(concave.GetConeSpread(), 0.0);
+  double focus = 0.6 / -concave.GetConeSpread();
+  ASSERT_NEAR(concave.GetWidthAt(focus), 0.0, EPS_STRONG);
+  ASSERT_NEAR(concave.GetWidthAt(2.0 * focus), 0.6, EPS_STRONG);
+}
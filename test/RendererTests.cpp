@@ -0,0 +1,389 @@
+#include "Tests.h"
+#include "Renderer.h"
+#include "Mesh.h"
+#include "Sphere.h"
+
+#include <cmath>
+
+// Small scene: a reflective floor, a mirror sphere and a matte sphere
+// lit by two lights.
+class RendererTests : public ::testing::Test {
+protected:
+  void SetUp() override {
+    MaterialManager &materials = scene.GetMaterials();
+    TMaterialId matte = materials.AddMaterial("matte", testMaterial1);
+    TMaterialId mirror = materials.AddMaterial("mirror",
+      Material(glm::dvec3(0.0), glm::dvec3(0.9), glm::dvec3(0.1), 100.0));
+
+    std::unique_ptr<Mesh> floor(new Mesh(false, matte));
+    auto v0 = floor->AddVertex(glm::dvec3(-10.0, 0.0, -10.0));
+    auto v1 = floor->AddVertex(glm::dvec3(-10.0, 0.0, 10.0));
+    auto v2 = floor->AddVertex(glm::dvec3(10.0, 0.0, 10.0));
+    auto v3 = floor->AddVertex(glm::dvec3(10.0, 0.0, -10.0));
+    floor->AddQuadFace(v0, v1, v2, v3);
+    floor->CalculateNormals();
+    scene.AddObject(std::move(floor));
+
+    scene.AddObject(std::unique_ptr<Sphere>(
+      new Sphere(glm::dvec3(-1.5, 1.0, 0.0), 1.0, mirror)));
+    scene.AddObject(std::unique_ptr<Sphere>(
+      new Sphere(glm::dvec3(1.5, 1.0, 0.0), 1.0, matte)));
+
+    scene.AddLight(PointLight(glm::dvec3(0.0, 8.0, -4.0), glm::dvec3(0.1),
+                              glm::dvec3(0.8), glm::dvec3(0.8)));
+    scene.AddLight(PointLight(glm::dvec3(5.0, 3.0, -5.0), glm::dvec3(0.0),
+                              glm::dvec3(0.3), glm::dvec3(0.3)));
+    scene.SetBackground(glm::dvec3(0.2, 0.3, 0.5));
+    scene.Freeze();
+  }
+
+  Framebuffer Render(const RenderSettings &settings, RenderStats *stats,
+                     GuideBuffers *guides = nullptr,
+                     AovBuffers *aovs = nullptr) {
+    Camera camera(glm::dvec3(0.0, 2.0, -8.0), glm::dvec3(0.0, -0.2, 1.0),
+                  glm::uvec2(Width, Height));
+    Framebuffer fb(Width, Height);
+    Renderer renderer(settings);
+    renderer.Render(scene, camera, fb, guides, aovs);
+    if (stats)
+      *stats = renderer.GetStats();
+    return fb;
+  }
+
+  static const unsigned Width = 40;
+  static const unsigned Height = 30;
+
+  Scene scene;
+};
+
+// === Renderer tests ===
+TEST_F(RendererTests, RecursiveTest) {
+  RenderStats stats;
+  Framebuffer fb = Render(RenderSettings(), &stats);
+
+  ASSERT_EQ(stats.primaryRays, Width * Height);
+  ASSERT_GT(stats.reflectionRays, 0);
+  ASSERT_GT(stats.shadowRays, 0);
+
+  // Top-left corner sees the sky.
+  ASSERT_VEC_NEAR(fb.At(0, 0), scene.GetBackground(), EPS_STRONG);
+  // Bottom row sees the lit floor.
+  ASSERT_GT(fb.At(Width / 2, Height - 1).r, 0.0);
+}
+
+TEST_F(RendererTests, WavefrontMatchesRecursiveTest) {
+  RenderSettings settings;
+  RenderStats recursiveStats;
+  Framebuffer recursive = Render(settings, &recursiveStats);
+
+  // Budget so small that the image is traced in many waves.
+  settings.mode = RenderMode::Wavefront;
+  settings.wavefrontMemoryBudget = 64 << 10;
+  RenderStats wavefrontStats;
+  Framebuffer wavefront = Render(settings, &wavefrontStats);
+
+  ASSERT_EQ(recursiveStats.primaryRays, wavefrontStats.primaryRays);
+  ASSERT_EQ(recursiveStats.reflectionRays, wavefrontStats.reflectionRays);
+  ASSERT_EQ(recursiveStats.shadowRays, wavefrontStats.shadowRays);
+  ASSERT_GT(wavefrontStats.waves, settings.maxDepth + 1);
+
+  for (std::size_t i = 0; i < recursive.GetNumPixels(); ++i)
+    ASSERT_VEC_NEAR(recursive[i], wavefront[i], EPS_WEAK);
+}
+
+TEST_F(RendererTests, DeferredMatchesRecursiveTest) {
+  RenderSettings settings;
+  RenderStats recursiveStats;
+  Framebuffer recursive = Render(settings, &recursiveStats);
+
+  // Tiles don't divide the image evenly.
+  settings.mode = RenderMode::Deferred;
+  settings.tileSize = 16;
+  RenderStats deferredStats;
+  Framebuffer deferred = Render(settings, &deferredStats);
+
+  ASSERT_EQ(recursiveStats.primaryRays, deferredStats.primaryRays);
+  ASSERT_EQ(recursiveStats.reflectionRays, deferredStats.reflectionRays);
+  ASSERT_EQ(recursiveStats.shadowRays, deferredStats.shadowRays);
+  ASSERT_GT(deferredStats.intersectionSeconds, 0.0);
+  ASSERT_GT(deferredStats.shadingSeconds, 0.0);
+
+  for (std::size_t i = 0; i < recursive.GetNumPixels(); ++i)
+    ASSERT_VEC_NEAR(recursive[i], deferred[i], EPS_WEAK);
+}
+
+TEST_F(RendererTests, LightCullingTest) {
+  // A row of short-range lights above the floor.
+  for (int i = 0; i < 20; ++i) {
+    scene.AddLight(PointLight(glm::dvec3(-9.5 + i, 0.5, -2.0), glm::dvec3(0.01),
+                              glm::dvec3(0.2), glm::dvec3(0.2), /*radius=*/1.5));
+  }
+
+  RenderSettings settings;
+  settings.mode = RenderMode::Deferred;
+  settings.lightCulling = false;
+  RenderStats denseStats;
+  Framebuffer dense = Render(settings, &denseStats);
+
+  settings.lightCulling = true;
+  RenderStats culledStats;
+  Framebuffer culled = Render(settings, &culledStats);
+
+  // Same shadow rays, far fewer lights visited.
+  ASSERT_EQ(denseStats.shadowRays, culledStats.shadowRays);
+  ASSERT_LT(4 * culledStats.lightSamples, denseStats.lightSamples);
+
+  for (std::size_t i = 0; i < dense.GetNumPixels(); ++i)
+    ASSERT_VEC_NEAR(dense[i], culled[i], EPS_WEAK);
+}
+
+TEST_F(RendererTests, LightCutoffTest) {
+  RenderSettings settings;
+  settings.lightCutoff = 0.0;
+  RenderStats allStats;
+  Framebuffer all = Render(settings, &allStats);
+
+  // Cutoff above any contribution: no shadow rays, ambient light only.
+  settings.lightCutoff = 10.0;
+  RenderStats noneStats;
+  Framebuffer none = Render(settings, &noneStats);
+
+  ASSERT_GT(allStats.shadowRays, 0);
+  ASSERT_EQ(noneStats.shadowRays, 0);
+  ASSERT_LT(none.At(Width / 2, Height - 1).r, all.At(Width / 2, Height - 1).r);
+}
+
+TEST_F(RendererTests, SampledLightsTest) {
+  for (int i = 0; i < 20; ++i) {
+    scene.AddLight(PointLight(glm::dvec3(-9.5 + i, 0.5, -2.0), glm::dvec3(0.01),
+                              glm::dvec3(0.2), glm::dvec3(0.2), /*radius=*/3.0));
+  }
+
+  RenderSettings settings;
+  settings.maxDepth = 0;
+  RenderStats allStats;
+  Framebuffer all = Render(settings, &allStats);
+
+  // Shadow rays are bounded by the samples, not by the number of lights.
+  settings.directLighting = DirectLighting::SampledLights;
+  settings.lightSamplesPerHit = 2;
+  RenderStats sampledStats;
+  Render(settings, &sampledStats);
+  ASSERT_LE(sampledStats.shadowRays, 2 * sampledStats.primaryRays);
+  ASSERT_LT(sampledStats.shadowRays, allStats.shadowRays);
+
+  // The estimate is unbiased: with many samples the mean matches.
+  settings.lightSamplesPerHit = 256;
+  Framebuffer sampled = Render(settings, nullptr);
+  glm::dvec3 allMean(0.0), sampledMean(0.0);
+  for (std::size_t i = 0; i < all.GetNumPixels(); ++i) {
+    allMean += all[i];
+    sampledMean += sampled[i];
+  }
+  ASSERT_VEC_NEAR(sampledMean / double(all.GetNumPixels()),
+                  allMean / double(all.GetNumPixels()), 5.0e-3);
+}
+
+TEST_F(RendererTests, AdaptiveSamplingTest) {
+  const std::uint64_t numPixels = Width * Height;
+
+  // Fixed number of samples.
+  RenderSettings settings;
+  settings.minSamples = 4;
+  settings.maxSamples = 4;
+  RenderStats fixedStats;
+  Framebuffer fixed = Render(settings, &fixedStats);
+  ASSERT_EQ(fixedStats.samples, 4 * numPixels);
+  ASSERT_EQ(fixedStats.primaryRays, 4 * numPixels);
+  ASSERT_EQ(fixedStats.samplesSaved, 0);
+  ASSERT_EQ(fixedStats.passes, 4);
+
+  // Flat sky converges after the minimal number of samples, edges don't.
+  settings.minSamples = 2;
+  settings.maxSamples = 16;
+  RenderStats adaptiveStats;
+  Framebuffer adaptive = Render(settings, &adaptiveStats);
+  ASSERT_GE(adaptiveStats.samples, 2 * numPixels);
+  ASSERT_LT(adaptiveStats.samples, 16 * numPixels);
+  ASSERT_GT(adaptiveStats.samples, 2 * numPixels);
+  ASSERT_EQ(adaptiveStats.samples + adaptiveStats.samplesSaved, 16 * numPixels);
+  ASSERT_VEC_NEAR(adaptive.At(0, 0), scene.GetBackground(), EPS_STRONG);
+
+  // Everything converges at once with a large threshold.
+  settings.errorThreshold = 100.0;
+  RenderStats earlyStats;
+  Render(settings, &earlyStats);
+  ASSERT_EQ(earlyStats.passes, 2);
+  ASSERT_EQ(earlyStats.samples, 2 * numPixels);
+}
+
+TEST_F(RendererTests, TimeBudgetTest) {
+  const std::uint64_t numPixels = Width * Height;
+
+  // Far more samples than fit into the budget.
+  RenderSettings settings;
+  settings.minSamples = 100000;
+  settings.maxSamples = 100000;
+  settings.timeBudget = 0.1;
+  RenderStats stats;
+  Framebuffer fb = Render(settings, &stats);
+
+  ASSERT_TRUE(stats.outOfTime);
+  ASSERT_GE(stats.samplesPerPixel, 1.0);
+  // Whole passes only: every pixel has the same number of samples.
+  ASSERT_EQ(stats.samples % numPixels, 0);
+  ASSERT_EQ(stats.samples / numPixels, stats.passes);
+  // Passes are short, so the deadline is kept closely.
+  ASSERT_LT(stats.renderSeconds, 2.0 * settings.timeBudget);
+  ASSERT_VEC_NEAR(fb.At(0, 0), scene.GetBackground(), EPS_STRONG);
+
+  // Enough time: all samples are taken.
+  settings.minSamples = 2;
+  settings.maxSamples = 2;
+  settings.timeBudget = 100.0;
+  Render(settings, &stats);
+  ASSERT_FALSE(stats.outOfTime);
+  ASSERT_EQ(stats.samplesPerPixel, 2.0);
+}
+
+TEST_F(RendererTests, PathTerminationTest) {
+  // Two facing mirrors: every camera ray bounces between them dozens of
+  // times before it escapes.
+  Scene hall;
+  TMaterialId mirror = hall.GetMaterials().AddMaterial("mirror",
+    Material(glm::dvec3(0.05), glm::dvec3(0.9), glm::dvec3(0.3), 20.0));
+  for (double x : {-2.0, 2.0}) {
+    std::unique_ptr<Mesh> wall(new Mesh(false, mirror));
+    wall->AddQuadFace(wall->AddVertex(glm::dvec3(x, -100.0, -100.0)),
+                      wall->AddVertex(glm::dvec3(x, -100.0, 100.0)),
+                      wall->AddVertex(glm::dvec3(x, 100.0, 100.0)),
+                      wall->AddVertex(glm::dvec3(x, 100.0, -100.0)));
+    wall->CalculateNormals();
+    hall.AddObject(std::move(wall));
+  }
+  hall.AddLight(PointLight(glm::dvec3(0.0, 5.0, 0.0), glm::dvec3(0.1),
+                           glm::dvec3(0.5), glm::dvec3(0.5)));
+  hall.Freeze();
+
+  Camera camera(ZERO_VEC, X_NORM_VEC, glm::uvec2(Width, Height));
+  auto render = [&](const RenderSettings &settings, RenderStats &stats) {
+    Framebuffer fb(Width, Height);
+    Renderer renderer(settings);
+    renderer.Render(hall, camera, fb);
+    stats = renderer.GetStats();
+    glm::dvec3 mean(0.0);
+    for (std::size_t i = 0; i < fb.GetNumPixels(); ++i)
+      mean += fb[i];
+    return mean / double(fb.GetNumPixels());
+  };
+
+  RenderSettings settings;
+  settings.maxDepth = 1000;
+  settings.minSamples = settings.maxSamples = 16;
+  settings.throughputCutoff = 0.0;
+  settings.rouletteThroughput = 0.0;
+  RenderStats fullStats;
+  glm::dvec3 full = render(settings, fullStats);
+  ASSERT_EQ(fullStats.pathsCutOff, 0);
+  ASSERT_EQ(fullStats.pathsTerminated, 0);
+
+  // 0.9^66 < 1/1024: the cutoff ends paths after 66 bounces at most.
+  settings.throughputCutoff = 1.0 / 1024.0;
+  RenderStats cutOffStats;
+  glm::dvec3 cutOff = render(settings, cutOffStats);
+  ASSERT_GT(cutOffStats.pathsCutOff, 0);
+  ASSERT_LE(cutOffStats.reflectionRays, 66 * cutOffStats.primaryRays);
+  ASSERT_LT(cutOffStats.reflectionRays, fullStats.reflectionRays);
+  ASSERT_VEC_NEAR(cutOff, full, 1.0e-3);
+
+  // Roulette ends most paths far earlier, the image stays the same on
+  // average.
+  settings.rouletteThroughput = 0.5;
+  RenderStats rouletteStats;
+  glm::dvec3 roulette = render(settings, rouletteStats);
+  ASSERT_GT(rouletteStats.pathsTerminated, 0);
+  ASSERT_LT(2 * rouletteStats.reflectionRays, cutOffStats.reflectionRays);
+  ASSERT_VEC_NEAR(roulette, full, 1.0e-2);
+}
+
+TEST_F(RendererTests, GuideBuffersTest) {
+  RenderSettings settings;
+  GuideBuffers guides;
+  Render(settings, nullptr, &guides);
+  ASSERT_EQ(guides.GetNumPixels(), Width * Height);
+
+  // Sky: nothing.
+  ASSERT_EQ(guides.depth[0], 0.0f);
+  ASSERT_EQ(guides.normalY[0], 0.0f);
+  // Floor: matte material, facing up.
+  std::size_t floor = (Height - 1) * Width + Width / 2;
+  ASSERT_NEAR(guides.normalY[floor], 1.0f, 1.0e-6f);
+  ASSERT_NEAR(guides.albedoR[floor], 0.8f, 1.0e-6f);
+  ASSERT_GT(guides.depth[floor], 0.0f);
+
+  // Antialiased guides are means over the samples, the same in all modes.
+  settings.minSamples = settings.maxSamples = 4;
+  Render(settings, nullptr, &guides);
+  ASSERT_NEAR(guides.normalY[floor], 1.0f, 1.0e-6f);
+  // No noise in the sky.
+  ASSERT_EQ(guides.error[0], 0.0f);
+  settings.mode = RenderMode::Wavefront;
+  GuideBuffers wavefront;
+  Render(settings, nullptr, &wavefront);
+  for (std::size_t i = 0; i < guides.GetNumPixels(); ++i) {
+    ASSERT_NEAR(guides.normalX[i], wavefront.normalX[i], 1.0e-6f);
+    ASSERT_NEAR(guides.albedoG[i], wavefront.albedoG[i], 1.0e-6f);
+    ASSERT_NEAR(guides.depth[i], wavefront.depth[i], 1.0e-4f);
+  }
+}
+
+TEST_F(RendererTests, AovTest) {
+  RenderSettings settings;
+  RenderStats plainStats, aovStats;
+  Framebuffer plain = Render(settings, &plainStats);
+  AovBuffers aovs(AovBit(Aov::Depth) | AovBit(Aov::Normal) |
+                  AovBit(Aov::Albedo) | AovBit(Aov::ObjectId));
+  GuideBuffers guides;
+  Framebuffer fb = Render(settings, &aovStats, &guides, &aovs);
+  ASSERT_EQ(aovs.GetNumPixels(), Width * Height);
+  ASSERT_EQ(aovs.GetNumChannels(), 8u);
+
+  // Same image, from the same rays.
+  for (std::size_t i = 0; i < fb.GetNumPixels(); ++i)
+    ASSERT_VEC_NEAR(fb[i], plain[i], 0.0);
+  ASSERT_EQ(aovStats.primaryRays, plainStats.primaryRays);
+  ASSERT_EQ(aovStats.reflectionRays, plainStats.reflectionRays);
+  ASSERT_EQ(aovStats.shadowRays, plainStats.shadowRays);
+
+  // Sky: infinitely far, no object.
+  ASSERT_TRUE(std::isinf(aovs.depth[0]));
+  ASSERT_EQ(aovs.objectId[0], -1.0f);
+  ASSERT_EQ(aovs.normalY[0], 0.0f);
+  // Floor: the first object, matte, facing up, as in the guides.
+  std::size_t floor = (Height - 1) * Width + Width / 2;
+  ASSERT_EQ(aovs.objectId[floor], 0.0f);
+  ASSERT_NEAR(aovs.normalY[floor], 1.0f, 1.0e-6f);
+  ASSERT_NEAR(aovs.albedoR[floor], 0.8f, 1.0e-6f);
+  ASSERT_EQ(aovs.depth[floor], guides.depth[floor]);
+  // Spheres: the matte one (+X) is on the left of the image.
+  std::size_t middle = (Height / 2) * Width;
+  ASSERT_EQ(aovs.objectId[middle + Width / 2 - 5], 2.0f);
+  ASSERT_EQ(aovs.objectId[middle + Width / 2 + 5], 1.0f);
+
+  // Only requested planes are filled; the other modes agree.
+  settings.mode = RenderMode::Wavefront;
+  AovBuffers ids(AovBit(Aov::ObjectId));
+  Render(settings, nullptr, nullptr, &ids);
+  ASSERT_TRUE(ids.depth.empty() && ids.normalX.empty() && ids.albedoR.empty());
+  ASSERT_EQ(ids.objectId, aovs.objectId);
+  settings.mode = RenderMode::Recursive;
+  settings.integrator = Integrator::PathTracing;
+  AovBuffers depths(AovBit(Aov::Depth));
+  Render(settings, nullptr, nullptr, &depths);
+  for (std::size_t i = 0; i < depths.GetNumPixels(); ++i) {
+    if (!std::isinf(aovs.depth[i]))
+      ASSERT_NEAR(depths.depth[i], aovs.depth[i], 1.0e-4f);
+    else
+      ASSERT_TRUE(std::isinf(depths.depth[i]));
+  }
+}
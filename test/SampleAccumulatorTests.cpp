@@ -0,0 +1,48 @@
+#include "Tests.h"
+#include "SampleAccumulator.h"
+
+#include <cmath>
+
+// === SampleAccumulator tests ===
+TEST(SampleAccumulatorTests, MeanAndVarianceTest) {
+  SampleAccumulator accumulator(2);
+  ASSERT_EQ(accumulator.GetNumPixels(), 2);
+  ASSERT_EQ(accumulator.GetNumSamples(0), 0);
+  ASSERT_TRUE(std::isinf(accumulator.GetError(0)));
+
+  // Gray samples: luminance equals the value.
+  const double values[] = { 0.1, 0.4, 0.2, 0.7, 0.6 };
+  double mean = 0.0;
+  for (double v : values) {
+    accumulator.AddSample(1, glm::dvec3(v));
+    mean += v / 5.0;
+  }
+  double variance = 0.0;
+  for (double v : values)
+    variance += (v - mean) * (v - mean) / 4.0;
+
+  ASSERT_EQ(accumulator.GetNumSamples(1), 5);
+  ASSERT_VEC_NEAR(accumulator.GetMean(1), glm::dvec3(mean), EPS_STRONG);
+  ASSERT_NEAR(accumulator.GetVariance(1), variance, EPS_STRONG);
+  ASSERT_NEAR(accumulator.GetError(1), std::sqrt(variance / 5.0), EPS_STRONG);
+
+  // Other pixels are untouched.
+  ASSERT_EQ(accumulator.GetNumSamples(0), 0);
+
+  Framebuffer fb(2, 1);
+  accumulator.Resolve(fb);
+  ASSERT_VEC_NEAR(fb[1], glm::dvec3(mean), EPS_STRONG);
+
+  accumulator.Reset(3);
+  ASSERT_EQ(accumulator.GetNumPixels(), 3);
+  ASSERT_EQ(accumulator.GetNumSamples(1), 0);
+}
+
+TEST(SampleAccumulatorTests, ConstantSamplesTest) {
+  SampleAccumulator accumulator(1);
+  for (int i = 0; i < 3; ++i)
+    accumulator.AddSample(0, glm::dvec3(0.2, 0.5, 0.9));
+  ASSERT_NEAR(accumulator.GetError(0), 0.0, EPS_STRONG);
+  ASSERT_NEAR(SampleAccumulator::Luminance(accumulator.GetMean(0)),
+              0.2126 * 0.2 + 0.7152 * 0.5 + 0.0722 * 0.9, EPS_STRONG);
+}
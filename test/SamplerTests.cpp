@@ -0,0 +1,140 @@
+#include "Tests.h"
+#include "Sampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <set>
+
+namespace {
+
+const SamplerType AllTypes[] = {
+  SamplerType::Random, SamplerType::Sobol, SamplerType::BlueNoise
+};
+
+} // anonymous namespace
+
+// === Sampler tests ===
+TEST(SamplerTests, PhiloxKnownAnswerTest) {
+  // Known-answer vectors of the Random123 library.
+  std::uint32_t result[4];
+
+  const std::uint32_t zeroCounter[4] = { 0, 0, 0, 0 };
+  const std::uint32_t zeroKey[2] = { 0, 0 };
+  Philox4x32(zeroCounter, zeroKey, result);
+  ASSERT_EQ(result[0], 0x6627E8D5u);
+  ASSERT_EQ(result[1], 0xE169C58Du);
+  ASSERT_EQ(result[2], 0xBC57AC4Cu);
+  ASSERT_EQ(result[3], 0x9B00DBD8u);
+
+  const std::uint32_t piCounter[4] = { 0x243F6A88u, 0x85A308D3u, 0x13198A2Eu, 0x03707344u };
+  const std::uint32_t piKey[2] = { 0xA4093822u, 0x299F31D0u };
+  Philox4x32(piCounter, piKey, result);
+  ASSERT_EQ(result[0], 0xD16CFE09u);
+  ASSERT_EQ(result[1], 0x94FDCCEBu);
+  ASSERT_EQ(result[2], 0x5001E420u);
+  ASSERT_EQ(result[3], 0x24126EA1u);
+}
+
+TEST(SamplerTests, SobolStratificationTest) {
+  // The first 2^k points of every dimension fall one into each of 2^k
+  // equal intervals, scrambled or not.
+  const unsigned k = 8;
+  for (unsigned dim = 0; dim < SobolDimensions; ++dim) {
+    std::set<std::uint32_t> plain, scrambled;
+    for (std::uint32_t i = 0; i < (1u << k); ++i) {
+      plain.insert(SobolSample(i, dim) >> (32 - k));
+      scrambled.insert(OwenScramble(SobolSample(i, dim), 12345u) >> (32 - k));
+    }
+    ASSERT_EQ(plain.size(), 1u << k);
+    ASSERT_EQ(scrambled.size(), 1u << k);
+  }
+
+  // First two dimensions form a (0, 2)-sequence: 2^k points fill every
+  // cell of a 2^a x 2^(k - a) grid exactly once.
+  for (unsigned a = 0; a <= k; ++a) {
+    std::set<std::uint32_t> cells;
+    for (std::uint32_t i = 0; i < (1u << k); ++i) {
+      std::uint32_t x = a ? OwenScramble(SobolSample(i, 0), 7u) >> (32 - a) : 0;
+      std::uint32_t y = a < k ? OwenScramble(SobolSample(i, 1), 9u) >> (32 - (k - a)) : 0;
+      cells.insert((x << (k - a)) | y);
+    }
+    ASSERT_EQ(cells.size(), 1u << k);
+  }
+}
+
+TEST(SamplerTests, DeterminismTest) {
+  for (SamplerType type : AllTypes) {
+    Sampler sampler(type, 42);
+    Sampler same(type, 42);
+    Sampler other(type, 43);
+
+    double values[37];
+    sampler.Generate(glm::uvec2(5, 7), 3, 1, 37, values);
+    bool differs = false;
+    for (std::uint32_t d = 0; d < 37; ++d) {
+      double v = sampler.Get(glm::uvec2(5, 7), 3, d + 1);
+      ASSERT_GE(v, 0.0);
+      ASSERT_LT(v, 1.0);
+      // Same value whatever the order and the way of generation.
+      ASSERT_EQ(v, values[d]);
+      ASSERT_EQ(v, same.Get(glm::uvec2(5, 7), 3, d + 1));
+      differs = differs || v != other.Get(glm::uvec2(5, 7), 3, d + 1);
+    }
+    ASSERT_TRUE(differs);
+  }
+}
+
+TEST(SamplerTests, ConvergenceTest) {
+  // Estimate the area of a quarter disk with 256 2D samples in many
+  // pixels: low-discrepancy samplers have far smaller error.
+  double error[3];
+  for (int t = 0; t < 3; ++t) {
+    Sampler sampler(AllTypes[t]);
+    double squaredError = 0.0;
+    for (unsigned p = 0; p < 64; ++p) {
+      glm::uvec2 pixel(p % 8, p / 8);
+      int inside = 0;
+      for (std::uint32_t i = 0; i < 256; ++i) {
+        double x = sampler.Get(pixel, i, 0);
+        double y = sampler.Get(pixel, i, 1);
+        inside += x * x + y * y < 1.0;
+      }
+      double estimate = inside / 256.0;
+      squaredError += (estimate - M_PI / 4.0) * (estimate - M_PI / 4.0);
+    }
+    error[t] = std::sqrt(squaredError / 64.0);
+  }
+
+  ASSERT_LT(error[1], 0.5 * error[0]);
+  ASSERT_LT(error[2], 0.5 * error[0]);
+}
+
+TEST(SamplerTests, BlueNoiseMaskTest) {
+  // Every value occurs once.
+  std::vector<double> values;
+  for (unsigned y = 0; y < BlueNoiseSize; ++y)
+    for (unsigned x = 0; x < BlueNoiseSize; ++x)
+      values.push_back(BlueNoise(x, y));
+  std::sort(values.begin(), values.end());
+  for (std::size_t i = 0; i < values.size(); ++i)
+    ASSERT_NEAR(values[i], (i + 0.5) / values.size(), EPS_STRONG);
+
+  // Tiles the plane.
+  ASSERT_EQ(BlueNoise(3, 5), BlueNoise(3 + BlueNoiseSize, 5 + 2 * BlueNoiseSize));
+
+  // No low frequencies: means of 8x8 blocks stay close to 1/2, much
+  // closer than for white noise (standard deviation 0.036).
+  double squaredDeviation = 0.0;
+  unsigned numBlocks = 0;
+  for (unsigned by = 0; by < BlueNoiseSize; by += 8) {
+    for (unsigned bx = 0; bx < BlueNoiseSize; bx += 8) {
+      double mean = 0.0;
+      for (unsigned y = by; y < by + 8; ++y)
+        for (unsigned x = bx; x < bx + 8; ++x)
+          mean += BlueNoise(x, y) / 64.0;
+      squaredDeviation += (mean - 0.5) * (mean - 0.5);
+      ++numBlocks;
+    }
+  }
+  ASSERT_LT(std::sqrt(squaredDeviation / numBlocks), 0.015);
+}
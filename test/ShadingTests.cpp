@@ -0,0 +1,167 @@
+#include "Tests.h"
+#include "Shading.h"
+
+#include <cmath>
+
+class ShadingTests : public ::testing::Test {
+protected:
+  void SetUp() override {
+    materialId = materials.AddMaterial("test", testMaterial1);
+    materials.Freeze();
+
+    lights.push_back(PointLight(/*position=*/glm::dvec3(0.0, 10.0, 0.0),
+                                /*ambient=*/glm::dvec3(0.1, 0.1, 0.1),
+                                /*specular=*/glm::dvec3(1.0, 1.0, 1.0),
+                                /*diffuse=*/glm::dvec3(1.0, 1.0, 1.0)));
+  }
+
+  MaterialManager materials;
+  TMaterialId materialId;
+  std::vector<PointLight> lights;
+};
+
+// === Shading tests ===
+TEST_F(ShadingTests, SingleHitTest) {
+  HitBatch hits;
+  // Light straight above, viewer at 45 degrees.
+  glm::dvec3 view = glm::normalize(glm::dvec3(1.0, 1.0, 0.0));
+  hits.Add(ZERO_VEC, Y_NORM_VEC, view, materialId);
+
+  std::vector<glm::dvec3> colors;
+  ShadeBlinnPhong(materials, lights, hits, colors);
+  ASSERT_EQ(colors.size(), 1);
+
+  // N.L = 1, N.H = cos(22.5 deg).
+  double NdotH = glm::dot(Y_NORM_VEC, glm::normalize(Y_NORM_VEC + view));
+  double expected = 0.3 * 0.1 + 0.8 * 1.0 + 0.1 * std::pow(NdotH, 10.0);
+  ASSERT_VEC_NEAR(colors[0], glm::dvec3(expected), EPS_WEAK);
+}
+
+TEST_F(ShadingTests, BackFacingTest) {
+  HitBatch hits;
+  // Surface faces away from the light: ambient only.
+  hits.Add(ZERO_VEC, -Y_NORM_VEC, -Y_NORM_VEC, materialId);
+
+  std::vector<glm::dvec3> colors;
+  ShadeBlinnPhong(materials, lights, hits, colors);
+  ASSERT_VEC_NEAR(colors[0], glm::dvec3(0.3 * 0.1), EPS_WEAK);
+}
+
+TEST_F(ShadingTests, BatchMatchesSingleHitsTest) {
+  // More hits than a single chunk, with different geometry each.
+  HitBatch batch;
+  const int numHits = 150;
+  for (int i = 0; i < numHits; ++i) {
+    double angle = 0.01 * i;
+    glm::dvec3 normal(std::sin(angle), std::cos(angle), 0.0);
+    batch.Add(glm::dvec3(0.1 * i, 0.0, 0.0), normal, Y_NORM_VEC, materialId);
+  }
+
+  std::vector<glm::dvec3> exact, fast;
+  ShadeBlinnPhong(materials, lights, batch, exact, SpecularPowMode::Exact);
+  ShadeBlinnPhong(materials, lights, batch, fast, SpecularPowMode::Fast);
+  ASSERT_EQ(exact.size(), numHits);
+  ASSERT_EQ(fast.size(), numHits);
+
+  for (int i = 0; i < numHits; ++i) {
+    HitBatch single;
+    single.Add(glm::dvec3(batch.pointX[i], batch.pointY[i], batch.pointZ[i]),
+               glm::dvec3(batch.normalX[i], batch.normalY[i], batch.normalZ[i]),
+               Y_NORM_VEC, materialId);
+    std::vector<glm::dvec3> color;
+    ShadeBlinnPhong(materials, lights, single, color);
+    ASSERT_VEC_NEAR(exact[i], color[0], EPS_STRONG);
+    // Fast pow only differs in the (small) specular term.
+    ASSERT_VEC_NEAR(exact[i], fast[i], 0.1);
+  }
+}
+
+TEST_F(ShadingTests, BucketTest) {
+  // Materials are frozen in SetUp: use a separate manager.
+  MaterialManager bucketMaterials;
+  TMaterialId matteId = bucketMaterials.AddMaterial("matte", testMaterial1);
+  TMaterialId shinyId = bucketMaterials.AddMaterial("shiny",
+    Material(glm::dvec3(0.0), glm::dvec3(0.9), glm::dvec3(0.2), 80.0));
+
+  // Two buckets: 70 matte hits followed by 30 shiny ones.
+  HitBatch hits;
+  for (int i = 0; i < 100; ++i) {
+    glm::dvec3 normal = glm::normalize(glm::dvec3(0.01 * i, 1.0, 0.0));
+    hits.Add(glm::dvec3(0.0, 0.0, 0.1 * i), normal, Y_NORM_VEC,
+             i < 70 ? matteId : shinyId);
+  }
+
+  std::vector<glm::dvec3> expected;
+  ShadeBlinnPhong(bucketMaterials, lights, hits, expected);
+
+  std::vector<glm::dvec3> colors(hits.Size());
+  ShadeBlinnPhongBucket(bucketMaterials, matteId, lights, hits, 0, 70, colors);
+  ShadeBlinnPhongBucket(bucketMaterials, shinyId, lights, hits, 70, 100, colors);
+
+  for (std::size_t i = 0; i < hits.Size(); ++i)
+    ASSERT_VEC_NEAR(colors[i], expected[i], EPS_STRONG);
+}
+
+TEST_F(ShadingTests, FalloffTest) {
+  // Light of radius 20 at distance 10: falloff (1 - 0.5^4)^2.
+  std::vector<PointLight> ranged(1, PointLight(lights[0].position,
+    lights[0].ambientColor, lights[0].specularColor, lights[0].diffuseColor,
+    /*radius=*/20.0));
+
+  HitBatch hits;
+  hits.Add(ZERO_VEC, Y_NORM_VEC, Y_NORM_VEC, materialId);
+  // Out of reach.
+  hits.Add(glm::dvec3(0.0, -15.0, 0.0), Y_NORM_VEC, Y_NORM_VEC, materialId);
+
+  std::vector<glm::dvec3> unbounded, colors;
+  ShadeBlinnPhong(materials, lights, hits, unbounded);
+  ShadeBlinnPhong(materials, ranged, hits, colors);
+
+  double falloff = (1.0 - 0.0625) * (1.0 - 0.0625);
+  ASSERT_VEC_NEAR(colors[0], falloff * unbounded[0], EPS_STRONG);
+  ASSERT_VEC_NEAR(colors[1], ZERO_VEC, EPS_STRONG);
+}
+
+TEST_F(ShadingTests, CulledMatchesDenseTest) {
+  // Lights of different radii around a row of hits.
+  std::vector<PointLight> many;
+  for (int l = 0; l < 10; ++l) {
+    many.push_back(PointLight(glm::dvec3(1.0 * l, 2.0, 0.0), glm::dvec3(0.05),
+                              glm::dvec3(0.3), glm::dvec3(0.3),
+                              /*radius=*/2.0 + 0.5 * l));
+  }
+
+  HitBatch hits;
+  for (int i = 0; i < 100; ++i) {
+    glm::dvec3 normal = glm::normalize(glm::dvec3(0.01 * i, 1.0, 0.0));
+    hits.Add(glm::dvec3(0.1 * i, 0.0, 0.0), normal, Y_NORM_VEC, materialId);
+  }
+
+  // Every other light is shadowed.
+  std::vector<double> visibility(many.size() * hits.Size());
+  for (std::size_t l = 0; l < many.size(); ++l)
+    for (std::size_t i = 0; i < hits.Size(); ++i)
+      visibility[l * hits.Size() + i] = (l + i) % 2 ? 1.0 : 0.0;
+
+  // Lists only hold the lights in reach.
+  HitLights hitLights;
+  for (std::size_t i = 0; i < hits.Size(); ++i) {
+    glm::dvec3 point(hits.pointX[i], hits.pointY[i], hits.pointZ[i]);
+    for (std::size_t l = 0; l < many.size(); ++l) {
+      if (glm::length(many[l].position - point) < many[l].radius)
+        hitLights.Add(static_cast<std::uint32_t>(l),
+                      visibility[l * hits.Size() + i]);
+    }
+    hitLights.EndHit();
+  }
+  ASSERT_LT(hitLights.Size(), many.size() * hits.Size());
+
+  for (SpecularPowMode mode : {SpecularPowMode::Exact, SpecularPowMode::Fast}) {
+    std::vector<glm::dvec3> dense, culled;
+    ShadeBlinnPhong(materials, many, hits, dense, mode, &visibility);
+    ShadeBlinnPhongCulled(materials, many, hits, hitLights, culled, mode);
+    ASSERT_EQ(culled.size(), hits.Size());
+    for (std::size_t i = 0; i < hits.Size(); ++i)
+      ASSERT_VEC_NEAR(culled[i], dense[i], EPS_STRONG);
+  }
+}
@@ -2,7 +2,7 @@
 #include "Sphere.h"
 
 TEST(SphereTests, IntersectionTest) {
-  IObject3D *s1 = new Sphere(ZERO_VEC, 5.0, testMaterial1);
+  IObject3D *s1 = new Sphere(ZERO_VEC, 5.0, testMaterialId1);
 
   // 2-points Intersection.
   Ray ray1(glm::dvec3(10.0, 0.0, 0.0), -X_NORM_VEC);
@@ -27,3 +27,18 @@ TEST(SphereTests, IntersectionTest) {
 
   delete s1;
 }
+
+TEST(SphereTests, CurvatureTest) {
+  Sphere sphere(ZERO_VEC, 4.0, testMaterialId1);
+
+  // Convex from outside, concave from inside.
+  IntersectionResult outside = sphere.Intersect(
+    Ray(glm::dvec3(10.0, 0.0, 0.0), -X_NORM_VEC, 0.0, 0.1));
+  ASSERT_TRUE(outside);
+  ASSERT_NEAR(outside.GetFacingCurvature(), 0.25, EPS_STRONG);
+  ASSERT_NEAR(outside.GetFootprint(), 0.6, EPS_STRONG);
+
+  IntersectionResult inside = sphere.Intersect(Ray(ZERO_VEC, X_NORM_VEC));
+  ASSERT_TRUE(inside);
+  ASSERT_NEAR(inside.GetFacingCurvature(), -0.25, EPS_STRONG);
+}
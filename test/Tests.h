@@ -3,6 +3,10 @@
 #include "gtest/gtest.h"
 #include "glm/glm.hpp"
 #include "Material.h"
+#include "Mesh.h"
+
+#include <cmath>
+#include <memory>
 
 #define ASSERT_VEC_NEAR(vec1, vec2, epsilon) \
   ASSERT_NEAR(glm::length(vec1 - vec2), 0.0, epsilon)
@@ -22,3 +26,38 @@ const Material testMaterial1(/*ambient=*/glm::dvec3(0.3, 0.3, 0.3),
                              /*specular=*/glm::dvec3(0.1, 0.1, 0.1),
                              /*diffuse=*/glm::dvec3(0.8, 0.8, 0.8),
                              /*shihiness=*/10.0);
+
+// Material id used by primitives in tests which don't shade anything.
+const TMaterialId testMaterialId1 = 0;
+
+// Heights of rolling hills, for Terrain().
+inline double RollingHills(double x, double z) {
+  return std::sin(x) * std::cos(0.7 * z);
+}
+
+// Terrain of 2 * n * n faces over [-10, 10]^2 at heights \p height(x, z),
+// with texture coordinates (x, z) / 8. Faces are of \p material, or in
+// stripes of it and \p stripeMaterial.
+template <typename THeight>
+std::unique_ptr<Mesh> Terrain(unsigned n, bool interpolate,
+                              TMaterialId material, THeight height,
+                              TMaterialId stripeMaterial = InvalidMaterialId) {
+  std::unique_ptr<Mesh> mesh(new Mesh(interpolate, material));
+  for (unsigned j = 0; j <= n; ++j) {
+    for (unsigned i = 0; i <= n; ++i) {
+      double x = -10.0 + 20.0 * i / n, z = -10.0 + 20.0 * j / n;
+      TMeshIndex v = mesh->AddVertex(glm::dvec3(x, height(x, z), z));
+      mesh->SetTexCoord(v, glm::dvec2(x, z) / 8.0);
+    }
+  }
+  for (unsigned j = 0; j < n; ++j) {
+    for (unsigned i = 0; i < n; ++i) {
+      TMeshIndex v = j * (n + 1) + i;
+      bool stripe = stripeMaterial != InvalidMaterialId && (i / 4) % 2;
+      mesh->AddQuadFace(v, v + n + 1, v + n + 2, v + 1,
+                        stripe ? stripeMaterial : material);
+    }
+  }
+  mesh->CalculateNormals();
+  return mesh;
+}
@@ -0,0 +1,321 @@
+#include "Tests.h"
+#include "Texture.h"
+#include "Renderer.h"
+#include "Mesh.h"
+#include "Sphere.h"
+
+#include <cstdio>
+#include <random>
+#include <thread>
+
+namespace {
+
+// Color of texel (x, y) of the test gradient.
+glm::vec3 Gradient(unsigned x, unsigned y) {
+  return glm::vec3((x % 256) / 255.0f, (y % 256) / 255.0f, ((x + y) % 256) / 255.0f);
+}
+
+std::vector<glm::vec3> GradientTexels(unsigned width, unsigned height) {
+  std::vector<glm::vec3> texels;
+  for (unsigned y = 0; y < height; ++y) {
+    for (unsigned x = 0; x < width; ++x)
+      texels.push_back(Gradient(x, y));
+  }
+  return texels;
+}
+
+// Texture files written by a test, removed when it ends.
+class TextureTests : public ::testing::Test {
+protected:
+  void TearDown() override {
+    for (const std::string &path : paths)
+      std::remove(path.c_str());
+  }
+
+  std::string Write(const std::string &name, unsigned width, unsigned height,
+                    const std::vector<glm::vec3> &texels, unsigned tileSize,
+                    TextureFormat format = TextureFormat::RGBA8) {
+    std::string path = "TextureTests_" + name + ".tmip";
+    paths.push_back(path);
+    EXPECT_TRUE(WriteTexture(path, width, height, texels, tileSize, format));
+    return path;
+  }
+
+  std::vector<std::string> paths;
+};
+
+// Bytes of a tile of \p tileSize texels.
+std::size_t TileBytes(unsigned tileSize) {
+  return static_cast<std::size_t>(tileSize) * tileSize * 4;
+}
+
+} // anonymous namespace
+
+TEST_F(TextureTests, ReadTest) {
+  const unsigned W = 100, H = 60;
+  TextureCache cache;
+  TTextureId id = cache.AddTexture(Write("gradient", W, H, GradientTexels(W, H), 16));
+  ASSERT_NE(id, InvalidTextureId);
+  ASSERT_EQ(cache.GetWidth(id), W);
+  ASSERT_EQ(cache.GetHeight(id), H);
+  // 100, 50, 25, 12, 6, 3, 1.
+  ASSERT_EQ(cache.GetNumLevels(id), 7u);
+
+  // Texel centers of the finest level, in tiles on and off the edges.
+  TextureStats stats;
+  for (unsigned y : { 0u, 17u, 59u }) {
+    for (unsigned x : { 0u, 31u, 32u, 99u }) {
+      glm::dvec2 uv((x + 0.5) / W, (y + 0.5) / H);
+      glm::dvec3 color = cache.Sample(id, uv, 0.0, stats);
+      ASSERT_VEC_NEAR(color, glm::dvec3(Gradient(x, y)), 1.0e-6);
+      // Coordinates wrap.
+      color = cache.Sample(id, uv + glm::dvec2(-2.0, 3.0), 0.0, stats);
+      ASSERT_VEC_NEAR(color, glm::dvec3(Gradient(x, y)), 1.0e-6);
+    }
+  }
+
+  // Between two texels.
+  glm::dvec3 color = cache.Sample(id, glm::dvec2(11.0 / W, 5.5 / H), 0.0, stats);
+  ASSERT_VEC_NEAR(color, 0.5 * glm::dvec3(Gradient(10, 5) + Gradient(11, 5)), 1.0e-6);
+
+  // Files which aren't textures.
+  ASSERT_EQ(cache.AddTexture("TextureTests_missing.tmip"), InvalidTextureId);
+  std::string path = Write("corrupt", W, H, GradientTexels(W, H), 16);
+  std::FILE *file = std::fopen(path.c_str(), "r+b");
+  ASSERT_TRUE(file);
+  std::fputs("XMIP", file);
+  std::fclose(file);
+  ASSERT_EQ(cache.AddTexture(path), InvalidTextureId);
+}
+
+TEST_F(TextureTests, MipTest) {
+  // Checkerboard of black and white texels: every coarser level is grey.
+  const unsigned N = 64;
+  std::vector<glm::vec3> texels;
+  for (unsigned y = 0; y < N; ++y) {
+    for (unsigned x = 0; x < N; ++x)
+      texels.push_back(glm::vec3((x + y) % 2 ? 1.0f : 0.0f));
+  }
+  TextureCache cache;
+  TTextureId id = cache.AddTexture(Write("checker", N, N, texels, 16));
+  ASSERT_EQ(cache.GetNumLevels(id), 7u);
+
+  TextureStats stats;
+  glm::dvec2 uv(0.3, 0.7);
+  glm::dvec3 grey(128.0 / 255.0);
+  for (double texelsCovered : { 2.0, 3.0, 16.0, 64.0, 1000.0 }) {
+    glm::dvec3 color = cache.Sample(id, uv, texelsCovered / N, stats);
+    ASSERT_VEC_NEAR(color, grey, 1.0e-6);
+  }
+
+  // Finer than a texel: the checkerboard.
+  glm::dvec3 white = cache.Sample(id, glm::dvec2(1.5 / N, 0.5 / N), 0.1 / N, stats);
+  ASSERT_VEC_NEAR(white, glm::dvec3(1.0), 1.0e-6);
+
+  // Between levels 0 and 1 (a footprint of sqrt(2) texels): half way.
+  glm::dvec3 blend = cache.Sample(id, glm::dvec2(1.5 / N, 0.5 / N),
+                                  std::sqrt(2.0) / N, stats);
+  ASSERT_VEC_NEAR(blend, 0.5 * (glm::dvec3(1.0) + grey), 1.0e-6);
+}
+
+TEST_F(TextureTests, BudgetTest) {
+  // 8 x 8 tiles of 16 x 16 texels on the finest level, room for 4.
+  const unsigned N = 128, T = 16;
+  TextureCache cache(4 * TileBytes(T));
+  TTextureId id = cache.AddTexture(Write("budget", N, N, GradientTexels(N, N), T));
+  ASSERT_EQ(cache.GetResidentBytes(), 0u);
+
+  // Nothing is read until a lookup needs it.
+  TextureStats stats;
+  auto tileCenter = [&](unsigned tx, unsigned ty) {
+    return glm::dvec2((tx + 0.5) * T / N, (ty + 0.5) * T / N);
+  };
+  cache.Sample(id, tileCenter(0, 0), 0.0, stats);
+  ASSERT_EQ(stats.tileMisses, 1u);
+  ASSERT_EQ(stats.bytesRead, TileBytes(T));
+  cache.Sample(id, tileCenter(0, 0), 0.0, stats);
+  ASSERT_EQ(stats.tileHits, 1u);
+  ASSERT_EQ(stats.tileMisses, 1u);
+
+  // Every tile once: the cache stays within the budget.
+  for (unsigned ty = 0; ty < N / T; ++ty) {
+    for (unsigned tx = 0; tx < N / T; ++tx) {
+      glm::dvec3 color = cache.Sample(id, tileCenter(tx, ty), 0.0, stats);
+      ASSERT_VEC_NEAR(color, glm::dvec3(Gradient(tx * T + T / 2, ty * T + T / 2)), 0.01);
+      ASSERT_LE(cache.GetResidentBytes(), cache.GetBudget());
+    }
+  }
+  ASSERT_EQ(stats.tileMisses, (N / T) * (N / T));
+  ASSERT_EQ(stats.bytesRead, stats.tileMisses * TileBytes(T));
+
+  // The last tile is still there, the first one was evicted.
+  TextureStats after;
+  cache.Sample(id, tileCenter(N / T - 1, N / T - 1), 0.0, after);
+  ASSERT_EQ(after.tileHits, 1u);
+  cache.Sample(id, tileCenter(0, 0), 0.0, after);
+  ASSERT_EQ(after.tileMisses, 1u);
+
+  cache.Clear();
+  ASSERT_EQ(cache.GetResidentBytes(), 0u);
+}
+
+TEST_F(TextureTests, CompressedTest) {
+  const unsigned N = 128, T = 16;
+  TextureCache cache, uncompressed;
+  TTextureId id = cache.AddTexture(Write("bc1", N, N, GradientTexels(N, N), T,
+                                         TextureFormat::BC1));
+  TTextureId rgba = uncompressed.AddTexture(Write("rgba", N, N, GradientTexels(N, N), T));
+  ASSERT_NE(id, InvalidTextureId);
+  ASSERT_EQ(cache.GetFormat(id), TextureFormat::BC1);
+  ASSERT_EQ(uncompressed.GetFormat(rgba), TextureFormat::RGBA8);
+  ASSERT_EQ(cache.GetNumLevels(id), 8u);
+
+  // Every texel of the finest level is close to the uncompressed one, at
+  // an eighth of the bytes.
+  TextureStats stats, uncompressedStats;
+  for (unsigned y = 0; y < N; ++y) {
+    for (unsigned x = 0; x < N; ++x) {
+      glm::dvec2 uv((x + 0.5) / N, (y + 0.5) / N);
+      glm::dvec3 color = cache.Sample(id, uv, 0.0, stats);
+      glm::dvec3 expected = uncompressed.Sample(rgba, uv, 0.0, uncompressedStats);
+      ASSERT_VEC_NEAR(color, expected, 0.03);
+    }
+  }
+  ASSERT_EQ(stats.tileMisses, (N / T) * (N / T));
+  ASSERT_EQ(stats.bytesRead * 8, uncompressedStats.bytesRead);
+  ASSERT_EQ(cache.GetResidentBytes() * 8, uncompressed.GetResidentBytes());
+
+  // Blocks of two colors are exact.
+  std::vector<glm::vec3> texels;
+  for (unsigned y = 0; y < N; ++y) {
+    for (unsigned x = 0; x < N; ++x)
+      texels.push_back((x + y) % 2 ? glm::vec3(1.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f));
+  }
+  id = cache.AddTexture(Write("bc1checker", N, N, texels, T, TextureFormat::BC1));
+  for (unsigned y : { 0u, 5u, 127u }) {
+    for (unsigned x : { 0u, 6u, 126u }) {
+      glm::dvec3 color = cache.Sample(id, glm::dvec2((x + 0.5) / N, (y + 0.5) / N),
+                                      0.0, stats);
+      ASSERT_VEC_NEAR(color, glm::dvec3(texels[y * N + x]), 1.0e-6);
+    }
+  }
+}
+
+TEST_F(TextureTests, ThreadsTest) {
+  // Threads sampling two textures through a cache much smaller than them
+  // get the same colors as a cache holding everything.
+  const unsigned N = 256, T = 16;
+  std::string gradient = Write("threads1", N, N, GradientTexels(N, N), T);
+  std::vector<glm::vec3> texels = GradientTexels(N, N);
+  for (glm::vec3 &t : texels)
+    t = glm::vec3(1.0f) - t;
+  std::string inverse = Write("threads2", N, N, texels, T);
+
+  TextureCache reference;
+  TextureCache cache(8 * TileBytes(T));
+  for (TextureCache *c : { &reference, &cache }) {
+    c->AddTexture(gradient);
+    c->AddTexture(inverse);
+  }
+
+  const unsigned NumThreads = 4, NumLookups = 4000;
+  std::vector<TextureStats> threadStats(NumThreads);
+  std::vector<unsigned> mismatches(NumThreads, 0);
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < NumThreads; ++t) {
+    threads.push_back(std::thread([&, t]() {
+      std::mt19937 rng(t);
+      std::uniform_real_distribution<double> uniform(0.0, 1.0);
+      TextureStats referenceStats;
+      for (unsigned i = 0; i < NumLookups; ++i) {
+        TTextureId id = rng() % 2;
+        glm::dvec2 uv(uniform(rng), uniform(rng));
+        double footprint = uniform(rng) * uniform(rng) * 0.1;
+        glm::dvec3 color = cache.Sample(id, uv, footprint, threadStats[t]);
+        glm::dvec3 expected = reference.Sample(id, uv, footprint, referenceStats);
+        if (glm::length(color - expected) > EPS_STRONG)
+          ++mismatches[t];
+      }
+    }));
+  }
+  for (std::thread &thread : threads)
+    thread.join();
+
+  TextureStats stats;
+  for (unsigned t = 0; t < NumThreads; ++t) {
+    ASSERT_EQ(mismatches[t], 0u);
+    stats += threadStats[t];
+  }
+  ASSERT_GT(stats.tileMisses, 8u);
+  ASSERT_GT(stats.tileHits, 0u);
+  ASSERT_LE(cache.GetResidentBytes(), cache.GetBudget() + NumThreads * TileBytes(T));
+}
+
+TEST_F(TextureTests, RenderTest) {
+  // A floor textured with a constant color looks the same as a floor whose
+  // diffuse color is multiplied by it, in all renderers.
+  const unsigned N = 32;
+  std::string path = Write("constant", N, N,
+                           std::vector<glm::vec3>(N * N, glm::vec3(0.2f, 0.6f, 1.0f)), 16);
+  glm::dvec3 texel(51.0 / 255.0, 153.0 / 255.0, 1.0);
+
+  auto render = [&](bool textured, const RenderSettings &settings,
+                    RenderStats &stats) {
+    Scene scene;
+    Material floorMaterial(glm::dvec3(0.1), glm::dvec3(0.2),
+                           glm::dvec3(0.8, 0.7, 0.5) * (textured ? glm::dvec3(1.0) : texel),
+                           20.0);
+    if (textured)
+      floorMaterial.SetDiffuseTexture(scene.GetTextures().AddTexture(path));
+    TMaterialId floor = scene.GetMaterials().AddMaterial("floor", floorMaterial);
+    TMaterialId ball = scene.GetMaterials().AddMaterial("ball", testMaterial1);
+
+    std::unique_ptr<Mesh> quad(new Mesh(false, floor));
+    auto v0 = quad->AddVertex(glm::dvec3(-10.0, 0.0, -10.0));
+    auto v1 = quad->AddVertex(glm::dvec3(-10.0, 0.0, 10.0));
+    auto v2 = quad->AddVertex(glm::dvec3(10.0, 0.0, 10.0));
+    auto v3 = quad->AddVertex(glm::dvec3(10.0, 0.0, -10.0));
+    quad->AddQuadFace(v0, v1, v2, v3);
+    quad->SetTexCoord(v0, glm::dvec2(0.0, 0.0));
+    quad->SetTexCoord(v1, glm::dvec2(0.0, 4.0));
+    quad->SetTexCoord(v2, glm::dvec2(4.0, 4.0));
+    quad->SetTexCoord(v3, glm::dvec2(4.0, 0.0));
+    quad->CalculateNormals();
+    scene.AddObject(std::move(quad));
+    scene.AddObject(std::unique_ptr<Sphere>(
+      new Sphere(glm::dvec3(0.0, 1.0, 0.0), 1.0, ball)));
+    scene.AddLight(PointLight(glm::dvec3(2.0, 5.0, -3.0), glm::dvec3(0.2),
+                              glm::dvec3(0.9), glm::dvec3(0.9)));
+    scene.SetBackground(glm::dvec3(0.1, 0.2, 0.3));
+    scene.Freeze();
+
+    Camera camera(glm::dvec3(0.0, 2.0, -6.0), glm::dvec3(0.0, -0.3, 1.0),
+                  glm::uvec2(24, 16));
+    Framebuffer fb(24, 16);
+    Renderer renderer(settings);
+    renderer.Render(scene, camera, fb);
+    stats = renderer.GetStats();
+    return fb;
+  };
+
+  RenderSettings whitted, wavefront, paths;
+  wavefront.mode = RenderMode::Wavefront;
+  // Shaded by material buckets rather than by per-hit light lists.
+  wavefront.lightCulling = false;
+  paths.integrator = Integrator::PathTracing;
+  paths.numThreads = 2;
+  paths.minSamples = paths.maxSamples = 2;
+  for (const RenderSettings &settings : { whitted, wavefront, paths }) {
+    RenderStats plainStats, texturedStats;
+    Framebuffer plain = render(false, settings, plainStats);
+    Framebuffer textured = render(true, settings, texturedStats);
+    for (std::size_t i = 0; i < plain.GetNumPixels(); ++i)
+      ASSERT_VEC_NEAR(textured[i], plain[i], EPS_WEAK);
+
+    ASSERT_EQ(plainStats.textures.tileHits + plainStats.textures.tileMisses, 0u);
+    ASSERT_GT(texturedStats.textures.tileHits, 0u);
+    ASSERT_GT(texturedStats.textures.tileMisses, 0u);
+    ASSERT_EQ(texturedStats.textures.bytesRead,
+              texturedStats.textures.tileMisses * TileBytes(16));
+  }
+}